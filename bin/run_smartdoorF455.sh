@@ -47,6 +47,7 @@ nohup $progdir/$prog </dev/null > $logdir/$logfile 2>&1 &
 PROG_PID=$(pgrep -x $prog)
 echo "$prog started successfully with PID $PROG_PID"
 echo "watch $logdir/$logfile for errors"
-# obtain process id to set CPU affinity to CPU #3
-# assuming that isolcpus=3 as been added to /boot/cmdline.txt
-sudo taskset -cp 3 $PROG_PID
+echo "events are logged to the file set in section [log] of config.toml, default $logdir/smartdoorF455.log"
+# CPU affinity and real-time priority of every thread are set by $prog itself,
+# see section [threads] in config.toml - matrix refresh on CPU #3, if isolcpus=3
+# has been added to /boot/cmdline.txt; cap_sys_nice (see above) allows SCHED_FIFO
@@ -0,0 +1,200 @@
+/**
+ * @file animation.cpp
+ * @brief Sprite sheets, marquee text and a vsync frame pacer for the LED panel
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ */
+#include "animation.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#define MARQUEE_GAP 16      // pixels between the end of a marquee text and its repetition
+#define COST_EWMA_SHIFT 3   // frame cost average adapts by 1/8 per frame
+#define VSYNC_EWMA_WEIGHT 0.125
+
+Sprite::Sprite(int width, int height, std::vector<Rgb> pixels, Rgb key_color)
+    : sprite_width(width), sprite_height(height), pixels(std::move(pixels))
+{
+    for (int y = 0; y < height; y++) {
+        const Rgb* row = this->pixels.data() + (size_t)y * width;
+        for (int x = 0; x < width;) {
+            if (row[x] == key_color) {
+                x++;
+                continue;
+            }
+            int start = x;
+            while (x < width && row[x] != key_color)
+                x++;
+            spans.push_back(Span{ (int16_t)y, (int16_t)start, (int16_t)(x - start) });
+        }
+    }
+}
+
+void Sprite::blit(Framebuffer& frame, int x, int y) const
+{
+    for (const Span& span : spans) {
+        int py = y + span.y;
+        if (py < 0 || py >= frame.height)
+            continue;
+        int left = std::max(x + span.x, 0);
+        int right = std::min(x + span.x + span.length, frame.width);
+        if (left >= right)
+            continue;
+        const Rgb* source = pixels.data() + (size_t)span.y * sprite_width + (left - x);
+        std::memcpy(&frame.pixel[py][left], source, (right - left) * sizeof(Rgb));
+    }
+}
+
+bool SpriteSheet::load_ppm(const std::string& path, int frame_width, int frame_height, Rgb key_color)
+{
+    frames.clear();
+    std::ifstream in(path, std::ios::binary);
+    std::string magic;
+    int width = 0, height = 0, maxval = 0;
+    in >> magic;
+    // header fields are separated by whitespace, # starts a comment
+    auto read_field = [&in](int& value) {
+        in >> std::ws;
+        while (in.peek() == '#') {
+            std::string comment;
+            std::getline(in, comment);
+            in >> std::ws;
+        }
+        in >> value;
+    };
+    read_field(width);
+    read_field(height);
+    read_field(maxval);
+    in.get(); // single whitespace before the pixel data
+    if (!in || magic != "P6" || maxval != 255 || width < frame_width || height < frame_height
+        || frame_width <= 0 || frame_height <= 0) {
+        std::cerr << "animation: " << path << " is no binary PPM (P6, maxval 255) with " << frame_width << "x" << frame_height << " frames" << std::endl;
+        return false;
+    }
+    std::vector<Rgb> image((size_t)width * height);
+    static_assert(sizeof(Rgb) == 3, "Rgb matches the PPM pixel layout");
+    if (!in.read(reinterpret_cast<char*>(image.data()), image.size() * sizeof(Rgb))) {
+        std::cerr << "animation: " << path << " is truncated" << std::endl;
+        return false;
+    }
+    for (int top = 0; top + frame_height <= height; top += frame_height) {
+        for (int left = 0; left + frame_width <= width; left += frame_width) {
+            std::vector<Rgb> pixels((size_t)frame_width * frame_height);
+            for (int y = 0; y < frame_height; y++)
+                std::copy_n(&image[(size_t)(top + y) * width + left], frame_width, &pixels[(size_t)y * frame_width]);
+            frames.emplace_back(frame_width, frame_height, std::move(pixels), key_color);
+        }
+    }
+    return !frames.empty();
+}
+
+FramePacer::FramePacer(double fps, double cpu_budget_percent)
+    : target_period_us(1e6 / std::min(std::max(fps, 30.0), 60.0)),
+      cpu_budget_percent(std::max(cpu_budget_percent, 0.1))
+{
+}
+
+void FramePacer::frame_done(int64_t cpu_us, int64_t swapped_us)
+{
+    frame_count++;
+    cost_total_us += cpu_us;
+    cost_average_us += (cpu_us - cost_average_us) / (1 << COST_EWMA_SHIFT);
+    if (last_swap_us != 0) {
+        int64_t interval = swapped_us - last_swap_us;
+        interval_count++;
+        double delta = interval - interval_mean;
+        interval_mean += delta / interval_count;
+        interval_m2 += delta * (interval - interval_mean);
+        interval_max = std::max(interval_max, interval);
+        // SwapOnVSync waited for fraction refreshes, unless the frame itself was late
+        double refresh = (double)interval / fraction;
+        vsync_period = vsync_period == 0.0 ? refresh : vsync_period + (refresh - vsync_period) * VSYNC_EWMA_WEIGHT;
+    }
+    last_swap_us = swapped_us;
+    if (vsync_period > 0.0) {
+        // the frame period has to hold both the configured rate and the CPU budget
+        double period = std::max(target_period_us, cost_average_us * 100.0 / cpu_budget_percent);
+        fraction = std::max(1u, (unsigned int)std::ceil(period / vsync_period - 0.05));
+    }
+}
+
+double FramePacer::jitter_us() const
+{
+    return interval_count > 1 ? std::sqrt(interval_m2 / (interval_count - 1)) : 0.0;
+}
+
+AnimationPlayer::AnimationPlayer(const AnimationConfig& config)
+    : config(config), frame_pacer(config.fps, config.cpu_budget_percent)
+{
+}
+
+bool AnimationPlayer::load_sprite_sheet()
+{
+    if (config.sprite_sheet.empty())
+        return true;
+    if (!sprite_sheet.load_ppm(config.sprite_sheet, config.sprite_frame_width, config.sprite_frame_height, config.sprite_key_color))
+        return false;
+    std::cout << "animation: " << sprite_sheet.frame_count() << " sprite frames loaded from " << config.sprite_sheet << std::endl;
+    return true;
+}
+
+void AnimationPlayer::play_sprite(int64_t now_us)
+{
+    if (sprite_sheet.frame_count() == 0)
+        return;
+    sprite_start_us = now_us;
+    sprite_end_us = now_us + config.sprite_duration_ms * 1000LL;
+}
+
+void AnimationPlayer::draw(Framebuffer& frame, int64_t now_us) const
+{
+    if (now_us >= sprite_end_us)
+        return;
+    int index = (int)((now_us - sprite_start_us) * config.sprite_fps / 1e6) % sprite_sheet.frame_count();
+    sprite_sheet.frame(index).blit(frame, config.sprite_x, config.sprite_y);
+}
+
+bool Marquee::set_text(const GlyphAtlas& font, const char* text, int panel_width, int baseline, int top, int bottom,
+                       Rgb color, Rgb bg_color, int64_t now_us)
+{
+    if (shown_text == text)
+        return strip.width() > 0;
+    shown_text = text;
+    strip = Sprite();
+    int text_width = font.text_width(text);
+    if (text_width <= panel_width || bottom <= top || top < 0 || bottom > Framebuffer::MAX_HEIGHT)
+        return false; // fits, no need to scroll
+    // render the strip chunk by chunk, draw_text clips to the framebuffer
+    const int strip_width = text_width + MARQUEE_GAP;
+    const int strip_height = bottom - top;
+    const Rgb key{ (uint8_t)~color.r, (uint8_t)~color.g, (uint8_t)~color.b };
+    std::vector<Rgb> pixels((size_t)strip_width * strip_height, key);
+    Framebuffer chunk;
+    chunk.resize(Framebuffer::MAX_WIDTH, Framebuffer::MAX_HEIGHT);
+    for (int left = 0; left < text_width; left += chunk.width) {
+        chunk.fill_rows(top, bottom, key);
+        font.draw_text(chunk, -left, baseline, color, text);
+        int columns = std::min(chunk.width, text_width - left);
+        for (int y = 0; y < strip_height; y++)
+            std::copy_n(chunk.pixel[top + y], columns, &pixels[(size_t)y * strip_width + left]);
+    }
+    strip = Sprite(strip_width, strip_height, std::move(pixels), key);
+    strip_top = top;
+    strip_bottom = bottom;
+    bg = bg_color;
+    start_us = now_us;
+    return true;
+}
+
+void Marquee::draw(Framebuffer& frame, int64_t now_us) const
+{
+    if (strip.width() == 0)
+        return;
+    int offset = (int)((now_us - start_us) * speed / 1000000 % strip.width());
+    frame.fill_rows(strip_top, strip_bottom, bg);
+    for (int x = -offset; x < frame.width; x += strip.width()) // wrap around
+        strip.blit(frame, x, strip_top);
+}
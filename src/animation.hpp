@@ -0,0 +1,213 @@
+/**
+ * @file animation.hpp
+ * @brief Sprite sheets, marquee text and a vsync frame pacer for the LED panel
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * Everything that moves is pre-rendered once, so a frame is only a few
+ * clipped span copies into a Framebuffer:
+ *
+ * - Sprite: pixels plus the list of opaque horizontal spans, built when the
+ *   sprite is created; blit() copies spans, transparent pixels cost nothing
+ * - SpriteSheet: the frames of a binary PPM (P6) image, side by side in a
+ *   grid, each frame a Sprite - e.g. a spinning Mario played when the door opens
+ * - Marquee: text too wide for the panel rendered once into a Sprite strip,
+ *   which is blitted at a time-based offset, wrapping around
+ *
+ * The frame index and marquee offset follow the monotonic clock, not the
+ * number of frames drawn, so a dropped frame never slows an animation down.
+ *
+ * FramePacer chooses the framerate_fraction passed to SwapOnVSync: the
+ * largest frame rate up to the configured fps (30..60) that keeps the CPU
+ * time of the render thread below cpu_budget_percent of one core, as the
+ * matrix refresh thread of rpi-rgb-led-matrix already takes up to half a
+ * core. It also keeps frame interval and cost statistics (jitter).
+ *
+ * Configured in section [animation] of config.toml. No hardware dependencies.
+ */
+#pragma once
+#include "glyph_atlas.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief settings of section [animation] in config.toml
+ */
+struct AnimationConfig {
+    double fps = 60.0;                  // frames per second while animating, 30..60
+    double cpu_budget_percent = 10.0;   // upper bound of render thread CPU time while animating
+    int marquee_speed = 24;             // pixels per second of text too wide for the panel
+    std::string sprite_sheet;           // binary PPM played when the door opens, empty = none
+    int sprite_frame_width = 32;        // size of one frame within the sheet
+    int sprite_frame_height = 32;
+    double sprite_fps = 12.0;           // sprite frames per second
+    int sprite_x = 0;                   // top left corner on the panel
+    int sprite_y = 0;
+    int sprite_duration_ms = 3000;      // how long the sprite plays
+    Rgb sprite_key_color;               // pixels of this color are transparent
+};
+
+/**
+ * @brief pre-rendered bitmap with transparency, blitted as opaque spans
+ */
+class Sprite {
+public:
+    Sprite() = default;
+    /**
+     * @brief takes width x height pixels, row major; pixels equal to key_color are transparent
+     */
+    Sprite(int width, int height, std::vector<Rgb> pixels, Rgb key_color);
+
+    int width() const { return sprite_width; }
+    int height() const { return sprite_height; }
+    /** copies the opaque pixels with the top left corner at (x, y), clipped to the panel */
+    void blit(Framebuffer& frame, int x, int y) const;
+
+private:
+    struct Span {
+        int16_t y, x, length;
+    };
+    int sprite_width = 0;
+    int sprite_height = 0;
+    std::vector<Rgb> pixels;
+    std::vector<Span> spans; // opaque runs, row by row
+};
+
+/**
+ * @brief frames of a sprite sheet image
+ */
+class SpriteSheet {
+public:
+    /**
+     * @brief loads a binary PPM (P6, maxval 255) and cuts it into frames, left to right, top to bottom
+     * @return false if the file cannot be read or holds no complete frame
+     */
+    bool load_ppm(const std::string& path, int frame_width, int frame_height, Rgb key_color);
+    int frame_count() const { return (int)frames.size(); }
+    const Sprite& frame(int index) const { return frames[index]; }
+
+private:
+    std::vector<Sprite> frames;
+};
+
+/**
+ * @class FramePacer
+ * @brief Chooses the vsync divider of animation frames and keeps frame timing statistics
+ *
+ * Example usage:
+ * @code
+ * FramePacer pacer(60.0, 10.0);
+ * int64_t cpu_start_us = thread_cpu_us();
+ * // ... draw the frame ...
+ * int64_t cpu_us = thread_cpu_us() - cpu_start_us;
+ * offscreen = matrix->SwapOnVSync(offscreen, pacer.vsync_fraction());
+ * pacer.frame_done(cpu_us, monotonic_us());
+ * @endcode
+ */
+class FramePacer {
+public:
+    FramePacer(double fps, double cpu_budget_percent);
+
+    /** number of panel refreshes per frame, framerate_fraction of SwapOnVSync */
+    unsigned int vsync_fraction() const { return fraction; }
+    /**
+     * @brief records a shown frame
+     * @param cpu_us CPU time the render thread spent on the frame
+     * @param swapped_us monotonic_us() when SwapOnVSync returned
+     */
+    void frame_done(int64_t cpu_us, int64_t swapped_us);
+    /** the next frame follows a pause, its interval is not counted */
+    void pause() { last_swap_us = 0; }
+
+    uint64_t frames() const { return frame_count; }
+    double mean_interval_us() const { return interval_count ? interval_mean : 0.0; }
+    /** standard deviation of the frame interval */
+    double jitter_us() const;
+    int64_t max_interval_us() const { return interval_max; }
+    double mean_cost_us() const { return frame_count ? (double)cost_total_us / frame_count : 0.0; }
+    double vsync_period_us() const { return vsync_period; }
+    double effective_fps() const { return interval_count && interval_mean > 0 ? 1e6 / interval_mean : 0.0; }
+
+private:
+    double target_period_us;    // 1 / configured fps
+    double cpu_budget_percent;
+    unsigned int fraction = 1;
+    double vsync_period = 0.0;  // estimated panel refresh period, 0 until measured
+    double cost_average_us = 0.0;
+    int64_t last_swap_us = 0;
+    uint64_t frame_count = 0;
+    uint64_t interval_count = 0;
+    double interval_mean = 0.0; // Welford's running mean and sum of squared deviations
+    double interval_m2 = 0.0;
+    int64_t interval_max = 0;
+    int64_t cost_total_us = 0;
+};
+
+/**
+ * @class Marquee
+ * @brief Text too wide for the panel, pre-rendered into a strip that scrolls over pixel rows
+ *
+ * Used from the render thread only.
+ */
+class Marquee {
+public:
+    /** @param speed pixels per second */
+    explicit Marquee(int speed) : speed(speed) {}
+
+    /**
+     * @brief scrolls text over pixel rows [top, bottom) if it is wider than panel_width
+     * @return true if the text scrolls, false if it fits and is drawn as static text
+     *
+     * Setting the same text again keeps its position, an empty text stops the marquee.
+     */
+    bool set_text(const GlyphAtlas& font, const char* text, int panel_width, int baseline, int top, int bottom,
+                  Rgb color, Rgb bg_color, int64_t now_us);
+    bool scrolling() const { return strip.width() > 0; }
+    /** fills the rows of the marquee with its background and blits the strip at the current offset */
+    void draw(Framebuffer& frame, int64_t now_us) const;
+    int top() const { return strip_top; }
+    int bottom() const { return strip_bottom; }
+
+private:
+    int speed;
+    std::string shown_text;
+    Sprite strip;               // text including the gap before it repeats
+    int strip_top = 0, strip_bottom = 0;
+    Rgb bg;
+    int64_t start_us = 0;
+};
+
+/**
+ * @class AnimationPlayer
+ * @brief Plays the door-open sprite and paces animation frames
+ *
+ * Used from the render thread only.
+ */
+class AnimationPlayer {
+public:
+    explicit AnimationPlayer(const AnimationConfig& config);
+
+    /** loads config.sprite_sheet if configured; false on error */
+    bool load_sprite_sheet();
+    /** starts the sprite animation for sprite_duration_ms */
+    void play_sprite(int64_t now_us);
+
+    /** true while the sprite plays */
+    bool active(int64_t now_us) const { return now_us < sprite_end_us; }
+    /** monotonic time when the sprite stops, 0 if it never played */
+    int64_t end_us() const { return sprite_end_us; }
+    /** draws the current sprite frame on top of frame */
+    void draw(Framebuffer& frame, int64_t now_us) const;
+
+    const AnimationConfig& settings() const { return config; }
+    FramePacer& pacer() { return frame_pacer; }
+
+private:
+    AnimationConfig config;
+    SpriteSheet sprite_sheet;
+    int64_t sprite_start_us = 0;
+    int64_t sprite_end_us = 0;
+    FramePacer frame_pacer;
+};
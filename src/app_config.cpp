@@ -0,0 +1,134 @@
+/**
+ * @file app_config.cpp
+ * @brief Typed snapshot of config.toml, published to all threads and reloaded on SIGHUP or when the file changes
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ */
+#include "app_config.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <thread>
+#include <unistd.h>
+
+#define INOTIFY_BUFFER_SIZE 4096 // holds a burst of events of one save
+
+enum class ConfigScope { Display, Animation, Gate, Camera, Log, Restart };
+
+/**
+ * @brief how a change of key ("section.key") is applied, Restart unless listed
+ */
+static ConfigScope config_scope(const std::string& key)
+{
+    static const std::map<std::string, ConfigScope> live = {
+        { "raspi.wait_time_until_reauthentication", ConfigScope::Gate },
+        { "raspi.trigger_burst_usec", ConfigScope::Gate },
+        { "matrix_options.clock_color", ConfigScope::Display },
+        { "matrix_options.date_color", ConfigScope::Display },
+        { "matrix_options.day_color", ConfigScope::Display },
+        { "matrix_options.username_color", ConfigScope::Display },
+        { "matrix_options.bg_color", ConfigScope::Display },
+        { "matrix_options.outline_color", ConfigScope::Display },
+        { "matrix_options.alert_color", ConfigScope::Display },
+        { "matrix_options.brightness", ConfigScope::Display },
+        { "matrix_options.idle_after_s", ConfigScope::Display },
+        { "matrix_options.blank_after_s", ConfigScope::Display },
+        { "matrix_options.idle_brightness", ConfigScope::Display },
+        { "matrix_options.idle_pwm_bits", ConfigScope::Display },
+        { "camera.camera_rotation", ConfigScope::Camera },
+        { "camera.security_level", ConfigScope::Camera },
+        { "camera.frontal_face_policy", ConfigScope::Camera },
+        { "camera.matcher_confidence_level", ConfigScope::Camera },
+        { "camera.algo_flow", ConfigScope::Camera },
+        { "camera.dump_mode", ConfigScope::Camera },
+        { "camera.max_spoofs", ConfigScope::Camera },
+        { "camera.gpio_auth_toggling", ConfigScope::Camera },
+        { "log.level", ConfigScope::Log },
+    };
+    if (key.compare(0, 10, "animation.") == 0)
+        return ConfigScope::Animation;
+    if (key.compare(0, 12, "log.modules.") == 0)
+        return ConfigScope::Log;
+    auto entry = live.find(key);
+    return entry == live.end() ? ConfigScope::Restart : entry->second;
+}
+
+ConfigDelta diff_config(const AppConfig& before, const AppConfig& after)
+{
+    ConfigDelta delta;
+    auto changed = [&delta](const std::string& key) {
+        switch (config_scope(key)) {
+        case ConfigScope::Display: delta.display = true; break;
+        case ConfigScope::Animation: delta.display = delta.animation = true; break;
+        case ConfigScope::Gate: delta.gate = true; break;
+        case ConfigScope::Camera: delta.camera = true; break;
+        case ConfigScope::Log: delta.log = true; break;
+        case ConfigScope::Restart: delta.restart.push_back(key); break;
+        }
+    };
+    // both maps are sorted by key, one merge pass finds changed, added and removed keys
+    auto old_entry = before.values.begin(), new_entry = after.values.begin();
+    while (old_entry != before.values.end() || new_entry != after.values.end()) {
+        if (new_entry == after.values.end() || (old_entry != before.values.end() && old_entry->first < new_entry->first)) {
+            changed((old_entry++)->first); // removed, default applies
+        }
+        else if (old_entry == before.values.end() || new_entry->first < old_entry->first) {
+            changed((new_entry++)->first); // added
+        }
+        else {
+            if (old_entry->second != new_entry->second)
+                changed(old_entry->first);
+            ++old_entry;
+            ++new_entry;
+        }
+    }
+    return delta;
+}
+
+ConfigWatcher::ConfigWatcher(const std::string& path)
+{
+    size_t slash = path.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : path.substr(0, std::max<size_t>(slash, 1));
+    file_name = slash == std::string::npos ? path : path.substr(slash + 1);
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    // the directory is watched, an editor replacing the file would end a watch on the file itself
+    if (inotify_fd < 0 || inotify_add_watch(inotify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        std::cerr << "config: cannot watch " << path << " (" << strerror(errno) << "), reload with SIGHUP only" << std::endl;
+        if (inotify_fd >= 0)
+            close(inotify_fd);
+        inotify_fd = -1;
+    }
+}
+
+ConfigWatcher::~ConfigWatcher()
+{
+    if (inotify_fd >= 0)
+        close(inotify_fd);
+}
+
+bool ConfigWatcher::wait(int timeout_ms)
+{
+    if (inotify_fd < 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+        return false;
+    }
+    struct pollfd watched = { inotify_fd, POLLIN, 0 };
+    if (poll(&watched, 1, timeout_ms) <= 0)
+        return false; // timeout, or a signal such as SIGHUP or SIGINT interrupted the wait
+    alignas(struct inotify_event) char buffer[INOTIFY_BUFFER_SIZE];
+    bool changed = false;
+    ssize_t length;
+    while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+        for (char* position = buffer; position < buffer + length;) {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(position);
+            if (event->len > 0 && file_name == event->name)
+                changed = true;
+            position += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return changed;
+}
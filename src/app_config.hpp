@@ -0,0 +1,163 @@
+/**
+ * @file app_config.hpp
+ * @brief Typed snapshot of config.toml, published to all threads and reloaded on SIGHUP or when the file changes
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * config.toml used to be queried by string key wherever a value was needed,
+ * and any change - a color, a timeout - meant a restart: camera reconnect,
+ * LED matrix re-init and MQTT reconnect.
+ *
+ * The file is now parsed and validated once into an immutable AppConfig.
+ * ConfigChannel publishes it by an atomic swap of a shared pointer; a reader
+ * keeps a consistent snapshot as long as it holds the pointer, hot paths
+ * compare generation() before taking one. Every key is also kept as text,
+ * so two snapshots can be compared key by key with diff_config(), and only
+ * the deltas are applied:
+ *
+ * - Display: colors, brightness, idle levels of [matrix_options] and all of
+ *   [animation] - taken over by the render thread with the next frame
+ * - Gate: wait_time_until_reauthentication and trigger_burst_usec of [raspi]
+ * - Camera: device settings of [camera] - SetDeviceConfig between two
+ *   authentications, without reconnecting
+ * - Log: level and [log.modules] of [log] - the next message is filtered by
+ *   the new levels
+ * - Restart: everything else, e.g. [mosquitto], [telegram], [threads], GPIO
+ *   pins, hardware mapping - logged, takes effect after a restart
+ *
+ * ConfigWatcher reports saves of config.toml with inotify; editors that
+ * write a new file and rename it over the old one are covered as well.
+ * A file that does not parse or validate is rejected as a whole, the
+ * running configuration stays.
+ *
+ * Example usage:
+ * @code
+ * ConfigWatcher watcher(CONFIG_FILE);
+ * while (running) {
+ *     if (watcher.wait(1000) || reload_requested) {
+ *         std::shared_ptr<const AppConfig> next = read_app_config(toml::parse_file(CONFIG_FILE)); // nullptr if invalid
+ *         ConfigDelta delta = diff_config(*app_config.get(), *next);
+ *         app_config.publish(next);
+ *     }
+ * }
+ * @endcode
+ *
+ * The header has no hardware dependencies.
+ */
+#pragma once
+#include "animation.hpp"
+#include "async_log.hpp"
+#include "glyph_atlas.hpp"
+#include "panel_power.hpp"
+#include "trigger_gate.hpp"
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief LED matrix settings of section [matrix_options] and [animation] in config.toml
+ */
+struct DisplayConfig {
+    Rgb clock_color{ 255, 28, 0 };
+    Rgb date_color{ 255, 28, 0 };
+    Rgb day_color{ 255, 28, 0 };
+    Rgb username_color{ 255, 0, 255 };
+    Rgb bg_color{ 0, 0, 0 };
+    Rgb outline_color{ 0, 0, 0 };
+    Rgb alert_color{ 255, 0, 0 };
+    int brightness = 80;                // percent 1..100 at full quality
+    std::string pixel_mapper_config;    // e.g. "Rotate:270", restart only
+    std::string hardware_mapping;       // e.g. "adafruit-hat", restart only
+    PanelPowerConfig power;
+    AnimationConfig animation;
+};
+
+/**
+ * @brief device settings of the F455, section [camera] in config.toml; names as in DeviceConfig.h
+ */
+struct CameraConfig {
+    std::string camera_rotation = "0";
+    std::string security_level = "Low";
+    std::string frontal_face_policy = "None";
+    std::string matcher_confidence_level = "Low";
+    std::string algo_flow = "FaceDetectionOnly";
+    std::string dump_mode = "None";
+    int max_spoofs = 0;
+    int gpio_auth_toggling = 0;
+};
+
+/**
+ * @brief validated settings of config.toml that are used after startup or change at runtime
+ */
+struct AppConfig {
+    GateConfig gate;
+    DisplayConfig display;
+    CameraConfig camera;
+    LogConfig log;
+    std::map<std::string, std::string> values; // every key as "section.key", value as text, for diff_config()
+};
+
+/**
+ * @brief what differs between two snapshots
+ */
+struct ConfigDelta {
+    bool display = false;               // render thread takes over the new DisplayConfig
+    bool animation = false;             // [animation] changed, player and marquees are rebuilt
+    bool gate = false;                  // new hold-off and burst window
+    bool camera = false;                // device settings to be written to the F455
+    bool log = false;                   // new log levels
+    std::vector<std::string> restart;   // changed keys that take effect after a restart
+    bool empty() const { return !display && !gate && !camera && !log && restart.empty(); }
+};
+
+/** compares two snapshots key by key */
+ConfigDelta diff_config(const AppConfig& before, const AppConfig& after);
+
+/**
+ * @class ConfigChannel
+ * @brief Publishes the current AppConfig to all threads
+ */
+class ConfigChannel {
+public:
+    /** snapshot, valid as long as the pointer is held; nullptr before the first publish() */
+    std::shared_ptr<const AppConfig> get() const {
+        return std::atomic_load_explicit(&current, std::memory_order_acquire);
+    }
+    /** replaces the snapshot; readers holding the old one keep it */
+    void publish(std::shared_ptr<const AppConfig> config) {
+        std::atomic_store_explicit(&current, std::move(config), std::memory_order_release);
+        publish_count.fetch_add(1, std::memory_order_release);
+    }
+    /** changes with every publish(); a single atomic load, for hot paths */
+    uint64_t generation() const { return publish_count.load(std::memory_order_acquire); }
+
+private:
+    std::shared_ptr<const AppConfig> current;
+    std::atomic<uint64_t> publish_count{0};
+};
+
+/**
+ * @class ConfigWatcher
+ * @brief Waits for saves of the config file with inotify
+ */
+class ConfigWatcher {
+public:
+    explicit ConfigWatcher(const std::string& path);
+    ~ConfigWatcher();
+    ConfigWatcher(const ConfigWatcher&) = delete;
+    ConfigWatcher& operator=(const ConfigWatcher&) = delete;
+
+    /**
+     * @brief sleeps up to timeout_ms or until the file was written or replaced
+     * @return true if the file changed; just sleeps if inotify is unavailable
+     */
+    bool wait(int timeout_ms);
+
+private:
+    int inotify_fd = -1;
+    std::string file_name; // name within the watched directory
+};
@@ -0,0 +1,322 @@
+/**
+ * @file async_log.cpp
+ * @brief Asynchronous logger: fixed-size records in a lock-free ring, formatted and written by a background thread
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ */
+#include "async_log.hpp"
+#include "thread_placement.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_FLUSH_MSEC 50          // the log thread drains the ring this often
+#define LOG_LINE_PREFIX_CHARS 48   // "2025-06-01 12:00:00.123 I telegram: "
+
+std::atomic<int> AsyncLog::levels[(int)LogModule::COUNT] = {
+    (int)LogLevel::Info, (int)LogLevel::Info, (int)LogLevel::Info, (int)LogLevel::Info,
+    (int)LogLevel::Info, (int)LogLevel::Info, (int)LogLevel::Info, (int)LogLevel::Info,
+    (int)LogLevel::Info, (int)LogLevel::Info, (int)LogLevel::Info };
+static_assert((int)LogModule::COUNT == 11, "initialize the level of every module");
+std::atomic<uint64_t> AsyncLog::written{0};
+std::atomic<uint64_t> AsyncLog::dropped{0};
+
+namespace {
+
+constexpr uint64_t RING_MASK = AsyncLog::RING_RECORDS - 1;
+static_assert((AsyncLog::RING_RECORDS & RING_MASK) == 0, "RING_RECORDS must be a power of two");
+
+/**
+ * @brief one slot of the ring
+ *
+ * sequence tells whose turn the slot is (bounded MPMC queue of D. Vyukov),
+ * stored minus the slot index so that the zero-initialized ring is empty
+ * before any constructor ran: free for the producer of position pos if
+ * sequence + index == pos, filled for the consumer if it equals pos + 1.
+ */
+struct Record {
+    std::atomic<uint64_t> sequence;
+    int64_t wall_us;
+    uint8_t module, level;
+    uint16_t length;
+    char text[AsyncLog::RECORD_TEXT_CHARS];
+};
+
+Record ring[AsyncLog::RING_RECORDS];
+alignas(64) std::atomic<uint64_t> ring_head{0}; // next position claimed by a producer
+alignas(64) uint64_t ring_tail = 0;             // next position read by the log thread
+
+std::mutex thread_mutex; // start(), stop() and the sleep of the log thread, never taken by producers
+std::condition_variable wake;
+std::thread log_thread;
+bool running = false;
+bool stopping = false;
+LogConfig settings;
+int log_fd = STDOUT_FILENO;
+size_t file_bytes = 0;
+std::atomic<uint64_t> rotations{0};
+
+int64_t wall_clock_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts); // vDSO, no system call
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+bool open_log_file()
+{
+    if (settings.file.empty()) {
+        log_fd = STDOUT_FILENO;
+        return true;
+    }
+    int fd = open(settings.file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "log: cannot open " << settings.file << " (" << strerror(errno) << "), logging to stdout" << std::endl;
+        log_fd = STDOUT_FILENO;
+        return false;
+    }
+    struct stat status;
+    file_bytes = fstat(fd, &status) == 0 ? (size_t)status.st_size : 0;
+    log_fd = fd;
+    return true;
+}
+
+void close_log_file()
+{
+    if (log_fd != STDOUT_FILENO)
+        close(log_fd);
+    log_fd = STDOUT_FILENO;
+}
+
+/**
+ * @brief file becomes file.1, file.1 becomes file.2, ..., the oldest is deleted
+ */
+void rotate_log_file()
+{
+    close_log_file();
+    for (int k = settings.keep_files - 1; k >= 1; k--)
+        rename((settings.file + "." + std::to_string(k)).c_str(), (settings.file + "." + std::to_string(k + 1)).c_str());
+    if (settings.keep_files > 0)
+        rename(settings.file.c_str(), (settings.file + ".1").c_str());
+    else
+        unlink(settings.file.c_str());
+    rotations.fetch_add(1, std::memory_order_relaxed);
+    open_log_file();
+}
+
+void write_bytes(const char* data, size_t size)
+{
+    size_t done = 0;
+    while (done < size) {
+        ssize_t count = ::write(log_fd, data + done, size - done);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            break; // disk full or closed stdout, the lines are lost
+        done += (size_t)count;
+    }
+    file_bytes += done;
+}
+
+/**
+ * @brief writes whole lines, rotates the file before it would grow beyond max_bytes
+ */
+void write_all(const std::string& lines)
+{
+    if (log_fd == STDOUT_FILENO) {
+        write_bytes(lines.data(), lines.size());
+        return;
+    }
+    size_t begin = 0;
+    while (begin < lines.size()) {
+        size_t room = settings.max_bytes > file_bytes ? settings.max_bytes - file_bytes : 0;
+        size_t end = begin + room >= lines.size() ? lines.size() : lines.rfind('\n', begin + room - 1);
+        if (room == 0 || end == std::string::npos || end < begin) { // not even one more line fits
+            if (file_bytes > 0) {
+                rotate_log_file();
+                continue;
+            }
+            end = lines.find('\n', begin); // a single line longer than max_bytes
+        }
+        end = end == std::string::npos || end >= lines.size() ? lines.size() : end + 1;
+        write_bytes(lines.data() + begin, end - begin);
+        begin = end;
+    }
+}
+
+/**
+ * @brief date and time of wall_us; the calendar part is formatted once per second
+ */
+const char* format_time(int64_t wall_us, char* millis)
+{
+    static time_t cached_second = -1;
+    static char cached_text[24];
+    time_t second = (time_t)(wall_us / 1000000);
+    if (second != cached_second) {
+        struct tm local;
+        localtime_r(&second, &local);
+        strftime(cached_text, sizeof(cached_text), "%Y-%m-%d %H:%M:%S", &local);
+        cached_second = second;
+    }
+    snprintf(millis, 8, ".%03d", (int)(wall_us / 1000 % 1000));
+    return cached_text;
+}
+
+/**
+ * @brief moves up to one ring of filled records into lines, oldest first
+ * @return true if the ring may hold more
+ */
+bool drain(std::string& lines)
+{
+    static const char level_letters[] = "DIWE";
+    for (size_t n = 0; n < AsyncLog::RING_RECORDS; n++) {
+        Record& record = ring[ring_tail & RING_MASK];
+        if (record.sequence.load(std::memory_order_acquire) + (ring_tail & RING_MASK) != ring_tail + 1)
+            return false; // empty, or the producer of this slot is still formatting
+        char millis[8];
+        char prefix[LOG_LINE_PREFIX_CHARS];
+        const char* date_time = format_time(record.wall_us, millis);
+        int prefix_length = snprintf(prefix, sizeof(prefix), "%s%s %c %s: ", date_time, millis,
+                                     level_letters[record.level & 3], log_module_name((LogModule)record.module));
+        lines.append(prefix, std::min<size_t>(prefix_length, sizeof(prefix) - 1));
+        lines.append(record.text, record.length);
+        lines.push_back('\n');
+        record.sequence.store(ring_tail + AsyncLog::RING_RECORDS - (ring_tail & RING_MASK), std::memory_order_release);
+        ring_tail++;
+    }
+    return true;
+}
+
+void log_thread_loop()
+{
+    place_this_thread("log");
+    std::string lines;
+    lines.reserve(AsyncLog::RING_RECORDS * 96);
+    uint64_t dropped_reported = 0;
+    std::unique_lock<std::mutex> lock(thread_mutex);
+    for (;;) {
+        bool last = stopping;
+        lock.unlock();
+        bool more;
+        do { // a batch is bounded by the ring, producers refilling it do not grow it
+            more = drain(lines);
+            uint64_t dropped_now = AsyncLog::dropped_count();
+            if (dropped_now != dropped_reported) { // overload shows in the log itself
+                char millis[8];
+                const char* date_time = format_time(wall_clock_us(), millis);
+                lines += std::string(date_time) + millis + " W log: " + std::to_string(dropped_now - dropped_reported) + " messages dropped, ring full\n";
+                dropped_reported = dropped_now;
+            }
+            write_all(lines);
+            lines.clear();
+        } while (more);
+        lock.lock();
+        if (last)
+            break;
+        wake.wait_for(lock, std::chrono::milliseconds(LOG_FLUSH_MSEC), [] { return stopping; });
+    }
+}
+
+} // namespace
+
+const char* log_module_name(LogModule module)
+{
+    static const char* const names[(int)LogModule::COUNT] = {
+        "main", "auth", "camera", "trigger", "display", "mqtt", "telegram", "snapshot", "motion", "control", "config" };
+    return names[(int)module];
+}
+
+bool parse_log_level(const std::string& name, LogLevel& level)
+{
+    static const char* const names[] = { "debug", "info", "warn", "error", "off" };
+    for (int l = 0; l <= (int)LogLevel::Off; l++) {
+        if (name == names[l]) {
+            level = (LogLevel)l;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t AsyncLog::rotation_count()
+{
+    return rotations.load(std::memory_order_relaxed);
+}
+
+bool AsyncLog::start(const LogConfig& config)
+{
+    std::lock_guard<std::mutex> lock(thread_mutex);
+    if (running)
+        return true;
+    settings = config;
+    set_levels(config);
+    bool opened = open_log_file();
+    stopping = false;
+    running = true;
+    log_thread = std::thread(log_thread_loop);
+    return opened;
+}
+
+void AsyncLog::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(thread_mutex);
+        if (!running)
+            return;
+        stopping = true;
+    }
+    wake.notify_one();
+    log_thread.join();
+    std::lock_guard<std::mutex> lock(thread_mutex);
+    running = false;
+    close_log_file();
+}
+
+void AsyncLog::set_levels(const LogConfig& config)
+{
+    for (int m = 0; m < (int)LogModule::COUNT; m++)
+        levels[m].store((int)config.module_levels[m], std::memory_order_relaxed);
+}
+
+bool AsyncLog::write(LogModule module, LogLevel level, const char* format, ...)
+{
+    uint64_t position = ring_head.load(std::memory_order_relaxed);
+    Record* record;
+    for (;;) {
+        record = &ring[position & RING_MASK];
+        int64_t lag = (int64_t)(record->sequence.load(std::memory_order_acquire) + (position & RING_MASK) - position);
+        if (lag == 0) {
+            if (ring_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                break; // slot claimed
+        }
+        else if (lag < 0) { // the log thread has not read this slot of the previous round yet
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        else {
+            position = ring_head.load(std::memory_order_relaxed); // another producer claimed it
+        }
+    }
+    record->wall_us = wall_clock_us();
+    record->module = (uint8_t)module;
+    record->level = (uint8_t)level;
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf(record->text, RECORD_TEXT_CHARS, format, arguments);
+    va_end(arguments);
+    record->length = (uint16_t)std::min<int>(std::max(length, 0), RECORD_TEXT_CHARS - 1);
+    record->sequence.store(position + 1 - (position & RING_MASK), std::memory_order_release);
+    written.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file async_log.hpp
+ * @brief Asynchronous logger: fixed-size records in a lock-free ring, formatted and written by a background thread
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * Every event used to print several lines with std::cout and
+ * return_current_time_and_date() - a stringstream and the non-reentrant
+ * std::localtime per line - on the RealSenseID callback thread, the auth
+ * worker and the render thread, into a log file on the SD card that grew
+ * without bound.
+ *
+ * LOG_INFO() and friends instead format the message with vsnprintf into a
+ * fixed-size record of a multi-producer, single-consumer ring: a slot is
+ * claimed with one compare-and-swap, nothing is allocated and no lock taken.
+ * If the ring is full the record is dropped and counted, a producer never
+ * waits for the SD card. The log thread drains the ring every
+ * LOG_FLUSH_MSEC, prefixes each line with date and time - formatted once per
+ * second - level and module, and writes all lines with one write(). The file
+ * is rotated by size: smartdoorF455.log becomes smartdoorF455.log.1 and so
+ * on, the oldest is deleted.
+ *
+ * Each module has its own level; a message below it costs one relaxed
+ * atomic load, its arguments are not evaluated.
+ *
+ * Example usage:
+ * @code
+ * LogConfig config;
+ * config.file = "/home/pi/log/smartdoorF455.log";
+ * AsyncLog::start(config);
+ * LOG_INFO(LogModule::Auth, "edge-to-unlock latency: %lld ms", (long long)latency_ms);
+ * AsyncLog::stop(); // writes what is left
+ * @endcode
+ *
+ * Configured in section [log] of config.toml. The header has no hardware
+ * dependencies.
+ */
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+enum class LogLevel : int { Debug = 0, Info = 1, Warn = 2, Error = 3, Off = 4 };
+
+/**
+ * @brief parts of the program with a level of their own, see [log.modules] in config.toml
+ */
+enum class LogModule : int {
+    Main, Auth, Camera, Trigger, Display, Mqtt, Telegram, Snapshot, Motion, Control, Config,
+    COUNT
+};
+
+const char* log_module_name(LogModule module);
+/** "debug", "info", "warn", "error" or "off"; false if name is none of them */
+bool parse_log_level(const std::string& name, LogLevel& level);
+
+/**
+ * @brief settings of section [log] in config.toml
+ */
+struct LogConfig {
+    std::string file;                               // log file, empty = stdout without rotation
+    size_t max_bytes = 10 * 1024 * 1024;            // size at which the file is rotated
+    int keep_files = 3;                             // rotated files kept, .1 is the newest
+    LogLevel level = LogLevel::Info;                // level of modules not in module_levels
+    LogLevel module_levels[(int)LogModule::COUNT];  // per module
+    LogConfig() {
+        for (LogLevel& module_level : module_levels)
+            module_level = level;
+    }
+};
+
+/**
+ * @class AsyncLog
+ * @brief Lock-free record ring and the log thread draining it
+ */
+class AsyncLog {
+public:
+    static constexpr size_t RECORD_TEXT_CHARS = 232; // longer messages are cut
+    static constexpr size_t RING_RECORDS = 1024;    // power of two
+
+    /** opens the log file and starts the log thread; records written before are kept */
+    static bool start(const LogConfig& config);
+    /** writes the records left in the ring and ends the log thread */
+    static void stop();
+
+    /** sets the levels of all modules, e.g. after config.toml was reloaded */
+    static void set_levels(const LogConfig& config);
+
+    static bool enabled(LogModule module, LogLevel level) {
+        return (int)level >= levels[(int)module].load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief formats a message into a free record of the ring; never blocks
+     * @return false if the ring was full and the message dropped
+     */
+    static bool write(LogModule module, LogLevel level, const char* format, ...) __attribute__((format(printf, 3, 4)));
+
+    static uint64_t written_count() { return written.load(std::memory_order_relaxed); }
+    static uint64_t dropped_count() { return dropped.load(std::memory_order_relaxed); }
+    static uint64_t rotation_count();
+
+private:
+    static std::atomic<int> levels[(int)LogModule::COUNT];
+    static std::atomic<uint64_t> written, dropped;
+};
+
+#define LOG_AT(module, level, ...) \
+    do { if (AsyncLog::enabled(module, level)) AsyncLog::write(module, level, __VA_ARGS__); } while (0)
+#define LOG_DEBUG(module, ...) LOG_AT(module, LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(module, ...) LOG_AT(module, LogLevel::Info, __VA_ARGS__)
+#define LOG_WARN(module, ...) LOG_AT(module, LogLevel::Warn, __VA_ARGS__)
+#define LOG_ERROR(module, ...) LOG_AT(module, LogLevel::Error, __VA_ARGS__)
@@ -0,0 +1,148 @@
+/**
+ * @file compositor.cpp
+ * @brief Layered compositor of the LED panel: cached base layer, priority overlays, one combine pass
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ */
+#include "compositor.hpp"
+#include <algorithm>
+
+constexpr Rgb Layer::TRANSPARENT;
+
+Layer::Layer(int priority, uint8_t opacity, int width, int height)
+    : layer_priority(priority), layer_opacity(opacity)
+{
+    pixels.resize(width, height);
+    pixels.fill(TRANSPARENT);
+    dirty_top = extent_top = pixels.height;
+    dirty_bottom = extent_bottom = 0;
+}
+
+void Layer::mark_dirty(int top, int bottom)
+{
+    top = std::max(top, 0);
+    bottom = std::min(bottom, pixels.height);
+    if (top >= bottom)
+        return;
+    dirty_top = std::min(dirty_top, top);
+    dirty_bottom = std::max(dirty_bottom, bottom);
+    extent_top = std::min(extent_top, top);
+    extent_bottom = std::max(extent_bottom, bottom);
+}
+
+void Layer::clear_rows(int top, int bottom)
+{
+    pixels.fill_rows(top, bottom, TRANSPARENT);
+    mark_dirty(top, bottom);
+    if (top <= extent_top && bottom >= extent_bottom) { // nothing left to cover
+        extent_top = pixels.height;
+        extent_bottom = 0;
+    }
+}
+
+void Layer::fill_rows(int top, int bottom, Rgb color)
+{
+    pixels.fill_rows(top, bottom, color);
+    mark_dirty(top, bottom);
+}
+
+int Layer::draw_text(const GlyphAtlas& font, int x, int y, Rgb color, const char* utf8)
+{
+    mark_dirty(y - font.baseline(), y - font.baseline() + font.height());
+    return font.draw_text(pixels, x, y, color, utf8);
+}
+
+void Layer::show(int64_t until_us)
+{
+    shown = true;
+    until = until_us;
+}
+
+void Layer::hide()
+{
+    shown = false;
+}
+
+Compositor::Compositor(int width, int height, Rgb background)
+    : width(std::min(width, Framebuffer::MAX_WIDTH)), height(std::min(height, Framebuffer::MAX_HEIGHT)), background(background)
+{
+}
+
+Layer& Compositor::add_layer(int priority, uint8_t opacity)
+{
+    auto position = std::upper_bound(layers.begin(), layers.end(), priority,
+                                     [](int p, const std::unique_ptr<Layer>& layer) { return p < layer->priority(); });
+    return **layers.insert(position, std::make_unique<Layer>(priority, opacity, width, height));
+}
+
+/**
+ * @brief alpha blends over onto under, alpha 0..255
+ */
+static inline Rgb blend(Rgb under, Rgb over, unsigned int alpha)
+{
+    unsigned int inverse = 255 - alpha;
+    return Rgb{ (uint8_t)((over.r * alpha + under.r * inverse + 127) / 255),
+                (uint8_t)((over.g * alpha + under.g * inverse + 127) / 255),
+                (uint8_t)((over.b * alpha + under.b * inverse + 127) / 255) };
+}
+
+bool Compositor::compose(Framebuffer& frame, int64_t now_us, int& top, int& bottom)
+{
+    top = first ? 0 : height;
+    bottom = first ? height : 0;
+    first = false;
+    for (auto& layer : layers) {
+        bool is_visible = layer->visible(now_us);
+        // rows drawn or cleared in a layer shown now or at the last compose; a hidden layer's
+        // rows are combined through its extent once it is shown
+        if (is_visible || layer->was_visible) {
+            top = std::min(top, layer->dirty_top);
+            bottom = std::max(bottom, layer->dirty_bottom);
+        }
+        if (is_visible != layer->was_visible) { // shown, hidden or timed out: everything it covers changes
+            top = std::min(top, layer->extent_top);
+            bottom = std::max(bottom, layer->extent_bottom);
+            layer->was_visible = is_visible;
+        }
+        layer->dirty_top = layer->pixels.height;
+        layer->dirty_bottom = 0;
+    }
+    if (top >= bottom)
+        return false;
+    frame.resize(width, height);
+    for (int y = top; y < bottom; y++) {
+        Rgb* out = frame.pixel[y];
+        std::fill(out, out + width, background);
+        for (const auto& layer : layers) {
+            if (!layer->was_visible || y < layer->extent_top || y >= layer->extent_bottom)
+                continue;
+            const Rgb* in = layer->pixels.pixel[y];
+            const unsigned int alpha = layer->layer_opacity;
+            if (alpha == 255) {
+                for (int x = 0; x < width; x++) {
+                    if (in[x] != Layer::TRANSPARENT)
+                        out[x] = in[x];
+                }
+            }
+            else {
+                for (int x = 0; x < width; x++) {
+                    if (in[x] != Layer::TRANSPARENT)
+                        out[x] = blend(out[x], in[x], alpha);
+                }
+            }
+        }
+    }
+    rows_total += bottom - top;
+    return true;
+}
+
+int64_t Compositor::next_expiry(int64_t now_us) const
+{
+    int64_t next = 0;
+    for (const auto& layer : layers) {
+        int64_t expiry = layer->expiry();
+        if (expiry > now_us && (next == 0 || expiry < next))
+            next = expiry;
+    }
+    return next;
+}
@@ -0,0 +1,124 @@
+/**
+ * @file compositor.hpp
+ * @brief Layered compositor of the LED panel: cached base layer, priority overlays, one combine pass
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * Each layer is a Framebuffer of its own, drawn only when its content
+ * changes - the clock base layer once a minute, the name overlay once per
+ * door opening. Pixels equal to Layer::TRANSPARENT let lower layers shine
+ * through, like the key color of a sprite sheet.
+ *
+ * - layers are combined in ascending priority; a layer with opacity below
+ *   255 is alpha blended over the layers beneath (e.g. a red spoof alert
+ *   tinting the clock)
+ * - every layer tracks the pixel rows drawn since the last compose (dirty
+ *   rows); showing, hiding or timing out a layer marks the rows it covers
+ * - compose() combines only the union of dirty rows into the output frame,
+ *   in a single pass over all layers per row; unchanged rows keep their pixels
+ *
+ * The header has no hardware dependencies.
+ */
+#pragma once
+#include "glyph_atlas.hpp"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * @class Layer
+ * @brief One plane of the panel with visibility, timeout, opacity and dirty rows
+ */
+class Layer {
+public:
+    /** pixels of this color are transparent; (1,0,1) is indistinguishable from black on the panel */
+    static constexpr Rgb TRANSPARENT{ 1, 0, 1 };
+
+    Layer(int priority, uint8_t opacity, int width, int height);
+
+    int priority() const { return layer_priority; }
+    uint8_t opacity() const { return layer_opacity; }
+    /** drawing surface; mark the rows changed by drawing with mark_dirty() */
+    Framebuffer& canvas() { return pixels; }
+    const Framebuffer& canvas() const { return pixels; }
+
+    /** makes the layer transparent in rows [top, bottom) */
+    void clear_rows(int top, int bottom);
+    void clear() { clear_rows(0, pixels.height); }
+    void fill_rows(int top, int bottom, Rgb color);
+    /** draws text with its baseline at y and marks the rows of the font */
+    int draw_text(const GlyphAtlas& font, int x, int y, Rgb color, const char* utf8);
+    void mark_dirty(int top, int bottom);
+
+    /**
+     * @brief shows the layer
+     * @param until_us monotonic time when it hides itself again, 0 = until hide()
+     */
+    void show(int64_t until_us = 0);
+    void hide();
+    bool visible(int64_t now_us) const { return shown && (until == 0 || now_us < until); }
+    /** timeout of a shown layer, 0 if none */
+    int64_t expiry() const { return shown ? until : 0; }
+
+private:
+    friend class Compositor;
+    int layer_priority;
+    uint8_t layer_opacity;
+    Framebuffer pixels;
+    bool shown = false;
+    int64_t until = 0;
+    bool was_visible = false;   // visibility at the last compose
+    int dirty_top, dirty_bottom; // rows changed since the last compose, empty if top >= bottom
+    int extent_top, extent_bottom; // rows holding non-transparent pixels since the last clear()
+};
+
+/**
+ * @class Compositor
+ * @brief Combines the dirty rows of all layers into one frame
+ *
+ * Example usage:
+ * @code
+ * Compositor compositor(32, 64, bg);
+ * Layer& base = compositor.add_layer(0);
+ * Layer& alert = compositor.add_layer(30, 160); // blended
+ * base.draw_text(font_time, 0, LINE_OFFSET_1, clock_color, "12:34");
+ * int top, bottom;
+ * if (compositor.compose(frame, monotonic_us(), top, bottom))
+ *     copy rows [top, bottom) of frame to the FrameCanvas;
+ * @endcode
+ */
+class Compositor {
+public:
+    /** @param background color of pixels no layer covers */
+    Compositor(int width, int height, Rgb background);
+
+    /** adds a layer, drawn above all layers of lower priority; references stay valid */
+    Layer& add_layer(int priority, uint8_t opacity = 255);
+
+    /**
+     * @brief combines all rows changed since the last call into frame
+     * @param frame output, keeps its pixels in unchanged rows - pass the same frame every time
+     * @param top, bottom set to the combined rows [top, bottom)
+     * @return false if nothing changed
+     */
+    bool compose(Framebuffer& frame, int64_t now_us, int& top, int& bottom);
+
+    /** earliest timeout of a visible layer after now_us, 0 if none */
+    int64_t next_expiry(int64_t now_us) const;
+
+    uint64_t rows_composed() const { return rows_total; }
+
+    /** new color of uncovered pixels; the next compose() combines every row */
+    void set_background(Rgb color) {
+        background = color;
+        first = true;
+    }
+
+private:
+    int width, height;
+    Rgb background;
+    std::vector<std::unique_ptr<Layer>> layers; // ascending priority
+    bool first = true;                          // first compose combines every row
+    uint64_t rows_total = 0;
+};
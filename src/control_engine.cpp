@@ -0,0 +1,302 @@
+/**
+ * @file control_engine.cpp
+ * @brief Command engine for topic_control: enrollment, deletion and user listing as preemptible jobs
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ */
+#include "control_engine.hpp"
+#include "async_log.hpp"
+#include "latency_trace.hpp"
+#include "thread_placement.hpp"
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+
+#define CANCEL_REPEAT_MSEC 100 // a preempted job is cancelled again at this interval until it returned
+
+const char* control_job_name(ControlJob::Kind kind)
+{
+    switch (kind) {
+    case ControlJob::Kind::Enroll: return "enroll";
+    case ControlJob::Kind::Delete: return "delete";
+    case ControlJob::Kind::List: return "list";
+    }
+    return "?";
+}
+
+void DeviceArbiter::acquire_for_auth(int64_t trigger_ts_us)
+{
+    int64_t start_us = monotonic_us();
+    Canceller cancel;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auth_waiting++; // from now on no job starts
+        if (job_active && !job_preempted) {
+            job_preempted = true;
+            preemptions.fetch_add(1, std::memory_order_relaxed);
+            cancel = job_cancel;
+        }
+    }
+    if (cancel)
+        cancel(); // outside the lock, the job thread may be reporting meanwhile
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        // a cancel that reached the device before the job's call started is lost, so it is repeated
+        while (!changed.wait_for(lock, std::chrono::milliseconds(CANCEL_REPEAT_MSEC),
+                                 [this] { return stopping || (!job_active && !auth_active); })) {
+            if (job_active && job_preempted && job_cancel) {
+                cancel = job_cancel;
+                lock.unlock();
+                cancel();
+                lock.lock();
+            }
+        }
+        auth_waiting--;
+        auth_active = true;
+    }
+    LatencyTrace::record(TraceStage::DeviceWait, start_us, monotonic_us(), trigger_ts_us);
+}
+
+void DeviceArbiter::release_auth()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auth_active = false;
+        last_auth_end_us = monotonic_us();
+    }
+    changed.notify_all();
+}
+
+bool DeviceArbiter::acquire_for_job(Canceller cancel, unsigned int resume_delay_ms)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        if (stopping)
+            return false;
+        if (auth_active || auth_waiting > 0 || job_active) {
+            changed.wait(lock);
+            continue;
+        }
+        int64_t resume_us = last_auth_end_us + (int64_t)resume_delay_ms * 1000;
+        int64_t now = monotonic_us();
+        if (last_auth_end_us == 0 || now >= resume_us)
+            break;
+        changed.wait_for(lock, std::chrono::microseconds(resume_us - now));
+    }
+    job_active = true;
+    job_preempted = false;
+    job_cancel = std::move(cancel);
+    return true;
+}
+
+bool DeviceArbiter::release_job()
+{
+    bool preempted;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job_active = false;
+        job_cancel = nullptr;
+        preempted = job_preempted;
+    }
+    changed.notify_all();
+    return preempted;
+}
+
+void DeviceArbiter::cancel_job()
+{
+    Canceller cancel;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (job_active)
+            cancel = job_cancel;
+    }
+    if (cancel)
+        cancel();
+}
+
+void DeviceArbiter::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+}
+
+ControlEngine::ControlEngine(const ControlEngineConfig& config, JobRunner runner, DeviceArbiter::Canceller cancel, StatusSink status)
+    : config(config), runner(std::move(runner)), cancel_device(std::move(cancel)), status(std::move(status))
+{
+}
+
+ControlEngine::~ControlEngine()
+{
+    stop();
+}
+
+void ControlEngine::start()
+{
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    if (running)
+        return;
+    running = true;
+    job_thread = std::thread(&ControlEngine::job_loop, this);
+}
+
+void ControlEngine::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (!running)
+            return;
+        running = false;
+        cancel_requested = job_running;
+    }
+    queue_changed.notify_all();
+    arbiter.cancel_job(); // abort a running enrollment, the device is needed for shutdown
+    arbiter.stop();
+    if (job_thread.joinable())
+        job_thread.join();
+}
+
+size_t ControlEngine::queued() const
+{
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return jobs.size();
+}
+
+void ControlEngine::report(const ControlJob& job, const std::string& text)
+{
+    std::string message = std::to_string(job.id) + " " + control_job_name(job.kind);
+    if (!job.user_id.empty())
+        message += " " + job.user_id;
+    message += ": " + text;
+    LOG_INFO(LogModule::Control, "%s", message.c_str());
+    if (status)
+        status(message);
+}
+
+bool ControlEngine::submit(const std::string& command)
+{
+    std::istringstream words(command);
+    std::string verb, user_id, extra;
+    words >> verb >> user_id >> extra;
+    std::transform(verb.begin(), verb.end(), verb.begin(), ::tolower);
+
+    if (verb == "cancel") { // drops queued jobs and aborts the running one
+        std::deque<ControlJob> dropped;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            dropped.swap(jobs);
+            cancel_requested = job_running;
+        }
+        for (const auto& job : dropped) {
+            cancelled.fetch_add(1, std::memory_order_relaxed);
+            report(job, "cancelled");
+        }
+        arbiter.cancel_job();
+        return true;
+    }
+
+    ControlJob job;
+    bool needs_user = true;
+    if (verb == "enroll")
+        job.kind = ControlJob::Kind::Enroll;
+    else if (verb == "delete")
+        job.kind = ControlJob::Kind::Delete;
+    else if (verb == "list")
+        needs_user = false;
+    else {
+        if (status)
+            status("unknown command '" + command + "', use: enroll <user>, delete <user>, list, cancel");
+        return false;
+    }
+    bool valid_user = !user_id.empty() && user_id.size() <= CONTROL_MAX_USER_ID_LENGTH &&
+        std::all_of(user_id.begin(), user_id.end(), [](unsigned char c) { return std::isgraph(c); });
+    if (!extra.empty() || (needs_user && !valid_user) || (!needs_user && !user_id.empty())) {
+        if (status)
+            status("invalid command '" + command + "', user ids have 1.." + std::to_string(CONTROL_MAX_USER_ID_LENGTH)
+                   + " characters without blanks");
+        return false;
+    }
+    job.user_id = user_id;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (jobs.size() >= config.max_queued) {
+            if (status)
+                status("rejected '" + command + "', " + std::to_string(jobs.size()) + " jobs queued");
+            return false;
+        }
+        job.id = next_id++;
+        jobs.push_back(job);
+        report(job, "queued"); // under the lock, so "queued" is always reported before "started"
+    }
+    queue_changed.notify_one();
+    return true;
+}
+
+/**
+ * @brief job thread - runs one job at a time whenever the arbiter grants the device
+ */
+void ControlEngine::job_loop()
+{
+    place_this_thread("control");
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    while (running) {
+        if (jobs.empty()) {
+            queue_changed.wait(lock);
+            continue;
+        }
+        ControlJob job = jobs.front();
+        jobs.pop_front();
+        job_running = true;
+        cancel_requested = false;
+        lock.unlock();
+
+        bool acquired = arbiter.acquire_for_job(cancel_device, config.resume_delay_ms);
+        if (acquired) {
+            job.attempts++;
+            report(job, job.attempts == 1 ? "started" : "restarted, attempt " + std::to_string(job.attempts));
+        }
+        lock.lock();
+        // checked again right before the device call: a cancel that arrived after
+        // acquiring the device found no call to abort, like a preemption that is repeated
+        if (!acquired || cancel_requested) { // stopped or cancelled before the device call
+            if (acquired)
+                arbiter.release_job();
+            job_running = false;
+            cancelled.fetch_add(1, std::memory_order_relaxed);
+            lock.unlock();
+            report(job, "cancelled");
+            lock.lock();
+            continue;
+        }
+        lock.unlock();
+
+        bool ok = runner(job, [&](const std::string& text) { report(job, text); });
+        bool preempted = arbiter.release_job();
+
+        lock.lock();
+        job_running = false;
+        std::string outcome;
+        if (ok) {
+            done.fetch_add(1, std::memory_order_relaxed);
+            outcome = "done";
+        }
+        else if (cancel_requested) {
+            cancelled.fetch_add(1, std::memory_order_relaxed);
+            outcome = "cancelled";
+        }
+        else if (preempted && job.attempts < config.max_attempts && running) {
+            restarted.fetch_add(1, std::memory_order_relaxed);
+            jobs.push_front(job); // continues before younger jobs once the door is quiet
+            outcome = "preempted by door authentication, restarting";
+        }
+        else {
+            failed.fetch_add(1, std::memory_order_relaxed);
+            outcome = preempted ? "failed, preempted " + std::to_string(job.attempts) + " times" : "failed";
+        }
+        lock.unlock();
+        report(job, outcome);
+        lock.lock();
+    }
+}
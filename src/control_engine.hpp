@@ -0,0 +1,186 @@
+/**
+ * @file control_engine.hpp
+ * @brief Command engine for topic_control: enrollment, deletion and user listing as preemptible jobs
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * Commands arrive as plain text on topic_control (MQTT network loop thread):
+ * @code
+ * mosquitto_pub -p 1884 -t smartdoorF455 -m "enroll alice"
+ * mosquitto_pub -p 1884 -t smartdoorF455 -m "delete alice"
+ * mosquitto_pub -p 1884 -t smartdoorF455 -m "list"
+ * mosquitto_pub -p 1884 -t smartdoorF455 -m "cancel"
+ * mosquitto_sub -p 1884 -v -t smartdoorF455/status
+ * @endcode
+ * submit() only parses and queues, a job thread runs the jobs one after the
+ * other on the shared FaceAuthenticator. Door authentication and jobs share
+ * the device through DeviceArbiter:
+ * - authentication always wins: a running job is cancelled (FaceAuthenticator::Cancel)
+ *   and restarted later, authentication waits only until the device returned
+ * - a job starts only when no authentication is pending or running and the
+ *   last one ended at least resume_delay_ms ago, so a person in front of the
+ *   door is not disturbed by a restarting enrollment
+ * - a preempted job is restarted up to max_attempts times; whoever enrolls
+ *   should stand still after the presence sensor fired once
+ *
+ * Progress (enrollment poses and hints) and results are reported as text on
+ * the status topic. The header has no hardware dependencies; device access is
+ * a plain function, so smartdoorF455_sim runs the engine with a simulated
+ * authenticator.
+ */
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#define CONTROL_MAX_USER_ID_LENGTH 31 // as RealSenseID::MAX_USERID_LENGTH
+
+/**
+ * @brief job created from a command on topic_control
+ */
+struct ControlJob {
+    enum class Kind { Enroll, Delete, List };
+    Kind kind = Kind::List;
+    std::string user_id;       // empty for List
+    uint64_t id = 0;           // job number, prefixes every status message
+    unsigned int attempts = 0; // runs started so far, more than one after preemption
+};
+
+const char* control_job_name(ControlJob::Kind kind);
+
+/**
+ * @brief settings of the command engine, read from section [mosquitto] in config.toml
+ */
+struct ControlEngineConfig {
+    size_t max_queued = 8;               // further commands are rejected
+    unsigned int max_attempts = 5;       // a job preempted this often is given up
+    unsigned int resume_delay_ms = 3000; // quiet time after an authentication before a job (re)starts
+};
+
+/**
+ * @class DeviceArbiter
+ * @brief Grants the F455 either to door authentication or to one control job
+ *
+ * Authentication preempts jobs: acquire_for_auth() cancels a running job and
+ * waits until its device call returned.
+ */
+class DeviceArbiter {
+public:
+    using Canceller = std::function<void()>;
+
+    /**
+     * @brief called by the auth worker before authenticating; preempts a running job
+     * @param trigger_ts_us timestamp of the causing trigger, the wait is traced as device_wait
+     */
+    void acquire_for_auth(int64_t trigger_ts_us = 0);
+    void release_auth();
+
+    /**
+     * @brief called by the job thread; waits until no authentication is pending and the quiet time passed
+     *
+     * @param cancel aborts the device call of the job, called from the auth worker thread on preemption
+     * @return false if stop() was called meanwhile
+     */
+    bool acquire_for_job(Canceller cancel, unsigned int resume_delay_ms);
+
+    /**
+     * @brief releases the device after a job
+     * @return true if the job was preempted by an authentication
+     */
+    bool release_job();
+
+    /**
+     * @brief aborts the device call of a running job (user request), no effect if none runs
+     */
+    void cancel_job();
+
+    void stop();
+
+    uint64_t preemption_count() const { return preemptions.load(std::memory_order_relaxed); }
+
+private:
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool auth_active = false;
+    unsigned int auth_waiting = 0;
+    bool job_active = false;
+    bool job_preempted = false;
+    bool stopping = false;
+    int64_t last_auth_end_us = 0;
+    Canceller job_cancel;
+    std::atomic<uint64_t> preemptions{0};
+};
+
+/**
+ * @class ControlEngine
+ * @brief Parses topic_control commands and runs them as jobs on a single job thread
+ *
+ * Example usage:
+ * @code
+ * ControlEngine engine(config, run_control_job, [] { authenticator->Cancel(); },
+ *                      [](const std::string& text) { mqtt_session->publish(topic_status, text); });
+ * mqtt_session->set_message_handler([&](const std::string&, const std::string& payload) { engine.submit(payload); });
+ * engine.start();
+ * // auth stage
+ * engine.device().acquire_for_auth();
+ * authenticator->Authenticate(auth_clbk);
+ * engine.device().release_auth();
+ * @endcode
+ */
+class ControlEngine {
+public:
+    using ProgressSink = std::function<void(const std::string& text)>;
+    /** runs a job on the device; progress texts are forwarded to the status topic */
+    using JobRunner = std::function<bool(const ControlJob& job, const ProgressSink& progress)>;
+    using StatusSink = std::function<void(const std::string& text)>;
+
+    ControlEngine(const ControlEngineConfig& config, JobRunner runner, DeviceArbiter::Canceller cancel, StatusSink status);
+    ~ControlEngine();
+    ControlEngine(const ControlEngine&) = delete;
+    ControlEngine& operator=(const ControlEngine&) = delete;
+
+    void start();
+    void stop();
+
+    /**
+     * @brief parses a command and queues it; returns immediately
+     *
+     * Safe to call from the MQTT network loop thread. Unknown or malformed
+     * commands and a full queue are answered on the status topic.
+     * @return true if the command was accepted
+     */
+    bool submit(const std::string& command);
+
+    DeviceArbiter& device() { return arbiter; }
+
+    size_t queued() const;
+    uint64_t jobs_done() const { return done.load(std::memory_order_relaxed); }
+    uint64_t jobs_failed() const { return failed.load(std::memory_order_relaxed); }
+    uint64_t jobs_cancelled() const { return cancelled.load(std::memory_order_relaxed); }
+    uint64_t jobs_restarted() const { return restarted.load(std::memory_order_relaxed); }
+
+private:
+    ControlEngineConfig config;
+    JobRunner runner;
+    DeviceArbiter::Canceller cancel_device;
+    StatusSink status;
+    DeviceArbiter arbiter;
+    mutable std::mutex queue_mutex;
+    std::condition_variable queue_changed;
+    std::deque<ControlJob> jobs;
+    uint64_t next_id = 1;
+    bool running = false;
+    bool job_running = false;      // a job was taken from the queue and has not finished yet
+    bool cancel_requested = false; // "cancel" arrived while a job was running
+    std::thread job_thread;
+    std::atomic<uint64_t> done{0}, failed{0}, cancelled{0}, restarted{0};
+
+    void report(const ControlJob& job, const std::string& text);
+    void job_loop();
+};
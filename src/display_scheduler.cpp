@@ -0,0 +1,124 @@
+/**
+ * @file display_scheduler.cpp
+ * @brief Event driven, wall clock aligned scheduler of the LED matrix display thread
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ */
+#include "display_scheduler.hpp"
+#include "latency_trace.hpp"
+#include "thread_placement.hpp"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SECONDS_PER_MINUTE 60
+
+DisplayScheduler::DisplayScheduler(RenderFunction render) : render(std::move(render)) {}
+
+DisplayScheduler::~DisplayScheduler()
+{
+    stop();
+    if (timer_fd >= 0)
+        close(timer_fd);
+    if (event_fd >= 0)
+        close(event_fd);
+}
+
+bool DisplayScheduler::start()
+{
+    if (running)
+        return true;
+    if (timer_fd < 0)
+        timer_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (event_fd < 0)
+        event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (timer_fd < 0 || event_fd < 0) {
+        std::cerr << "display scheduler: cannot create timer or event descriptor: " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (!arm_minute_timer()) {
+        std::cerr << "display scheduler: cannot arm minute timer: " << strerror(errno) << std::endl;
+        return false;
+    }
+    running = true;
+    worker = std::thread(&DisplayScheduler::run, this);
+    return true;
+}
+
+void DisplayScheduler::stop()
+{
+    if (!running.exchange(false))
+        return;
+    notify();
+    if (worker.joinable())
+        worker.join();
+}
+
+void DisplayScheduler::notify()
+{
+    int64_t none = 0;
+    first_event_us.compare_exchange_strong(none, monotonic_us()); // keep the oldest pending event
+    uint64_t one = 1;
+    if (event_fd >= 0)
+        (void)!write(event_fd, &one, sizeof(one));
+}
+
+bool DisplayScheduler::arm_minute_timer()
+{
+    // absolute expiry at the next full minute, then every minute - stays aligned to hh:mm:00
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = (now.tv_sec / SECONDS_PER_MINUTE + 1) * SECONDS_PER_MINUTE;
+    spec.it_interval.tv_sec = SECONDS_PER_MINUTE;
+    return timerfd_settime(timer_fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, nullptr) == 0;
+}
+
+void DisplayScheduler::run()
+{
+    place_this_thread("display");
+    int64_t deadline_us = render(monotonic_us());
+    while (running) {
+        int timeout_ms = -1; // nothing but the minute timer and events to wait for
+        if (deadline_us != 0) {
+            int64_t wait_us = deadline_us - monotonic_us();
+            timeout_ms = wait_us <= 0 ? 0 : (int)((wait_us + 999) / 1000);
+        }
+        struct pollfd fds[2] = { { timer_fd, POLLIN, 0 }, { event_fd, POLLIN, 0 } };
+        int ready = poll(fds, 2, timeout_ms);
+        if (ready < 0) {
+            if (errno == EINTR)
+                continue;
+            std::cerr << "display scheduler: poll failed: " << strerror(errno) << std::endl;
+            break;
+        }
+        if (!running)
+            break;
+        if (ready == 0)
+            deadline_wakeups_count.fetch_add(1, std::memory_order_relaxed);
+        if (fds[0].revents & POLLIN) {
+            uint64_t expirations;
+            if (read(timer_fd, &expirations, sizeof(expirations)) < 0 && errno == ECANCELED)
+                arm_minute_timer(); // wall clock was set, realign to the new minute boundary
+            minute_wakeups_count.fetch_add(1, std::memory_order_relaxed);
+        }
+        int64_t event_us = 0;
+        if (fds[1].revents & POLLIN) {
+            uint64_t count;
+            (void)!read(event_fd, &count, sizeof(count));
+            event_us = first_event_us.exchange(0);
+            event_wakeups_count.fetch_add(1, std::memory_order_relaxed);
+        }
+        deadline_us = render(monotonic_us());
+        if (event_us != 0) {
+            int64_t latency_us = monotonic_us() - event_us;
+            int64_t max = max_event_latency.load(std::memory_order_relaxed);
+            while (latency_us > max && !max_event_latency.compare_exchange_weak(max, latency_us, std::memory_order_relaxed)) {}
+        }
+    }
+}
@@ -0,0 +1,85 @@
+/**
+ * @file display_scheduler.hpp
+ * @brief Event driven, wall clock aligned scheduler of the LED matrix display thread
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * The clock shows HH:MM, so its content changes 1,440 times a day - polling it
+ * every second wakes the display thread 86,400 times a day and still shows a
+ * new minute up to one interval late. DisplayScheduler instead sleeps in
+ * poll() on two file descriptors until something can have changed:
+ *
+ * - a CLOCK_REALTIME timerfd armed on absolute minute boundaries; with
+ *   TFD_TIMER_CANCEL_ON_SET a clock step (NTP, manual date change) wakes it too
+ * - an eventfd written by notify() when an authentication result or hint
+ *   arrives, so the new overlay reaches the panel within one render
+ * - the poll timeout, set to the earliest overlay deadline the render function
+ *   returned, so overlays expire on time instead of after a number of ticks
+ *
+ * The render function runs on the scheduler thread only. notify() is a single
+ * write() and may be called from any thread, including signal handlers.
+ * The header has no hardware dependencies.
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+/**
+ * @class DisplayScheduler
+ * @brief Runs a render function on minute boundaries, events and overlay deadlines
+ *
+ * Example usage:
+ * @code
+ * DisplayScheduler scheduler([](int64_t now_us) { render_clock(); return overlay_deadline_us; });
+ * scheduler.start();
+ * scheduler.notify(); // from the authentication callback
+ * scheduler.stop();
+ * @endcode
+ */
+class DisplayScheduler {
+public:
+    /**
+     * @brief renders the frame for now_us (monotonic_us())
+     * @return monotonic time in us when the frame has to be rendered again
+     *         (e.g. an overlay expires), 0 if only the next minute matters
+     */
+    using RenderFunction = std::function<int64_t(int64_t now_us)>;
+
+    explicit DisplayScheduler(RenderFunction render);
+    ~DisplayScheduler();
+    DisplayScheduler(const DisplayScheduler&) = delete;
+    DisplayScheduler& operator=(const DisplayScheduler&) = delete;
+
+    /**
+     * @brief creates timer and event descriptors and starts the thread, which renders at once
+     * @return false if the descriptors could not be created
+     */
+    bool start();
+    /** stops and joins the thread; notify() stays safe to call afterwards */
+    void stop();
+
+    /** wakes the thread to render now; async-signal-safe */
+    void notify();
+
+    uint64_t minute_wakeups() const { return minute_wakeups_count.load(std::memory_order_relaxed); }
+    uint64_t event_wakeups() const { return event_wakeups_count.load(std::memory_order_relaxed); }
+    uint64_t deadline_wakeups() const { return deadline_wakeups_count.load(std::memory_order_relaxed); }
+    /** longest time from notify() until the render function returned, in us */
+    int64_t max_event_latency_us() const { return max_event_latency.load(std::memory_order_relaxed); }
+
+private:
+    RenderFunction render;
+    int timer_fd = -1;
+    int event_fd = -1;
+    std::atomic<bool> running{false};
+    std::thread worker;
+    std::atomic<int64_t> first_event_us{0}; // monotonic_us() of the oldest unhandled notify(), 0 if none
+    std::atomic<uint64_t> minute_wakeups_count{0}, event_wakeups_count{0}, deadline_wakeups_count{0};
+    std::atomic<int64_t> max_event_latency{0};
+
+    bool arm_minute_timer();
+    void run();
+};
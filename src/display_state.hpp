@@ -0,0 +1,115 @@
+/**
+ * @file display_state.hpp
+ * @brief Race-free channel of the display state from callback threads to the LED matrix thread
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * Replaces std::atomic<std::string*> name_lastauthenticated, whose string
+ * was assigned by the RealSenseID callback thread while the render thread
+ * read and cleared it - a data race on the string buffer, and an allocation
+ * in the authentication callback.
+ *
+ * DisplayState is a fixed-size POD snapshot. StateChannel publishes it
+ * through a triple buffer:
+ * - writers (authentication result, hints, control commands) serialize on a
+ *   mutex, modify their own copy and publish it with one atomic exchange -
+ *   no allocation, the critical section is a copy of the snapshot
+ * - the single reader (render thread) is wait-free: one atomic load, and an
+ *   exchange if a newer snapshot was published; it never sees a torn state
+ *   and never blocks a writer
+ *
+ * The header has no hardware dependencies.
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <type_traits>
+
+#define DISPLAY_USER_BYTES 64 // storage of the user name incl. terminating zero
+
+/**
+ * @brief what the LED matrix shows besides the clock; all times are monotonic_us()
+ */
+struct DisplayState {
+    char user[DISPLAY_USER_BYTES] = {}; // last authenticated user, UTF-8
+    int32_t auth_status = -1;           // RealSenseID::AuthenticateStatus of the last result, -1 none yet
+    int32_t hint = -1;                  // last RealSenseID::AuthenticateStatus hint, -1 none yet
+    int64_t auth_ts_us = 0;             // time of the last authentication result
+    int64_t user_until_us = 0;          // user is displayed until then
+    int64_t hint_until_us = 0;          // hint is displayed until then
+    int64_t alert_until_us = 0;         // spoof alert is displayed until then
+    uint64_t auth_count = 0;            // authentication results so far
+
+    /**
+     * @brief copies name, cut after max_chars UTF-8 characters (never within a character)
+     */
+    void set_user(const char* name, size_t max_chars) {
+        size_t bytes = 0, chars = 0;
+        while (name[bytes] != '\0' && chars < max_chars) {
+            size_t length = 1;
+            while ((name[bytes + length] & 0xC0) == 0x80) // continuation bytes of the same character
+                length++;
+            if (bytes + length >= sizeof(user))
+                break;
+            bytes += length;
+            chars++;
+        }
+        memcpy(user, name, bytes);
+        user[bytes] = '\0';
+    }
+};
+
+/**
+ * @class StateChannel
+ * @brief Triple buffer with serialized writers and one wait-free reader
+ *
+ * Example usage:
+ * @code
+ * StateChannel<DisplayState> display_state;
+ * display_state.update([&](DisplayState& state) { state.set_user(user_id, MAX_NAME_LENGTH); }); // any thread
+ * DisplayState shown = display_state.read(); // render thread only
+ * @endcode
+ */
+template <typename T>
+class StateChannel {
+    static_assert(std::is_trivially_copyable<T>::value, "snapshots are copied as plain memory");
+
+public:
+    /**
+     * @brief modifies the latest state and publishes it
+     * @param modify callable taking T&; runs under the writer lock, must not block
+     */
+    template <typename Modify>
+    void update(Modify&& modify) {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        modify(latest);
+        buffers[back] = latest;
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+        updates.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief latest published state; wait-free, to be called from a single reader thread
+     */
+    T read() {
+        if (middle.load(std::memory_order_acquire) & FRESH)
+            front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+        return buffers[front];
+    }
+
+    uint64_t update_count() const { return updates.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr uint8_t INDEX = 0x03;
+    static constexpr uint8_t FRESH = 0x04; // middle holds a snapshot the reader has not taken yet
+    T buffers[3] = {};
+    std::atomic<uint8_t> middle{1};  // buffer exchanged between writer and reader
+    uint8_t back = 0;                // written by writers, under writer_mutex
+    uint8_t front = 2;               // read by the reader
+    T latest = {};                   // writers' copy, under writer_mutex
+    std::mutex writer_mutex;
+    std::atomic<uint64_t> updates{0};
+};
@@ -0,0 +1,91 @@
+/**
+ * @file door_controller.cpp
+ * @brief What happens at the door on an authentication result: display, door opener, notification
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ */
+#include "door_controller.hpp"
+#include "async_log.hpp"
+#include "latency_trace.hpp"
+#include "metrics.hpp"
+#include <string>
+
+DoorController::DoorController(const DoorControllerConfig& config, StateChannel<DisplayState>& display_state,
+                               const TriggerPipeline& pipeline, NotificationOutbox* outbox, StatusNames status_names,
+                               Notify wake_display, OpenDoor open_door)
+    : config(config), display_state(display_state), pipeline(pipeline), outbox(outbox), status_names(status_names),
+      wake_display(std::move(wake_display)), open_door(std::move(open_door))
+{
+}
+
+void DoorController::on_result(AuthOutcome outcome, int status, const char* user_id)
+{
+    int64_t trigger_ts_us = pipeline.inflight_trigger_ts_us();
+    TraceSpan span(TraceStage::OnResult, trigger_ts_us);
+    Metrics::count_auth_status(status);
+    if (outcome == AuthOutcome::Granted) {
+        display_state.update([&](DisplayState& state) { // no allocation, never waits for the render thread
+            state.set_user(user_id, config.max_name_length);
+            state.auth_status = (int32_t)status;
+            state.auth_ts_us = monotonic_us();
+            state.user_until_us = state.auth_ts_us + config.name_display_us;
+            state.auth_count++;
+        });
+        if (wake_display)
+            wake_display(); // show the name now, not at the next minute
+        LOG_INFO(LogModule::Auth, "Hallo %s", user_id);
+        // TRIGGER DOOR OPENER - the daemon publishes an MQTT message to the door buzzer gateway,
+        // adapt open_door in smartdoorF455.cpp according to your interface
+        if (open_door)
+            open_door(trigger_ts_us);
+        granted.fetch_add(1, std::memory_order_relaxed);
+        if (trigger_ts_us != 0)
+            LOG_INFO(LogModule::Auth, "edge-to-unlock latency: %lld ms", (long long)(monotonic_us() - trigger_ts_us) / 1000);
+        if (outbox) { // hand off to notification outbox, never wait on Telegram here
+            Notification notification;
+            notification.text = std::string("Door opened for ") + user_id;
+            notification.trigger_ts_us = trigger_ts_us;
+            outbox->post(std::move(notification));
+        }
+        return;
+    }
+    const bool spoof = outcome == AuthOutcome::Spoof;
+    LOG_WARN(LogModule::Auth, "RealSenseID::AuthenticateStatus: %s", status_names(status));
+    (spoof ? spoofs : denied).fetch_add(1, std::memory_order_relaxed);
+    if (spoof)
+        Metrics::add(MetricCounter::AuthSpoofs);
+    display_state.update([&](DisplayState& state) {
+        state.auth_status = (int32_t)status;
+        state.auth_ts_us = monotonic_us();
+        if (spoof)
+            state.alert_until_us = state.auth_ts_us + config.alert_display_us;
+        state.auth_count++;
+    });
+    if (spoof && wake_display)
+        wake_display();
+    if (outbox) { // repeated attempts within the coalesce window are sent as one message with a count
+        Notification notification;
+        notification.text = "RealSenseID::AuthenticateStatus: unauthorized person tried to access";
+        notification.trigger_ts_us = trigger_ts_us;
+        outbox->post(std::move(notification));
+    }
+}
+
+void DoorController::on_hint(int hint)
+{
+    TraceSpan span(TraceStage::OnHint, pipeline.inflight_trigger_ts_us());
+    LOG_INFO(LogModule::Auth, "authentication hint: %s", status_names(hint));
+    Metrics::add(MetricCounter::AuthHints);
+    display_state.update([&](DisplayState& state) {
+        state.hint = (int32_t)hint;
+        state.hint_until_us = monotonic_us() + config.hint_display_us;
+    });
+    if (wake_display)
+        wake_display();
+}
+
+void DoorController::on_faces(size_t count)
+{
+    TraceSpan span(TraceStage::OnFaceDetected, pipeline.inflight_trigger_ts_us());
+    Metrics::add(MetricCounter::FacesDetected, count);
+}
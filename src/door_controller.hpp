@@ -0,0 +1,82 @@
+/**
+ * @file door_controller.hpp
+ * @brief What happens at the door on an authentication result: display, door opener, notification
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * DoorController is the AuthListener of every authentication, whichever
+ * AuthDevice runs it. On a granted result it shows the name on the LED
+ * matrix, opens the door - publish over MQTT in the daemon - and hands a
+ * message to the notification outbox; a denied result or a spoofing attempt
+ * only updates the display and is notified. Hints are shown for a while.
+ *
+ * All callbacks run on the thread of the device and never wait: the display
+ * state is a StateChannel, the outbox and the door opener queue the work.
+ *
+ * Example usage:
+ * @code
+ * DoorController door(DoorControllerConfig(), display_state, trigger_pipeline, outbox.get(),
+ *                     auth_status_name, [] { wake_display(); },
+ *                     [](int64_t trigger_ts_us) { mqtt_session->publish_door_open(trigger_ts_us); });
+ * auth_device->authenticate(door);
+ * @endcode
+ *
+ * The header has no hardware dependencies.
+ */
+#pragma once
+#include "display_state.hpp"
+#include "hal.hpp"
+#include "notification_outbox.hpp"
+#include "trigger_pipeline.hpp"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+/**
+ * @brief how long results are shown on the LED matrix
+ */
+struct DoorControllerConfig {
+    int64_t name_display_us = 5000000;   // name of the authenticated person
+    int64_t hint_display_us = 2000000;   // authentication hint
+    int64_t alert_display_us = 3000000;  // tint after a spoofing attempt
+    size_t max_name_length = 16;         // characters of the name shown, wider names scroll
+};
+
+/**
+ * @class DoorController
+ * @brief Reacts to authentication results of any AuthDevice
+ */
+class DoorController : public AuthListener {
+public:
+    using Notify = std::function<void()>;
+    /** opens the door for the trigger at trigger_ts_us (0 if unknown); must not block */
+    using OpenDoor = std::function<void(int64_t trigger_ts_us)>;
+
+    /**
+     * @param outbox may be nullptr if nobody is notified
+     * @param status_names names statuses and hints in the log
+     * @param wake_display renders the display state now instead of at the next minute
+     */
+    DoorController(const DoorControllerConfig& config, StateChannel<DisplayState>& display_state,
+                   const TriggerPipeline& pipeline, NotificationOutbox* outbox, StatusNames status_names,
+                   Notify wake_display, OpenDoor open_door);
+
+    void on_result(AuthOutcome outcome, int status, const char* user_id) override;
+    void on_hint(int hint) override;
+    void on_faces(size_t count) override;
+
+    uint64_t granted_count() const { return granted.load(std::memory_order_relaxed); }
+    uint64_t denied_count() const { return denied.load(std::memory_order_relaxed); }
+    uint64_t spoof_count() const { return spoofs.load(std::memory_order_relaxed); }
+
+private:
+    DoorControllerConfig config;
+    StateChannel<DisplayState>& display_state;
+    const TriggerPipeline& pipeline;
+    NotificationOutbox* outbox;
+    StatusNames status_names;
+    Notify wake_display;
+    OpenDoor open_door;
+    std::atomic<uint64_t> granted{0}, denied{0}, spoofs{0};
+};
@@ -0,0 +1,173 @@
+/**
+ * @file door_trace.cpp
+ * @brief Door traffic as a list of visits: generated for a whole day or read from a CSV file
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ */
+#include "door_trace.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+#define TRACE_HOUR_US (3600LL * 1000000)
+#define TRACE_CSV_HEADER "time,visitor,user,dwell_ms,bounces,hints,auth_ms"
+
+namespace {
+
+// relative traffic per hour of day at the door of a family home
+const double hour_weights[24] = { 1, 0.3, 0.2, 0.2, 0.3, 1, 4, 10, 8, 4, 3, 3,
+                                  5, 4, 3, 4, 6, 9, 10, 7, 5, 3, 2, 1 };
+
+/**
+ * @brief "07:12:04.250" - hours go beyond 23 in traces longer than a day
+ */
+std::string format_trace_time(int64_t at_us)
+{
+    int64_t ms = at_us / 1000;
+    char text[32];
+    snprintf(text, sizeof(text), "%02lld:%02lld:%02lld.%03lld", (long long)(ms / 3600000), (long long)(ms / 60000 % 60),
+             (long long)(ms / 1000 % 60), (long long)(ms % 1000));
+    return text;
+}
+
+bool parse_trace_time(const std::string& text, int64_t& at_us)
+{
+    long long hours = 0, minutes = 0, milliseconds = 0;
+    double seconds = 0;
+    if (sscanf(text.c_str(), "%lld:%lld:%lf", &hours, &minutes, &seconds) != 3 || hours < 0 || minutes < 0
+        || minutes > 59 || seconds < 0 || seconds >= 60)
+        return false;
+    milliseconds = (long long)(seconds * 1000 + 0.5);
+    at_us = ((hours * 60 + minutes) * 60000 + milliseconds) * 1000;
+    return true;
+}
+
+bool parse_visitor(const std::string& name, Visitor& visitor)
+{
+    for (Visitor v : { Visitor::Resident, Visitor::Stranger, Visitor::Spoofer, Visitor::Passerby }) {
+        if (name == visitor_name(v)) {
+            visitor = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+const char* visitor_name(Visitor visitor)
+{
+    static const char* const names[] = { "resident", "stranger", "spoofer", "passerby" };
+    return names[(int)visitor];
+}
+
+DoorTrace generate_day_trace(const TraceProfile& profile)
+{
+    DoorTrace trace;
+    trace.duration_us = profile.duration_us;
+    const int hours = (int)((profile.duration_us + TRACE_HOUR_US - 1) / TRACE_HOUR_US);
+    if (hours <= 0)
+        return trace;
+    std::vector<double> weights(hours);
+    for (int h = 0; h < hours; h++)
+        weights[h] = hour_weights[h % 24];
+    std::mt19937 rng(profile.seed);
+    std::discrete_distribution<int> hour_of(weights.begin(), weights.end());
+    std::uniform_int_distribution<int64_t> within_hour(0, TRACE_HOUR_US - 1);
+    std::uniform_int_distribution<int> percent(1, 100);
+    auto between = [&rng](int64_t low, int64_t high) { return std::uniform_int_distribution<int64_t>(low, high)(rng); };
+    const int visits = (int)((int64_t)profile.visits * profile.duration_us / (24 * TRACE_HOUR_US));
+    for (int v = 0; v < visits; v++) {
+        DoorEvent event;
+        event.at_us = hour_of(rng) * TRACE_HOUR_US + within_hour(rng);
+        if (event.at_us >= profile.duration_us)
+            event.at_us = profile.duration_us - 1; // last, partial hour
+        int roll = percent(rng);
+        if ((roll -= profile.passerby_percent) <= 0) {
+            event.visitor = Visitor::Passerby;
+            event.dwell_us = between(800000, 3000000);
+        }
+        else if ((roll -= profile.stranger_percent) <= 0) {
+            event.visitor = Visitor::Stranger;
+            event.dwell_us = between(5000000, 20000000);
+            event.hints = (int)between(0, 2);
+        }
+        else if ((roll -= profile.spoof_percent) <= 0) {
+            event.visitor = Visitor::Spoofer;
+            event.dwell_us = between(5000000, 15000000);
+        }
+        else if (!profile.residents.empty()) {
+            event.visitor = Visitor::Resident;
+            event.user = profile.residents[between(0, (int64_t)profile.residents.size() - 1)];
+            event.dwell_us = between(2000000, 8000000);
+            event.hints = percent(rng) <= 30 ? 1 : 0; // looked aside at first
+        }
+        event.bounces = (int)between(0, 4);
+        trace.events.push_back(event);
+    }
+    std::sort(trace.events.begin(), trace.events.end(),
+              [](const DoorEvent& a, const DoorEvent& b) { return a.at_us < b.at_us; });
+    return trace;
+}
+
+bool save_trace(const std::string& path, const DoorTrace& trace)
+{
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "trace: cannot write " << path << std::endl;
+        return false;
+    }
+    file << TRACE_CSV_HEADER "\n";
+    for (const DoorEvent& event : trace.events)
+        file << format_trace_time(event.at_us) << ',' << visitor_name(event.visitor) << ',' << event.user << ','
+             << event.dwell_us / 1000 << ',' << event.bounces << ',' << event.hints << ',' << event.auth_us / 1000 << '\n';
+    return (bool)file;
+}
+
+bool load_trace(const std::string& path, DoorTrace& trace)
+{
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "trace: cannot read " << path << std::endl;
+        return false;
+    }
+    trace = DoorTrace();
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty() || line[0] == '#' || line == TRACE_CSV_HEADER)
+            continue;
+        std::vector<std::string> fields;
+        std::stringstream columns(line);
+        std::string field;
+        while (std::getline(columns, field, ','))
+            fields.push_back(field);
+        if (!line.empty() && line.back() == ',')
+            fields.push_back(std::string());
+        DoorEvent event;
+        long long dwell_ms = 0, auth_ms = 0;
+        bool valid = fields.size() == 7 && parse_trace_time(fields[0], event.at_us) && parse_visitor(fields[1], event.visitor)
+                  && sscanf(fields[3].c_str(), "%lld", &dwell_ms) == 1 && sscanf(fields[4].c_str(), "%d", &event.bounces) == 1
+                  && sscanf(fields[5].c_str(), "%d", &event.hints) == 1 && sscanf(fields[6].c_str(), "%lld", &auth_ms) == 1
+                  && dwell_ms >= 0 && auth_ms >= 0 && event.bounces >= 0 && event.hints >= 0
+                  && (event.visitor != Visitor::Resident || !fields[2].empty());
+        if (!valid) {
+            std::cerr << "trace: " << path << ":" << line_number << ": expected " TRACE_CSV_HEADER << std::endl;
+            return false;
+        }
+        event.user = fields[2];
+        event.dwell_us = dwell_ms * 1000;
+        event.auth_us = auth_ms * 1000;
+        trace.duration_us = std::max(trace.duration_us, event.at_us + event.dwell_us);
+        trace.events.push_back(event);
+    }
+    std::stable_sort(trace.events.begin(), trace.events.end(),
+                     [](const DoorEvent& a, const DoorEvent& b) { return a.at_us < b.at_us; });
+    return true;
+}
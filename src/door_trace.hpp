@@ -0,0 +1,79 @@
+/**
+ * @file door_trace.hpp
+ * @brief Door traffic as a list of visits: generated for a whole day or read from a CSV file
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * A visit is someone passing the presence sensor: a resident who is let in,
+ * a stranger or a spoofing attempt that is denied, or a passer-by whose face
+ * is never seen. Each visit produces a rising edge with a few bouncing
+ * edges, and a falling edge when the person leaves after dwell time.
+ *
+ * generate_day_trace() spreads visits over 24 hours like a family home:
+ * quiet at night, peaks when people leave in the morning and come back in
+ * the evening. Traces are saved and loaded as CSV, so a day recorded from
+ * the log of a real door can be replayed as well:
+ * @code
+ * time,visitor,user,dwell_ms,bounces,hints,auth_ms
+ * 07:12:04.250,resident,Anna,4200,3,1,0
+ * 07:40:31.000,passerby,,1500,2,0,0
+ * @endcode
+ * auth_ms 0 takes the latency of the AuthScript of the simulated authenticator.
+ *
+ * The header has no hardware dependencies.
+ */
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class Visitor : int {
+    Resident,  // enrolled, authentication grants access
+    Stranger,  // face seen but not enrolled
+    Spoofer,   // photo or screen held into the camera
+    Passerby   // triggers the sensor, no face in front of the camera
+};
+
+const char* visitor_name(Visitor visitor);
+
+/**
+ * @brief one visit, times relative to the start of the trace
+ */
+struct DoorEvent {
+    int64_t at_us = 0;          // rising edge of the presence sensor
+    Visitor visitor = Visitor::Passerby;
+    std::string user;           // name of the resident
+    int64_t dwell_us = 3000000; // falling edge this long after at_us
+    int bounces = 2;            // the contact opens and closes again this often within a few ms
+    int hints = 0;              // authentication hints before the result
+    int64_t auth_us = 0;        // scripted authentication latency, 0 = default of the script
+};
+
+struct DoorTrace {
+    std::vector<DoorEvent> events; // ordered by at_us
+    int64_t duration_us = 0;       // end of the traced period
+};
+
+/**
+ * @brief parameters of generate_day_trace()
+ */
+struct TraceProfile {
+    int visits = 160;                // per day
+    std::vector<std::string> residents = { "Anna", "Ben", "Clara", "David" };
+    int stranger_percent = 12;       // of all visits
+    int spoof_percent = 2;
+    int passerby_percent = 25;       // the rest are residents
+    int64_t duration_us = 24LL * 3600 * 1000000;
+    unsigned int seed = 4711;
+};
+
+/** visits of a day, same trace for the same profile */
+DoorTrace generate_day_trace(const TraceProfile& profile);
+
+/**
+ * @brief reads a trace written by save_trace() or by hand
+ * @return false if the file cannot be read or a line is malformed, reported on std::cerr
+ */
+bool load_trace(const std::string& path, DoorTrace& trace);
+bool save_trace(const std::string& path, const DoorTrace& trace);
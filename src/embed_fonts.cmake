@@ -0,0 +1,44 @@
+##
+# @file embed_fonts.cmake
+#
+# @brief Embeds BDF fonts as string literals into a generated source file
+# @details
+# Runs in script mode after rpi-rgb-led-matrix was fetched, as its fonts are
+# not available at configure time:
+# cmake -DFONT_DIR=<dir> -DFONTS=6x12,4x6 -DOUTPUT=<file> -P embed_fonts.cmake
+# The font list is comma separated, as a ';' would split the custom command.
+# The generated file defines embedded_font() declared in glyph_atlas.hpp.
+#
+# @author Joerg Wallmersperger
+#
+##
+string(REPLACE "," ";" FONTS "${FONTS}")
+set(SOURCE "// generated by embed_fonts.cmake from ${FONT_DIR} - do not edit\n")
+string(APPEND SOURCE "#include \"glyph_atlas.hpp\"\n#include <cstring>\n\n")
+set(TABLE "")
+foreach(FONT ${FONTS})
+    file(READ "${FONT_DIR}/${FONT}.bdf" BDF)
+    string(MAKE_C_IDENTIFIER "font_${FONT}_bdf" SYMBOL)
+    # raw string literal keeps the BDF text as is
+    string(APPEND SOURCE "static const char ${SYMBOL}[] = R\"BDF(${BDF})BDF\";\n")
+    string(APPEND TABLE "        { \"${FONT}\", ${SYMBOL} },\n")
+endforeach()
+string(APPEND SOURCE "
+const char* embedded_font(const char* name)
+{
+    static const struct { const char* name; const char* bdf; } fonts[] = {
+${TABLE}    };
+    for (const auto& font : fonts) {
+        if (std::strcmp(font.name, name) == 0)
+            return font.bdf;
+    }
+    return nullptr;
+}
+")
+# rewrite only on change, so the executable is not relinked on every build
+if(EXISTS "${OUTPUT}")
+    file(READ "${OUTPUT}" PREVIOUS)
+endif()
+if(NOT "${PREVIOUS}" STREQUAL "${SOURCE}")
+    file(WRITE "${OUTPUT}" "${SOURCE}")
+endif()
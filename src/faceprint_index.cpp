@@ -0,0 +1,197 @@
+/**
+ * @file faceprint_index.cpp
+ * @brief In-memory faceprint index for host-side matching
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ */
+#include "faceprint_index.hpp"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+int32_t faceprint_dot(const int16_t* a, const int16_t* b, size_t n)
+{
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    int32x4_t acc0 = vdupq_n_s32(0), acc1 = vdupq_n_s32(0);
+    for (size_t i = 0; i < n; i += 8) {
+        int16x8_t va = vld1q_s16(a + i);
+        int16x8_t vb = vld1q_s16(b + i);
+        acc0 = vmlal_s16(acc0, vget_low_s16(va), vget_low_s16(vb));
+        acc1 = vmlal_s16(acc1, vget_high_s16(va), vget_high_s16(vb));
+    }
+    int32x4_t acc = vaddq_s32(acc0, acc1);
+    return vgetq_lane_s32(acc, 0) + vgetq_lane_s32(acc, 1) + vgetq_lane_s32(acc, 2) + vgetq_lane_s32(acc, 3);
+#elif defined(__SSE2__)
+    __m128i acc0 = _mm_setzero_si128(), acc1 = _mm_setzero_si128();
+    for (size_t i = 0; i < n; i += 16) { // rows are 64-byte aligned, stride is a multiple of 32
+        acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_load_si128((const __m128i*)(a + i)), _mm_load_si128((const __m128i*)(b + i))));
+        acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_load_si128((const __m128i*)(a + i + 8)), _mm_load_si128((const __m128i*)(b + i + 8))));
+    }
+    __m128i acc = _mm_add_epi32(acc0, acc1);
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(acc);
+#else
+    int32_t sum = 0;
+    for (size_t i = 0; i < n; i++)
+        sum += (int32_t)a[i] * b[i];
+    return sum;
+#endif
+}
+
+void FaceprintIndex::AlignedFree::operator()(int16_t* p) const
+{
+    std::free(p);
+}
+
+FaceprintIndex::FaceprintIndex(size_t dims)
+    : n_dims(dims), n_stride((dims + LANES - 1) / LANES * LANES)
+{
+}
+
+FaceprintIndex::FaceprintIndex(const FaceprintIndex& other)
+    : n_dims(other.n_dims), n_stride(other.n_stride)
+{
+    grow(other.size());
+    user_ids = other.user_ids;
+    if (other.size())
+        std::memcpy(rows.get(), other.rows.get(), other.size() * n_stride * sizeof(int16_t));
+}
+
+/**
+ * @brief reallocates the row array, rows stay contiguous and 64-byte aligned
+ */
+void FaceprintIndex::grow(size_t rows_needed)
+{
+    if (rows_needed <= capacity)
+        return;
+    size_t new_capacity = std::max<size_t>({rows_needed, capacity * 2, 64});
+    size_t bytes = new_capacity * n_stride * sizeof(int16_t); // multiple of 64, as required by aligned_alloc
+    int16_t* p = static_cast<int16_t*>(std::aligned_alloc(64, bytes));
+    if (!p)
+        throw std::bad_alloc();
+    if (size())
+        std::memcpy(p, rows.get(), size() * n_stride * sizeof(int16_t));
+    rows.reset(p);
+    capacity = new_capacity;
+}
+
+void FaceprintIndex::reserve(size_t rows_needed)
+{
+    grow(rows_needed);
+    user_ids.reserve(rows_needed);
+}
+
+bool faceprint_normalize(const int16_t* features, size_t dims, size_t stride, int16_t* row)
+{
+    double norm = 0.0;
+    for (size_t i = 0; i < dims; i++)
+        norm += (double)features[i] * features[i];
+    if (norm <= 0.0)
+        return false;
+    // scale slightly below FACEPRINT_UNIT, so rounding can't push the norm above it
+    const double scale = (FACEPRINT_UNIT - 1) / std::sqrt(norm);
+    for (size_t i = 0; i < dims; i++)
+        row[i] = (int16_t)std::lround(features[i] * scale);
+    std::fill(row + dims, row + stride, (int16_t)0);
+    return true;
+}
+
+void faceprint_scan(const int16_t* rows, size_t stride, size_t begin, size_t end, const int16_t* probe,
+                    const std::function<bool(size_t)>* excluded, long& best_row, int32_t& best_dot)
+{
+    best_row = -1;
+    best_dot = INT32_MIN;
+    const int16_t* r = rows + begin * stride;
+    for (size_t i = begin; i < end; i++, r += stride) {
+        int32_t dot = faceprint_dot(probe, r, stride);
+        if (dot > best_dot && !(excluded && (*excluded)(i))) {
+            best_dot = dot;
+            best_row = (long)i;
+        }
+    }
+}
+
+bool FaceprintIndex::normalize(const int16_t* features, int16_t* row) const
+{
+    return faceprint_normalize(features, n_dims, n_stride, row);
+}
+
+bool FaceprintIndex::add(const std::string& user_id, const int16_t* features)
+{
+    grow(size() + 1);
+    if (!normalize(features, rows.get() + size() * n_stride))
+        return false;
+    user_ids.push_back(user_id);
+    return true;
+}
+
+size_t FaceprintIndex::remove(const std::string& user_id)
+{
+    size_t kept = 0;
+    for (size_t r = 0; r < size(); r++) { // compact in place, keeps the order of remaining rows
+        if (user_ids[r] == user_id)
+            continue;
+        if (kept != r) {
+            std::memcpy(rows.get() + kept * n_stride, rows.get() + r * n_stride, n_stride * sizeof(int16_t));
+            user_ids[kept] = std::move(user_ids[r]);
+        }
+        kept++;
+    }
+    size_t removed = size() - kept;
+    user_ids.resize(kept);
+    return removed;
+}
+
+FaceprintMatch FaceprintIndex::best_match(const int16_t* features, unsigned int threads) const
+{
+    FaceprintMatch match;
+    if (size() == 0)
+        return match;
+    alignas(64) int16_t probe_buffer[1024];
+    std::vector<int16_t> probe_heap;
+    int16_t* probe = probe_buffer;
+    if (n_stride > 1024) { // not for RealSenseID faceprints, kept for completeness
+        probe_heap.resize(n_stride + 32);
+        probe = reinterpret_cast<int16_t*>(((uintptr_t)probe_heap.data() + 63) & ~(uintptr_t)63);
+    }
+    if (!normalize(features, probe))
+        return match;
+
+    size_t workers = std::min<size_t>(std::max(threads, 1u), std::max<size_t>(size() / MIN_ROWS_PER_THREAD, 1));
+    long best_row = -1;
+    int32_t best_dot = INT32_MIN;
+    if (workers == 1) {
+        faceprint_scan(rows.get(), n_stride, 0, size(), probe, nullptr, best_row, best_dot);
+    }
+    else {
+        std::vector<long> rows_best(workers);
+        std::vector<int32_t> dots_best(workers);
+        std::vector<std::thread> pool;
+        size_t chunk = (size() + workers - 1) / workers;
+        for (size_t w = 1; w < workers; w++)
+            pool.emplace_back(faceprint_scan, rows.get(), n_stride, w * chunk, std::min(size(), (w + 1) * chunk), probe,
+                              nullptr, std::ref(rows_best[w]), std::ref(dots_best[w]));
+        faceprint_scan(rows.get(), n_stride, 0, std::min(size(), chunk), probe, nullptr, rows_best[0], dots_best[0]); // calling thread takes the first range
+        for (auto& t : pool)
+            t.join();
+        for (size_t w = 0; w < workers; w++) {
+            if (rows_best[w] >= 0 && dots_best[w] > best_dot) {
+                best_dot = dots_best[w];
+                best_row = rows_best[w];
+            }
+        }
+    }
+    match.index = best_row;
+    match.score = (float)best_dot / ((float)FACEPRINT_UNIT * FACEPRINT_UNIT);
+    match.user_id = user_ids[best_row];
+    return match;
+}
@@ -0,0 +1,132 @@
+/**
+ * @file faceprint_index.hpp
+ * @brief In-memory faceprint index for host-side matching
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * The F455 extracts a faceprint (feature vector) of the person in front of
+ * the camera; matching against the enrolled users then runs on the Pi instead
+ * of the device database, which lifts the device's user limit.
+ *
+ * Faceprints are L2-normalized to FACEPRINT_UNIT and stored as int16 rows in
+ * one contiguous, 64-byte aligned array. By Cauchy-Schwarz no partial dot
+ * product can exceed FACEPRINT_UNIT^2 = 2^28, so the similarity kernel
+ * accumulates in int32 without overflow checks:
+ * - NEON (vmlal_s16) on the Pi, SSE2 (_mm_madd_epi16) on x86, scalar otherwise
+ * - large indexes are scanned by several threads, each on its own row range
+ *
+ * The header has no hardware dependencies. FaceprintIndex is the in-memory
+ * form; the door matches against the memory-mapped FaceprintStore
+ * (faceprint_store.hpp), which shares faceprint_normalize() and
+ * faceprint_scan() with it.
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define FACEPRINT_UNIT 16384 // L2 norm of stored faceprints, 2^14
+
+/**
+ * @brief best match of a probe faceprint
+ */
+struct FaceprintMatch {
+    long index = -1;      // row of the best match, -1 if index is empty
+    float score = -1.0f;  // cosine similarity -1..1
+    std::string user_id;
+};
+
+/**
+ * @brief dot product of two int16 vectors, n must be a multiple of FaceprintIndex::LANES
+ */
+int32_t faceprint_dot(const int16_t* a, const int16_t* b, size_t n);
+
+/**
+ * @brief scales features to L2 norm FACEPRINT_UNIT into row and zero pads it to stride
+ * @return false if the features are all zero
+ */
+bool faceprint_normalize(const int16_t* features, size_t dims, size_t stride, int16_t* row);
+
+/**
+ * @brief scans rows [begin, end) of a row array for the highest dot product with probe
+ *
+ * Used for rows owned by FaceprintIndex and for memory-mapped rows of FaceprintStore.
+ * @param rows 64-byte aligned rows of stride int16 values
+ * @param excluded optional; asked only for a row about to become the best one, true skips it
+ * @param best_row receives the best row, -1 if none
+ * @param best_dot receives its dot product
+ */
+void faceprint_scan(const int16_t* rows, size_t stride, size_t begin, size_t end, const int16_t* probe,
+                    const std::function<bool(size_t)>* excluded, long& best_row, int32_t& best_dot);
+
+/**
+ * @class FaceprintIndex
+ * @brief Contiguous, cache-aligned faceprint array with SIMD similarity scan
+ *
+ * Example usage:
+ * @code
+ * auto index = std::make_shared<FaceprintIndex>(RSID_NUM_OF_RECOGNITION_FEATURES);
+ * index->add("joerg", features);
+ * FaceprintMatch match = index->best_match(probe, 4);
+ * if (match.score >= threshold) open_door(match.user_id);
+ * @endcode
+ */
+class FaceprintIndex {
+public:
+    static constexpr size_t LANES = 32;          // row stride is padded to 32 features (64 bytes)
+    static constexpr size_t MIN_ROWS_PER_THREAD = 2048; // smaller scans stay on the calling thread
+
+    explicit FaceprintIndex(size_t dims);
+    FaceprintIndex(const FaceprintIndex& other);
+    FaceprintIndex& operator=(const FaceprintIndex&) = delete;
+
+    void reserve(size_t rows);
+
+    /**
+     * @brief normalizes and appends a faceprint
+     * @return false if the features are all zero
+     */
+    bool add(const std::string& user_id, const int16_t* features);
+
+    /**
+     * @brief removes all faceprints of a user
+     * @return number of removed rows
+     */
+    size_t remove(const std::string& user_id);
+
+    /**
+     * @brief normalizes features into a row of stride() int16 values (zero padded)
+     * @return false if the features are all zero
+     */
+    bool normalize(const int16_t* features, int16_t* row) const;
+
+    /**
+     * @brief scans all rows for the highest cosine similarity
+     *
+     * @param probe faceprint with dims() features as delivered by the device
+     * @param threads number of scanning threads, 1 scans on the calling thread
+     */
+    FaceprintMatch best_match(const int16_t* probe, unsigned int threads = 1) const;
+
+    size_t size() const { return user_ids.size(); }
+    size_t dims() const { return n_dims; }
+    size_t stride() const { return n_stride; }
+    size_t memory_bytes() const { return capacity * n_stride * sizeof(int16_t); }
+    const std::string& user_id(size_t row) const { return user_ids[row]; }
+    const int16_t* row(size_t row) const { return rows.get() + row * n_stride; }
+
+private:
+    struct AlignedFree { void operator()(int16_t* p) const; };
+
+    size_t n_dims;
+    size_t n_stride;
+    size_t capacity = 0;
+    std::unique_ptr<int16_t[], AlignedFree> rows;
+    std::vector<std::string> user_ids;
+
+    void grow(size_t rows_needed);
+};
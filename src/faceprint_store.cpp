@@ -0,0 +1,613 @@
+/**
+ * @file faceprint_store.cpp
+ * @brief Memory-mapped faceprint database with append-only segments and atomic manifest swaps
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ */
+#include "faceprint_store.hpp"
+#include "thread_placement.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SEGMENT_MAGIC "SDFPSEG1"
+#define SEGMENT_VERSION 1
+#define MANIFEST_NAME "MANIFEST"
+#define MANIFEST_HEADER "smartdoorF455-faceprints 1"
+
+/**
+ * @brief on-disk header of a segment file, followed by rows, ids, blobs and tombstones
+ */
+struct SegmentHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t dims;
+    uint32_t stride;
+    uint32_t id_bytes;
+    uint32_t blob_bytes;
+    uint32_t reserved0;
+    uint64_t generation;
+    uint64_t rows;
+    uint64_t tombstones;
+    uint64_t rows_offset;
+    uint64_t ids_offset;
+    uint64_t blobs_offset;
+    uint64_t tombstones_offset;
+    uint64_t file_bytes;
+    uint64_t checksum;     // FNV-1a of all header bytes before this field
+    uint8_t reserved[24];  // pads the header to 128 bytes, rows start 64-byte aligned
+};
+static_assert(sizeof(SegmentHeader) == 128, "segment header must be 128 bytes");
+
+static uint64_t fnv1a(const void* data, size_t bytes)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < bytes; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static size_t align64(size_t offset)
+{
+    return (offset + 63) & ~(size_t)63;
+}
+
+/**
+ * @brief writes all bytes, retrying on short writes
+ */
+static bool write_all(int fd, const void* data, size_t bytes)
+{
+    const char* p = static_cast<const char*>(data);
+    while (bytes > 0) {
+        ssize_t n = ::write(fd, p, bytes);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += n;
+        bytes -= (size_t)n;
+    }
+    return true;
+}
+
+/**
+ * @brief makes a rename in dir durable
+ */
+static void fsync_directory(const std::string& dir)
+{
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+/**
+ * @brief writes content to path.tmp, syncs it and renames it over path
+ */
+static bool write_file_atomically(const std::string& dir, const std::string& name, const std::string& content)
+{
+    std::string path = dir + "/" + name;
+    std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return false;
+    bool ok = write_all(fd, content.data(), content.size()) && ::fsync(fd) == 0;
+    ok = (::close(fd) == 0) && ok;
+    if (!ok || ::rename(tmp.c_str(), path.c_str()) != 0) {
+        ::unlink(tmp.c_str());
+        return false;
+    }
+    fsync_directory(dir);
+    return true;
+}
+
+FaceprintSegment::~FaceprintSegment()
+{
+    if (mapping)
+        ::munmap(mapping, mapping_bytes);
+}
+
+std::shared_ptr<const FaceprintSegment> FaceprintSegment::map(const std::string& path, size_t dims)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return nullptr;
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SegmentHeader)) {
+        ::close(fd);
+        return nullptr;
+    }
+    void* mapping = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); // the mapping keeps the file alive
+    if (mapping == MAP_FAILED)
+        return nullptr;
+    std::shared_ptr<FaceprintSegment> segment(new FaceprintSegment());
+    segment->mapping = mapping;
+    segment->mapping_bytes = (size_t)st.st_size;
+
+    const SegmentHeader* h = static_cast<const SegmentHeader*>(mapping);
+    size_t stride = (dims + FaceprintIndex::LANES - 1) / FaceprintIndex::LANES * FaceprintIndex::LANES;
+    if (std::memcmp(h->magic, SEGMENT_MAGIC, 8) != 0 || h->version != SEGMENT_VERSION ||
+        h->checksum != fnv1a(h, offsetof(SegmentHeader, checksum)) || h->dims != dims || h->stride != stride ||
+        h->id_bytes != FACEPRINT_ID_BYTES || h->file_bytes != (uint64_t)st.st_size ||
+        h->rows_offset % 64 != 0 ||
+        h->rows_offset + h->rows * stride * sizeof(int16_t) > h->file_bytes ||
+        h->ids_offset + h->rows * FACEPRINT_ID_BYTES > h->file_bytes ||
+        h->blobs_offset + h->rows * h->blob_bytes > h->file_bytes ||
+        h->tombstones_offset + h->tombstones * FACEPRINT_ID_BYTES > h->file_bytes) {
+        std::cerr << "faceprint store: invalid segment " << path << std::endl;
+        return nullptr;
+    }
+    const char* base = static_cast<const char*>(mapping);
+    segment->name = std::filesystem::path(path).filename().string();
+    segment->gen = h->generation;
+    segment->n_rows = h->rows;
+    segment->n_stride = stride;
+    segment->n_tombstones = h->tombstones;
+    segment->n_blob_bytes = h->blob_bytes;
+    segment->row_data = reinterpret_cast<const int16_t*>(base + h->rows_offset);
+    segment->id_data = base + h->ids_offset;
+    segment->blob_data = reinterpret_cast<const uint8_t*>(base + h->blobs_offset);
+    segment->tombstone_data = base + h->tombstones_offset;
+    ::madvise(const_cast<char*>(base) + h->rows_offset, h->rows * stride * sizeof(int16_t), MADV_WILLNEED);
+    return segment;
+}
+
+/**
+ * @brief builds, per segment, the set of user ids deleted by later segments
+ *
+ * Costs O(segments + tombstones), independent of the number of stored rows.
+ */
+void FaceprintDb::index_tombstones()
+{
+    deleted_later.assign(segment_list.size(), nullptr);
+    auto later = std::make_shared<std::unordered_set<std::string>>();
+    for (size_t s = segment_list.size(); s-- > 0;) {
+        deleted_later[s] = later;
+        const FaceprintSegment& segment = *segment_list[s];
+        if (segment.tombstone_count() == 0)
+            continue;
+        auto merged = std::make_shared<std::unordered_set<std::string>>(*later);
+        for (size_t t = 0; t < segment.tombstone_count(); t++)
+            merged->insert(std::string(segment.tombstone(t), strnlen(segment.tombstone(t), FACEPRINT_ID_BYTES)));
+        later = merged;
+    }
+}
+
+bool FaceprintDb::is_deleted(size_t segment, size_t row) const
+{
+    const auto& deleted = deleted_later[segment];
+    if (deleted->empty())
+        return false;
+    const char* id = segment_list[segment]->user_id(row);
+    return deleted->count(std::string(id, strnlen(id, FACEPRINT_ID_BYTES))) > 0;
+}
+
+size_t FaceprintDb::rows() const
+{
+    size_t rows = 0;
+    for (const auto& segment : segment_list)
+        rows += segment->size();
+    return rows;
+}
+
+std::vector<std::string> FaceprintDb::user_ids() const
+{
+    std::set<std::string> ids;
+    for (size_t s = 0; s < segment_list.size(); s++) {
+        for (size_t r = 0; r < segment_list[s]->size(); r++) {
+            if (!is_deleted(s, r)) {
+                const char* id = segment_list[s]->user_id(r);
+                ids.emplace(id, strnlen(id, FACEPRINT_ID_BYTES));
+            }
+        }
+    }
+    return std::vector<std::string>(ids.begin(), ids.end());
+}
+
+FaceprintMatch FaceprintDb::best_match(const int16_t* features, unsigned int threads) const
+{
+    FaceprintMatch match;
+    size_t total = rows();
+    if (total == 0 || segment_list.empty())
+        return match;
+    const size_t stride = segment_list.front()->stride();
+    alignas(64) int16_t probe[1024];
+    if (stride > 1024 || !faceprint_normalize(features, n_dims, stride, probe))
+        return match;
+
+    struct Best {
+        long segment = -1;
+        long row = -1;
+        int32_t dot = INT32_MIN;
+    };
+    // worker w scans the w-th slice of every segment, so all workers get the same share
+    auto scan_slice = [&](size_t w, size_t workers, Best& best) {
+        for (size_t s = 0; s < segment_list.size(); s++) {
+            const FaceprintSegment& segment = *segment_list[s];
+            size_t begin = segment.size() * w / workers, end = segment.size() * (w + 1) / workers;
+            std::function<bool(size_t)> deleted = [&](size_t row) { return is_deleted(s, row); };
+            long row;
+            int32_t dot;
+            faceprint_scan(segment.rows(), stride, begin, end, probe,
+                           deleted_later[s]->empty() ? nullptr : &deleted, row, dot);
+            if (row >= 0 && dot > best.dot)
+                best = { (long)s, row, dot };
+        }
+    };
+    size_t workers = std::min<size_t>(std::max(threads, 1u), std::max<size_t>(total / FaceprintIndex::MIN_ROWS_PER_THREAD, 1));
+    std::vector<Best> best(workers);
+    std::vector<std::thread> pool;
+    for (size_t w = 1; w < workers; w++)
+        pool.emplace_back(scan_slice, w, workers, std::ref(best[w]));
+    scan_slice(0, workers, best[0]); // calling thread takes the first slice
+    for (auto& t : pool)
+        t.join();
+    Best overall;
+    for (const Best& b : best) {
+        if (b.row >= 0 && b.dot > overall.dot)
+            overall = b;
+    }
+    if (overall.row < 0)
+        return match;
+    const char* id = segment_list[overall.segment]->user_id(overall.row);
+    match.index = overall.row;
+    match.score = (float)overall.dot / ((float)FACEPRINT_UNIT * FACEPRINT_UNIT);
+    match.user_id.assign(id, strnlen(id, FACEPRINT_ID_BYTES));
+    return match;
+}
+
+FaceprintStore::FaceprintStore(const std::string& directory, size_t dims)
+    : dir(directory), n_dims(dims),
+      n_stride((dims + FaceprintIndex::LANES - 1) / FaceprintIndex::LANES * FaceprintIndex::LANES)
+{
+    auto empty = std::make_shared<FaceprintDb>();
+    empty->n_dims = dims;
+    current = empty;
+}
+
+FaceprintStore::~FaceprintStore()
+{
+    stop_compaction();
+}
+
+bool FaceprintStore::open()
+{
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec) {
+        std::cerr << "faceprint store: cannot create " << dir << ": " << ec.message() << std::endl;
+        return false;
+    }
+    std::ifstream manifest(dir + "/" MANIFEST_NAME);
+    if (!manifest) { // new database
+        std::vector<std::shared_ptr<const FaceprintSegment>> none;
+        if (!write_manifest(none))
+            return false;
+        publish(none);
+        remove_unlisted_segments(none);
+        return true;
+    }
+    std::string line;
+    std::getline(manifest, line);
+    if (line != MANIFEST_HEADER) {
+        std::cerr << "faceprint store: unknown manifest format in " << dir << std::endl;
+        return false;
+    }
+    std::vector<std::shared_ptr<const FaceprintSegment>> segments;
+    while (std::getline(manifest, line)) {
+        std::istringstream fields(line);
+        std::string key, value;
+        fields >> key >> value;
+        if (key == "dims" && std::stoul(value) != n_dims) {
+            std::cerr << "faceprint store: " << dir << " holds faceprints of " << value << " features" << std::endl;
+            return false;
+        }
+        if (key == "next_generation")
+            next_generation = std::max<uint64_t>(next_generation, std::stoull(value));
+        if (key == "segment") {
+            auto segment = FaceprintSegment::map(dir + "/" + value, n_dims);
+            if (!segment) {
+                std::cerr << "faceprint store: cannot map segment " << value << std::endl;
+                return false;
+            }
+            next_generation = std::max<uint64_t>(next_generation, segment->generation() + 1);
+            segments.push_back(segment);
+        }
+    }
+    publish(segments);
+    remove_unlisted_segments(segments); // leftovers of a crash between segment write and manifest swap
+    return true;
+}
+
+/**
+ * @brief writes a new segment file from records, deletions and optionally the live rows of a snapshot
+ *
+ * @return file name of the durable segment, empty on error
+ */
+std::string FaceprintStore::write_segment(const std::vector<FaceprintRecord>& added, const std::vector<std::string>& deleted,
+                                          const FaceprintDb* merge_from)
+{
+    struct Source {
+        const int16_t* row;
+        const char* id;
+        const uint8_t* blob;
+        size_t blob_bytes;
+    };
+    std::vector<Source> merged;
+    size_t blob_bytes = 0;
+    if (merge_from) {
+        for (size_t s = 0; s < merge_from->segments().size(); s++) {
+            const FaceprintSegment& segment = *merge_from->segments()[s];
+            blob_bytes = std::max(blob_bytes, segment.blob_bytes());
+            for (size_t r = 0; r < segment.size(); r++) {
+                if (!merge_from->is_deleted(s, r))
+                    merged.push_back({ segment.rows() + r * n_stride, segment.user_id(r), segment.blob(r), segment.blob_bytes() });
+            }
+        }
+    }
+    for (const auto& record : added)
+        blob_bytes = std::max(blob_bytes, record.device_blob.size());
+    const size_t rows = merged.size() + added.size();
+
+    SegmentHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, SEGMENT_MAGIC, 8);
+    h.version = SEGMENT_VERSION;
+    h.dims = (uint32_t)n_dims;
+    h.stride = (uint32_t)n_stride;
+    h.id_bytes = FACEPRINT_ID_BYTES;
+    h.blob_bytes = (uint32_t)blob_bytes;
+    h.generation = next_generation.fetch_add(1);
+    h.rows = rows;
+    h.tombstones = deleted.size();
+    h.rows_offset = sizeof(SegmentHeader);
+    h.ids_offset = h.rows_offset + rows * n_stride * sizeof(int16_t);
+    h.blobs_offset = align64(h.ids_offset + rows * FACEPRINT_ID_BYTES);
+    h.tombstones_offset = align64(h.blobs_offset + rows * blob_bytes);
+    h.file_bytes = h.tombstones_offset + deleted.size() * FACEPRINT_ID_BYTES;
+    h.checksum = fnv1a(&h, offsetof(SegmentHeader, checksum));
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "seg-%016llx.fpd", (unsigned long long)h.generation);
+    std::string path = dir + "/" + name;
+    std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return std::string();
+    // sections are written through one reusable buffer, so memory stays bounded for large merges
+    std::vector<char> buffer;
+    auto flush = [&](bool force) {
+        if (buffer.empty() || (!force && buffer.size() < (1u << 20)))
+            return true;
+        bool ok = write_all(fd, buffer.data(), buffer.size());
+        buffer.clear();
+        return ok;
+    };
+    auto pad_to = [&](uint64_t offset, uint64_t written) {
+        buffer.insert(buffer.end(), (size_t)(offset - written), 0);
+    };
+    bool ok = write_all(fd, &h, sizeof(h));
+    alignas(64) int16_t row[1024];
+    for (size_t i = 0; ok && i < rows; i++) {
+        if (i < merged.size())
+            std::memcpy(row, merged[i].row, n_stride * sizeof(int16_t)); // already normalized
+        else if (!faceprint_normalize(added[i - merged.size()].features.data(), n_dims, n_stride, row))
+            std::memset(row, 0, n_stride * sizeof(int16_t)); // all-zero faceprint never matches
+        const char* p = reinterpret_cast<const char*>(row);
+        buffer.insert(buffer.end(), p, p + n_stride * sizeof(int16_t));
+        ok = flush(false);
+    }
+    for (size_t i = 0; ok && i < rows; i++) {
+        char id[FACEPRINT_ID_BYTES] = {};
+        if (i < merged.size())
+            std::memcpy(id, merged[i].id, FACEPRINT_ID_BYTES - 1);
+        else
+            added[i - merged.size()].user_id.copy(id, FACEPRINT_ID_BYTES - 1);
+        buffer.insert(buffer.end(), id, id + FACEPRINT_ID_BYTES);
+        ok = flush(false);
+    }
+    pad_to(h.blobs_offset, h.ids_offset + rows * FACEPRINT_ID_BYTES);
+    for (size_t i = 0; ok && blob_bytes && i < rows; i++) {
+        size_t start = buffer.size();
+        buffer.resize(start + blob_bytes, 0);
+        if (i < merged.size() && merged[i].blob)
+            std::memcpy(buffer.data() + start, merged[i].blob, merged[i].blob_bytes);
+        else if (i >= merged.size() && !added[i - merged.size()].device_blob.empty())
+            std::memcpy(buffer.data() + start, added[i - merged.size()].device_blob.data(), added[i - merged.size()].device_blob.size());
+        ok = flush(false);
+    }
+    pad_to(h.tombstones_offset, h.blobs_offset + rows * blob_bytes);
+    for (const auto& id : deleted) {
+        char entry[FACEPRINT_ID_BYTES] = {};
+        id.copy(entry, FACEPRINT_ID_BYTES - 1);
+        buffer.insert(buffer.end(), entry, entry + FACEPRINT_ID_BYTES);
+    }
+    ok = ok && flush(true) && ::fsync(fd) == 0;
+    ok = (::close(fd) == 0) && ok;
+    if (!ok || ::rename(tmp.c_str(), path.c_str()) != 0) {
+        ::unlink(tmp.c_str());
+        std::cerr << "faceprint store: cannot write segment " << path << std::endl;
+        return std::string();
+    }
+    fsync_directory(dir);
+    return name;
+}
+
+bool FaceprintStore::write_manifest(const std::vector<std::shared_ptr<const FaceprintSegment>>& segments)
+{
+    std::ostringstream manifest;
+    manifest << MANIFEST_HEADER << "\n";
+    manifest << "dims " << n_dims << "\n";
+    manifest << "next_generation " << next_generation.load() << "\n";
+    for (const auto& segment : segments)
+        manifest << "segment " << segment->file_name() << "\n";
+    return write_file_atomically(dir, MANIFEST_NAME, manifest.str());
+}
+
+/**
+ * @brief makes a new segment list visible to the matching path
+ */
+void FaceprintStore::publish(std::vector<std::shared_ptr<const FaceprintSegment>> segments)
+{
+    auto db = std::make_shared<FaceprintDb>();
+    db->n_dims = n_dims;
+    db->segment_list = std::move(segments);
+    db->index_tombstones();
+    std::atomic_store(&current, std::shared_ptr<const FaceprintDb>(db));
+}
+
+void FaceprintStore::remove_unlisted_segments(const std::vector<std::shared_ptr<const FaceprintSegment>>& segments)
+{
+    std::unordered_set<std::string> listed;
+    for (const auto& segment : segments)
+        listed.insert(segment->file_name());
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        std::string name = entry.path().filename().string();
+        bool segment_file = name.compare(0, 4, "seg-") == 0;
+        bool tmp_file = name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0;
+        if ((segment_file && !listed.count(name)) || tmp_file)
+            std::filesystem::remove(entry.path(), ec); // still mapped segments stay readable until unmapped
+    }
+}
+
+bool FaceprintStore::append(const std::vector<FaceprintRecord>& added, const std::vector<std::string>& deleted)
+{
+    if (added.empty() && deleted.empty())
+        return true;
+    size_t segment_count;
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        std::string name = write_segment(added, deleted, nullptr);
+        if (name.empty())
+            return false;
+        auto segment = FaceprintSegment::map(dir + "/" + name, n_dims);
+        if (!segment)
+            return false;
+        auto segments = snapshot()->segments();
+        segments.push_back(segment);
+        if (!write_manifest(segments)) {
+            ::unlink((dir + "/" + name).c_str());
+            return false;
+        }
+        segment_count = segments.size();
+        publish(std::move(segments));
+    }
+    if (segment_count > compaction_threshold)
+        compaction_wakeup.notify_one();
+    return true;
+}
+
+bool FaceprintStore::replace(const std::vector<FaceprintRecord>& records)
+{
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    std::string name = write_segment(records, {}, nullptr);
+    if (name.empty())
+        return false;
+    auto segment = FaceprintSegment::map(dir + "/" + name, n_dims);
+    if (!segment)
+        return false;
+    std::vector<std::shared_ptr<const FaceprintSegment>> segments{segment};
+    if (!write_manifest(segments))
+        return false;
+    publish(segments);
+    remove_unlisted_segments(segments);
+    return true;
+}
+
+bool FaceprintStore::compact()
+{
+    std::shared_ptr<const FaceprintDb> base = snapshot();
+    if (base->segments().size() <= 1 && (base->segments().empty() || base->segments()[0]->tombstone_count() == 0))
+        return true;
+    // the merge runs without the writer lock, enrollment continues meanwhile
+    std::string name = write_segment({}, {}, base.get());
+    if (name.empty())
+        return false;
+    auto merged = FaceprintSegment::map(dir + "/" + name, n_dims);
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    auto latest = snapshot()->segments();
+    bool base_is_prefix = merged && latest.size() >= base->segments().size() &&
+        std::equal(base->segments().begin(), base->segments().end(), latest.begin());
+    if (!base_is_prefix) { // replaced meanwhile, merge is stale
+        ::unlink((dir + "/" + name).c_str());
+        return false;
+    }
+    // segments appended during the merge stay behind the merged one, their tombstones still apply
+    std::vector<std::shared_ptr<const FaceprintSegment>> segments{merged};
+    segments.insert(segments.end(), latest.begin() + base->segments().size(), latest.end());
+    if (!write_manifest(segments)) {
+        ::unlink((dir + "/" + name).c_str());
+        return false;
+    }
+    publish(segments);
+    remove_unlisted_segments(segments);
+    compactions.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void FaceprintStore::start_compaction(size_t max_segments)
+{
+    std::lock_guard<std::mutex> lock(compaction_mutex);
+    if (compaction_running)
+        return;
+    compaction_threshold = std::max<size_t>(max_segments, 1);
+    compaction_running = true;
+    compaction_thread = std::thread(&FaceprintStore::compaction_loop, this);
+}
+
+void FaceprintStore::stop_compaction()
+{
+    {
+        std::lock_guard<std::mutex> lock(compaction_mutex);
+        if (!compaction_running)
+            return;
+        compaction_running = false;
+    }
+    compaction_wakeup.notify_all();
+    if (compaction_thread.joinable())
+        compaction_thread.join();
+}
+
+/**
+ * @brief background compaction, woken by append() or once a minute
+ */
+void FaceprintStore::compaction_loop()
+{
+    place_this_thread("fp_compaction");
+    std::unique_lock<std::mutex> lock(compaction_mutex);
+    while (compaction_running) {
+        // appends during a compaction are picked up by the predicate, no wakeup gets lost
+        bool due = compaction_wakeup.wait_for(lock, std::chrono::seconds(60), [this] {
+            return !compaction_running || snapshot()->segments().size() > compaction_threshold;
+        });
+        if (!compaction_running)
+            break;
+        if (!due)
+            continue;
+        lock.unlock();
+        bool ok = compact();
+        lock.lock();
+        if (!ok) { // back off instead of retrying in a loop
+            std::cerr << "faceprint store: compaction failed" << std::endl;
+            compaction_wakeup.wait_for(lock, std::chrono::seconds(60), [this] { return !compaction_running; });
+        }
+    }
+}
@@ -0,0 +1,206 @@
+/**
+ * @file faceprint_store.hpp
+ * @brief Memory-mapped faceprint database with append-only segments and atomic manifest swaps
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * Host-side user store for host matching. A database directory holds
+ * - immutable segment files (seg-<generation>.fpd): a fixed header followed by
+ *   64-byte aligned normalized faceprint rows, user ids, optional raw device
+ *   faceprints (for export to the F455) and tombstones of deleted users
+ * - MANIFEST: the ordered list of live segments, replaced atomically by
+ *   write, fsync and rename
+ *
+ * Segments are mapped read-only and scanned in place, so opening the
+ * database does not parse any faceprint - startup cost depends on the number
+ * of segments, not on the number of users. Enrollment and deletion write a
+ * new small segment and swap the manifest; the matching path keeps using its
+ * FaceprintDb snapshot and never waits for a writer. A tombstone hides all
+ * rows of a user in segments listed before it. A background thread compacts
+ * the segments into one as soon as there are more than max_segments.
+ *
+ * A crash leaves either the old or the new manifest; segment files not listed
+ * in it are removed on the next open.
+ */
+#pragma once
+#include "faceprint_index.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#define FACEPRINT_ID_BYTES 32 // user id incl. terminating zero, as RealSenseID::MAX_USERID_LENGTH + 1
+
+/**
+ * @class FaceprintSegment
+ * @brief One read-only memory-mapped segment file
+ */
+class FaceprintSegment {
+public:
+    ~FaceprintSegment();
+    FaceprintSegment(const FaceprintSegment&) = delete;
+    FaceprintSegment& operator=(const FaceprintSegment&) = delete;
+
+    /**
+     * @brief maps a segment file and validates its header
+     * @return nullptr if the file is missing, truncated or of another dimension
+     */
+    static std::shared_ptr<const FaceprintSegment> map(const std::string& path, size_t dims);
+
+    const std::string& file_name() const { return name; }
+    uint64_t generation() const { return gen; }
+    size_t size() const { return n_rows; }
+    size_t stride() const { return n_stride; }
+    size_t tombstone_count() const { return n_tombstones; }
+    size_t blob_bytes() const { return n_blob_bytes; }
+    const int16_t* rows() const { return row_data; }
+    const char* user_id(size_t row) const { return id_data + row * FACEPRINT_ID_BYTES; }
+    const uint8_t* blob(size_t row) const { return n_blob_bytes ? blob_data + row * n_blob_bytes : nullptr; }
+    const char* tombstone(size_t i) const { return tombstone_data + i * FACEPRINT_ID_BYTES; }
+
+private:
+    FaceprintSegment() = default;
+    std::string name;
+    void* mapping = nullptr;
+    size_t mapping_bytes = 0;
+    uint64_t gen = 0;
+    size_t n_rows = 0, n_stride = 0, n_tombstones = 0, n_blob_bytes = 0;
+    const int16_t* row_data = nullptr;
+    const char* id_data = nullptr;
+    const uint8_t* blob_data = nullptr;
+    const char* tombstone_data = nullptr;
+};
+
+/**
+ * @class FaceprintDb
+ * @brief Immutable snapshot of the live segments, used by the matching path
+ */
+class FaceprintDb {
+public:
+    /**
+     * @brief scans all live rows of all segments for the highest cosine similarity
+     *
+     * @param features faceprint with dims() features as delivered by the device
+     * @param threads number of scanning threads, 1 scans on the calling thread
+     */
+    FaceprintMatch best_match(const int16_t* features, unsigned int threads = 1) const;
+
+    /**
+     * @brief true if the row is hidden by a tombstone in a later segment
+     */
+    bool is_deleted(size_t segment, size_t row) const;
+
+    /**
+     * @brief ids of all users with at least one live faceprint, sorted
+     *
+     * Reads all user ids - meant for listings, not for the matching path.
+     */
+    std::vector<std::string> user_ids() const;
+
+    size_t dims() const { return n_dims; }
+    size_t rows() const;     // stored rows including rows hidden by tombstones
+    const std::vector<std::shared_ptr<const FaceprintSegment>>& segments() const { return segment_list; }
+
+private:
+    friend class FaceprintStore;
+    size_t n_dims = 0;
+    std::vector<std::shared_ptr<const FaceprintSegment>> segment_list;        // oldest first
+    std::vector<std::shared_ptr<const std::unordered_set<std::string>>> deleted_later; // per segment
+    void index_tombstones();
+};
+
+/**
+ * @brief one enrolled faceprint to be written into a segment
+ */
+struct FaceprintRecord {
+    std::string user_id;
+    std::vector<int16_t> features;   // dims() features as delivered by the device
+    std::vector<uint8_t> device_blob; // optional raw RealSenseID::Faceprints for export to the device
+};
+
+/**
+ * @class FaceprintStore
+ * @brief Writer side of the faceprint database and owner of the current snapshot
+ *
+ * Example usage:
+ * @code
+ * FaceprintStore store("/home/pi/smartdoorF455/faceprints", RSID_NUM_OF_RECOGNITION_FEATURES);
+ * store.open();
+ * store.start_compaction(8);
+ * store.append({record}, {});                 // enrollment, readers are not blocked
+ * FaceprintMatch match = store.snapshot()->best_match(probe, 2);
+ * @endcode
+ */
+class FaceprintStore {
+public:
+    FaceprintStore(const std::string& directory, size_t dims);
+    ~FaceprintStore();
+    FaceprintStore(const FaceprintStore&) = delete;
+    FaceprintStore& operator=(const FaceprintStore&) = delete;
+
+    /**
+     * @brief reads the manifest and maps its segments; creates an empty database if there is none
+     * @return false if the directory can't be created or the manifest is unreadable
+     */
+    bool open();
+
+    /**
+     * @brief current snapshot; lock-free, never waits for a writer
+     */
+    std::shared_ptr<const FaceprintDb> snapshot() const { return std::atomic_load(&current); }
+
+    /**
+     * @brief writes added faceprints and deleted users as one new segment and swaps the manifest
+     *
+     * Deletions apply to all earlier segments. Writers are serialized; the
+     * matching path keeps its snapshot until it asks for a new one.
+     */
+    bool append(const std::vector<FaceprintRecord>& added, const std::vector<std::string>& deleted);
+
+    /**
+     * @brief replaces the whole database by the given faceprints, e.g. on import from the device
+     */
+    bool replace(const std::vector<FaceprintRecord>& records);
+
+    /**
+     * @brief merges all live rows into a single segment without tombstones
+     */
+    bool compact();
+
+    /**
+     * @brief starts a background thread compacting once there are more than max_segments segments
+     */
+    void start_compaction(size_t max_segments);
+    void stop_compaction();
+
+    size_t dims() const { return n_dims; }
+    uint64_t compaction_count() const { return compactions.load(std::memory_order_relaxed); }
+
+private:
+    std::string dir;
+    size_t n_dims;
+    size_t n_stride;
+    std::shared_ptr<const FaceprintDb> current;
+    std::mutex writer_mutex;  // serializes append, replace and compaction swaps
+    std::atomic<uint64_t> next_generation{1}; // compaction allocates outside writer_mutex
+    std::thread compaction_thread;
+    std::mutex compaction_mutex;
+    std::condition_variable compaction_wakeup;
+    bool compaction_running = false;
+    size_t compaction_threshold = 8;
+    std::atomic<uint64_t> compactions{0};
+
+    std::string write_segment(const std::vector<FaceprintRecord>& added, const std::vector<std::string>& deleted,
+                              const FaceprintDb* merge_from);
+    bool write_manifest(const std::vector<std::shared_ptr<const FaceprintSegment>>& segments);
+    void publish(std::vector<std::shared_ptr<const FaceprintSegment>> segments);
+    void remove_unlisted_segments(const std::vector<std::shared_ptr<const FaceprintSegment>>& segments);
+    void compaction_loop();
+};
@@ -0,0 +1,182 @@
+/**
+ * @file glyph_atlas.cpp
+ * @brief Pre-rasterized glyph atlas and packed-bitmap blit into a framebuffer of the LED panel
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ */
+#include "glyph_atlas.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#define UNICODE_REPLACEMENT_CHARACTER 0xFFFD
+
+void Framebuffer::resize(int new_width, int new_height)
+{
+    width = std::min(std::max(new_width, 0), MAX_WIDTH);
+    height = std::min(std::max(new_height, 0), MAX_HEIGHT);
+}
+
+void Framebuffer::fill_rows(int top, int bottom, Rgb color)
+{
+    top = std::max(top, 0);
+    bottom = std::min(bottom, height);
+    for (int y = top; y < bottom; y++)
+        std::fill(pixel[y], pixel[y] + width, color);
+}
+
+uint32_t utf8_next(const char*& text)
+{
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(text);
+    uint32_t cp = *p++;
+    int continuation = cp >= 0xF0 ? 3 : cp >= 0xE0 ? 2 : cp >= 0xC0 ? 1 : 0;
+    if (continuation) {
+        uint32_t decoded = cp & (0x3F >> continuation);
+        int i = 0;
+        for (; i < continuation && (p[i] & 0xC0) == 0x80; i++)
+            decoded = (decoded << 6) | (p[i] & 0x3F);
+        if (i == continuation) { // complete sequence, otherwise the lead byte stands for itself
+            cp = decoded;
+            p += continuation;
+        }
+    }
+    text = reinterpret_cast<const char*>(p);
+    return cp;
+}
+
+bool GlyphAtlas::load_bdf(const char* bdf)
+{
+    glyphs.clear();
+    rows.clear();
+    std::fill(ascii, ascii + 128, -1);
+    replacement = -1;
+    if (!bdf)
+        return false;
+    std::istringstream in(bdf);
+    std::string line;
+    Glyph glyph;
+    int bbx_width = 0, x_offset = 0;
+    bool in_bitmap = false, in_char = false;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (in_bitmap) {
+            if (line == "ENDCHAR") {
+                in_bitmap = in_char = false;
+                glyph.height = (int)(rows.size() - glyph.first_row);
+                if (glyph.codepoint != (uint32_t)-1)
+                    glyphs.push_back(glyph);
+                else
+                    rows.resize(glyph.first_row); // unencoded glyph
+                continue;
+            }
+            // a hex row holds bbx_width bits, padded to whole bytes; align its first pixel to bit 31
+            uint32_t bits = (uint32_t)std::strtoul(line.c_str(), nullptr, 16);
+            int row_bits = (int)line.size() * 4;
+            uint32_t row = row_bits >= 32 ? bits : bits << (32 - row_bits);
+            if (bbx_width < 32)
+                row &= ~(0xFFFFFFFFu >> bbx_width);
+            row = x_offset >= 0 ? row >> std::min(x_offset, 31) : row << std::min(-x_offset, 31);
+            rows.push_back(row);
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string keyword;
+        fields >> keyword;
+        if (keyword == "FONTBOUNDINGBOX") {
+            int w, h, xo, yo;
+            if (fields >> w >> h >> xo >> yo) {
+                font_height = h;
+                font_baseline = h + yo; // as rgb_matrix::Font
+            }
+        }
+        else if (keyword == "STARTCHAR") {
+            in_char = true;
+            glyph = Glyph();
+            glyph.codepoint = (uint32_t)-1;
+            bbx_width = x_offset = 0;
+        }
+        else if (in_char && keyword == "ENCODING") {
+            long encoding = -1;
+            fields >> encoding;
+            glyph.codepoint = encoding >= 0 ? (uint32_t)encoding : (uint32_t)-1;
+        }
+        else if (in_char && keyword == "DWIDTH") {
+            fields >> glyph.device_width;
+        }
+        else if (in_char && keyword == "BBX") {
+            int h;
+            fields >> bbx_width >> h >> x_offset >> glyph.y_offset;
+            bbx_width = std::min(bbx_width, MAX_GLYPH_WIDTH);
+        }
+        else if (in_char && keyword == "BITMAP") {
+            in_bitmap = true;
+            glyph.first_row = (uint32_t)rows.size();
+        }
+    }
+    if (glyphs.empty() || font_height == 0)
+        return false;
+    std::stable_sort(glyphs.begin(), glyphs.end(), [](const Glyph& a, const Glyph& b) { return a.codepoint < b.codepoint; });
+    for (size_t i = 0; i < glyphs.size(); i++) {
+        if (glyphs[i].codepoint < 128 && ascii[glyphs[i].codepoint] < 0)
+            ascii[glyphs[i].codepoint] = (int)i;
+        if (glyphs[i].codepoint == UNICODE_REPLACEMENT_CHARACTER)
+            replacement = (int)i;
+    }
+    return true;
+}
+
+const GlyphAtlas::Glyph* GlyphAtlas::find(uint32_t codepoint) const
+{
+    if (codepoint < 128)
+        return ascii[codepoint] >= 0 ? &glyphs[ascii[codepoint]] : (replacement >= 0 ? &glyphs[replacement] : nullptr);
+    auto it = std::lower_bound(glyphs.begin(), glyphs.end(), codepoint,
+                               [](const Glyph& g, uint32_t cp) { return g.codepoint < cp; });
+    if (it != glyphs.end() && it->codepoint == codepoint)
+        return &*it;
+    return replacement >= 0 ? &glyphs[replacement] : nullptr;
+}
+
+int GlyphAtlas::text_width(const char* utf8, int kerning) const
+{
+    int width = 0;
+    while (*utf8) {
+        const Glyph* g = find(utf8_next(utf8));
+        if (g)
+            width += g->device_width + kerning;
+    }
+    return width;
+}
+
+int GlyphAtlas::draw_text(Framebuffer& frame, int x, int y, Rgb color, const char* utf8, int kerning) const
+{
+    const int start_x = x;
+    while (*utf8) {
+        const Glyph* g = find(utf8_next(utf8));
+        if (!g)
+            continue;
+        int top = y - g->height - g->y_offset;
+        // pixels left of the panel are shifted out, pixels right of it masked
+        uint32_t clip = x >= 0 ? 0xFFFFFFFFu : x <= -32 ? 0 : 0xFFFFFFFFu >> -x;
+        if (frame.width - x < 32)
+            clip &= frame.width - x <= 0 ? 0 : ~(0xFFFFFFFFu >> (frame.width - x));
+        if (clip) {
+            const uint32_t* row = rows.data() + g->first_row;
+            for (int r = 0; r < g->height; r++) {
+                int py = top + r;
+                if (py < 0 || py >= frame.height)
+                    continue;
+                uint32_t bits = row[r] & clip;
+                Rgb* out = frame.pixel[py];
+                while (bits) {
+                    int column = __builtin_clz(bits);
+                    out[x + column] = color;
+                    bits &= ~(0x80000000u >> column);
+                }
+            }
+        }
+        x += g->device_width + kerning;
+    }
+    return x - start_x;
+}
@@ -0,0 +1,117 @@
+/**
+ * @file glyph_atlas.hpp
+ * @brief Pre-rasterized glyph atlas and packed-bitmap blit into a framebuffer of the LED panel
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * The BDF fonts of rpi-rgb-led-matrix are embedded into the executable at
+ * build time (embed_fonts.cmake generates embedded_fonts.cpp), so there is no
+ * runtime dependency on FONT_PATH. At startup each font is parsed once into a
+ * GlyphAtlas: every glyph row is one 32-bit word, leftmost pixel in bit 31,
+ * with the glyph's x offset already applied. draw_text() blits set bits only
+ * (count leading zeros) into a Framebuffer, which is copied to the
+ * FrameCanvas in one pass - no per-pixel virtual calls while rendering text.
+ *
+ * The header has no hardware dependencies.
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief 24 bit colour as used by rgb_matrix::Color
+ */
+struct Rgb {
+    uint8_t r = 0, g = 0, b = 0;
+    bool operator==(const Rgb& other) const { return r == other.r && g == other.g && b == other.b; }
+    bool operator!=(const Rgb& other) const { return !(*this == other); }
+};
+
+/**
+ * @brief pixels of the 64x32 LED panel, row major
+ *
+ * Sized for either orientation: a pixel mapper like "Rotate:270" turns the
+ * canvas into 32 columns by 64 rows, see resize().
+ */
+struct Framebuffer {
+    static constexpr int MAX_WIDTH = 64;
+    static constexpr int MAX_HEIGHT = 64;
+    int width = 64;
+    int height = 32;
+    Rgb pixel[MAX_HEIGHT][MAX_WIDTH];
+
+    /** sets the canvas size, clipped to MAX_WIDTH x MAX_HEIGHT */
+    void resize(int new_width, int new_height);
+    void fill(Rgb color) { fill_rows(0, height, color); }
+    /** fills pixel rows [top, bottom), clipped to the panel */
+    void fill_rows(int top, int bottom, Rgb color);
+};
+
+/**
+ * @class GlyphAtlas
+ * @brief One BDF font as packed glyph bitmaps
+ *
+ * Example usage:
+ * @code
+ * GlyphAtlas font;
+ * font.load_bdf(embedded_font("6x12"));
+ * font.draw_text(frame, 0, LINE_OFFSET_1, clock_color, "12:34");
+ * @endcode
+ */
+class GlyphAtlas {
+public:
+    static constexpr int MAX_GLYPH_WIDTH = 32; // one uint32_t per glyph row
+
+    /**
+     * @brief parses BDF font source
+     * @return false if the text is no BDF font or has no glyphs
+     */
+    bool load_bdf(const char* bdf);
+
+    /** height of the font bounding box, as rgb_matrix::Font::height() */
+    int height() const { return font_height; }
+    /** pixel rows above the baseline, as rgb_matrix::Font::baseline() */
+    int baseline() const { return font_baseline; }
+    size_t glyph_count() const { return glyphs.size(); }
+
+    /**
+     * @brief draws UTF-8 text with its baseline at y, like rgb_matrix::DrawText
+     * @return advance in pixels
+     */
+    int draw_text(Framebuffer& frame, int x, int y, Rgb color, const char* utf8, int kerning = 0) const;
+
+    /** advance of UTF-8 text in pixels without drawing it */
+    int text_width(const char* utf8, int kerning = 0) const;
+
+private:
+    struct Glyph {
+        uint32_t codepoint = 0;
+        int device_width = 0;   // advance in pixels (DWIDTH)
+        int height = 0;         // bitmap rows (BBX height)
+        int y_offset = 0;       // BBX y offset, bottom row relative to the baseline
+        uint32_t first_row = 0; // index into rows
+    };
+    int font_height = 0;
+    int font_baseline = 0;
+    std::vector<Glyph> glyphs;   // sorted by codepoint
+    std::vector<uint32_t> rows;  // all glyph rows, leftmost pixel in bit 31
+    int ascii[128];              // glyph index of ASCII codepoints, -1 if missing
+    int replacement = -1;        // glyph drawn for missing codepoints, as rgb_matrix uses U+FFFD
+
+    const Glyph* find(uint32_t codepoint) const;
+};
+
+/**
+ * @brief decodes one UTF-8 sequence and advances text; invalid bytes decode as themselves
+ */
+uint32_t utf8_next(const char*& text);
+
+/**
+ * @brief BDF source of a font embedded at build time
+ * @param name file name without .bdf, e.g. "6x12"
+ * @return nullptr if the font was not embedded
+ */
+const char* embedded_font(const char* name);
@@ -0,0 +1,132 @@
+/**
+ * @file hal.hpp
+ * @brief Hardware abstraction: presence sensor, face authenticator, LED panel and snapshot camera
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * The daemon talks to wiringPi, RealSenseID, rpi-rgb-led-matrix and OpenCV
+ * only through these four interfaces. The adapters to the real libraries
+ * live in smartdoorF455.cpp; simulated implementations for a plain Linux
+ * box are in hal_sim.hpp:
+ *
+ * | interface      | smartdoorF455.cpp      | hal_sim.hpp          |
+ * |----------------|------------------------|----------------------|
+ * | TriggerSource  | GpioTriggerSource      | TraceTriggerSource   |
+ * | AuthDevice     | RealSenseAuthDevice    | ScriptedAuthDevice   |
+ * | LedPanel       | RgbMatrixPanel         | MemoryPanel          |
+ * | SnapshotCamera | CvSnapshotCamera       | SimSnapshotCamera    |
+ *
+ * Everything behind the interfaces - trigger pipeline, door controller, LED
+ * display, notification outbox - is the same code in the daemon and in
+ * smartdoorF455_replay.
+ *
+ * The header has no hardware dependencies.
+ */
+#pragma once
+#include "glyph_atlas.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/**
+ * @brief names a device status, e.g. RealSenseID::Description; never returns nullptr
+ */
+using StatusNames = const char* (*)(int status);
+
+/**
+ * @class TriggerSource
+ * @brief Presence sensor reporting edges, e.g. a PIR or a photoelectric barrier on a GPIO pin
+ */
+class TriggerSource {
+public:
+    /** edge is EdgePolicy::Falling or Rising, status false if the edge could not be read reliably */
+    using EdgeHandler = std::function<void(int edge, int status)>;
+
+    virtual ~TriggerSource() = default;
+    /**
+     * @brief starts reporting edges to on_edge, called on a thread of the source
+     * @return false if the sensor could not be set up
+     */
+    virtual bool start(EdgeHandler on_edge) = 0;
+    /** no on_edge call is running or follows after it returned */
+    virtual void stop() = 0;
+};
+
+/**
+ * @brief result of an authentication as far as the door is concerned
+ */
+enum class AuthOutcome : int {
+    Granted,  // enrolled user recognized, user_id is set
+    Denied,   // no face, unknown face, device error
+    Spoof     // spoofing attempt: photo, mask, screen
+};
+
+/**
+ * @class AuthListener
+ * @brief Receives the callbacks of one authentication, on a thread of the device
+ */
+class AuthListener {
+public:
+    virtual ~AuthListener() = default;
+    /** status is the device status for metrics and log, user_id nullptr unless Granted */
+    virtual void on_result(AuthOutcome outcome, int status, const char* user_id) = 0;
+    /** the person should move, e.g. FaceIsTooFarToTheLeft */
+    virtual void on_hint(int hint) = 0;
+    virtual void on_faces(size_t count) = 0;
+};
+
+/**
+ * @class AuthDevice
+ * @brief Face authenticator, e.g. the F455
+ */
+class AuthDevice {
+public:
+    virtual ~AuthDevice() = default;
+    /**
+     * @brief authenticates the person in front of the camera; the callbacks run before it returns
+     * @return false if the device reported an error; on_result may not have been called then
+     */
+    virtual bool authenticate(AuthListener& listener) = 0;
+    /** makes a running authenticate() return early; any thread */
+    virtual void cancel() = 0;
+};
+
+/**
+ * @class LedPanel
+ * @brief Double-buffered LED matrix: rows are set offscreen, then swapped to the panel
+ */
+class LedPanel {
+public:
+    virtual ~LedPanel() = default;
+    virtual int width() const = 0;
+    virtual int height() const = 0;
+    /** bit planes the panel was created with, the full quality of set_quality() */
+    virtual int pwm_bits() const = 0;
+    /** copies pixel rows [top, bottom) of source to the offscreen buffer */
+    virtual void set_rows(const Framebuffer& source, int top, int bottom) = 0;
+    /** clears the offscreen buffer */
+    virtual void clear() = 0;
+    /**
+     * @brief shows the offscreen buffer at the next vsync; the previously shown buffer becomes offscreen
+     * @param vsync_fraction waits at least this many refresh cycles since the last swap
+     */
+    virtual void swap(unsigned int vsync_fraction = 1) = 0;
+    /** brightness 1..100 applies to pixels set afterwards, pwm_bits to both buffers */
+    virtual void set_quality(uint8_t brightness, uint8_t pwm_bits) = 0;
+};
+
+/**
+ * @class SnapshotCamera
+ * @brief Camera delivering a jpeg of the scene at a trigger
+ */
+class SnapshotCamera {
+public:
+    virtual ~SnapshotCamera() = default;
+    /**
+     * @brief encodes the frame closest to trigger_ts_us (monotonic_us()) into jpeg, reusing its capacity
+     * @return false if no frame is available or encoding failed
+     */
+    virtual bool capture_jpeg(int64_t trigger_ts_us, std::vector<unsigned char>& jpeg) = 0;
+};
@@ -0,0 +1,273 @@
+/**
+ * @file hal_sim.cpp
+ * @brief Simulated presence sensor, face authenticator, LED panel and snapshot camera
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ */
+#include "hal_sim.hpp"
+#include "latency_trace.hpp"
+#include "thread_placement.hpp"
+#include "trigger_gate.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+#define SIM_BOUNCE_USEC 800 // distance of bouncing edges of the presence sensor, trace time
+
+const char* sim_status_name(int status)
+{
+    static const char* const names[(int)SimStatus::COUNT] = {
+        "Success", "NoFaceDetected", "Forbidden", "Spoof", "Failure",
+        "FaceIsTooFarToTheLeft", "FaceIsTooFarToTheRight", "FaceTiltIsTooUp", "FaceTiltIsTooDown" };
+    return status >= 0 && status < (int)SimStatus::COUNT ? names[status] : "Unknown";
+}
+
+TraceTriggerSource::TraceTriggerSource(const DoorTrace& trace, double speed, SceneHandler on_scene)
+    : trace(trace), speed(speed), on_scene(std::move(on_scene))
+{
+}
+
+TraceTriggerSource::~TraceTriggerSource()
+{
+    stop();
+}
+
+bool TraceTriggerSource::start(EdgeHandler handler)
+{
+    if (player.joinable())
+        return true;
+    on_edge = std::move(handler);
+    stopping = false;
+    done = false;
+    player = std::thread(&TraceTriggerSource::play, this);
+    return true;
+}
+
+void TraceTriggerSource::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (player.joinable())
+        player.join();
+}
+
+bool TraceTriggerSource::wait(int timeout_ms)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    return wake.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this] { return done || stopping; });
+}
+
+bool TraceTriggerSource::sleep_until(int64_t start_us, int64_t at_us)
+{
+    const int64_t wake_us = start_us + (int64_t)(at_us / speed);
+    std::unique_lock<std::mutex> lock(mutex);
+    for (int64_t now_us = monotonic_us(); now_us < wake_us && !stopping; now_us = monotonic_us())
+        wake.wait_for(lock, std::chrono::microseconds(wake_us - now_us));
+    return !stopping;
+}
+
+/**
+ * @brief posts the edges of all visits in trace order, like the ISR thread of wiringPi
+ */
+void TraceTriggerSource::play()
+{
+    place_this_thread("isr");
+    enum Kind { Arrive, Bounce, Leave };
+    struct Step {
+        int64_t at_us;
+        Kind kind;
+        size_t visit;
+        int edge;
+    };
+    std::vector<Step> steps;
+    for (size_t v = 0; v < trace.events.size(); v++) {
+        const DoorEvent& event = trace.events[v];
+        steps.push_back({ event.at_us, Arrive, v, (int)EdgePolicy::Rising });
+        for (int b = 0; b < event.bounces; b++) { // contact opens and closes again
+            steps.push_back({ event.at_us + (2 * b + 1) * SIM_BOUNCE_USEC, Bounce, v, (int)EdgePolicy::Falling });
+            steps.push_back({ event.at_us + (2 * b + 2) * SIM_BOUNCE_USEC, Bounce, v, (int)EdgePolicy::Rising });
+        }
+        steps.push_back({ event.at_us + std::max<int64_t>(event.dwell_us, (2 * event.bounces + 1) * SIM_BOUNCE_USEC),
+                          Leave, v, (int)EdgePolicy::Falling });
+    }
+    std::stable_sort(steps.begin(), steps.end(), [](const Step& a, const Step& b) { return a.at_us < b.at_us; });
+    const int64_t start_us = monotonic_us();
+    const DoorEvent* at_door = nullptr;
+    for (const Step& step : steps) {
+        if (!sleep_until(start_us, step.at_us))
+            break;
+        position.store(step.at_us, std::memory_order_relaxed);
+        const DoorEvent* visit = &trace.events[step.visit];
+        if (step.kind == Arrive) {
+            at_door = visit;
+            on_scene(visit);
+        }
+        else if (step.kind == Leave && at_door == visit) { // gone before the falling edge; a later visitor may still be there
+            at_door = nullptr;
+            on_scene(nullptr);
+        }
+        on_edge(step.edge, 1);
+        edges.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (sleep_until(start_us, trace.duration_us))
+        position.store(trace.duration_us, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mutex);
+    done = true;
+    wake.notify_all();
+}
+
+ScriptedAuthDevice::ScriptedAuthDevice(const AuthScript& script, double speed)
+    : script(script), speed(speed), rng(script.seed)
+{
+}
+
+void ScriptedAuthDevice::present(const DoorEvent* visit)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    scene = visit;
+}
+
+void ScriptedAuthDevice::cancel()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        cancelled = true;
+    }
+    wake.notify_all();
+}
+
+bool ScriptedAuthDevice::device_sleep(int64_t duration_us)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    return !wake.wait_for(lock, std::chrono::microseconds((int64_t)(duration_us / speed)), [this] { return cancelled; });
+}
+
+bool ScriptedAuthDevice::authenticate(AuthListener& listener)
+{
+    attempt_count.fetch_add(1, std::memory_order_relaxed);
+    const DoorEvent* visit;
+    int64_t jitter_us;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        visit = scene; // whoever stands at the door when the device starts looking
+        cancelled = false;
+        jitter_us = std::uniform_int_distribution<int64_t>(0, std::max<int64_t>(script.jitter_us, 0))(rng);
+    }
+    const Visitor visitor = visit ? visit->visitor : Visitor::Passerby;
+    int64_t latency_us = visitor == Visitor::Resident ? script.granted_us
+                       : visitor == Visitor::Stranger ? script.denied_us
+                       : visitor == Visitor::Spoofer ? script.spoof_us : script.no_face_us;
+    if (visit && visit->auth_us > 0)
+        latency_us = visit->auth_us;
+    latency_us += jitter_us;
+    if (visitor != Visitor::Passerby)
+        listener.on_faces(1);
+    const int hints = visit ? visit->hints : 0;
+    const int hint_kinds = (int)SimStatus::COUNT - (int)SimStatus::FaceIsTooFarToTheLeft;
+    for (int h = 0; h < hints; h++) { // the person moves after each hint
+        if (!device_sleep(latency_us / (hints + 1))) {
+            listener.on_result(AuthOutcome::Denied, (int)SimStatus::Failure, nullptr);
+            return true;
+        }
+        listener.on_hint((int)SimStatus::FaceIsTooFarToTheLeft + h % hint_kinds);
+    }
+    if (!device_sleep(latency_us - hints * (latency_us / (hints + 1)))) {
+        listener.on_result(AuthOutcome::Denied, (int)SimStatus::Failure, nullptr);
+        return true;
+    }
+    switch (visitor) {
+    case Visitor::Resident:
+        listener.on_result(AuthOutcome::Granted, (int)SimStatus::Success, visit->user.c_str());
+        break;
+    case Visitor::Stranger:
+        listener.on_result(AuthOutcome::Denied, (int)SimStatus::Forbidden, nullptr);
+        break;
+    case Visitor::Spoofer:
+        listener.on_result(AuthOutcome::Spoof, (int)SimStatus::Spoof, nullptr);
+        break;
+    case Visitor::Passerby:
+        listener.on_result(AuthOutcome::Denied, (int)SimStatus::NoFaceDetected, nullptr);
+        break;
+    }
+    return true;
+}
+
+MemoryPanel::MemoryPanel(int width, int height, int refresh_hz, std::string dump_dir)
+    : vsync_us(refresh_hz > 0 ? 1000000 / refresh_hz : 0), dump_dir(std::move(dump_dir))
+{
+    for (Framebuffer& buffer : buffers) {
+        buffer.resize(width, height);
+        buffer.fill(Rgb{ 0, 0, 0 });
+    }
+}
+
+void MemoryPanel::set_rows(const Framebuffer& source, int top, int bottom)
+{
+    Framebuffer& offscreen = buffers[shown_index ^ 1];
+    bottom = std::min(bottom, std::min(offscreen.height, source.height));
+    const int width = std::min(offscreen.width, source.width);
+    for (int y = std::max(top, 0); y < bottom; y++) {
+        for (int x = 0; x < width; x++) { // dimmed when set, like SetPixel of rpi-rgb-led-matrix
+            const Rgb& pixel = source.pixel[y][x];
+            offscreen.pixel[y][x] = Rgb{ (uint8_t)(pixel.r * brightness / 100), (uint8_t)(pixel.g * brightness / 100),
+                                         (uint8_t)(pixel.b * brightness / 100) };
+        }
+    }
+}
+
+void MemoryPanel::clear()
+{
+    buffers[shown_index ^ 1].fill(Rgb{ 0, 0, 0 });
+}
+
+void MemoryPanel::swap(unsigned int vsync_fraction)
+{
+    if (vsync_us > 0) {
+        const int64_t next_us = last_swap_us + vsync_us * std::max(vsync_fraction, 1u);
+        const int64_t now_us = monotonic_us();
+        std::this_thread::sleep_for(std::chrono::microseconds(next_us > now_us ? next_us - now_us : vsync_us));
+    }
+    last_swap_us = monotonic_us();
+    shown_index ^= 1;
+    uint64_t swaps_done = swap_count.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (!dump_dir.empty()) {
+        char name[32];
+        snprintf(name, sizeof(name), "/frame_%06llu.ppm", (unsigned long long)swaps_done);
+        write_ppm(dump_dir + name);
+    }
+}
+
+void MemoryPanel::set_quality(uint8_t new_brightness, uint8_t /*pwm_bits*/)
+{
+    brightness = std::min<uint8_t>(new_brightness, 100);
+}
+
+bool MemoryPanel::write_ppm(const std::string& path) const
+{
+    const Framebuffer& buffer = shown();
+    std::ofstream file(path, std::ios::binary);
+    file << "P6\n" << buffer.width << " " << buffer.height << "\n255\n";
+    for (int y = 0; y < buffer.height; y++) {
+        for (int x = 0; x < buffer.width; x++) {
+            const Rgb& pixel = buffer.pixel[y][x];
+            const char rgb[3] = { (char)pixel.r, (char)pixel.g, (char)pixel.b };
+            file.write(rgb, 3);
+        }
+    }
+    return (bool)file;
+}
+
+bool SimSnapshotCamera::capture_jpeg(int64_t /*trigger_ts_us*/, std::vector<unsigned char>& jpeg)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds((int64_t)(capture_us / speed)));
+    jpeg.assign(std::max<size_t>(jpeg_bytes, 4), 0x55);
+    jpeg[0] = 0xFF; // start and end of image markers, enough for a size and a quick look
+    jpeg[1] = 0xD8;
+    jpeg[jpeg.size() - 2] = 0xFF;
+    jpeg[jpeg.size() - 1] = 0xD9;
+    return true;
+}
@@ -0,0 +1,182 @@
+/**
+ * @file hal_sim.hpp
+ * @brief Simulated presence sensor, face authenticator, LED panel and snapshot camera
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * Implementations of the interfaces of hal.hpp for smartdoorF455_replay:
+ *
+ * - TraceTriggerSource plays a DoorTrace: at every visit it tells who stands
+ *   at the door and posts the edges of the presence sensor
+ * - ScriptedAuthDevice answers like the F455 would for whoever stands at the
+ *   door: a resident is granted, a stranger denied, a spoofer detected, a
+ *   passer-by shows no face; latencies come from an AuthScript or the trace
+ * - MemoryPanel keeps both buffers of the LED matrix in memory, waits for a
+ *   simulated vsync and writes the shown buffer as PPM image
+ * - SimSnapshotCamera delivers a jpeg-sized buffer after the capture time
+ *
+ * All durations are divided by speed: at speed 100 a day of door traffic is
+ * replayed in 14.4 minutes with every pipeline stage, queue and thread of the
+ * daemon running as usual. The vsync of MemoryPanel is not scaled, the
+ * refresh rate of a panel does not change with the traffic at the door.
+ *
+ * The header has no hardware dependencies.
+ */
+#pragma once
+#include "door_trace.hpp"
+#include "hal.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+
+/**
+ * @brief statuses and hints reported by ScriptedAuthDevice, named by sim_status_name()
+ */
+enum class SimStatus : int {
+    Success, NoFaceDetected, Forbidden, Spoof, Failure,
+    FaceIsTooFarToTheLeft, FaceIsTooFarToTheRight, FaceTiltIsTooUp, FaceTiltIsTooDown,
+    COUNT
+};
+
+const char* sim_status_name(int status);
+
+/**
+ * @class TraceTriggerSource
+ * @brief Plays the visits of a trace as presence sensor edges on a thread of its own
+ */
+class TraceTriggerSource : public TriggerSource {
+public:
+    /** called before the edges of a visit with the visit, and with nullptr when the visitor left */
+    using SceneHandler = std::function<void(const DoorEvent* visit)>;
+
+    TraceTriggerSource(const DoorTrace& trace, double speed, SceneHandler on_scene);
+    ~TraceTriggerSource() override;
+
+    bool start(EdgeHandler on_edge) override;
+    void stop() override;
+
+    /**
+     * @brief waits up to timeout_ms until the whole trace was played or stop() was called
+     * @return true if the trace is over
+     */
+    bool wait(int timeout_ms);
+    /** position in the trace, trace time in us */
+    int64_t position_us() const { return position.load(std::memory_order_relaxed); }
+    uint64_t edges_posted() const { return edges.load(std::memory_order_relaxed); }
+
+private:
+    const DoorTrace& trace;
+    double speed;
+    SceneHandler on_scene;
+    EdgeHandler on_edge;
+    std::thread player;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    bool done = false;
+    std::atomic<int64_t> position{0};
+    std::atomic<uint64_t> edges{0};
+
+    void play();
+    /** sleeps until trace time at_us; false if stopped meanwhile */
+    bool sleep_until(int64_t start_us, int64_t at_us);
+};
+
+/**
+ * @brief authentication latencies of ScriptedAuthDevice, like a F455 in low security mode
+ */
+struct AuthScript {
+    int64_t granted_us = 650000;   // until Success
+    int64_t denied_us = 1400000;   // until Forbidden, the device tries several frames
+    int64_t spoof_us = 900000;     // until Spoof
+    int64_t no_face_us = 2500000;  // until NoFaceDetected, the device times out
+    int64_t jitter_us = 250000;    // added uniformly 0..jitter_us
+    unsigned int seed = 4711;
+};
+
+/**
+ * @class ScriptedAuthDevice
+ * @brief Answers for whoever stands at the door, after a scripted latency
+ */
+class ScriptedAuthDevice : public AuthDevice {
+public:
+    ScriptedAuthDevice(const AuthScript& script, double speed);
+
+    /** who stands at the door now, nullptr if nobody; the visit has to outlive the device */
+    void present(const DoorEvent* visit);
+
+    bool authenticate(AuthListener& listener) override;
+    void cancel() override;
+
+    uint64_t attempts() const { return attempt_count.load(std::memory_order_relaxed); }
+
+private:
+    AuthScript script;
+    double speed;
+    std::mutex mutex;
+    std::condition_variable wake;
+    const DoorEvent* scene = nullptr;
+    bool cancelled = false;
+    std::mt19937 rng;
+    std::atomic<uint64_t> attempt_count{0};
+
+    /** sleeps for duration_us of device time; false if cancelled */
+    bool device_sleep(int64_t duration_us);
+};
+
+/**
+ * @class MemoryPanel
+ * @brief LED panel with both buffers in memory, optionally dumping every shown frame as PPM
+ */
+class MemoryPanel : public LedPanel {
+public:
+    /**
+     * @param refresh_hz simulated vsync, 0 = swap at once
+     * @param dump_dir if not empty, every swap writes frame_<n>.ppm there
+     */
+    MemoryPanel(int width, int height, int refresh_hz = 120, std::string dump_dir = std::string());
+
+    int width() const override { return buffers[0].width; }
+    int height() const override { return buffers[0].height; }
+    int pwm_bits() const override { return 11; }
+    void set_rows(const Framebuffer& source, int top, int bottom) override;
+    void clear() override;
+    void swap(unsigned int vsync_fraction = 1) override;
+    void set_quality(uint8_t brightness, uint8_t pwm_bits) override;
+
+    /** buffer on the panel; read it on the render thread or after LedDisplay::stop() */
+    const Framebuffer& shown() const { return buffers[shown_index]; }
+    /** writes the shown buffer; pixels are dimmed by the brightness they were set with, like the LEDs */
+    bool write_ppm(const std::string& path) const;
+    uint64_t swaps() const { return swap_count.load(std::memory_order_relaxed); }
+
+private:
+    Framebuffer buffers[2];
+    int shown_index = 0;
+    int64_t vsync_us;
+    int64_t last_swap_us = 0;
+    std::string dump_dir;
+    uint8_t brightness = 100;
+    std::atomic<uint64_t> swap_count{0};
+};
+
+/**
+ * @class SimSnapshotCamera
+ * @brief Delivers a jpeg-sized buffer after the time a webcam frame takes to encode
+ */
+class SimSnapshotCamera : public SnapshotCamera {
+public:
+    SimSnapshotCamera(int64_t capture_us, size_t jpeg_bytes, double speed)
+        : capture_us(capture_us), jpeg_bytes(jpeg_bytes), speed(speed) {}
+
+    bool capture_jpeg(int64_t trigger_ts_us, std::vector<unsigned char>& jpeg) override;
+
+private:
+    int64_t capture_us;
+    size_t jpeg_bytes;
+    double speed;
+};
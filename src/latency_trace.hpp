@@ -0,0 +1,248 @@
+/**
+ * @file latency_trace.hpp
+ * @brief End-to-end latency tracing from GPIO edge to door-open publish
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * Every stage between presence sensor edge and the Siedle gateway receiving
+ * "open" records a span with monotonic timestamps. A span holds the stage,
+ * its duration and its offset to the causing sensor edge. Spans go into a
+ * fixed-size ring per thread - recording takes no lock and never allocates.
+ * A ring is released when its thread exits and reused by the next new
+ * thread, so up to MAX_THREADS threads may record at once.
+ * LatencyTrace::dump() aggregates all rings into p50/p95/p99/max per stage;
+ * smartdoorF455 dumps on SIGUSR1:
+ * @code
+ * kill -USR1 $(pgrep -x smartdoorF455)
+ * @endcode
+ */
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <time.h>
+#include <vector>
+
+/**
+ * @brief monotonic time in microseconds (CLOCK_MONOTONIC)
+ */
+inline int64_t monotonic_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief CPU time consumed by the calling thread in microseconds (CLOCK_THREAD_CPUTIME_ID)
+ */
+inline int64_t thread_cpu_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief CPU time consumed by all threads of the process in microseconds (CLOCK_PROCESS_CPUTIME_ID)
+ */
+inline int64_t process_cpu_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief traced stages, in the order they occur for one door opening
+ */
+enum class TraceStage : int {
+    MotionDetect = 0, // camera motion detector, from frame grab to posting the trigger
+    IsrEntry,         // presence_detected_clbk posting the trigger
+    DebounceAccept,   // edge passed the trigger gate and was queued
+    DebounceReject,   // edge dropped by the trigger gate (edge policy, burst, in flight, hold-off)
+    DeviceWait,       // authentication waiting for a preempted control job to release the F455
+    Authenticate,     // FaceAuthenticator::Authenticate call
+    OnHint,           // MyAuthClbk::OnHint
+    OnFaceDetected,   // MyAuthClbk::OnFaceDetected
+    HostMatch,        // host-side faceprint matching in HostAuthClbk::OnResult
+    OnResult,         // MyAuthClbk::OnResult
+    MqttReconnect,    // background reconnect of MQTT session, from disconnect to CONNACK
+    MqttPublish,      // mosquitto_publish of "open"
+    MqttAck,          // publish of "open" until PUBACK (QoS 1)
+    TelegramSend,     // sendMessage/sendPhoto
+    COUNT
+};
+
+inline const char* trace_stage_name(TraceStage stage)
+{
+    static const char* const names[(int)TraceStage::COUNT] = {
+        "motion_detect", "isr_entry", "debounce_accept", "debounce_reject", "device_wait", "authenticate", "on_hint",
+        "on_face_detected", "host_match", "on_result", "mqtt_reconnect", "mqtt_publish", "mqtt_ack", "telegram_send" };
+    return names[(int)stage];
+}
+
+/**
+ * @class LatencyTrace
+ * @brief Per-thread span rings and percentile report
+ */
+class LatencyTrace {
+public:
+    static constexpr int MAX_THREADS = 16;       // threads that may record spans at once
+    static constexpr int SPANS_PER_THREAD = 256; // ring size per thread, power of two
+
+    /**
+     * @brief records a finished span
+     *
+     * @param stage traced stage
+     * @param start_us monotonic start of the stage
+     * @param end_us monotonic end of the stage
+     * @param trigger_ts_us monotonic timestamp of the causing sensor edge, 0 if unknown
+     */
+    static void record(TraceStage stage, int64_t start_us, int64_t end_us, int64_t trigger_ts_us = 0) {
+        Ring* ring = thread_ring();
+        if (!ring) {
+            lost.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        uint64_t head = ring->head.load(std::memory_order_relaxed);
+        Span& span = ring->spans[head & (SPANS_PER_THREAD - 1)];
+        span.stage.store((int)stage, std::memory_order_relaxed);
+        span.duration_us.store(end_us - start_us, std::memory_order_relaxed);
+        span.since_trigger_us.store(trigger_ts_us ? start_us - trigger_ts_us : -1, std::memory_order_relaxed);
+        ring->head.store(head + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief writes p50/p95/p99/max per stage of all recorded spans
+     *
+     * Only called from the main thread; may allocate.
+     */
+    static void dump(std::ostream& os) {
+        std::vector<int64_t> durations[(int)TraceStage::COUNT];
+        std::vector<int64_t> offsets[(int)TraceStage::COUNT];
+        int threads = std::min(rings_used.load(std::memory_order_acquire), MAX_THREADS);
+        for (int t = 0; t < threads; t++) {
+            Ring& ring = all_rings()[t];
+            uint64_t head = ring.head.load(std::memory_order_acquire);
+            uint64_t count = std::min<uint64_t>(head, SPANS_PER_THREAD);
+            for (uint64_t i = head - count; i < head; i++) {
+                const Span& span = ring.spans[i & (SPANS_PER_THREAD - 1)];
+                int stage = span.stage.load(std::memory_order_relaxed);
+                if (stage < 0 || stage >= (int)TraceStage::COUNT)
+                    continue;
+                durations[stage].push_back(span.duration_us.load(std::memory_order_relaxed));
+                int64_t offset = span.since_trigger_us.load(std::memory_order_relaxed);
+                if (offset >= 0)
+                    offsets[stage].push_back(offset);
+            }
+        }
+        os << "latency trace [us]          n      p50      p95      p99      max | since edge p50      p95      p99" << std::endl;
+        for (int stage = 0; stage < (int)TraceStage::COUNT; stage++) {
+            if (durations[stage].empty())
+                continue;
+            auto d = percentiles(durations[stage]);
+            os << std::left << std::setw(20) << trace_stage_name((TraceStage)stage) << std::right
+               << std::setw(8) << durations[stage].size()
+               << std::setw(9) << d[0] << std::setw(9) << d[1] << std::setw(9) << d[2] << std::setw(9) << d[3] << " |";
+            if (!offsets[stage].empty()) {
+                auto o = percentiles(offsets[stage]);
+                os << std::setw(20) << o[0] << std::setw(9) << o[1] << std::setw(9) << o[2];
+            }
+            os << std::endl;
+        }
+        uint64_t lost_spans = lost.load(std::memory_order_relaxed);
+        if (lost_spans)
+            os << "spans lost (more than " << MAX_THREADS << " threads at once): " << lost_spans << std::endl;
+    }
+
+private:
+    struct Span {
+        std::atomic<int> stage{-1};
+        std::atomic<int64_t> duration_us{0};
+        std::atomic<int64_t> since_trigger_us{-1};
+    };
+    struct alignas(64) Ring {
+        std::atomic<uint64_t> head{0};
+        Span spans[SPANS_PER_THREAD];
+    };
+    static_assert((SPANS_PER_THREAD & (SPANS_PER_THREAD - 1)) == 0, "SPANS_PER_THREAD must be a power of two");
+
+    static inline std::atomic<int> rings_used{0}; // highest ring claimed + 1
+    static inline std::atomic<bool> claimed[MAX_THREADS]{};
+    static inline std::atomic<uint64_t> lost{0};
+
+    /**
+     * @brief statically allocated rings of all threads
+     */
+    static Ring* all_rings() {
+        static Ring rings[MAX_THREADS];
+        return rings;
+    }
+
+    /**
+     * @brief claims a free ring on first use of a thread, releases it at thread exit
+     *
+     * The spans stay in the ring for dump(); the next thread appends to them.
+     */
+    struct RingLease {
+        int index = -1;
+        RingLease() {
+            for (int i = 0; i < MAX_THREADS; i++) {
+                bool expected = false;
+                if (!claimed[i].compare_exchange_strong(expected, true, std::memory_order_acquire))
+                    continue;
+                int used = rings_used.load(std::memory_order_relaxed);
+                while (used <= i && !rings_used.compare_exchange_weak(used, i + 1, std::memory_order_acq_rel))
+                    ;
+                index = i;
+                break;
+            }
+        }
+        ~RingLease() {
+            if (index >= 0)
+                claimed[index].store(false, std::memory_order_release);
+        }
+    };
+
+    /**
+     * @brief ring of the calling thread, nullptr while MAX_THREADS other threads hold one
+     */
+    static Ring* thread_ring() {
+        thread_local RingLease lease;
+        return lease.index >= 0 ? &all_rings()[lease.index] : nullptr;
+    }
+
+    /**
+     * @brief p50, p95, p99 and max of samples (sorts samples)
+     */
+    static std::vector<int64_t> percentiles(std::vector<int64_t>& samples) {
+        std::sort(samples.begin(), samples.end());
+        auto at = [&](double p) { return samples[(size_t)(p * (samples.size() - 1))]; };
+        return { at(0.50), at(0.95), at(0.99), samples.back() };
+    }
+};
+
+/**
+ * @class TraceSpan
+ * @brief records the enclosing scope as span of a stage
+ *
+ * @code
+ * { TraceSpan span(TraceStage::MqttPublish, trigger_ts_us); mosquitto_publish(...); }
+ * @endcode
+ */
+class TraceSpan {
+public:
+    explicit TraceSpan(TraceStage stage, int64_t trigger_ts_us = 0)
+        : stage(stage), trigger_ts_us(trigger_ts_us), start_us(monotonic_us()) {}
+    ~TraceSpan() { LatencyTrace::record(stage, start_us, monotonic_us(), trigger_ts_us); }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+private:
+    TraceStage stage;
+    int64_t trigger_ts_us;
+    int64_t start_us;
+};
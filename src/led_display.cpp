@@ -0,0 +1,435 @@
+/**
+ * @file led_display.cpp
+ * @brief Clock, date, names, hints and alerts on the LED matrix, drawn through a LedPanel
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ */
+#include "led_display.hpp"
+#include "async_log.hpp"
+#include "latency_trace.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define DATE_FORMAT_STRING "%d.%m" // DD.MM.YY format
+#define DAY_FORMAT_STRING "%A" // name of day according to LOCALE
+// #define TIME_FORMAT_STRING "%H:%M"    // HH:MM format
+// BDF fonts of rpi-rgb-led-matrix, embedded at build time - see EMBEDDED_FONTS in CMakeLists.txt
+#define FONT_TIME "6x12"
+#define FONT_DAY  "4x6"
+#define FONT_DATE "6x12"
+#define FONT_NAME "6x12"
+#define LINE_OFFSET_1 7
+#define LINE_OFFSET_2 (LINE_OFFSET_1+6)
+#define LINE_OFFSET_3 (LINE_OFFSET_2+8)
+#define LINE_OFFSET_4 (LINE_OFFSET_3+8)
+// layers of the LED panel, drawn in ascending priority
+#define LAYER_BASE 0 // clock, day, date - redrawn when the minute or date changes
+#define LAYER_HINT 10 // authentication hint
+#define LAYER_AUTH 20 // name of the authenticated person, covers a hint
+#define LAYER_ALERT 30 // spoofing attempt, blended over the panel
+#define LAYER_SPRITE 40 // door-open animation
+#define ALERT_OPACITY 144 // 0..255, how strongly the alert tints the layers beneath
+#define ALERT_TEXT "SPOOF"
+
+void format_clock_lines(time_t now, char text[BASE_LINES][DISPLAY_LINE_CHARS])
+{
+    struct tm local;
+    localtime_r(&now, &local); // one conversion per tick instead of three std::localtime calls
+    strftime(text[0], DISPLAY_LINE_CHARS, "%H:%M", &local);
+    strftime(text[1], DISPLAY_LINE_CHARS, DAY_FORMAT_STRING, &local);
+    strftime(text[2], DISPLAY_LINE_CHARS, DATE_FORMAT_STRING, &local);
+}
+
+LedDisplay::LedDisplay(const ConfigChannel& config, StateChannel<DisplayState>& display_state, PanelPower& panel_power,
+                       StatusNames hint_names)
+    : app_config(config), display_state(display_state), panel_power(panel_power), hint_names(hint_names)
+{
+}
+
+LedDisplay::~LedDisplay()
+{
+    stop();
+}
+
+/**
+ * @brief creates animation player and marquees, loads the sprite sheet
+ */
+void LedDisplay::create_animation(const AnimationConfig& config)
+{
+    animation = std::make_unique<AnimationPlayer>(config);
+    hint_marquee = std::make_unique<Marquee>(animation->settings().marquee_speed);
+    auth_marquee = std::make_unique<Marquee>(animation->settings().marquee_speed);
+    if (!animation->load_sprite_sheet())
+        std::cerr << "continuing without door-open animation" << std::endl;
+}
+
+/**
+ * @brief takes over display settings of a reloaded config.toml
+ *
+ * Colors, brightness and idle levels apply to the next frame: every layer
+ * is redrawn and all rows are combined once. Animation player and
+ * marquees are only rebuilt if [animation] changed.
+ */
+void LedDisplay::apply_display_config(int64_t now_us)
+{
+    std::shared_ptr<const AppConfig> next = app_config.get();
+    ConfigDelta delta = diff_config(*display_config, *next);
+    if (!delta.display) {
+        display_config = next;
+        return;
+    }
+    const DisplayConfig& display = next->display;
+    display_config = next;
+    full_brightness = (uint8_t)display.brightness;
+    panel_power.retune(display.power);
+    if (panel_power.level() == PanelLevel::Full)
+        set_quality(full_brightness, full_pwm_bits);
+    else if (panel_power.level() == PanelLevel::Idle)
+        set_quality((uint8_t)display.power.idle_brightness, (uint8_t)display.power.idle_pwm_bits);
+    if (delta.animation) {
+        sprite_layer->clear();
+        sprite_layer->hide();
+        create_animation(display.animation);
+    }
+    compositor->set_background(display.bg_color);
+    base_valid = false; // clock, date and day in the new colors
+    update_overlays(display_state.read(), now_us, true);
+    LOG_INFO(LogModule::Config, "display settings applied%s", delta.animation ? ", animation rebuilt" : "");
+}
+
+/**
+ * @brief redraws the lines of the base layer whose text changed, once a minute at most
+ */
+void LedDisplay::update_base_layer()
+{
+    const GlyphAtlas* const fonts[BASE_LINES] = { &font_time, &font_day, &font_date };
+    static const int baselines[BASE_LINES] = { LINE_OFFSET_1, LINE_OFFSET_2, LINE_OFFSET_3 };
+    const DisplayConfig& display = display_config->display;
+    const Rgb colors[BASE_LINES] = { display.clock_color, display.day_color, display.date_color };
+    char text[BASE_LINES][DISPLAY_LINE_CHARS];
+    format_clock_lines(time(nullptr), text);
+    bool redraw[BASE_LINES];
+    for (int line = 0; line < BASE_LINES; line++)
+        redraw[line] = !base_valid || strcmp(base_text[line], text[line]) != 0;
+    add_overlapping_lines(redraw); // clearing a line erases overlapping neighbours, redraw them too
+    for (int line = 0; line < BASE_LINES; line++) {
+        if (redraw[line])
+            base_layer->clear_rows(line_top[line], line_bottom[line]);
+    }
+    for (int line = 0; line < BASE_LINES; line++) {
+        if (!redraw[line])
+            continue;
+        base_layer->draw_text(*fonts[line], 0, baselines[line], colors[line], text[line]);
+        memcpy(base_text[line], text[line], DISPLAY_LINE_CHARS);
+        lines_drawn.fetch_add(1, std::memory_order_relaxed);
+    }
+    base_valid = true;
+}
+
+/**
+ * @brief draws text on the last line of an overlay layer, as marquee if it is too wide
+ */
+void LedDisplay::draw_overlay_line(Layer& layer, Marquee& marquee, const char* text, int64_t now_us)
+{
+    const DisplayConfig& display = display_config->display;
+    layer.fill_rows(line_top[3], line_bottom[3], display.bg_color); // covers the layers beneath
+    if (!marquee.set_text(font_name, text, frame.width, LINE_OFFSET_4, line_top[3], line_bottom[3],
+                          display.username_color, display.bg_color, now_us))
+        layer.draw_text(font_name, 0, LINE_OFFSET_4, display.username_color, text);
+    lines_drawn.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief redraws and shows the overlays whose part of the display state changed
+ *
+ * With restyle, every overlay still showing is redrawn, e.g. in new colors.
+ * Overlays hide themselves when their time is up, the compositor then uncovers
+ * the layers beneath without redrawing them.
+ */
+void LedDisplay::update_overlays(const DisplayState& state, int64_t now_us, bool restyle)
+{
+    const bool user_changed = state.user_until_us != shown_state.user_until_us;
+    if ((user_changed || restyle) && now_us < state.user_until_us && state.user[0] != '\0') {
+        draw_overlay_line(*auth_layer, *auth_marquee, state.user, now_us);
+        auth_layer->show(state.user_until_us);
+        if (user_changed) {
+            animation->play_sprite(now_us); // door opened
+            if (animation->active(now_us))
+                sprite_layer->show(animation->end_us());
+        }
+    }
+    if ((state.hint_until_us != shown_state.hint_until_us || restyle) && now_us < state.hint_until_us) {
+        draw_overlay_line(*hint_layer, *hint_marquee, hint_names(state.hint), now_us);
+        hint_layer->show(state.hint_until_us);
+    }
+    if ((state.alert_until_us != shown_state.alert_until_us || restyle) && now_us < state.alert_until_us) {
+        alert_layer->fill_rows(0, frame.height, display_config->display.alert_color);
+        alert_layer->draw_text(font_name, 0, LINE_OFFSET_4, Rgb{ 255, 255, 255 }, ALERT_TEXT);
+        alert_layer->show(state.alert_until_us);
+    }
+    /* be creative and add more layers here - scroll stock prices or display weather forecast */
+    shown_state = state;
+}
+
+/**
+ * @brief draws the current frame of the sprite and of scrolling overlays into their layers
+ * @return false if nothing moves
+ */
+bool LedDisplay::update_animations(int64_t now_us)
+{
+    bool moving = false;
+    if (animation->active(now_us)) {
+        const AnimationConfig& settings = animation->settings();
+        const int top = settings.sprite_y, bottom = settings.sprite_y + settings.sprite_frame_height;
+        sprite_layer->clear_rows(top, bottom);
+        animation->draw(sprite_layer->canvas(), now_us);
+        sprite_layer->mark_dirty(top, bottom);
+        moving = true;
+    }
+    // a hint marquee scrolls only while no name covers it
+    Layer* line_layer = auth_layer->visible(now_us) ? auth_layer : hint_layer->visible(now_us) ? hint_layer : nullptr;
+    Marquee* marquee = line_layer == auth_layer ? auth_marquee.get() : hint_marquee.get();
+    if (line_layer != nullptr && marquee->scrolling()) {
+        marquee->draw(line_layer->canvas(), now_us);
+        line_layer->mark_dirty(marquee->top(), marquee->bottom());
+        moving = true;
+    }
+    return moving;
+}
+
+/**
+ * @brief marks every line whose pixel rows overlap a dirty line as dirty as well
+ */
+void LedDisplay::add_overlapping_lines(bool dirty[BASE_LINES])
+{
+    for (int line = 0; line < BASE_LINES; line++) {
+        for (int other = 0; other < BASE_LINES && dirty[line]; other++) {
+            if (other != line && line_top[other] < line_bottom[line] && line_top[line] < line_bottom[other])
+                dirty[other] = true;
+        }
+    }
+}
+
+/**
+ * @brief pixel rows of every line, from font height and baseline
+ */
+void LedDisplay::compute_line_rows()
+{
+    const GlyphAtlas* fonts[DISPLAY_LINES] = { &font_time, &font_day, &font_date, &font_name };
+    const int baselines[DISPLAY_LINES] = { LINE_OFFSET_1, LINE_OFFSET_2, LINE_OFFSET_3, LINE_OFFSET_4 };
+    for (int line = 0; line < DISPLAY_LINES; line++) {
+        line_top[line] = std::max(baselines[line] - fonts[line]->baseline(), 0);
+        line_bottom[line] = std::min(baselines[line] - fonts[line]->baseline() + fonts[line]->height(), panel->height());
+    }
+}
+
+/**
+ * @brief sets brightness and PWM bits of the panel; brightness applies to pixels set afterwards
+ */
+void LedDisplay::set_quality(uint8_t brightness, uint8_t pwm_bits)
+{
+    panel->set_quality(brightness, pwm_bits);
+}
+
+/**
+ * @brief switches the panel to the power level wanted by panel_power
+ * @return true if the level changed; the frame has to be copied completely then
+ */
+bool LedDisplay::apply_power_level(int64_t now_us)
+{
+    const PanelLevel wanted = panel_power.wanted(now_us);
+    if (wanted == panel_power.level())
+        return false;
+    const PanelPowerConfig& config = panel_power.config();
+    switch (wanted) {
+    case PanelLevel::Full:
+        set_quality(full_brightness, full_pwm_bits);
+        break;
+    case PanelLevel::Idle:
+        set_quality((uint8_t)config.idle_brightness, (uint8_t)config.idle_pwm_bits);
+        break;
+    case PanelLevel::Blank:
+        panel->clear();
+        panel->swap();
+        set_quality(full_brightness, 1); // single bit plane, shortest refresh cycle
+        animation->pacer().pause();
+        break;
+    }
+    panel_power.set_level(wanted, now_us, process_cpu_us());
+    return true;
+}
+
+/**
+ * @brief earlier of two deadlines, 0 = none
+ */
+static int64_t earliest(int64_t a_us, int64_t b_us)
+{
+    return a_us == 0 ? b_us : b_us == 0 ? a_us : std::min(a_us, b_us);
+}
+
+// render_clock is invoked on the display_scheduler thread: on minute boundaries, on
+// authentication results, hints and alerts, and when an overlay expires (returned deadline).
+// Every layer is drawn only when its content changes: the base layer when a line of the
+// clock changes, an overlay when its part of the display state changes. The compositor then
+// combines the rows dirty in any visible layer into frame in a single pass; the offscreen
+// buffer of the panel holds the frame before the one shown, so these rows plus the rows of
+// the previous frame are copied to it. An unchanged frame is not swapped at all.
+// While an animation plays, its layer is redrawn every frame and the swap is paced by the
+// vsync divider of the FramePacer; the returned deadline is then the current time, so the
+// scheduler renders the next frame right away.
+// When nobody was at the door for a while, the panel drops to the idle or blank level of
+// panel_power; a presence trigger notifies the scheduler, and the frame rendered for it is
+// copied completely at full quality.
+int64_t LedDisplay::render_clock(int64_t now_us)
+{
+    if (first_run) {
+        first_run = false;
+        pid_t tid = syscall(SYS_gettid);
+        LOG_INFO(LogModule::Display, "process id: %d, task_function process id: %d", (int)getpid(), (int)tid);
+    }
+    if (app_config.generation() != config_generation) { // config.toml was reloaded
+        config_generation = app_config.generation();
+        apply_display_config(now_us);
+    }
+    const bool level_changed = apply_power_level(now_us);
+    const PanelLevel level = panel_power.level();
+    if (level == PanelLevel::Blank) {
+        frames_skipped.fetch_add(1, std::memory_order_relaxed); // layers catch up when the panel wakes
+        return 0; // woken by presence
+    }
+    const DisplayState state = display_state.read(); // wait-free, consistent snapshot
+    int64_t cpu_start_us = thread_cpu_us();
+    int64_t render_start_us = monotonic_us();
+    update_base_layer();
+    update_overlays(state, now_us);
+    const bool animating = update_animations(now_us);
+    int top, bottom;
+    if (!compositor->compose(frame, now_us, top, bottom) && !level_changed) {
+        frames_skipped.fetch_add(1, std::memory_order_relaxed); // identical frame, nothing to copy or swap
+        animation->pacer().pause();
+        return earliest(compositor->next_expiry(now_us), panel_power.next_change_us(now_us));
+    }
+    if (level_changed) { // pixels of both buffers were set at another brightness or blanked
+        top = 0;
+        bottom = frame.height;
+    }
+    panel->set_rows(frame, std::min(top, stale_top), std::max(bottom, stale_bottom));
+    stale_top = top; // rows the shown frame has and offscreen lacks after the swap
+    stale_bottom = bottom;
+    frames_rendered.fetch_add(1, std::memory_order_relaxed);
+    Metrics::observe(MetricHistogram::RenderFrame, monotonic_us() - render_start_us);
+    if (!animating) {
+        panel->swap(); // swap double buffer at the next vsync
+        animation->pacer().pause();
+        if (level_changed && level == PanelLevel::Full)
+            panel_power.woke(monotonic_us());
+        return earliest(compositor->next_expiry(now_us), panel_power.next_change_us(now_us));
+    }
+    int64_t cpu_us = thread_cpu_us() - cpu_start_us;
+    panel->swap(animation->pacer().vsync_fraction());
+    animation->pacer().frame_done(cpu_us, monotonic_us());
+    if (level_changed && level == PanelLevel::Full)
+        panel_power.woke(monotonic_us());
+    frames_animated.fetch_add(1, std::memory_order_relaxed);
+    return now_us;
+} // render_clock
+
+bool LedDisplay::prepare(std::unique_ptr<LedPanel> led_panel)
+{
+    if (running)
+        return false;
+    panel = std::move(led_panel);
+    config_generation = app_config.generation(); // a reload from now on is taken over by render_clock
+    display_config = app_config.get();
+    const DisplayConfig& display = display_config->display;
+    if (!font_date.load_bdf(embedded_font(FONT_DATE)) || !font_time.load_bdf(embedded_font(FONT_TIME)) // parse embedded BDF fonts once into glyph atlases
+        || !font_day.load_bdf(embedded_font(FONT_DAY)) || !font_name.load_bdf(embedded_font(FONT_NAME))) {
+        std::cerr << "Couldn't load embedded fonts" << std::endl;
+        return false;
+    }
+    full_brightness = (uint8_t)display.brightness;
+    full_pwm_bits = (uint8_t)panel->pwm_bits();
+    frame.resize(panel->width(), panel->height()); // 32x64 if rotated by 90 or 270 degrees
+    stale_top = frame.height;
+    stale_bottom = 0;
+    compute_line_rows();
+    panel_power.configure(display.power, monotonic_us(), process_cpu_us()); // inactivity counts from now
+    compositor = std::make_unique<Compositor>(frame.width, frame.height, display.bg_color);
+    base_layer = &compositor->add_layer(LAYER_BASE);
+    base_layer->show();
+    hint_layer = &compositor->add_layer(LAYER_HINT);
+    auth_layer = &compositor->add_layer(LAYER_AUTH);
+    alert_layer = &compositor->add_layer(LAYER_ALERT, ALERT_OPACITY);
+    sprite_layer = &compositor->add_layer(LAYER_SPRITE);
+    create_animation(display.animation);
+    return true;
+}
+
+bool LedDisplay::start(std::unique_ptr<LedPanel> led_panel)
+{
+    if (running)
+        return true;
+    if (!prepare(std::move(led_panel)))
+        return false;
+    // thread sleeps until the next minute, an authentication event or an overlay deadline
+    scheduler = std::make_unique<DisplayScheduler>([this](int64_t now_us) { return render_clock(now_us); });
+    if (!scheduler->start()) {
+        std::cerr << "Failed to start display scheduler" << std::endl;
+        return false;
+    }
+    running = true;
+    std::cout << "display thread task_function started (minute aligned, event driven)" << std::endl;
+    return true;
+}
+
+std::unique_ptr<LedPanel> LedDisplay::stop()
+{
+    if (running) {
+        running = false;
+        scheduler->stop(); // notify() stays safe for late callbacks
+        std::cout << "display thread task_function stopped" << std::endl;
+        print_render_stats();
+        const FramePacer& pacer = animation->pacer(); // render thread has ended, safe to read
+        if (pacer.frames() > 0)
+            std::cout << "animation frames: " << pacer.frames() << ", fps: " << pacer.effective_fps()
+                      << ", jitter: " << pacer.jitter_us() / 1000.0 << " ms, max interval: " << pacer.max_interval_us() / 1000.0
+                      << " ms, cost: " << pacer.mean_cost_us() << " us, vsync: " << pacer.vsync_period_us() / 1000.0 << " ms" << std::endl;
+    }
+    return std::move(panel);
+}
+
+void LedDisplay::write_metrics(std::ostream& os) const
+{
+    write_counter(os, "smartdoor_frames_rendered_total", "LED matrix frames drawn", frames_rendered.load(std::memory_order_relaxed));
+    write_counter(os, "smartdoor_frames_skipped_total", "LED matrix frames skipped as unchanged or blank", frames_skipped.load(std::memory_order_relaxed));
+    write_counter(os, "smartdoor_panel_wakeups_total", "LED matrix panel woken from idle or blank by presence", panel_power.wakeups());
+    write_gauge(os, "smartdoor_panel_level", "LED matrix panel level: 0 full, 1 idle, 2 blank", (int)panel_power.level());
+}
+
+void LedDisplay::print_render_stats() const
+{
+    std::cout << "matrix frames rendered: " << frames_rendered.load(std::memory_order_relaxed)
+              << ", skipped: " << frames_skipped.load(std::memory_order_relaxed)
+              << ", lines drawn: " << lines_drawn.load(std::memory_order_relaxed)
+              << ", animated: " << frames_animated.load(std::memory_order_relaxed) << std::endl;
+    if (compositor)
+        std::cout << "compositor rows combined: " << compositor->rows_composed() << std::endl;
+    const int64_t now_us = monotonic_us(), cpu_us = process_cpu_us();
+    static const char* const level_names[] = { "full", "idle", "blank" };
+    for (PanelLevel level : { PanelLevel::Full, PanelLevel::Idle, PanelLevel::Blank })
+        std::cout << "panel " << level_names[(int)level] << ": entered " << panel_power.entries(level)
+                  << "x, " << panel_power.seconds(level, now_us) << " s, process cpu "
+                  << panel_power.cpu_percent(level, now_us, cpu_us) << "%" << std::endl;
+    std::cout << "panel wakeups: " << panel_power.wakeups() << ", max presence-to-full-frame: "
+              << panel_power.max_wake_latency_us() / 1000.0 << " ms" << std::endl;
+    if (scheduler)
+        std::cout << "display wakeups minute: " << scheduler->minute_wakeups()
+                  << ", event: " << scheduler->event_wakeups()
+                  << ", deadline: " << scheduler->deadline_wakeups()
+                  << ", max event-to-pixel: " << scheduler->max_event_latency_us() / 1000.0 << " ms" << std::endl;
+}
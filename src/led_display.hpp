@@ -0,0 +1,144 @@
+/**
+ * @file led_display.hpp
+ * @brief Clock, date, names, hints and alerts on the LED matrix, drawn through a LedPanel
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * LedDisplay renders the display state on the display_scheduler thread: on
+ * minute boundaries, on authentication results, hints and alerts, and when an
+ * overlay expires. The daemon draws through RgbMatrixPanel, the replay
+ * simulator through MemoryPanel - same layers, same timing, same counters.
+ *
+ * Features:
+ * - Real-time display of clock, date and day of week
+ * - Display of authenticated user names, authentication hints and spoof alerts for a fixed time
+ * - Layered composition: clock, date and day on a cached base layer, overlays with
+ *   priorities, timeouts and blending on top (see compositor.hpp)
+ * - Double buffering for smooth display updates
+ * - Idle power levels: reduced brightness and PWM bits or a blank panel when
+ *   nobody was at the door for a while, full quality again on presence (see panel_power.hpp)
+ * - Configurable colors for different display elements, taken over on reload of config.toml
+ *
+ * Example usage:
+ * @code
+ * LedDisplay display(app_config, display_state, panel_power, auth_status_name);
+ * display.start(std::move(panel)); // renders on minute boundaries and on notify()
+ * display.notify();                // from the authentication callback
+ * display.stop();
+ * @endcode
+ *
+ * The header has no hardware dependencies.
+ */
+#pragma once
+#include "animation.hpp"
+#include "app_config.hpp"
+#include "compositor.hpp"
+#include "display_scheduler.hpp"
+#include "display_state.hpp"
+#include "glyph_atlas.hpp"
+#include "hal.hpp"
+#include "panel_power.hpp"
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <ostream>
+
+#define DISPLAY_LINES 4 // time, day, date, name of authenticated person
+#define BASE_LINES 3 // time, day, date on the base layer; the last line belongs to the overlays
+#define DISPLAY_LINE_CHARS DISPLAY_USER_BYTES // buffer per line incl. terminating zero, enough for UTF-8 day and user names
+
+/**
+ * @class LedDisplay
+ * @brief Renders the display state into a LedPanel on a scheduler thread
+ */
+class LedDisplay {
+public:
+    /**
+     * @param hint_names names the hints of the display state, e.g. RealSenseID::Description
+     */
+    LedDisplay(const ConfigChannel& config, StateChannel<DisplayState>& display_state, PanelPower& panel_power,
+               StatusNames hint_names);
+    ~LedDisplay();
+    LedDisplay(const LedDisplay&) = delete;
+    LedDisplay& operator=(const LedDisplay&) = delete;
+
+    /**
+     * @brief loads fonts, sets up the layers and starts the scheduler thread, which renders at once
+     * @return false if the embedded fonts are missing or the scheduler could not be started
+     */
+    bool start(std::unique_ptr<LedPanel> led_panel);
+    /**
+     * @brief loads fonts and sets up the layers without a thread; start() does this first
+     * @return false if the embedded fonts are missing
+     */
+    bool prepare(std::unique_ptr<LedPanel> led_panel);
+    /**
+     * @brief renders one frame; runs on the scheduler thread after start(), called
+     * directly only after prepare() alone, e.g. by smartdoorF455_bench
+     * @return next deadline, see DisplayScheduler
+     */
+    int64_t render_clock(int64_t now_us);
+    /**
+     * @brief stops the thread and prints render statistics
+     * @return the panel, nullptr if not started; an RgbMatrixPanel clears the LEDs when destroyed
+     */
+    std::unique_ptr<LedPanel> stop();
+
+    /** renders now instead of at the next minute; any thread, also before start() and after stop() */
+    void notify() {
+        if (scheduler)
+            scheduler->notify();
+    }
+
+    /** writes frame and panel counters for the metrics endpoint */
+    void write_metrics(std::ostream& os) const;
+    /** prints how many frames were drawn and how many were skipped as unchanged */
+    void print_render_stats() const;
+
+    uint64_t rendered_count() const { return frames_rendered.load(std::memory_order_relaxed); }
+    uint64_t skipped_count() const { return frames_skipped.load(std::memory_order_relaxed); }
+
+private:
+    const ConfigChannel& app_config;
+    StateChannel<DisplayState>& display_state;
+    PanelPower& panel_power;
+    StatusNames hint_names;
+    bool running = false;
+    std::unique_ptr<LedPanel> panel;
+    std::unique_ptr<DisplayScheduler> scheduler;
+    std::shared_ptr<const AppConfig> display_config; // snapshot the display is drawn with
+    uint64_t config_generation = 0; // of app_config when display_config was taken
+    GlyphAtlas font_time, font_date, font_day, font_name;
+    Framebuffer frame; // output of the compositor, rows copied to the panel
+    std::unique_ptr<Compositor> compositor;
+    Layer *base_layer = nullptr, *hint_layer = nullptr, *auth_layer = nullptr, *alert_layer = nullptr,
+          *sprite_layer = nullptr; // owned by compositor
+    std::unique_ptr<Marquee> hint_marquee, auth_marquee; // hints and names too wide for the panel
+    std::unique_ptr<AnimationPlayer> animation;
+    char base_text[BASE_LINES][DISPLAY_LINE_CHARS] = {}; // drawn into base_layer
+    bool base_valid = false; // false until base_layer was drawn once
+    DisplayState shown_state; // state the overlays were drawn for
+    int stale_top = 0, stale_bottom = 0; // rows of the shown frame not yet copied to offscreen, bottom exclusive
+    uint8_t full_brightness = 100, full_pwm_bits = 11; // configured quality, restored on presence
+    int line_top[DISPLAY_LINES] = {}, line_bottom[DISPLAY_LINES] = {}; // pixel rows covered by a line, bottom exclusive
+    bool first_run = true;
+    std::atomic<uint64_t> frames_rendered{0}, frames_skipped{0}, lines_drawn{0}, frames_animated{0};
+
+    void create_animation(const AnimationConfig& config);
+    void apply_display_config(int64_t now_us);
+    void update_base_layer();
+    void draw_overlay_line(Layer& layer, Marquee& marquee, const char* text, int64_t now_us);
+    void update_overlays(const DisplayState& state, int64_t now_us, bool restyle = false);
+    bool update_animations(int64_t now_us);
+    void add_overlapping_lines(bool dirty[BASE_LINES]);
+    void compute_line_rows();
+    void set_quality(uint8_t brightness, uint8_t pwm_bits);
+    bool apply_power_level(int64_t now_us);
+};
+
+/**
+ * @brief formats time, day and date of the clock lines for local time now
+ */
+void format_clock_lines(time_t now, char text[BASE_LINES][DISPLAY_LINE_CHARS]);
@@ -0,0 +1,291 @@
+/**
+ * @file metrics.cpp
+ * @brief Prometheus text metrics: per-thread counter shards and a local scrape endpoint
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ */
+#include "metrics.hpp"
+#include "thread_placement.hpp"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sstream>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define METRICS_REQUEST_BYTES 2048 // request line and headers of a scrape, the rest is ignored
+#define METRICS_IO_TIMEOUT_SEC 2   // a stalled client does not block the next scrape longer
+
+Metrics::Shard* Metrics::all_shards()
+{
+    static Shard shards[MAX_THREADS];
+    return shards;
+}
+
+Metrics::Shard* Metrics::claim_shard()
+{
+    for (int index = 0; index < MAX_THREADS; index++) {
+        bool expected = false;
+        if (!claimed[index].compare_exchange_strong(expected, true, std::memory_order_acquire))
+            continue;
+        int used = shards_used.load(std::memory_order_relaxed);
+        while (used <= index && !shards_used.compare_exchange_weak(used, index + 1, std::memory_order_acq_rel))
+            ;
+        return &all_shards()[index];
+    }
+    lost.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+}
+
+void Metrics::release_shard(Shard* shard)
+{
+    if (shard) // counts stay in the shard, the next thread adds to them
+        claimed[shard - all_shards()].store(false, std::memory_order_release);
+}
+
+int Metrics::bucket_of(int64_t duration_us)
+{
+    int bucket = 0;
+    for (int64_t bound = FIRST_BUCKET_US; bucket < HISTOGRAM_BUCKETS && duration_us > bound; bound <<= 1)
+        bucket++;
+    return bucket;
+}
+
+/**
+ * @brief us as seconds with all digits, the default precision of a stream would round large sums
+ */
+static std::string seconds(uint64_t us)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%llu.%06llu", (unsigned long long)(us / 1000000), (unsigned long long)(us % 1000000));
+    return text;
+}
+
+void write_counter(std::ostream& os, const char* name, const char* help, uint64_t value)
+{
+    os << "# HELP " << name << " " << help << "\n# TYPE " << name << " counter\n" << name << " " << value << "\n";
+}
+
+void write_gauge(std::ostream& os, const char* name, const char* help, double value)
+{
+    os << "# HELP " << name << " " << help << "\n# TYPE " << name << " gauge\n" << name << " " << value << "\n";
+}
+
+void Metrics::write_text(std::ostream& os)
+{
+    static const char* const counter_names[(int)MetricCounter::COUNT][2] = {
+        { "smartdoor_faces_detected_total", "faces reported by the F455 during authentication" },
+        { "smartdoor_auth_hints_total", "authentication hints reported by the F455" },
+        { "smartdoor_auth_spoofs_total", "authentications rejected as spoofing attempt" } };
+    static const char* const histogram_names[(int)MetricHistogram::COUNT][2] = {
+        { "smartdoor_auth_duration_seconds", "duration of an authentication on the F455" },
+        { "smartdoor_render_frame_seconds", "LED matrix frame from layer update to copied rows, without vsync" },
+        { "smartdoor_snapshot_capture_seconds", "snapshot taken from the frame ring and encoded as jpeg" } };
+
+    uint64_t counters[(int)MetricCounter::COUNT] = {};
+    uint64_t auth_status[STATUS_SLOTS] = {};
+    uint64_t buckets[(int)MetricHistogram::COUNT][HISTOGRAM_BUCKETS + 1] = {};
+    uint64_t sums_us[(int)MetricHistogram::COUNT] = {};
+    int shards = std::min(shards_used.load(std::memory_order_acquire), MAX_THREADS);
+    for (int t = 0; t < shards; t++) {
+        const Shard& shard = all_shards()[t];
+        for (int c = 0; c < (int)MetricCounter::COUNT; c++)
+            counters[c] += shard.counters[c].load(std::memory_order_relaxed);
+        for (int s = 0; s < STATUS_SLOTS; s++)
+            auth_status[s] += shard.auth_status[s].load(std::memory_order_relaxed);
+        for (int h = 0; h < (int)MetricHistogram::COUNT; h++) {
+            for (int b = 0; b <= HISTOGRAM_BUCKETS; b++)
+                buckets[h][b] += shard.histograms[h].buckets[b].load(std::memory_order_relaxed);
+            sums_us[h] += shard.histograms[h].sum_us.load(std::memory_order_relaxed);
+        }
+    }
+
+    for (int c = 0; c < (int)MetricCounter::COUNT; c++)
+        write_counter(os, counter_names[c][0], counter_names[c][1], counters[c]);
+
+    os << "# HELP smartdoor_auth_results_total authentication results by RealSenseID::AuthenticateStatus\n"
+          "# TYPE smartdoor_auth_results_total counter\n";
+    for (int s = 0; s < STATUS_SLOTS; s++) {
+        if (auth_status[s] == 0)
+            continue;
+        os << "smartdoor_auth_results_total{status=\"";
+        if (status_name)
+            os << status_name(s);
+        else
+            os << s;
+        os << "\"} " << auth_status[s] << "\n";
+    }
+    int64_t last_auth = last_auth_us.load(std::memory_order_relaxed);
+    if (last_auth != 0)
+        write_gauge(os, "smartdoor_last_auth_age_seconds", "time since the last authentication result",
+                    (monotonic_us() - last_auth) / 1e6);
+
+    for (int h = 0; h < (int)MetricHistogram::COUNT; h++) {
+        const char* name = histogram_names[h][0];
+        os << "# HELP " << name << " " << histogram_names[h][1] << "\n# TYPE " << name << " histogram\n";
+        uint64_t cumulative = 0;
+        int64_t bound_us = FIRST_BUCKET_US;
+        for (int b = 0; b < HISTOGRAM_BUCKETS; b++, bound_us <<= 1) {
+            cumulative += buckets[h][b];
+            os << name << "_bucket{le=\"" << bound_us / 1e6 << "\"} " << cumulative << "\n";
+        }
+        cumulative += buckets[h][HISTOGRAM_BUCKETS];
+        os << name << "_bucket{le=\"+Inf\"} " << cumulative << "\n"
+           << name << "_sum " << seconds(sums_us[h]) << "\n"
+           << name << "_count " << cumulative << "\n";
+    }
+    uint64_t lost_threads = lost.load(std::memory_order_relaxed);
+    if (lost_threads)
+        write_counter(os, "smartdoor_metrics_threads_lost", "threads not counted, more than Metrics::MAX_THREADS at once", lost_threads);
+}
+
+MetricsServer::MetricsServer(const MetricsConfig& config, Collector collector)
+    : config(config), collector(std::move(collector))
+{
+}
+
+MetricsServer::~MetricsServer()
+{
+    stop();
+}
+
+bool MetricsServer::start()
+{
+    const std::string& listen_on = config.listen;
+    if (listen_on.compare(0, 5, "unix:") == 0) {
+        std::string path = listen_on.substr(5);
+        struct sockaddr_un address = {};
+        if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+            std::cerr << "metrics: invalid socket path " << path << std::endl;
+            return false;
+        }
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+        unlink(path.c_str()); // left over from a previous run
+        listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0 || bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+            std::cerr << "metrics: cannot bind " << listen_on << " (" << strerror(errno) << ")" << std::endl;
+            stop();
+            return false;
+        }
+    }
+    else {
+        size_t colon = listen_on.rfind(':');
+        std::string host = colon == std::string::npos || colon == 0 ? "127.0.0.1" : listen_on.substr(0, colon);
+        struct sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        int port = colon == std::string::npos ? 0 : atoi(listen_on.c_str() + colon + 1);
+        if (port <= 0 || port > 65535 || inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) {
+            std::cerr << "metrics: invalid address " << listen_on << ", expected host:port or unix:path" << std::endl;
+            return false;
+        }
+        address.sin_port = htons((uint16_t)port);
+        listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int reuse = 1;
+        if (listen_fd >= 0)
+            setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (listen_fd < 0 || bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+            std::cerr << "metrics: cannot bind " << listen_on << " (" << strerror(errno) << ")" << std::endl;
+            stop();
+            return false;
+        }
+    }
+    stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (listen(listen_fd, 4) < 0 || stop_fd < 0) {
+        std::cerr << "metrics: cannot listen on " << listen_on << " (" << strerror(errno) << ")" << std::endl;
+        stop();
+        return false;
+    }
+    server = std::thread(&MetricsServer::run, this);
+    std::cout << "metrics: serving /metrics on " << listen_on << std::endl;
+    return true;
+}
+
+void MetricsServer::stop()
+{
+    if (server.joinable()) {
+        uint64_t one = 1;
+        if (write(stop_fd, &one, sizeof(one)) < 0) // eventfd never blocks with a small count
+            std::cerr << "metrics: cannot wake server thread" << std::endl;
+        server.join();
+    }
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        if (config.listen.compare(0, 5, "unix:") == 0)
+            unlink(config.listen.c_str() + 5);
+    }
+    if (stop_fd >= 0)
+        close(stop_fd);
+    listen_fd = stop_fd = -1;
+}
+
+void MetricsServer::run()
+{
+    place_this_thread("metrics");
+    for (;;) {
+        struct pollfd fds[2] = { { listen_fd, POLLIN, 0 }, { stop_fd, POLLIN, 0 } };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents)
+            break;
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+            continue;
+        serve(fd);
+        close(fd);
+    }
+}
+
+/**
+ * @brief answers one HTTP request: the metrics for GET /metrics, 404 otherwise
+ */
+void MetricsServer::serve(int fd)
+{
+    struct timeval timeout = { METRICS_IO_TIMEOUT_SEC, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    char request[METRICS_REQUEST_BYTES];
+    size_t length = 0;
+    while (length < sizeof(request) - 1) { // until the end of the headers
+        ssize_t count = recv(fd, request + length, sizeof(request) - 1 - length, 0);
+        if (count <= 0)
+            break;
+        length += (size_t)count;
+        request[length] = '\0';
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+            break;
+    }
+    request[length] = '\0';
+    std::string response;
+    if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET / ", 6) == 0) {
+        std::ostringstream body;
+        Metrics::write_text(body);
+        if (collector)
+            collector(body);
+        write_counter(body, "smartdoor_metrics_scrapes_total", "scrapes of this endpoint", scrapes.fetch_add(1, std::memory_order_relaxed) + 1);
+        std::string text = body.str();
+        response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + std::to_string(text.size())
+                 + "\r\nConnection: close\r\n\r\n" + text;
+    }
+    else {
+        response = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    }
+    size_t done = 0;
+    while (done < response.size()) {
+        ssize_t count = send(fd, response.data() + done, response.size() - done, MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            break; // client gone or stalled
+        done += (size_t)count;
+    }
+}
@@ -0,0 +1,198 @@
+/**
+ * @file metrics.hpp
+ * @brief Prometheus text metrics: per-thread counter shards and a local scrape endpoint
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * Counters and histograms are kept in one shard per thread, like the span
+ * rings of LatencyTrace: a thread only writes its own shard, with a relaxed
+ * load and store - no locked instruction, no shared cache line, no lock.
+ * The shards are summed up only when the endpoint is scraped. A shard is
+ * returned to the pool when its thread exits and the next new thread adds
+ * to its counts, so only MAX_THREADS threads running at once are counted.
+ *
+ * Components that already count in atomics of their own (trigger gate,
+ * MQTT session, notification outbox, ...) are not counted twice; the
+ * collector function passed to MetricsServer writes them on scrape with
+ * write_counter() and write_gauge().
+ *
+ * MetricsServer answers GET /metrics on a local TCP port or a Unix socket
+ * from a thread of its own, one connection after the other:
+ * @code
+ * curl -s http://127.0.0.1:9455/metrics
+ * curl -s --unix-socket /run/user/1000/smartdoorF455.sock http://localhost/metrics
+ * @endcode
+ *
+ * Configured in section [metrics] of config.toml. The header has no
+ * hardware dependencies.
+ */
+#pragma once
+#include "latency_trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <thread>
+
+/**
+ * @brief counters of the shards
+ */
+enum class MetricCounter : int {
+    FacesDetected,  // faces reported by OnFaceDetected
+    AuthHints,      // hints reported by OnHint
+    AuthSpoofs,     // results Spoof, Spoof_2D, ... - also counted by status
+    COUNT
+};
+
+/**
+ * @brief histograms of the shards, durations in us
+ */
+enum class MetricHistogram : int {
+    AuthDuration,     // Authenticate / ExtractFaceprintsForAuth call
+    RenderFrame,      // LED matrix frame from layer update to copied rows, without waiting for vsync
+    SnapshotCapture,  // frame from the ring, rotated and encoded as jpeg
+    COUNT
+};
+
+/**
+ * @class Metrics
+ * @brief Per-thread shards of counters, authentication results and histograms
+ */
+class Metrics {
+public:
+    static constexpr int MAX_THREADS = 32;        // threads that may count
+    static constexpr int STATUS_SLOTS = 256;      // AuthenticateStatus values 0..255
+    static constexpr int HISTOGRAM_BUCKETS = 16;  // upper bounds 250 us * 2^k, k = 0..15 (8.2 s), plus +Inf
+    static constexpr int64_t FIRST_BUCKET_US = 250;
+
+    static void add(MetricCounter counter, uint64_t n = 1) {
+        if (Shard* shard = thread_shard())
+            bump(shard->counters[(int)counter], n);
+    }
+
+    /** counts an authentication result by its RealSenseID::AuthenticateStatus value */
+    static void count_auth_status(int status) {
+        if (Shard* shard = thread_shard())
+            bump(shard->auth_status[status & (STATUS_SLOTS - 1)], 1);
+        last_auth_us.store(monotonic_us(), std::memory_order_relaxed);
+    }
+
+    static void observe(MetricHistogram histogram, int64_t duration_us) {
+        Shard* shard = thread_shard();
+        if (!shard)
+            return;
+        Histogram& h = shard->histograms[(int)histogram];
+        bump(h.buckets[bucket_of(duration_us)], 1);
+        bump(h.sum_us, (uint64_t)std::max<int64_t>(duration_us, 0));
+    }
+
+    /**
+     * @brief names the values of count_auth_status() in the output, e.g. RealSenseID::Description
+     *
+     * Statuses are written as numbers without it.
+     */
+    static void set_status_names(const char* (*name)(int status)) { status_name = name; }
+
+    /** writes all shard metrics in Prometheus text format; any thread */
+    static void write_text(std::ostream& os);
+
+    /** bucket of duration_us, HISTOGRAM_BUCKETS for +Inf */
+    static int bucket_of(int64_t duration_us);
+
+private:
+    struct Histogram {
+        std::atomic<uint64_t> buckets[HISTOGRAM_BUCKETS + 1];
+        std::atomic<uint64_t> sum_us;
+    };
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> counters[(int)MetricCounter::COUNT];
+        std::atomic<uint64_t> auth_status[STATUS_SLOTS];
+        Histogram histograms[(int)MetricHistogram::COUNT];
+    };
+
+    static inline std::atomic<int> shards_used{0}; // highest shard claimed + 1
+    static inline std::atomic<bool> claimed[MAX_THREADS]{};
+    static inline std::atomic<uint64_t> lost{0};
+    static inline std::atomic<int64_t> last_auth_us{0};
+    static inline const char* (*status_name)(int) = nullptr;
+
+    /** single writer per shard: no read-modify-write needed */
+    static void bump(std::atomic<uint64_t>& value, uint64_t n) {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    /** statically allocated, zero-initialized shards of all threads */
+    static Shard* all_shards();
+
+    /** claims a free shard on first use of a thread, releases it at thread exit */
+    struct ShardLease {
+        Shard* shard = claim_shard();
+        ~ShardLease() { release_shard(shard); }
+    };
+
+    /** shard of the calling thread; nullptr while MAX_THREADS other threads hold one */
+    static Shard* thread_shard() {
+        thread_local ShardLease lease;
+        return lease.shard;
+    }
+    static Shard* claim_shard();
+    static void release_shard(Shard* shard);
+};
+
+/** writes "# HELP", "# TYPE" and the value of a counter */
+void write_counter(std::ostream& os, const char* name, const char* help, uint64_t value);
+/** writes "# HELP", "# TYPE" and the value of a gauge */
+void write_gauge(std::ostream& os, const char* name, const char* help, double value);
+
+/**
+ * @brief settings of section [metrics] in config.toml
+ */
+struct MetricsConfig {
+    std::string listen;  // "127.0.0.1:9455", "unix:/path/to.sock" or "" = no endpoint
+};
+
+/**
+ * @class MetricsServer
+ * @brief Answers scrapes of /metrics on a local TCP port or Unix socket
+ *
+ * Example usage:
+ * @code
+ * MetricsServer server(config, [](std::ostream& os) {
+ *     write_gauge(os, "smartdoor_outbox_depth", "notifications waiting", outbox->depth());
+ * });
+ * server.start();
+ * @endcode
+ */
+class MetricsServer {
+public:
+    /** writes the metrics of components that count on their own, called on the server thread */
+    using Collector = std::function<void(std::ostream& os)>;
+
+    MetricsServer(const MetricsConfig& config, Collector collector);
+    ~MetricsServer();
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    /**
+     * @brief binds the socket and starts the server thread
+     * @return false if the address is invalid or in use
+     */
+    bool start();
+    void stop();
+
+    uint64_t scrape_count() const { return scrapes.load(std::memory_order_relaxed); }
+
+private:
+    MetricsConfig config;
+    Collector collector;
+    int listen_fd = -1;
+    int stop_fd = -1;  // eventfd, wakes the server thread on stop()
+    std::thread server;
+    std::atomic<uint64_t> scrapes{0};
+
+    void run();
+    void serve(int fd);
+};
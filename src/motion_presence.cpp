@@ -0,0 +1,231 @@
+/**
+ * @file motion_presence.cpp
+ * @brief Camera based motion presence detector as alternative to the PIR/IR sensor
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ */
+#include "motion_presence.hpp"
+#include "async_log.hpp"
+#include "latency_trace.hpp" // monotonic_us(), thread_cpu_us(), TraceStage::MotionDetect
+#include "trigger_gate.hpp"  // EdgePolicy values equal INT_EDGE_RISING/FALLING
+#include "thread_placement.hpp"
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <time.h>
+
+#define CPU_WINDOW_USEC 1000000 // CPU budget is checked once per window
+
+size_t motion_diff_update(const uint8_t* __restrict frame, uint8_t* __restrict background, size_t pixels,
+                          uint8_t threshold, unsigned int learn_shift)
+{
+    const int round = 1 << (learn_shift - 1);
+    size_t changed = 0;
+    for (size_t i = 0; i < pixels; i++) { // no branches and no aliasing, so gcc/clang emit NEON/SSE2 code at -O3
+        int diff = (int)frame[i] - (int)background[i];
+        int magnitude = diff < 0 ? -diff : diff;
+        changed += magnitude > threshold;
+        background[i] = (uint8_t)((int)background[i] + ((diff + round) >> learn_shift));
+    }
+    return changed;
+}
+
+MotionPresence::MotionPresence(const MotionPresenceConfig& config, TriggerSink sink)
+    : config(config), sink(std::move(sink))
+{
+    this->config.learn_shift = std::min(std::max(this->config.learn_shift, 1u), 7u);
+    this->config.width = std::max(this->config.width, 16);
+    this->config.height = std::max(this->config.height, 16);
+    period_us.store((int64_t)(1e6 / std::max(this->config.fps, 0.1)), std::memory_order_relaxed);
+}
+
+MotionPresence::~MotionPresence()
+{
+    stop();
+}
+
+/**
+ * @brief opens V4L2 device (numeric source) or video file (any other source)
+ *
+ * A V4L2 device is asked for the analysed frame size and raw YUYV, so the
+ * luma plane can be used without colour conversion.
+ */
+bool MotionPresence::open_source()
+{
+    file_source = config.source.empty() || !std::all_of(config.source.begin(), config.source.end(), ::isdigit);
+    if (file_source) {
+        camera.open(config.source);
+    }
+    else {
+        camera.open(std::stoi(config.source), cv::CAP_V4L2);
+        camera.set(cv::CAP_PROP_FOURCC, cv::VideoWriter::fourcc('Y', 'U', 'Y', 'V'));
+        camera.set(cv::CAP_PROP_CONVERT_RGB, 0); // deliver YUYV as is, no BGR conversion
+        camera.set(cv::CAP_PROP_FRAME_WIDTH, config.width);
+        camera.set(cv::CAP_PROP_FRAME_HEIGHT, config.height);
+        camera.set(cv::CAP_PROP_FPS, config.fps);
+        camera.set(cv::CAP_PROP_BUFFERSIZE, 1); // keep driver queue short, frames must be fresh
+    }
+    return camera.isOpened();
+}
+
+bool MotionPresence::start()
+{
+    if (running)
+        return true;
+    if (!open_source()) {
+        std::cerr << "ERROR: Could not open motion source " << config.source << std::endl;
+        return false;
+    }
+    std::cout << "motion presence " << config.source << ": " << config.width << "x" << config.height
+              << " @ " << config.fps << " fps, cpu budget " << config.cpu_budget_percent << "%" << std::endl;
+    running = true;
+    capture_thread = std::thread(&MotionPresence::capture_loop, this);
+    return true;
+}
+
+void MotionPresence::stop()
+{
+    if (!running)
+        return;
+    running = false;
+    if (capture_thread.joinable())
+        capture_thread.join();
+    camera.release(); // Closes video file or capturing device
+}
+
+/**
+ * @brief capture thread - grabs continuously, decodes and analyses at the current frame period
+ *
+ * Like SnapshotCapture::capture_loop() a V4L2 device paces the loop itself and
+ * grab() without retrieve() drops stale driver buffers; a video file is paced
+ * by sleeping.
+ */
+void MotionPresence::capture_loop()
+{
+    place_this_thread("motion");
+    int64_t next_us = monotonic_us();
+    int64_t window_start_us = next_us;
+    int64_t window_cpu_start_us = thread_cpu_us();
+    while (running) {
+        if (file_source)
+            std::this_thread::sleep_for(std::chrono::microseconds(std::max<int64_t>(next_us - monotonic_us(), 0)));
+        if (!camera.grab()) {
+            if (file_source) { // loop video file
+                camera.set(cv::CAP_PROP_POS_FRAMES, 0);
+                continue;
+            }
+            LOG_WARN(LogModule::Motion, "grab failed, reopening %s", config.source.c_str());
+            camera.release();
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            open_source();
+            continue;
+        }
+        int64_t now = monotonic_us();
+        if (now >= next_us) {
+            next_us += period_us.load(std::memory_order_relaxed);
+            if (next_us < now) // we fell behind, don't try to catch up
+                next_us = now + period_us.load(std::memory_order_relaxed);
+            if (camera.retrieve(grabbed) && !grabbed.empty())
+                process(grabbed, now);
+        }
+        if (now - window_start_us >= CPU_WINDOW_USEC) {
+            int64_t cpu_now = thread_cpu_us();
+            enforce_cpu_budget(cpu_now - window_cpu_start_us, now - window_start_us);
+            window_start_us = now;
+            window_cpu_start_us = cpu_now;
+        }
+    }
+}
+
+/**
+ * @brief stretches or relaxes the frame period so CPU use stays below the budget
+ *
+ * @param cpu_us CPU time used by the capture thread within the window
+ * @param wall_us length of the window
+ */
+void MotionPresence::enforce_cpu_budget(int64_t cpu_us, int64_t wall_us)
+{
+    const double budget = std::max(config.cpu_budget_percent, 0.1);
+    const int64_t nominal_us = (int64_t)(1e6 / std::max(config.fps, 0.1));
+    double used = 100.0 * cpu_us / std::max<int64_t>(wall_us, 1);
+    last_cpu_percent.store(used, std::memory_order_relaxed);
+    int64_t period = period_us.load(std::memory_order_relaxed);
+    if (used > budget)
+        period = (int64_t)(period * used / budget); // analyse fewer frames
+    else if (used < budget / 2 && period > nominal_us)
+        period = std::max(nominal_us, period * 4 / 5); // slowly back to the configured rate
+    period_us.store(std::min<int64_t>(period, 4 * CPU_WINDOW_USEC), std::memory_order_relaxed);
+}
+
+bool MotionPresence::offer_frame(const cv::Mat& frame, int64_t grab_ts_us)
+{
+    if (offer_window_us == 0)
+        offer_window_us = grab_ts_us;
+    if (grab_ts_us < next_offer_us)
+        return false;
+    next_offer_us = std::max(next_offer_us + period_us.load(std::memory_order_relaxed), grab_ts_us);
+    int64_t cpu_start_us = thread_cpu_us();
+    bool triggered = process(frame, grab_ts_us);
+    offer_window_cpu_us += thread_cpu_us() - cpu_start_us;
+    if (grab_ts_us - offer_window_us >= CPU_WINDOW_USEC) {
+        enforce_cpu_budget(offer_window_cpu_us, grab_ts_us - offer_window_us);
+        offer_window_us = grab_ts_us;
+        offer_window_cpu_us = 0;
+    }
+    return triggered;
+}
+
+/**
+ * @brief converts a captured frame into the downscaled grayscale buffer gray
+ */
+void MotionPresence::to_gray(const cv::Mat& frame)
+{
+    const cv::Mat* src = &frame;
+    if (frame.type() == CV_8UC2) { // YUYV: luma is every other byte
+        cv::extractChannel(frame, luma, 0);
+        src = &luma;
+    }
+    else if (frame.type() == CV_8UC3) {
+        cv::cvtColor(frame, luma, cv::COLOR_BGR2GRAY);
+        src = &luma;
+    }
+    if (src->cols == config.width && src->rows == config.height)
+        src->copyTo(gray);
+    else
+        cv::resize(*src, gray, cv::Size(config.width, config.height), 0, 0, cv::INTER_AREA);
+}
+
+bool MotionPresence::process(const cv::Mat& frame, int64_t grab_ts_us)
+{
+    to_gray(frame);
+    if (!gray.isContinuous() || gray.type() != CV_8UC1)
+        return false;
+    processed.fetch_add(1, std::memory_order_relaxed);
+    if (!background_valid) {
+        gray.copyTo(background);
+        background_valid = true;
+        return false;
+    }
+    const size_t pixels = gray.total();
+    size_t changed = motion_diff_update(gray.ptr<uint8_t>(), background.ptr<uint8_t>(), pixels,
+                                        (uint8_t)std::min(config.threshold, 255u), config.learn_shift);
+    double changed_percent = 100.0 * changed / pixels;
+    last_changed_percent.store(changed_percent, std::memory_order_relaxed);
+    bool motion = changed_percent >= config.min_area_percent;
+    motion_run = motion ? motion_run + 1 : 0;
+    still_run = motion ? 0 : still_run + 1;
+    if (!in_motion && motion_run >= std::max(config.min_frames, 1u)) {
+        in_motion = true;
+        sink((int)EdgePolicy::Rising, 1); // same event as a rising edge of the presence sensor
+        triggers.fetch_add(1, std::memory_order_relaxed);
+        int64_t now = monotonic_us();
+        last_detect_us.store(now - grab_ts_us, std::memory_order_relaxed);
+        LatencyTrace::record(TraceStage::MotionDetect, grab_ts_us, now);
+        return true;
+    }
+    if (in_motion && still_run >= std::max(config.still_frames, 1u)) {
+        in_motion = false;
+        sink((int)EdgePolicy::Falling, 1);
+    }
+    return false;
+}
@@ -0,0 +1,154 @@
+/**
+ * @file motion_presence.hpp
+ * @brief Camera based motion presence detector as alternative to the PIR/IR sensor
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * Detects a person approaching the door on a downscaled grayscale stream of
+ * the F455 webcam (or a recorded video file) instead of an HC-SR501 or
+ * E18-D80NK sensor. Every frame is compared against a slowly adapting
+ * background model; if enough pixels differ for a few consecutive frames,
+ * a rising edge is posted into the trigger pipeline - the same trigger event
+ * presence_detected_clbk produces. A falling edge follows once the scene is
+ * still again.
+ *
+ * - frame differencing and background update run in one pass over 8-bit
+ *   pixels, written so the compiler vectorizes it (NEON on the Pi, SSE2 on x86)
+ * - the detector keeps its own CPU time below cpu_budget_percent of one core
+ *   by stretching the frame period when frames get expensive
+ * - if the webcam stream is already held open by SnapshotCapture, frames are
+ *   handed over from its capture thread instead of opening the device twice
+ *
+ * Selected with presence_sensor in section [raspi], tuned in section [motion]
+ * of config.toml.
+ */
+#pragma once
+#include <opencv2/opencv.hpp> // @see https://docs.opencv.org/4.x/
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+/**
+ * @brief settings of section [motion] in config.toml
+ */
+struct MotionPresenceConfig {
+    std::string source = "0";           // V4L2 device index or path to a video file
+    double fps = 10.0;                  // frames analysed per second
+    int width = 160;                    // analysed frame size, frames are downscaled to it
+    int height = 120;
+    unsigned int threshold = 25;        // gray level difference of a changed pixel
+    double min_area_percent = 2.0;      // changed pixels in percent of the frame to count as motion
+    unsigned int min_frames = 2;        // consecutive motion frames before the trigger is posted
+    unsigned int still_frames = 10;     // consecutive still frames before motion counts as ended
+    unsigned int learn_shift = 4;       // background adapts by 1/2^learn_shift of the difference per frame
+    double cpu_budget_percent = 5.0;    // upper bound of CPU time used, in percent of one core
+};
+
+/**
+ * @brief frame differencing against a background model in a single pass
+ *
+ * Counts pixels differing more than threshold from the background and moves
+ * the background towards the frame by difference >> learn_shift (rounded).
+ * Plain loop over uint8_t without branches, vectorized by the compiler.
+ *
+ * @param frame grayscale pixels of the current frame
+ * @param background grayscale background model, updated in place
+ * @param pixels number of pixels of both buffers
+ * @param threshold gray level difference of a changed pixel
+ * @param learn_shift adaption rate of the background, 1..7
+ * @return number of changed pixels
+ */
+size_t motion_diff_update(const uint8_t* __restrict frame, uint8_t* __restrict background, size_t pixels,
+                          uint8_t threshold, unsigned int learn_shift);
+
+/**
+ * @class MotionPresence
+ * @brief Motion detector posting presence triggers like the GPIO ISR
+ *
+ * Example usage:
+ * @code
+ * MotionPresence motion(config, [](int edge, int status) { trigger_pipeline.post_trigger(edge, status); });
+ * motion.start();                             // own capture thread
+ * // or, sharing the webcam stream of the snapshot capture thread:
+ * snapshot_capture->set_frame_observer([&](const cv::Mat& f, int64_t ts) { motion.offer_frame(f, ts); }, config.fps);
+ * motion.stop();
+ * @endcode
+ */
+class MotionPresence {
+public:
+    using TriggerSink = std::function<void(int edge, int status)>;
+
+    MotionPresence(const MotionPresenceConfig& config, TriggerSink sink);
+    ~MotionPresence();
+    MotionPresence(const MotionPresence&) = delete;
+    MotionPresence& operator=(const MotionPresence&) = delete;
+
+    /**
+     * @brief opens the source and starts the capture thread
+     * @return false if the source could not be opened
+     */
+    bool start();
+    void stop();
+
+    /**
+     * @brief analyses one frame; must always be called from the same thread
+     *
+     * Accepts BGR, YUYV (luma is used directly) or grayscale frames of any size.
+     * @param frame captured frame
+     * @param grab_ts_us monotonic timestamp the frame was grabbed at
+     * @return true if a rising edge was posted for this frame
+     */
+    bool process(const cv::Mat& frame, int64_t grab_ts_us);
+
+    /**
+     * @brief analyses a frame handed over by another capture thread, if due
+     *
+     * Drops frames arriving faster than the current frame period and keeps
+     * the CPU budget by measuring the time spent in process().
+     * @return true if a rising edge was posted for this frame
+     */
+    bool offer_frame(const cv::Mat& frame, int64_t grab_ts_us);
+
+    const MotionPresenceConfig& settings() const { return config; }
+    uint64_t frames_processed() const { return processed.load(std::memory_order_relaxed); }
+    uint64_t triggers_posted() const { return triggers.load(std::memory_order_relaxed); }
+    double changed_percent() const { return last_changed_percent.load(std::memory_order_relaxed); }
+    double cpu_percent() const { return last_cpu_percent.load(std::memory_order_relaxed); }
+    double effective_fps() const { return 1e6 / std::max<int64_t>(period_us.load(std::memory_order_relaxed), 1); }
+    int64_t last_detect_latency_us() const { return last_detect_us.load(std::memory_order_relaxed); }
+
+private:
+    MotionPresenceConfig config;
+    TriggerSink sink;
+    cv::VideoCapture camera;
+    bool file_source = false;
+    std::thread capture_thread;
+    std::atomic<bool> running{false};
+
+    cv::Mat grabbed;     // decode target, reused for every frame
+    cv::Mat luma;        // grayscale at source resolution
+    cv::Mat gray;        // grayscale at analysed resolution
+    cv::Mat background;  // background model, same size as gray
+    bool background_valid = false;
+    unsigned int motion_run = 0; // consecutive frames with motion
+    unsigned int still_run = 0;  // consecutive frames without motion
+    bool in_motion = false;
+
+    std::atomic<int64_t> period_us{100000}; // current frame period, stretched by the CPU budget
+    std::atomic<uint64_t> processed{0}, triggers{0};
+    std::atomic<double> last_changed_percent{0.0}, last_cpu_percent{0.0};
+    std::atomic<int64_t> last_detect_us{0};
+    int64_t next_offer_us = 0;     // offer_frame(): next frame due
+    int64_t offer_window_us = 0;   // offer_frame(): start of CPU budget window
+    int64_t offer_window_cpu_us = 0; // offer_frame(): CPU time spent in process() within window
+
+    bool open_source();
+    void capture_loop();
+    void to_gray(const cv::Mat& frame);
+    void enforce_cpu_budget(int64_t cpu_us, int64_t wall_us);
+};
@@ -0,0 +1,192 @@
+/**
+ * @file mqtt_session.cpp
+ * @brief Persistent MQTT session for door intercommunication
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ */
+#include "mqtt_session.hpp"
+#include "async_log.hpp"
+#include "latency_trace.hpp"
+#include <iostream>
+
+#define DOOR_OPEN_PAYLOAD "open"  // payload length includes the terminating NUL, as expected by the Siedle gateway
+
+MqttSession::MqttSession(const MqttSessionConfig& config) : config(config)
+{
+}
+
+MqttSession::~MqttSession()
+{
+    stop();
+}
+
+bool MqttSession::start()
+{
+    if (mosq)
+        return true;
+    mosquitto_lib_init(); // initialize MQTT mosquitto client
+    mosq = mosquitto_new(config.client_id.c_str(), true, this);
+    if (!mosq) {
+        std::cerr << "Failed to create mosquitto client" << std::endl;
+        mosquitto_lib_cleanup();
+        return false;
+    }
+    mosquitto_connect_callback_set(mosq, &MqttSession::on_connect);
+    mosquitto_disconnect_callback_set(mosq, &MqttSession::on_disconnect);
+    mosquitto_publish_callback_set(mosq, &MqttSession::on_publish);
+    mosquitto_message_callback_set(mosq, &MqttSession::on_message);
+    mosquitto_reconnect_delay_set(mosq, config.reconnect_delay_min_s, config.reconnect_delay_max_s, true); // exponential backoff
+#if LIBMOSQUITTO_VERSION_NUMBER >= 2000000
+    mosquitto_int_option(mosq, MOSQ_OPT_TCP_NODELAY, 1); // door command must not wait for Nagle
+#endif
+    std::cout << "Connecting to mosquitto broker at " << config.host << ":" << config.port << std::endl;
+    int rc = mosquitto_connect_async(mosq, config.host.c_str(), config.port, config.keepalive);
+    if (rc != MOSQ_ERR_SUCCESS) // not fatal, network loop thread retries in background
+        std::cerr << "mosquitto broker not reachable yet: " << mosquitto_strerror(rc) << " - retrying in background" << std::endl;
+    rc = mosquitto_loop_start(mosq); // network loop thread: keepalive, reconnect, acks
+    if (rc != MOSQ_ERR_SUCCESS) {
+        std::cerr << "Failed to start mosquitto network loop: " << mosquitto_strerror(rc) << std::endl;
+        mosquitto_destroy(mosq);
+        mosq = nullptr;
+        mosquitto_lib_cleanup();
+        return false;
+    }
+    return true;
+}
+
+void MqttSession::stop()
+{
+    if (!mosq)
+        return;
+    mosquitto_disconnect(mosq);
+    mosquitto_loop_stop(mosq, false);
+    mosquitto_destroy(mosq); // free mosquitto struct
+    mosq = nullptr;
+    mosquitto_lib_cleanup(); // and cleanup
+    connected = false;
+}
+
+bool MqttSession::publish_door_open(int64_t trigger_ts_us)
+{
+    if (!mosq)
+        return false;
+    int mid = 0;
+    int64_t publish_us = monotonic_us();
+    // the network loop thread may read the PUBACK before mosquitto_publish
+    // returns; on_publish waits on pending_mutex until the mid is tracked
+    std::unique_lock<std::mutex> lock(pending_mutex, std::defer_lock);
+    if (config.qos_door > 0)
+        lock.lock();
+    // one publish over the established connection, libmosquitto queues it
+    // while the network loop thread reconnects
+    int rc = mosquitto_publish(mosq, &mid, config.topic_door.c_str(), sizeof(DOOR_OPEN_PAYLOAD), DOOR_OPEN_PAYLOAD, config.qos_door, false);
+    int64_t published_us = monotonic_us();
+    if (rc == MOSQ_ERR_SUCCESS && lock.owns_lock())
+        track_ack(mid, publish_us, trigger_ts_us);
+    if (lock.owns_lock())
+        lock.unlock();
+    LatencyTrace::record(TraceStage::MqttPublish, publish_us, published_us, trigger_ts_us);
+    if (rc != MOSQ_ERR_SUCCESS) {
+        failures.fetch_add(1, std::memory_order_relaxed);
+        LOG_ERROR(LogModule::Mqtt, "cannot publish to mosquitto: %s", mosquitto_strerror(rc));
+        return false;
+    }
+    publishes.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool MqttSession::publish(const std::string& topic, const std::string& payload, int qos, bool retain)
+{
+    if (!mosq)
+        return false;
+    int rc = mosquitto_publish(mosq, NULL, topic.c_str(), (int)payload.size(), payload.data(), qos, retain);
+    if (rc != MOSQ_ERR_SUCCESS) {
+        message_failures.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    message_publishes.fetch_add(1, std::memory_order_relaxed); // not door commands, see publish_count()
+    return true;
+}
+
+/**
+ * @brief remembers publish time of a QoS 1 message until its PUBACK arrives
+ *
+ * The caller holds pending_mutex since before mosquitto_publish, so a fast
+ * PUBACK finds its entry.
+ */
+void MqttSession::track_ack(int mid, int64_t publish_us, int64_t trigger_ts_us)
+{
+    PendingAck* slot = &pending[0];
+    for (auto& entry : pending) {
+        if (entry.mid == 0) {
+            slot = &entry;
+            break;
+        }
+        if (entry.publish_us < slot->publish_us) // all busy: overwrite oldest
+            slot = &entry;
+    }
+    slot->mid = mid;
+    slot->publish_us = publish_us;
+    slot->trigger_ts_us = trigger_ts_us;
+}
+
+void MqttSession::on_connect(struct mosquitto* mosq, void* obj, int rc)
+{
+    MqttSession* self = static_cast<MqttSession*>(obj);
+    if (rc != 0) {
+        LOG_ERROR(LogModule::Mqtt, "mosquitto connect refused: %s", mosquitto_connack_string(rc));
+        return;
+    }
+    if (self->ever_connected.exchange(true)) {
+        int64_t now = monotonic_us();
+        self->reconnects.fetch_add(1, std::memory_order_relaxed);
+        LatencyTrace::record(TraceStage::MqttReconnect, self->disconnected_us.load(std::memory_order_relaxed), now);
+    }
+    self->connected.store(true, std::memory_order_release);
+    LOG_INFO(LogModule::Mqtt, "connected to mosquitto broker %s:%d", self->config.host.c_str(), self->config.port);
+    // subscriptions are not persistent with a clean session, renew them on every connect
+    LOG_INFO(LogModule::Mqtt, "subscribing to mosquitto topic: %s", self->config.topic_door.c_str());
+    if (mosquitto_subscribe(mosq, NULL, self->config.topic_door.c_str(), 0) != MOSQ_ERR_SUCCESS)
+        LOG_ERROR(LogModule::Mqtt, "failed to subscribe to mosquitto topic_door");
+    if (!self->config.topic_control.empty()) {
+        LOG_INFO(LogModule::Mqtt, "subscribing to mosquitto topic: %s", self->config.topic_control.c_str());
+        if (mosquitto_subscribe(mosq, NULL, self->config.topic_control.c_str(), 0) != MOSQ_ERR_SUCCESS)
+            LOG_ERROR(LogModule::Mqtt, "failed to subscribe to mosquitto topic_control");
+    }
+}
+
+void MqttSession::on_disconnect(struct mosquitto* mosq, void* obj, int rc)
+{
+    MqttSession* self = static_cast<MqttSession*>(obj);
+    self->connected.store(false, std::memory_order_release);
+    self->disconnected_us.store(monotonic_us(), std::memory_order_relaxed);
+    if (rc != 0) // unexpected, network loop thread reconnects with backoff
+        LOG_WARN(LogModule::Mqtt, "mosquitto connection lost: %s - reconnecting", mosquitto_strerror(rc));
+}
+
+void MqttSession::on_publish(struct mosquitto* mosq, void* obj, int mid)
+{
+    MqttSession* self = static_cast<MqttSession*>(obj);
+    int64_t now = monotonic_us();
+    std::lock_guard<std::mutex> lock(self->pending_mutex);
+    for (auto& entry : self->pending) {
+        if (entry.mid != mid)
+            continue;
+        self->acks.fetch_add(1, std::memory_order_relaxed);
+        self->last_ack_us.store(now - entry.publish_us, std::memory_order_relaxed);
+        LatencyTrace::record(TraceStage::MqttAck, entry.publish_us, now, entry.trigger_ts_us);
+        entry.mid = 0;
+        break;
+    }
+}
+
+void MqttSession::on_message(struct mosquitto* mosq, void* obj, const struct mosquitto_message* message)
+{
+    MqttSession* self = static_cast<MqttSession*>(obj);
+    if (!self->message_handler || !message->topic)
+        return;
+    std::string payload;
+    if (message->payload && message->payloadlen > 0)
+        payload.assign(static_cast<const char*>(message->payload), message->payloadlen);
+    self->message_handler(message->topic, payload);
+}
@@ -0,0 +1,131 @@
+/**
+ * @file mqtt_session.hpp
+ * @brief Persistent MQTT session for door intercommunication
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * Keeps one long-lived libmosquitto connection to the broker. A dedicated
+ * network loop thread (mosquitto_loop_start) services keepalive and
+ * reconnects with exponential backoff off the hot path, so publishing the
+ * door command is a single pre-connected write - no reconnect per unlock.
+ * For QoS 1 the time until PUBACK is reported as delivery-acknowledged latency.
+ *
+ * Can be tried against a local broker on loopback:
+ * @code
+ * mosquitto -p 1884 &
+ * mosquitto_sub -p 1884 -v -t siedle/exec &
+ * ./smartdoorF455_sim 10 1500 1000 1884
+ * @endcode
+ */
+#pragma once
+#include <mosquitto.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+/**
+ * @brief settings of section [mosquitto] in config.toml
+ */
+struct MqttSessionConfig {
+    std::string host = "localhost";
+    int port = 1883;
+    int keepalive = 60;                 // seconds
+    std::string client_id = "smartdoorF455";
+    std::string topic_door = "siedle/exec";
+    std::string topic_control;          // optional, subscribed if not empty
+    int qos_door = 1;                   // QoS of door command; 1 reports PUBACK latency
+    unsigned int reconnect_delay_min_s = 1;  // reconnect backoff of network loop thread
+    unsigned int reconnect_delay_max_s = 30;
+};
+
+/**
+ * @class MqttSession
+ * @brief libmosquitto client with background network loop and door command publish
+ *
+ * Example usage:
+ * @code
+ * MqttSession session(config);
+ * session.start();
+ * session.publish_door_open(trigger_ts_us); // from MyAuthClbk::OnResult
+ * session.stop();
+ * @endcode
+ */
+class MqttSession {
+public:
+    using MessageHandler = std::function<void(const std::string& topic, const std::string& payload)>;
+
+    explicit MqttSession(const MqttSessionConfig& config);
+    ~MqttSession();
+    MqttSession(const MqttSession&) = delete;
+    MqttSession& operator=(const MqttSession&) = delete;
+
+    /**
+     * @brief creates the client, connects and starts the network loop thread
+     *
+     * An unreachable broker is not fatal - the network loop keeps
+     * reconnecting in the background.
+     * @return false if the client could not be created or the loop not started
+     */
+    bool start();
+    void stop();
+
+    /**
+     * @brief publishes "open" on topic_door over the established connection
+     * @param trigger_ts_us monotonic timestamp of the causing sensor edge for latency tracing
+     */
+    bool publish_door_open(int64_t trigger_ts_us = 0);
+
+    /**
+     * @brief publishes an arbitrary message, e.g. replies on topic_control
+     */
+    bool publish(const std::string& topic, const std::string& payload, int qos = 0, bool retain = false);
+
+    /**
+     * @brief handler for incoming messages; must be set before start()
+     *
+     * Called on the network loop thread, so it must return quickly.
+     */
+    void set_message_handler(MessageHandler handler) { message_handler = std::move(handler); }
+
+    bool is_connected() const { return connected.load(std::memory_order_acquire); }
+    const MqttSessionConfig& settings() const { return config; }
+    /** door open messages of publish_door_open() */
+    uint64_t publish_count() const { return publishes.load(std::memory_order_relaxed); }
+    uint64_t publish_failures() const { return failures.load(std::memory_order_relaxed); }
+    /** other messages of publish(), e.g. replies on topic_control */
+    uint64_t message_publish_count() const { return message_publishes.load(std::memory_order_relaxed); }
+    uint64_t message_publish_failures() const { return message_failures.load(std::memory_order_relaxed); }
+    uint64_t ack_count() const { return acks.load(std::memory_order_relaxed); }
+    uint64_t reconnect_count() const { return reconnects.load(std::memory_order_relaxed); }
+    int64_t last_ack_latency_us() const { return last_ack_us.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr int PENDING_ACKS = 16;
+    struct PendingAck {
+        int mid = 0;             // 0 marks a free entry
+        int64_t publish_us = 0;
+        int64_t trigger_ts_us = 0;
+    };
+
+    MqttSessionConfig config;
+    struct mosquitto* mosq = nullptr;
+    MessageHandler message_handler;
+    std::atomic<bool> connected{false};
+    std::atomic<bool> ever_connected{false};
+    std::atomic<int64_t> disconnected_us{0};
+    std::atomic<uint64_t> publishes{0}, failures{0}, acks{0}, reconnects{0};
+    std::atomic<uint64_t> message_publishes{0}, message_failures{0};
+    std::atomic<int64_t> last_ack_us{0};
+    std::mutex pending_mutex;
+    PendingAck pending[PENDING_ACKS];
+
+    void track_ack(int mid, int64_t publish_us, int64_t trigger_ts_us); // pending_mutex held
+
+    static void on_connect(struct mosquitto* mosq, void* obj, int rc);
+    static void on_disconnect(struct mosquitto* mosq, void* obj, int rc);
+    static void on_publish(struct mosquitto* mosq, void* obj, int mid);
+    static void on_message(struct mosquitto* mosq, void* obj, const struct mosquitto_message* message);
+};
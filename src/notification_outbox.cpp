@@ -0,0 +1,173 @@
+/**
+ * @file notification_outbox.cpp
+ * @brief Non-blocking notification outbox with coalescing and retry
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ */
+#include "notification_outbox.hpp"
+#include "latency_trace.hpp" // monotonic_us()
+#include "thread_placement.hpp"
+#include <algorithm>
+#include <climits>
+
+NotificationOutbox::NotificationOutbox(const OutboxConfig& config, Sender sender)
+    : config(config), sender(std::move(sender))
+{
+}
+
+NotificationOutbox::~NotificationOutbox()
+{
+    stop();
+}
+
+void NotificationOutbox::start()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running)
+        return;
+    running = true;
+    sender_thread = std::thread(&NotificationOutbox::sender_loop, this);
+}
+
+void NotificationOutbox::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running)
+            return;
+        running = false;
+    }
+    wakeup.notify_all();
+    if (sender_thread.joinable())
+        sender_thread.join(); // waits for a send in progress, at most one HTTP timeout
+    std::lock_guard<std::mutex> lock(mutex);
+    dropped.fetch_add(queue.size(), std::memory_order_relaxed);
+    queue.clear();
+}
+
+size_t NotificationOutbox::depth() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return queue.size();
+}
+
+/**
+ * @brief time the given text was last sent (or is being sent), 0 if not within window
+ *
+ * Caller holds mutex.
+ */
+int64_t NotificationOutbox::recently_sent_us(const std::string& text, int64_t now) const
+{
+    for (const auto& r : recent) {
+        if (r.text == text && now - r.sent_us < (int64_t)config.coalesce_window_ms * 1000)
+            return r.sent_us;
+    }
+    return 0;
+}
+
+/**
+ * @brief remembers a sent text and forgets texts older than the coalesce window
+ *
+ * Caller holds mutex.
+ */
+void NotificationOutbox::remember_sent(const std::string& text, int64_t now)
+{
+    const int64_t window_us = (int64_t)config.coalesce_window_ms * 1000;
+    recent.erase(std::remove_if(recent.begin(), recent.end(), [&](const RecentText& r) {
+        return r.text == text || now - r.sent_us >= window_us; }), recent.end());
+    recent.push_back({text, now});
+}
+
+void NotificationOutbox::post(Notification&& notification)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!running)
+        return;
+    int64_t now = monotonic_us();
+    Entry entry;
+    entry.posted_us = now;
+    entry.not_before_us = now;
+    if (notification.kind == Notification::Kind::Text && config.coalesce_window_ms > 0) {
+        for (auto& queued : queue) { // identical text still waiting: count it
+            if (queued.notification.kind == Notification::Kind::Text && queued.notification.text == notification.text) {
+                queued.notification.count += notification.count;
+                coalesced.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+        int64_t last_sent_us = recently_sent_us(notification.text, now);
+        if (last_sent_us != 0) // sent a moment ago: collect repetitions until the window has passed
+            entry.not_before_us = last_sent_us + (int64_t)config.coalesce_window_ms * 1000;
+    }
+    if (queue.size() >= std::max<size_t>(config.capacity, 1)) { // overload: drop oldest
+        queue.pop_front();
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    entry.notification = std::move(notification);
+    queue.push_back(std::move(entry));
+    wakeup.notify_one();
+}
+
+/**
+ * @brief sender thread - delivers due messages one at a time
+ */
+void NotificationOutbox::sender_loop()
+{
+    place_this_thread("outbox");
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running) {
+        int64_t now = monotonic_us();
+        int64_t next_due_us = LLONG_MAX;
+        auto due = queue.end();
+        for (auto it = queue.begin(); it != queue.end(); ++it) {
+            if (it->not_before_us <= now) {
+                due = it;
+                break;
+            }
+            next_due_us = std::min(next_due_us, it->not_before_us);
+        }
+        if (due == queue.end()) {
+            if (queue.empty())
+                wakeup.wait(lock);
+            else
+                wakeup.wait_for(lock, std::chrono::microseconds(next_due_us - now));
+            continue;
+        }
+        Entry entry = std::move(*due);
+        queue.erase(due);
+        Notification message = entry.notification;
+        if (message.kind == Notification::Kind::Text) {
+            remember_sent(message.text, now); // repetitions arriving during the send are coalesced
+            if (message.count > 1)
+                message.text += " (" + std::to_string(message.count) + "x)";
+        }
+        lock.unlock();
+
+        int64_t start_us = monotonic_us();
+        SendResult result = sender(message);
+        int64_t end_us = monotonic_us();
+        last_send_us.store(end_us - start_us, std::memory_order_relaxed);
+        if (end_us - start_us > max_send_us.load(std::memory_order_relaxed))
+            max_send_us.store(end_us - start_us, std::memory_order_relaxed);
+
+        lock.lock();
+        if (result == SendResult::Sent) {
+            sent.fetch_add(1, std::memory_order_relaxed);
+            last_queue_us.store(start_us - entry.posted_us, std::memory_order_relaxed);
+            if (message.kind == Notification::Kind::Text)
+                remember_sent(entry.notification.text, end_us);
+        }
+        else if (result == SendResult::Retry && ++entry.attempts < config.max_attempts) {
+            retries.fetch_add(1, std::memory_order_relaxed);
+            int64_t backoff_ms = std::min<int64_t>((int64_t)config.retry_initial_ms << std::min(entry.attempts - 1, 20u), config.retry_max_ms);
+            entry.not_before_us = end_us + backoff_ms * 1000;
+            if (queue.size() >= std::max<size_t>(config.capacity, 1))
+                dropped.fetch_add(1, std::memory_order_relaxed); // overload: the retried message is the oldest
+            else
+                queue.push_front(std::move(entry));
+        }
+        else {
+            failed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
@@ -0,0 +1,124 @@
+/**
+ * @file notification_outbox.hpp
+ * @brief Non-blocking notification outbox with coalescing and retry
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * Producers (RealSenseID callback thread, snapshot worker) post messages
+ * into a bounded outbox and return immediately. A single sender thread
+ * delivers them, so a slow or unreachable api.telegram.org never stalls
+ * authentication or the GPIO thread.
+ * - bursts of identical text messages within coalesce_window_ms become one
+ *   message with a count ("... (3x)"), the first one is sent right away
+ * - transient failures are retried with exponential backoff
+ * - under overload the oldest queued message is dropped
+ * - queue depth and send latency are exposed as metrics
+ *
+ * The sender is a plain function, so a stand-in can replace Telegram.
+ */
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
+
+/**
+ * @brief message handed to the notification outbox
+ */
+struct Notification {
+    enum class Kind { Text, Photo };
+    Kind kind = Kind::Text;
+    std::string text;        // message text or caption
+    std::shared_ptr<const std::vector<unsigned char>> photo_jpeg; // in-memory jpeg if kind == Photo
+    int64_t trigger_ts_us = 0; // timestamp of the causing trigger, 0 if none
+    unsigned int count = 1;  // number of coalesced identical messages
+};
+
+/**
+ * @brief settings of the outbox, read from section [telegram] in config.toml
+ */
+struct OutboxConfig {
+    size_t capacity = 32;                  // queued messages; oldest is dropped beyond
+    unsigned int coalesce_window_ms = 30000; // identical texts within this window are merged
+    unsigned int retry_initial_ms = 1000;  // first retry delay, doubled per attempt
+    unsigned int retry_max_ms = 60000;     // upper bound of retry delay
+    unsigned int max_attempts = 6;         // message is given up after this many attempts
+};
+
+/**
+ * @class NotificationOutbox
+ * @brief Bounded outbox drained by a single sender thread
+ *
+ * Example usage:
+ * @code
+ * NotificationOutbox outbox(config, send_notification);
+ * outbox.start();
+ * outbox.post(std::move(notification)); // never blocks on I/O
+ * outbox.stop();
+ * @endcode
+ */
+class NotificationOutbox {
+public:
+    enum class SendResult { Sent, Retry, Failed };
+    using Sender = std::function<SendResult(const Notification&)>;
+
+    NotificationOutbox(const OutboxConfig& config, Sender sender);
+    ~NotificationOutbox();
+    NotificationOutbox(const NotificationOutbox&) = delete;
+    NotificationOutbox& operator=(const NotificationOutbox&) = delete;
+
+    void start();
+    /**
+     * @brief stops the sender thread; messages still queued are discarded
+     */
+    void stop();
+
+    /**
+     * @brief queues a message; takes a short lock, never waits on the sender
+     */
+    void post(Notification&& notification);
+
+    size_t depth() const;
+    uint64_t sent_count() const { return sent.load(std::memory_order_relaxed); }
+    uint64_t failed_count() const { return failed.load(std::memory_order_relaxed); }
+    uint64_t dropped_count() const { return dropped.load(std::memory_order_relaxed); }
+    uint64_t coalesced_count() const { return coalesced.load(std::memory_order_relaxed); }
+    uint64_t retry_count() const { return retries.load(std::memory_order_relaxed); }
+    int64_t last_send_latency_us() const { return last_send_us.load(std::memory_order_relaxed); }
+    int64_t max_send_latency_us() const { return max_send_us.load(std::memory_order_relaxed); }
+    int64_t last_queue_latency_us() const { return last_queue_us.load(std::memory_order_relaxed); }
+
+private:
+    struct Entry {
+        Notification notification;
+        int64_t posted_us = 0;     // first post, for queue latency
+        int64_t not_before_us = 0; // coalesce window or retry backoff
+        unsigned int attempts = 0;
+    };
+    struct RecentText {
+        std::string text;
+        int64_t sent_us = 0;
+    };
+
+    OutboxConfig config;
+    Sender sender;
+    mutable std::mutex mutex;
+    std::condition_variable wakeup;
+    std::deque<Entry> queue;
+    std::vector<RecentText> recent; // texts sent within coalesce window
+    std::thread sender_thread;
+    bool running = false;
+    std::atomic<uint64_t> sent{0}, failed{0}, dropped{0}, coalesced{0}, retries{0};
+    std::atomic<int64_t> last_send_us{0}, max_send_us{0}, last_queue_us{0};
+
+    void sender_loop();
+    int64_t recently_sent_us(const std::string& text, int64_t now) const;
+    void remember_sent(const std::string& text, int64_t now);
+};
@@ -0,0 +1,154 @@
+/**
+ * @file panel_power.hpp
+ * @brief Presence-aware power levels of the LED matrix panel
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * The refresh thread of rpi-rgb-led-matrix keeps scanning the panel around
+ * the clock, even when nobody is at the door. PanelPower decides the level
+ * the panel should run at from the time since the last presence:
+ *
+ * - Full: configured brightness and PWM bits
+ * - Idle: after idle_after_s without presence - idle_brightness and
+ *   idle_pwm_bits; fewer bit planes shorten every refresh cycle, so with
+ *   limit_refresh_rate_hz the refresh thread sleeps longer per frame
+ * - Blank: after blank_after_s - panel dark, a single bit plane
+ *
+ * activity() is called by the presence sensor ISR and motion detection; it
+ * is a single atomic store and async-signal-safe. The render thread applies
+ * the wanted level and reports it with set_level(). Going back to Full is
+ * done in the frame rendered for the presence trigger.
+ *
+ * Counters measure the effect: time and process CPU time spent per level,
+ * and the latency from presence trigger to the first full quality frame.
+ *
+ * Configured in section [matrix_options] of config.toml. The header has no
+ * hardware dependencies.
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <initializer_list>
+
+enum class PanelLevel : int { Full = 0, Idle = 1, Blank = 2 };
+
+/**
+ * @brief power settings of section [matrix_options] in config.toml
+ */
+struct PanelPowerConfig {
+    int idle_after_s = 0;           // seconds without presence before the panel idles, 0 = never
+    int blank_after_s = 0;          // seconds without presence before the panel is blanked, 0 = never
+    int idle_brightness = 20;       // percent, 1..100
+    int idle_pwm_bits = 4;          // 1..11 bit planes while idle
+    int limit_refresh_rate_hz = 0;  // refresh thread frame rate cap, 0 = as fast as possible
+};
+
+/**
+ * @class PanelPower
+ * @brief Chooses the power level of the panel and counts time, CPU and wake latency per level
+ *
+ * Example usage:
+ * @code
+ * panel_power.activity(monotonic_us()); // presence sensor ISR
+ * // render thread:
+ * PanelLevel wanted = panel_power.wanted(now_us);
+ * if (wanted != panel_power.level()) {
+ *     apply brightness / PWM bits / blank;
+ *     panel_power.set_level(wanted, now_us, process_cpu_us());
+ * }
+ * @endcode
+ */
+class PanelPower {
+public:
+    /** sets the thresholds and starts the inactivity period at now_us */
+    void configure(const PanelPowerConfig& config, int64_t now_us, int64_t cpu_us) {
+        settings = config;
+        last_activity_us.store(now_us, std::memory_order_relaxed);
+        level_since_us.store(now_us, std::memory_order_relaxed);
+        level_since_cpu_us.store(cpu_us, std::memory_order_relaxed);
+    }
+    const PanelPowerConfig& config() const { return settings; }
+
+    /** render thread: new thresholds and idle level, the running inactivity period continues */
+    void retune(const PanelPowerConfig& config) { settings = config; }
+
+    /** presence at monotonic time ts_us; any thread, async-signal-safe */
+    void activity(int64_t ts_us) {
+        last_activity_us.store(ts_us, std::memory_order_relaxed);
+    }
+
+    /** level the panel should run at */
+    PanelLevel wanted(int64_t now_us) const {
+        int64_t inactive_us = now_us - last_activity_us.load(std::memory_order_relaxed);
+        if (settings.blank_after_s > 0 && inactive_us >= settings.blank_after_s * 1000000LL)
+            return PanelLevel::Blank;
+        if (settings.idle_after_s > 0 && inactive_us >= settings.idle_after_s * 1000000LL)
+            return PanelLevel::Idle;
+        return PanelLevel::Full;
+    }
+
+    /** monotonic time when the wanted level drops next without further presence, 0 if never */
+    int64_t next_change_us(int64_t now_us) const {
+        const int64_t last_us = last_activity_us.load(std::memory_order_relaxed);
+        int64_t next = 0;
+        for (int after_s : { settings.idle_after_s, settings.blank_after_s }) {
+            int64_t at_us = last_us + after_s * 1000000LL;
+            if (after_s > 0 && at_us > now_us && (next == 0 || at_us < next))
+                next = at_us;
+        }
+        return next;
+    }
+
+    PanelLevel level() const { return (PanelLevel)current.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief render thread: the panel runs at level from now on
+     * @param cpu_us process_cpu_us() at the change
+     */
+    void set_level(PanelLevel level, int64_t now_us, int64_t cpu_us) {
+        const int previous = current.load(std::memory_order_relaxed);
+        time_us[previous].fetch_add(now_us - level_since_us.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        cpu_time_us[previous].fetch_add(cpu_us - level_since_cpu_us.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        level_since_us.store(now_us, std::memory_order_relaxed);
+        level_since_cpu_us.store(cpu_us, std::memory_order_relaxed);
+        entry_count[(int)level].fetch_add(1, std::memory_order_relaxed);
+        current.store((int)level, std::memory_order_relaxed);
+    }
+
+    /** render thread: the first full quality frame after a lower level was swapped at shown_us */
+    void woke(int64_t shown_us) {
+        int64_t latency_us = shown_us - last_activity_us.load(std::memory_order_relaxed);
+        wake_count.fetch_add(1, std::memory_order_relaxed);
+        if (latency_us > max_wake_us.load(std::memory_order_relaxed))
+            max_wake_us.store(latency_us, std::memory_order_relaxed);
+    }
+
+    uint64_t entries(PanelLevel level) const { return entry_count[(int)level].load(std::memory_order_relaxed); }
+    /** seconds spent at level, including the running period */
+    double seconds(PanelLevel level, int64_t now_us) const {
+        return (time_us[(int)level].load(std::memory_order_relaxed) + running(level, now_us - level_since_us.load(std::memory_order_relaxed))) / 1e6;
+    }
+    /** process CPU time at level in percent of one core */
+    double cpu_percent(PanelLevel level, int64_t now_us, int64_t cpu_us) const {
+        int64_t wall_us = time_us[(int)level].load(std::memory_order_relaxed) + running(level, now_us - level_since_us.load(std::memory_order_relaxed));
+        int64_t used_us = cpu_time_us[(int)level].load(std::memory_order_relaxed) + running(level, cpu_us - level_since_cpu_us.load(std::memory_order_relaxed));
+        return wall_us > 0 ? 100.0 * used_us / wall_us : 0.0;
+    }
+    uint64_t wakeups() const { return wake_count.load(std::memory_order_relaxed); }
+    int64_t max_wake_latency_us() const { return max_wake_us.load(std::memory_order_relaxed); }
+
+private:
+    int64_t running(PanelLevel level, int64_t amount) const {
+        return level == this->level() ? amount : 0;
+    }
+
+    PanelPowerConfig settings;
+    std::atomic<int64_t> last_activity_us{0};
+    std::atomic<int> current{(int)PanelLevel::Full};
+    std::atomic<int64_t> level_since_us{0}, level_since_cpu_us{0};
+    std::atomic<int64_t> time_us[3] = {}, cpu_time_us[3] = {};
+    std::atomic<uint64_t> entry_count[3] = {};
+    std::atomic<uint64_t> wake_count{0};
+    std::atomic<int64_t> max_wake_us{0};
+};
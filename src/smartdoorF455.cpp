@@ -52,19 +52,40 @@
  * - OpenCV library (Apache License 2.0)
  *   https://opencv.org/
  * 
- * smartdoorF455 creates 3 threads:
- * ================================
+ * smartdoorF455 creates these threads:
+ * ====================================
  * - wiringPiISR2 registers a callback on a GPIO pin interrupt, when presence sensor triggers
- *   consumes < 4% CPU time on RPI4b
- * - matrix_task.start() - creates a low CPU consuming thread with function matrixLEDTask::task_function
- *   to control the LED matrix panel
- * - inside matrixLEDTask::task_function a further thread is created to refresh the
+ *   consumes < 4% CPU time on RPI4b. The callback only posts a timestamped event into the
+ *   trigger pipeline (see trigger_pipeline.hpp)
+ * - trigger pipeline auth and snapshot workers - authentication and camera snapshot run on
+ *   separate threads, so the door opener never waits on camera capture
+ * - notification outbox sender thread - delivers Telegram messages and photos with coalescing
+ *   and retry, so a slow Telegram server never stalls authentication (see notification_outbox.hpp)
+ * - led_display->start() - creates the display scheduler thread (see led_display.hpp), which
+ *   sleeps until the next minute boundary, an authentication result or hint, or an overlay deadline
+ *   and then renders the LED matrix panel
+ * - inside RgbMatrixPanel::open a further thread is created to refresh the
  *   LED Matrix display  (from rpi-rgb-led-matrix library)
  *   the line "matrix = RGBMatrix::CreateFromOptions" - creates this CPU heavy thread 
  *   which may take up to 50% of a single Raspberry Pi 4 CPU core. CPU usage of this 
  *   thread is dependand upon the Matrix configuration e.g. whether direct GPIO cabling or a Adafruit matrix
  *   bonnet is used to connect the LED matrix to the Raspberry Pi.
  *   
+ * - startup stages "init:<stage>" - Telegram, GPIO, camera, MQTT and display are initialized
+ *   concurrently and end before the main loop starts (see startup_graph.hpp); the time from
+ *   launch to a usable door is logged
+ *
+ * wiringPi, RealSenseID, rpi-rgb-led-matrix and OpenCV are used through the adapters
+ * GpioTriggerSource, RealSenseAuthDevice, RgbMatrixPanel and CvSnapshotCamera of the
+ * interfaces in hal.hpp; smartdoorF455_replay runs the same pipeline on simulated hardware.
+ *
+ * Every thread is named and placed on CPU cores with a scheduling policy as
+ * configured in section [threads] of config.toml (see thread_placement.hpp).
+ * Threads that record latency spans or count metrics each hold a ring of
+ * LatencyTrace (at most 16 at once) and a shard of Metrics (at most 32 at
+ * once), released when the thread exits, so threads that come and go such
+ * as the startup stages do not use them up. A thread beyond the limit is
+ * reported as "spans lost" and smartdoor_metrics_threads_lost.
  * With the following linux shell command you may observe the processes 
  * associated to the above described threads:
  * % top -H -p $(pgrep -x smartdoorF455)
@@ -75,62 +96,79 @@
  * @note See installation instructions in README file
  */
 #include "smartdoorF455.hpp"
-#define STDOUT_ADDTL_INFO  /* provides additional information on stdout e.g. prints date/time when movement sensor triggers camera */
-#define DISPLAY_NAME_IN_ITERATIONS 5  // how long name of authenticated person is displayed, when door opens in main loop iterations
-#define DATE_FORMAT_STRING "%d.%m" // DD.MM.YY format
-#define DAY_FORMAT_STRING "%A" // name of day according to LOCALE 
-// #define TIME_FORMAT_STRING "%H:%M"    // HH:MM format
-#define FONT_PATH "../external/rpi-rgb-led-matrix-src/fonts/" 
-#define FONT_TIME FONT_PATH "6x12.bdf"
-#define FONT_DAY  FONT_PATH "4x6.bdf"
-#define FONT_DATE FONT_PATH "6x12.bdf"
-#define FONT_NAME FONT_PATH "6x12.bdf"
-#define MAX_NAME_LENGTH 5 /* maximum name length displayed of authenticated person */
-#define LINE_OFFSET_1 7
-#define LINE_OFFSET_2 (LINE_OFFSET_1+6)
-#define LINE_OFFSET_3 (LINE_OFFSET_2+8)
-#define LINE_OFFSET_4 (LINE_OFFSET_3+8)
-#define DELAY_MSEC  1000 /* delay in milliseconds; adjust frequency to match potential scrolling or animation patterns */
-#define DEBOUNCE_PERIOD 1000 // in us; 1.000 equals = 1 ms; debounce filter for presence sensor
+#include "latency_trace.hpp"
+#include "trigger_pipeline.hpp"
+#include "snapshot_capture.hpp"
+#include "motion_presence.hpp"
+#include "mqtt_session.hpp"
+#include "notification_outbox.hpp"
+#include "faceprint_store.hpp"
+#include "control_engine.hpp"
+#include "glyph_atlas.hpp"
+#include "animation.hpp"
+#include "display_state.hpp"
+#include "panel_power.hpp"
+#include "hal.hpp"
+#include "door_controller.hpp"
+#include "led_display.hpp"
+#include "thread_placement.hpp"
+#include "startup_graph.hpp"
+#include "app_config.hpp"
+#include "async_log.hpp"
+#include "metrics.hpp"
+#define DISPLAY_NAME_MSEC 5000 // how long name of authenticated person is displayed, when door opens
+#define DISPLAY_HINT_MSEC 2000 // how long an authentication hint is displayed
+#define DISPLAY_ALERT_MSEC 3000 // how long the panel is tinted after a spoofing attempt
+#define MAX_NAME_LENGTH 16 /* maximum name length displayed of authenticated person in characters; names wider than the panel scroll */
+#define DEBOUNCE_PERIOD 1000 // in us; 1.000 equals = 1 ms; default debounce filter of wiringPi for presence sensor
+#define JPEG_BUFFER_POOL 3 // in-memory jpeg buffers in flight between snapshot worker and notification outbox
 /* global variables ...
    are ugly, however the following are used both in main and callback functions
    any hint how to eliminate this global variable greatly appreciated */
 std::unique_ptr<RealSenseID::FaceAuthenticator> authenticator; // object instace used to communicate with F455 camera for authentication 
+std::unique_ptr<AuthDevice> auth_device; // authentication on the F455 behind the interface of hal.hpp, see RealSenseAuthDevice
+std::unique_ptr<DoorController> door_controller; // display, door opener and notifications on authentication results
+std::unique_ptr<TriggerSource> gpio_trigger; // presence sensor on gpio_sensor_pin, see GpioTriggerSource
 RealSenseID::SerialConfig serial_config; // serial configuration for F455 camera
 std::string serial_conf_string;
 toml::table config_toml; // toml config file
-// see https://www.reddit.com/r/learnprogramming/comments/18w4ifo/c_how_to_share_a_string_across_threads/
-std::atomic<std::string *> name_lastauthenticated = new std::string(); // string is shared among threads, therefore trivially copyable atomic variable required
+StateChannel<DisplayState> display_state; // last user, status and hint, written by callbacks and read by the LED matrix thread
+std::unique_ptr<LedDisplay> led_display; // renders the LED matrix on minute boundaries and on events
 bool use_mosquitto = false; // is MQTT protocol used to communicate with outer world e.g. to activate door buzzer?
-struct mosquitto *mosq; // used both in main an authentication callback functions
-const char *topic_door;
+std::unique_ptr<MqttSession> mqtt_session; // persistent MQTT connection, used both in main an authentication callback functions
 volatile bool interrupt_received = false;
+volatile sig_atomic_t dump_trace_requested = 0; // set by SIGUSR1, latency trace is printed by main loop
+volatile sig_atomic_t reload_requested = 0; // set by SIGHUP, config.toml is reloaded by main loop
+ConfigChannel app_config; // typed snapshot of config.toml, replaced on reload (see app_config.hpp)
 bool use_telegram;  // check if telegram bot is used
 bool send_snapshot;  // check if telegram bot shall be used to send photo
+bool save_snapshots = false; // additionally store snapshots in ~/smartdoorF455/snapshots/
+int jpeg_quality = 85; // jpeg quality of snapshots 0..100
 const char *bot_token; // every bot has its unique token
 long chat_id; 
 TgBot::Bot* bot;  //  telegram bot object
+TriggerPipeline trigger_pipeline; // decouples presence sensor ISR from authentication and snapshot
+std::unique_ptr<NotificationOutbox> outbox; // delivers Telegram messages off the callback threads
+std::unique_ptr<MotionPresence> motion_presence; // camera based presence detection, if selected in [raspi]
+PanelPower panel_power; // idle and blank levels of the LED matrix, woken by presence
+bool host_matching = false; // match faceprints on the Pi instead of the device database, see [camera] matching
+std::unique_ptr<FaceprintStore> faceprint_store; // memory-mapped faceprint database for host matching
+std::unique_ptr<ControlEngine> control_engine; // runs topic_control commands, shares the F455 with authentication
+float host_match_threshold = 0.6f; // minimum cosine similarity of a host-side match
+unsigned int host_match_threads = 2; // threads scanning large faceprint indexes
+std::unique_ptr<SnapshotCapture> snapshot_capture; // keeps webcam stream open, holds most recent frames for snapshots
+std::unique_ptr<SnapshotCamera> snapshot_camera; // encodes snapshots of snapshot_capture, see CvSnapshotCamera
 std::string usb_device; // USB device for Intel RealSenseID F455 camera
 DeviceInfo device_info; // type of Intel RealSense camera 
+const int64_t launch_us = monotonic_us(); // program start, startup timing is relative to it
+int64_t startup_ready_us = 0; // time after launch when the last startup stage ended
 
 /**
- * @brief Returns the current date and time as a formatted string
- * 
- * This function retrieves the current system time and converts it to a formatted string.
- * The format used is "YYYY-MM-DD HH:MM:SS" in local time.
- * 
- * @return std::string Formatted string containing current date and time
- * 
- * @note Uses the system's local time settings
+ * @brief Name of a RealSenseID::AuthenticateStatus, for metrics, door controller and LED display
  */
-std::string return_current_time_and_date()
+const char* auth_status_name(int status)
 {
-    auto now = std::chrono::system_clock::now();
-    auto in_time_t = std::chrono::system_clock::to_time_t(now);
-
-    std::stringstream ss;
-    ss << std::put_time(std::localtime(&in_time_t), "%Y-%m-%d %X");
-    return ss.str();
+    return RealSenseID::Description((RealSenseID::AuthenticateStatus)status);
 }
 
 /**
@@ -138,13 +176,16 @@ std::string return_current_time_and_date()
  * @brief Callback class for authentication results.
  * 
  * This class is used to receive authentication results from the Intel RealSenseID F455 camera.
- * It implements the RealSenseID::AuthenticationCallback interface and is used to handle authentication results.
+ * It implements the RealSenseID::AuthenticationCallback interface and hands the results to the
+ * AuthListener of the running authentication - door_controller, see door_controller.hpp.
  */
 class MyAuthClbk : public RealSenseID::AuthenticationCallback
 {
     private:
-    //
+    AuthListener* listener = nullptr;
     public:
+    /** listener of the next authentication */
+    void set_listener(AuthListener& next) { listener = &next; }
     /**
      * @memberof MyAuthClbk
      * @brief Called when authentication results are available.
@@ -158,56 +199,12 @@ class MyAuthClbk : public RealSenseID::AuthenticationCallback
      */
     void OnResult(const RealSenseID::AuthenticateStatus status, const char* user_id) override
     {
-        if (status == RealSenseID::AuthenticateStatus::Success){
-            name_lastauthenticated.load()->assign(user_id);
-
-            // old: strncpy(name_lastauthenticated,user_id,MAX_NAME_LENGTH); // copy first MAX_NAME_LENGTH chars of authenticated users
-#ifdef STDOUT_ADDTL_INFO
-            cout <<  return_current_time_and_date() << " Hallo " << user_id << std::endl;
-            cout << "MyAuthClbk::OnResult send_snapshot=" << send_snapshot << ", use_telegram=" << use_telegram << ", chat_id=" << chat_id << std::endl;
-#endif /* STDOUT_ADDTL_INFO */
-            // TRIGGER DOOR OPENER START - ADAPT THIS CODE according to your interface to 
-            //                             your door buzzer
-
-            if(use_mosquitto){   
-                // send MQTT message to Siedle gateway to open door            
-                if (mosquitto_reconnect(mosq) != MOSQ_ERR_SUCCESS)
-                    std::cout << "cannot reconnect to mosquitto "  << std::endl;
-                if (mosquitto_publish(mosq, NULL, topic_door, 5, "open", 0, false) != MOSQ_ERR_SUCCESS)
-                    std::cout << "cannot publish to mosquitto "  << std::endl;
-
-                // TRIGGER DOOR OPENER END
-            } // end if use_mosquitto
-            if (use_telegram) {
-#ifdef STDOUT_ADDTL_INFO
-                cout <<  return_current_time_and_date() << " trying telegram bot " << bot_token << " to send message to chat_id " << chat_id << endl;
-#endif /* STDOUT_ADDTL_INFO */
-                try {
-
-                    if (chat_id != 0) {
-                        bot->getApi().sendMessage(chat_id, std::string("Door opened for ") + user_id);
-                    }
-                }
-                catch (TgBot::TgException& e) {
-                    printf("error sending telegram message: %s\n", e.what());
-                }
-
-            } // end if (use_telegram)
-        } // end if authentication successful
-        else // authentication failed
-        {
-            std::cout << return_current_time_and_date() << " RealSenseID::AuthenticateStatus: " << status << std::endl;
-            try {
-
-                if (chat_id != 0) {
-                    bot->getApi().sendMessage(chat_id, std::string("RealSenseID::AuthenticateStatus: unauthorized person tried to access"));
-                }
-            }
-            catch (TgBot::TgException& e) {
-                printf("error sending telegram message: %s\n", e.what());
-            }
-        }
-
+        AuthOutcome outcome = AuthOutcome::Denied;
+        if (status == RealSenseID::AuthenticateStatus::Success)
+            outcome = AuthOutcome::Granted;
+        else if (strncmp(RealSenseID::Description(status), "Spoof", 5) == 0) // Spoof, Spoof_2D, ...
+            outcome = AuthOutcome::Spoof;
+        listener->on_result(outcome, (int)status, user_id);
     } // end of MyAuthClbk::OnResult()
     /**
      * @memberof MyAuthClbk
@@ -221,8 +218,7 @@ class MyAuthClbk : public RealSenseID::AuthenticationCallback
      */
     void OnHint(const RealSenseID::AuthenticateStatus hint) override
     {
-        std::cout << "Authentication hint: " << hint << std::endl;
-        std::cout << "OnHint: send_snapshot=" << send_snapshot << ", use_telegram=" << use_telegram << ", chat_id=" << chat_id << std::endl;   
+        listener->on_hint((int)hint);
     }
     /**
      * @memberof MyAuthClbk
@@ -239,12 +235,84 @@ class MyAuthClbk : public RealSenseID::AuthenticationCallback
     void OnFaceDetected(const std::vector<RealSenseID::FaceRect>& faces, const unsigned int ts) override
     {
         for (auto& face : faces)
+            LOG_DEBUG(LogModule::Camera, "detected face %u,%u %ux%u (timestamp %u)", face.x, face.y, face.w, face.h, ts);
+        listener->on_faces(faces.size());
+    }
+}; // end class MyAuthClbk
+
+/**
+ * @class HostAuthClbk
+ * @brief Callback class for host-side matching of faceprints extracted by the F455.
+ *
+ * The device only detects the face, checks for spoofs and extracts its faceprint.
+ * The faceprint is matched against faceprint_store on the Pi; the result is
+ * handed to MyAuthClbk::OnResult, so opening the door and notifications behave
+ * exactly like matching on the device.
+ */
+class HostAuthClbk : public RealSenseID::AuthFaceprintsExtractionCallback
+{
+    private:
+    MyAuthClbk& auth_clbk;
+    public:
+    explicit HostAuthClbk(MyAuthClbk& auth_clbk) : auth_clbk(auth_clbk) {}
+    /**
+     * @memberof HostAuthClbk
+     * @brief Called when the faceprint of the person in front of the camera is extracted.
+     *
+     * @param status The status of the extraction, Success if a faceprint is available.
+     * @param faceprints The extracted faceprint, nullptr if extraction failed.
+     */
+    void OnResult(const RealSenseID::AuthenticateStatus status, const RealSenseID::ExtractedFaceprints* faceprints) override
+    {
+        if (status != RealSenseID::AuthenticateStatus::Success || faceprints == nullptr) {
+            auth_clbk.OnResult(status, nullptr); // spoof, no face, ... - reported as by the device
+            return;
+        }
+        FaceprintMatch match;
         {
-            printf("** Detected face %u,%u %ux%u (timestamp %u)\n", face.x, face.y, face.w, face.h, ts);
-        
+            TraceSpan span(TraceStage::HostMatch, trigger_pipeline.inflight_trigger_ts_us());
+            if (faceprint_store) // snapshot stays valid even if enrollment swaps the manifest meanwhile
+                match = faceprint_store->snapshot()->best_match(reinterpret_cast<const int16_t*>(faceprints->data.featuresVector), host_match_threads);
         }
+        LOG_DEBUG(LogModule::Auth, "host match: %s, score %.3f", match.user_id.c_str(), match.score);
+        if (match.index >= 0 && match.score >= host_match_threshold)
+            auth_clbk.OnResult(RealSenseID::AuthenticateStatus::Success, match.user_id.c_str());
+        else
+            auth_clbk.OnResult(RealSenseID::AuthenticateStatus::Forbidden, nullptr);
     }
-}; // end class MyAuthClbk
+    void OnHint(const RealSenseID::AuthenticateStatus hint) override
+    {
+        auth_clbk.OnHint(hint);
+    }
+    void OnFaceDetected(const std::vector<RealSenseID::FaceRect>& faces, const unsigned int ts) override
+    {
+        auth_clbk.OnFaceDetected(faces, ts);
+    }
+}; // end class HostAuthClbk
+
+/**
+ * @class RealSenseAuthDevice
+ * @brief AuthDevice on the F455: matching on the device, or on the Pi if host_matching is set
+ */
+class RealSenseAuthDevice : public AuthDevice
+{
+    private:
+    MyAuthClbk auth_clbk; // callback object for authentication results
+    HostAuthClbk host_auth_clbk{auth_clbk}; // host-side matching, results end up in auth_clbk as well
+    public:
+    bool authenticate(AuthListener& listener) override
+    {
+        auth_clbk.set_listener(listener);
+        RealSenseID::Status status = host_matching
+            ? authenticator->ExtractFaceprintsForAuth(host_auth_clbk) // device extracts, Pi matches
+            : authenticator->Authenticate(auth_clbk); // trigger camera authentication process
+        return status == RealSenseID::Status::Ok;
+    }
+    void cancel() override
+    {
+        authenticator->Cancel();
+    }
+}; // end class RealSenseAuthDevice
 
 /**
  * @brief Callback class for handling facial enrollment events.
@@ -255,7 +323,12 @@ class MyAuthClbk : public RealSenseID::AuthenticationCallback
  */
 class MyEnrollClbk : public RealSenseID::EnrollmentCallback
 {
+private:
+    ControlEngine::ProgressSink progress; // streams poses and hints to the topic_control status topic
+    bool enrolled = false;
 public:
+    explicit MyEnrollClbk(ControlEngine::ProgressSink progress = nullptr) : progress(std::move(progress)) {}
+    bool succeeded() const { return enrolled; }
     /**
      * @memberof MyEnrollClbk
      * @brief Called when enrollment process completes or fails.
@@ -265,7 +338,9 @@ public:
      */
     void OnResult(const RealSenseID::EnrollStatus status) override
     {
-        std::cout << "on_result: enroll_status: " << status << std::endl;
+        LOG_INFO(LogModule::Control, "enroll result: %s", RealSenseID::Description(status));
+        enrolled = status == RealSenseID::EnrollStatus::Success;
+        report("result", status);
     }
     /**
      * @memberof MyEnrollClbk
@@ -276,7 +351,8 @@ public:
      */
     void OnProgress(const RealSenseID::FacePose pose) override
     {
-        std::cout << "on_progress: enroll_pose: " << pose << std::endl;
+        LOG_INFO(LogModule::Control, "enroll pose: %s", RealSenseID::Description(pose));
+        report("pose", pose);
     }
    /**
     * @memberof MyEnrollClbk
@@ -287,7 +363,50 @@ public:
      */
     void OnHint(const RealSenseID::EnrollStatus hint) override
     {
-        std::cout << "on_hint: enroll_hint: " << hint << std::endl;
+        LOG_INFO(LogModule::Control, "enroll hint: %s", RealSenseID::Description(hint));
+        report("hint", hint);
+    }
+private:
+    template <typename T>
+    void report(const char* what, const T& value)
+    {
+        if (!progress)
+            return;
+        std::ostringstream text;
+        text << what << " " << value;
+        progress(text.str());
+    }
+};
+
+/**
+ * @class HostEnrollClbk
+ * @brief Callback class for enrollment into faceprint_store when matching on the host.
+ *
+ * The device extracts the enrollment faceprint only, nothing is stored in
+ * the device database.
+ */
+class HostEnrollClbk : public RealSenseID::EnrollFaceprintsExtractionCallback
+{
+private:
+    MyEnrollClbk progress_clbk; // same progress reporting as device enrollment
+public:
+    std::vector<int16_t> features; // extracted faceprint, empty if enrollment failed
+    explicit HostEnrollClbk(ControlEngine::ProgressSink progress) : progress_clbk(std::move(progress)) {}
+    void OnResult(const RealSenseID::EnrollStatus status, const RealSenseID::ExtractedFaceprints* faceprints) override
+    {
+        progress_clbk.OnResult(status);
+        if (status == RealSenseID::EnrollStatus::Success && faceprints) {
+            const int16_t* vector = reinterpret_cast<const int16_t*>(faceprints->data.featuresVector);
+            features.assign(vector, vector + RSID_NUM_OF_RECOGNITION_FEATURES);
+        }
+    }
+    void OnProgress(const RealSenseID::FacePose pose) override
+    {
+        progress_clbk.OnProgress(pose);
+    }
+    void OnHint(const RealSenseID::EnrollStatus hint) override
+    {
+        progress_clbk.OnHint(hint);
     }
 };
 
@@ -296,8 +415,8 @@ public:
  * @brief Creates and connects a FaceAuthenticator object for the Intel RealSense ID camera.
  *
  *
- * @return std::unique_ptr<RealSenseID::FaceAuthenticator> A unique pointer to the configured FaceAuthenticator
- * @throws Calls std::exit(1) if Connection to the device fails
+ * @return std::unique_ptr<RealSenseID::FaceAuthenticator> A unique pointer to the configured FaceAuthenticator,
+ *         nullptr if connection to the device fails
  *
  * @note Under RSID_SECURE compilation, uses secure authentication with s_signer
  */
@@ -314,19 +433,109 @@ std::unique_ptr<RealSenseID::FaceAuthenticator> createAuthenticator(RealSenseID:
     if (connect_status != RealSenseID::Status::Ok)
     {
         std::cout << "Failed connecting to port " << serial_config.port << " status:" << connect_status << std::endl;
-        std::cout << "serial port: " << serial_config.port << std::endl;
-        std::exit(1);
+        return nullptr;
     }
     std::cout << "Connected to device" << std::endl;
     return authenticator;  
 } // end createAuthenticator()
 
+/**
+ * @brief Reads serial port and device type of the last start from the port cache
+ *
+ * The cache holds one line "<serial port> <device type>", written by
+ * write_port_cache() after a successful device discovery.
+ *
+ * @return true if the cache names a known device type and its port still exists
+ */
+bool read_port_cache(const std::string& path)
+{
+    std::ifstream cache(path);
+    std::string port;
+    int device_type = (int)RealSenseID::DeviceType::Unknown;
+    if (!(cache >> port >> device_type) || device_type == (int)RealSenseID::DeviceType::Unknown || access(port.c_str(), F_OK) != 0)
+        return false;
+    device_info.deviceType = (RealSenseID::DeviceType)device_type;
+    serial_conf_string = port;
+    serial_config.port = serial_conf_string.c_str();
+    return true;
+}
+
+/**
+ * @brief Stores serial port and device type of the discovered device for the next start
+ */
+void write_port_cache(const std::string& path)
+{
+    std::ofstream cache(path, std::ios::trunc);
+    cache << serial_conf_string << " " << (int)device_info.deviceType << std::endl;
+    if (!cache)
+        std::cerr << "camera: cannot write port cache " << path << std::endl;
+}
+
+/**
+ * @brief Discovers connected RealSenseID devices and selects the first one
+ *
+ * Enumerating the serial ports and probing each takes most of the camera
+ * startup time, so it only runs if the port cache is missing or stale.
+ *
+ * @return false if no device was found
+ */
+bool discover_F455_device()
+{
+    auto devices = RealSenseID::DiscoverDevices();
+    for (const auto& device : devices)
+    {
+        std::cout << "  [*] Found rsid device " << device.deviceType << ". port: " << device.serialPort << std::endl;
+        if (device.deviceType == RealSenseID::DeviceType::Unknown)
+        {
+            std::cout << "Unkown device type for port " << device.serialPort << std::endl;
+            std::exit(1);
+        }
+        device_info.deviceType = device.deviceType; // Store device information
+        serial_conf_string = std::string(device.serialPort);
+        std::cout << "serial port string: " << serial_conf_string << std::endl;
+        serial_config.port = serial_conf_string.c_str();
+        return true; // found 1st RealSenseID device
+    }
+    return false; // no devices found
+}
+
+/**
+ * @brief Maps the names of section [camera] to the device configuration of the F455
+ */
+DeviceConfig to_device_config(const CameraConfig& camera)
+{
+    DeviceConfig F455_config;
+    F455_config.camera_rotation = camera_rotation.at(camera.camera_rotation); // names are validated by read_camera_config()
+    F455_config.security_level = security_level.at(camera.security_level);
+    F455_config.frontal_face_policy = frontal_face_policy.at(camera.frontal_face_policy);
+    F455_config.matcher_confidence_level = matcher_confidence_level.at(camera.matcher_confidence_level);
+    F455_config.algo_flow = algo_flow.at(camera.algo_flow);
+    F455_config.dump_mode = dump_mode.at(camera.dump_mode);
+    F455_config.max_spoofs = (unsigned char) camera.max_spoofs; // max_spoofs currently defined as unsigned char in RealSenseID/DeviceConfig.h
+    F455_config.gpio_auth_toggling = camera.gpio_auth_toggling;
+    return F455_config;
+}
+
+/**
+ * @brief true if the device already runs with configuration wanted
+ */
+bool same_device_config(const DeviceConfig& current, const DeviceConfig& wanted)
+{
+    return current.camera_rotation == wanted.camera_rotation && current.security_level == wanted.security_level
+        && current.frontal_face_policy == wanted.frontal_face_policy && current.matcher_confidence_level == wanted.matcher_confidence_level
+        && current.algo_flow == wanted.algo_flow && current.dump_mode == wanted.dump_mode
+        && current.max_spoofs == wanted.max_spoofs && current.gpio_auth_toggling == wanted.gpio_auth_toggling;
+}
+
 /**
  * @brief Initializes and configures the Intel RealSense F455 camera
  * 
  * This function performs the following operations:
- * - Discovers connected RealSenseID devices
- * - Stores device and serial port information for the first valid device found
+ * - Connects to the serial port of the last start, read from the port cache
+ *   (port_cache in section [camera] of config.toml)
+ * - Otherwise discovers connected RealSenseID devices, stores device and
+ *   serial port information for the first valid device found and updates
+ *   the port cache
  * - Configures camera parameters from config.toml file including:
  *   - Camera rotation
  *   - Security level
@@ -336,72 +545,75 @@ std::unique_ptr<RealSenseID::FaceAuthenticator> createAuthenticator(RealSenseID:
  *   - Dump mode
  *   - Max spoofs
  *   - GPIO authentication toggling
- * - Creates an authenticator and applies the configuration
+ * - Applies the configuration, unless the device reports it already runs with it
  * 
  * @return true if camera is successfully initialized and configured
  * @return false if no devices found or configuration fails
  */
 bool init_F455_camera(){
-    auto devices = RealSenseID::DiscoverDevices();
-    if (!devices.empty())
-    {
-        for (const auto& device : devices)
-        {
-            std::cout << "  [*] Found rsid device " << device.deviceType << ". port: " << device.serialPort << std::endl;
-            if (device.deviceType == RealSenseID::DeviceType::Unknown)
-            {
-                std::cout << "Unkown device type for port " << device.serialPort << std::endl;
-                std::exit(1);
-            }
-            else {
-
-                device_info.deviceType = device.deviceType; // Store device information
-                serial_conf_string = std::string(device.serialPort);
-                std::cout << "serial port string: " << serial_conf_string << std::endl;
-                serial_config.port = serial_conf_string.c_str();
-                break; // found 1st RealSenseID device - break for loop
-            }
-        } // for
-        DeviceConfig F455_config; // set Intel RealSense F455 camera parameters from config.toml
-        F455_config.camera_rotation = camera_rotation.at(config_toml["camera"]["camera_rotation"].value<std::string>().value().c_str()); // map string to enum value
-        F455_config.security_level = security_level.at(config_toml["camera"]["security_level"].value<std::string>().value().c_str()); 
-        F455_config.frontal_face_policy = frontal_face_policy.at(config_toml["camera"]["frontal_face_policy"].value<std::string>().value().c_str());  //  run authentication on closest face
-        F455_config.matcher_confidence_level = matcher_confidence_level.at(config_toml["camera"]["matcher_confidence_level"].value<std::string>().value().c_str());  
-        F455_config.algo_flow = algo_flow.at(config_toml["camera"]["algo_flow"].value<std::string>().value().c_str());
-        F455_config.dump_mode = dump_mode.at(config_toml["camera"]["dump_mode"].value<std::string>().value().c_str());
-        int max_spoofs_int = config_toml["camera"]["max_spoofs"].value_or(0); 
-        F455_config.max_spoofs = (unsigned char) max_spoofs_int;   // max_spoofs currently defined as unsigned char in RealSenseID/DeviceConfig.h
-        F455_config.gpio_auth_toggling = config_toml["camera"]["gpio_auth_toggling"].value_or(0); 
-        std::cout << "F455_config values "  << std::endl;
-        std::cout << "camera_rotation: " << F455_config.camera_rotation << std::endl;
-        std::cout << "security_level: " << F455_config.security_level << std::endl;
-        std::cout << "frontal_face_policy: " << F455_config.frontal_face_policy << std::endl;
-        std::cout << "matcher_confidence_level: " << F455_config.matcher_confidence_level << std::endl;
-        std::cout << "algo_flow: " << F455_config.algo_flow << std::endl;
-        std::cout << "dump_mode: " << F455_config.dump_mode << std::endl;
-        std::cout << "max_spoofs_int: " << max_spoofs_int << std::endl;
-        std::cout << "max_spoofs: " << (int) F455_config.max_spoofs << std::endl;
-        std::cout << "gpio_auth_toggling: " << F455_config.gpio_auth_toggling << std::endl;
-        std::cout << "serial port: " << serial_config.port << std::endl;
+    std::string port_cache = config_toml["camera"]["port_cache"].value_or(std::string(getenv("HOME")) + "/smartdoorF455/rsid_port.cache");
+    std::vector<pid_t> threads_before = list_threads();
+    if (read_port_cache(port_cache)) {
+        std::cout << "camera: trying cached serial port " << serial_config.port << std::endl;
         authenticator = createAuthenticator(serial_config);
-        auto status = authenticator->SetDeviceConfig(F455_config);
-        if (status != RealSenseID::Status::Ok) {
-            std::cerr << "Failed to set device config: " << status << std::endl;
+    }
+    if (!authenticator) { // no cache, or the device moved to another port
+        if (!discover_F455_device())
             return(false);
-        }
-        else return(true);
-    } // no devices found
-    return(false);
+        authenticator = createAuthenticator(serial_config);
+        if (!authenticator)
+            return(false);
+        write_port_cache(port_cache);
+    }
+    place_new_threads(threads_before, "realsense"); // serial reader threads of the SDK
+    DeviceConfig F455_config = to_device_config(app_config.get()->camera); // set Intel RealSense F455 camera parameters from config.toml
+    std::cout << "F455_config values "  << std::endl;
+    std::cout << "camera_rotation: " << F455_config.camera_rotation << std::endl;
+    std::cout << "security_level: " << F455_config.security_level << std::endl;
+    std::cout << "frontal_face_policy: " << F455_config.frontal_face_policy << std::endl;
+    std::cout << "matcher_confidence_level: " << F455_config.matcher_confidence_level << std::endl;
+    std::cout << "algo_flow: " << F455_config.algo_flow << std::endl;
+    std::cout << "dump_mode: " << F455_config.dump_mode << std::endl;
+    std::cout << "max_spoofs: " << (int) F455_config.max_spoofs << std::endl;
+    std::cout << "gpio_auth_toggling: " << F455_config.gpio_auth_toggling << std::endl;
+    std::cout << "serial port: " << serial_config.port << std::endl;
+    DeviceConfig current_config;
+    if (authenticator->QueryDeviceConfig(current_config) == RealSenseID::Status::Ok && same_device_config(current_config, F455_config)) {
+        std::cout << "camera: device config unchanged, not written" << std::endl; // spares a write to the device flash
+        return(true);
+    }
+    auto status = authenticator->SetDeviceConfig(F455_config);
+    if (status != RealSenseID::Status::Ok) {
+        std::cerr << "Failed to set device config: " << status << std::endl;
+        return(false);
+    }
+    else return(true);
+}
+
+/**
+ * @brief Restores full quality of an idle or blank LED matrix panel
+ *
+ * Called on every presence trigger, from the ISR and from motion detection;
+ * an atomic store and an eventfd write, safe in any thread.
+ */
+void wake_display()
+{
+    panel_power.activity(monotonic_us());
+    if (led_display)
+        led_display->notify(); // full quality in the next frame, an unchanged full frame is skipped
 }
 
 /**
- * @brief Callback function for presence detection.
+ * @class GpioTriggerSource
+ * @brief Presence sensor on gpio_sensor_pin, the TriggerSource of the daemon
  *
- * This function is called when the presence sensor (PIR or photoelectric barrier)
- * detects a change in the environment. It is called everytime when gpio_sensor_pin level has changed
- * no matter, whether it be high-to-low or low-to-high. It triggers facial authentication using
- * the Intel RealSense ID F455 camera if enough time has passed since the last
- * authentication.
+ * presence_detected_clbk() is called when the presence sensor (PIR or photoelectric barrier)
+ * detects a change in the environment. It is called when gpio_sensor_pin level has changed
+ * in the direction(s) selected by trigger_edge in config.toml. It runs on the wiringPiISR2 thread and
+ * the edge handler of main() only offers a timestamped edge to the trigger gate of the pipeline (edge policy, burst
+ * collapsing, authentication in flight, hold-off - see trigger_gate.hpp); authentication and snapshot
+ * run on the pipeline worker threads (see authenticate_presence() and capture_snapshot()),
+ * notifications on the outbox sender thread (see send_notification()).
  * 
  * Thoughts on detecting user presence:
  * - Utilize camera-based computer vision techniques to detect user presence to eliminate the need 
@@ -410,77 +622,830 @@ bool init_F455_camera(){
  * - Consider user data privacy and security when capturing and processing images.
  *
  */
-void presence_detected_clbk(struct WPIWfiStatus wfiStatus, void* userdata)
-{    
-    static MyAuthClbk auth_clbk; // callback object for authentication results
-    static bool initial_run = true;
-    static uint32_t wait_time_until_reauthentication = config_toml["raspi"]["wait_time_until_reauthentication"].value_or(3); // in seconds
-    using Clock = std::chrono::steady_clock;
-    // A static variable retains its value between function calls.
-    // It's initialized to the current time on the very first call.
-    static Clock::time_point last_run = Clock::now();
-    // Get the current time.
-    Clock::time_point now = Clock::now();
-    // We convert the duration to seconds as a floating-point number.
-    std::chrono::duration<double> elapsed_seconds = now - last_run;
-    bool min_time_elapsed = (elapsed_seconds.count() >= wait_time_until_reauthentication);
-    std::cout << return_current_time_and_date()  << " presence sensor triggered presence_detected_clbk " << std::endl;
-    std::cout << return_current_time_and_date()  << " wfiStatus.statusOK (should be 1): " << wfiStatus.statusOK << std::endl;
-    // validate, whether this function should actually run, return if
-    // - min_time_elapsed is false (time since last authentication is less than wait_time_until_reauthentication) or
-    // - wfiStatus.statusOK is not OK (!= 1) and
-    // - initial run is false
-    if (((wfiStatus.statusOK != 1) || !min_time_elapsed) && !initial_run){
+class GpioTriggerSource : public TriggerSource
+{
+    private:
+    int pin;
+    EdgePolicy edge_policy;
+    int debounce_usec;
+    EdgeHandler on_edge;
+    bool started = false;
+    static void presence_detected_clbk(struct WPIWfiStatus wfiStatus, void* userdata)
+    {
+        static_cast<GpioTriggerSource*>(userdata)->on_edge(wfiStatus.edge, wfiStatus.statusOK);
+    }
+    public:
+    GpioTriggerSource(int pin, EdgePolicy edge_policy, int debounce_usec)
+        : pin(pin), edge_policy(edge_policy), debounce_usec(debounce_usec) {}
+    ~GpioTriggerSource() override { stop(); }
+    bool start(EdgeHandler handler) override
+    {
+        on_edge = std::move(handler);
+        // EdgePolicy values equal INT_EDGE_FALLING/RISING/BOTH, so the kernel already drops unwanted edges
+        std::vector<pid_t> threads_before = list_threads();
+        wiringPiISR2(pin, (int)edge_policy, &presence_detected_clbk, debounce_usec, this);
+        place_new_threads(threads_before, "isr");
+        started = true;
+        return true;
+    }
+    void stop() override
+    {
+        if (started)
+            wiringPiISRStop(pin); // joins the ISR thread
+        started = false;
+    }
+}; // end class GpioTriggerSource
+
+/**
+ * @brief Auth stage of the trigger pipeline - triggers facial authentication
+ *
+ * Runs on the auth worker thread for every trigger that passed the
+ * trigger gate. Results are delivered to door_controller on the RealSenseID
+ * callback thread - through MyAuthClbk, and HostAuthClbk if host_matching is set.
+ *
+ * @param event accepted trigger event
+ */
+void authenticate_presence(const TriggerEvent& event)
+{
+    LOG_INFO(LogModule::Trigger, "presence sensor triggered, dispatch latency %lld us", (long long)(monotonic_us() - event.ts_us));
+    if (control_engine)
+        control_engine->device().acquire_for_auth(event.ts_us); // preempts a running enrollment
+    {
+        TraceSpan span(TraceStage::Authenticate, event.ts_us);
+        int64_t auth_start_us = monotonic_us();
+        if (!auth_device->authenticate(*door_controller)) // results arrive at door_controller
+            LOG_DEBUG(LogModule::Auth, "authentication not completed");
+        Metrics::observe(MetricHistogram::AuthDuration, monotonic_us() - auth_start_us);
+    }
+    if (control_engine)
+        control_engine->device().release_auth();
+    LOG_DEBUG(LogModule::Auth, "authentication done, serial port %s", serial_config.port);
+    if (event.ts_us == trigger_pipeline.first_accepted_ts_us())
+        LOG_INFO(LogModule::Main, "startup: launch to first accepted trigger %lld ms", (long long)(event.ts_us - launch_us) / 1000);
+} // end authenticate_presence
+
+/**
+ * @brief Reads the user ids of the device database
+ *
+ * @return false if the device database could not be read
+ */
+bool query_device_user_ids(std::vector<std::string>& ids)
+{
+    unsigned int number_of_users = 0;
+    if (authenticator->QueryNumberOfUsers(number_of_users) != RealSenseID::Status::Ok)
+        return false;
+    std::vector<std::vector<char>> id_buffers(number_of_users, std::vector<char>(RealSenseID::MAX_USERID_LENGTH + 1));
+    std::vector<char*> user_ids(number_of_users);
+    for (unsigned int i = 0; i < number_of_users; i++)
+        user_ids[i] = id_buffers[i].data();
+    if (number_of_users > 0 && authenticator->QueryUserIds(user_ids.data(), number_of_users) != RealSenseID::Status::Ok)
+        return false;
+    ids.assign(user_ids.begin(), user_ids.begin() + number_of_users);
+    return true;
+}
+
+/**
+ * @brief Runs a topic_control job on the F455, called on the job thread of control_engine
+ *
+ * The device is granted by the DeviceArbiter of control_engine; an
+ * authentication cancels a running enrollment with FaceAuthenticator::Cancel().
+ * @return true if the job succeeded
+ */
+bool run_control_job(const ControlJob& job, const ControlEngine::ProgressSink& progress)
+{
+    switch (job.kind) {
+    case ControlJob::Kind::Enroll:
+        if (host_matching) { // faceprint goes into faceprint_store, replacing earlier ones of the user
+            HostEnrollClbk enroll_clbk(progress);
+            if (authenticator->ExtractFaceprintsForEnroll(enroll_clbk) != RealSenseID::Status::Ok || enroll_clbk.features.empty())
+                return false;
+            FaceprintRecord record;
+            record.user_id = job.user_id;
+            record.features = std::move(enroll_clbk.features);
+            return faceprint_store->append({ record }, { job.user_id });
+        }
+        else {
+            MyEnrollClbk enroll_clbk(progress);
+            return authenticator->Enroll(enroll_clbk, job.user_id.c_str()) == RealSenseID::Status::Ok && enroll_clbk.succeeded();
+        }
+    case ControlJob::Kind::Delete: {
+        // always removed from the device as well, a user deleted on the host must not open the door in device matching
+        bool removed = authenticator->RemoveUser(job.user_id.c_str()) == RealSenseID::Status::Ok;
+        if (host_matching)
+            return faceprint_store->append({}, { job.user_id });
+        return removed;
+    }
+    case ControlJob::Kind::List: {
+        std::vector<std::string> ids;
+        if (host_matching)
+            ids = faceprint_store->snapshot()->user_ids();
+        else if (!query_device_user_ids(ids))
+            return false;
+        std::string list = std::to_string(ids.size()) + " users:";
+        for (const auto& id : ids)
+            list += " " + id;
+        progress(list);
+        return true;
+    }
+    }
+    return false;
+} // end run_control_job
+
+/**
+ * @brief Imports the faceprints of all users enrolled on the device into faceprint_store
+ *
+ * The raw device faceprints are kept in the store, so the users can be
+ * written back to a replaced camera with export_faceprints_to_device().
+ * @return number of imported faceprints, -1 if the device database could not be read
+ */
+long import_faceprints_from_device()
+{
+    unsigned int number_of_users = 0;
+    if (authenticator->QueryNumberOfUsers(number_of_users) != RealSenseID::Status::Ok)
+        return -1;
+    std::vector<FaceprintRecord> records;
+    if (number_of_users > 0) {
+        std::vector<RealSenseID::Faceprints> faceprints(number_of_users);
+        std::vector<std::vector<char>> id_buffers(number_of_users, std::vector<char>(RealSenseID::MAX_USERID_LENGTH + 1));
+        std::vector<char*> user_ids(number_of_users);
+        for (unsigned int i = 0; i < number_of_users; i++)
+            user_ids[i] = id_buffers[i].data();
+        unsigned int ids_read = number_of_users, faceprints_read = number_of_users;
+        if (authenticator->QueryUserIds(user_ids.data(), ids_read) != RealSenseID::Status::Ok ||
+            authenticator->GetUsersFaceprints(faceprints.data(), faceprints_read) != RealSenseID::Status::Ok)
+            return -1;
+        for (unsigned int i = 0; i < std::min(ids_read, faceprints_read); i++) { // both lists are in device database order
+            FaceprintRecord record;
+            record.user_id = user_ids[i];
+            const int16_t* features = reinterpret_cast<const int16_t*>(faceprints[i].data.adaptiveDescriptorWithoutMask);
+            record.features.assign(features, features + RSID_NUM_OF_RECOGNITION_FEATURES);
+            const uint8_t* raw = reinterpret_cast<const uint8_t*>(&faceprints[i]);
+            record.device_blob.assign(raw, raw + sizeof(RealSenseID::Faceprints));
+            records.push_back(std::move(record));
+        }
+    }
+    if (!faceprint_store->replace(records))
+        return -1;
+    return (long)records.size();
+} // end import_faceprints_from_device
+
+/**
+ * @brief Writes all live users of faceprint_store with device faceprints into the device database
+ *
+ * @return number of exported users, -1 on error
+ */
+long export_faceprints_to_device()
+{
+    std::shared_ptr<const FaceprintDb> db = faceprint_store->snapshot();
+    std::vector<RealSenseID::UserFaceprints_t> users;
+    std::vector<std::string> ids;
+    for (size_t s = 0; s < db->segments().size(); s++) {
+        const FaceprintSegment& segment = *db->segments()[s];
+        if (segment.blob_bytes() != sizeof(RealSenseID::Faceprints))
+            continue; // faceprints enrolled on the host only, the device can't use them
+        for (size_t r = 0; r < segment.size(); r++) {
+            const uint8_t* blob = segment.blob(r);
+            if (db->is_deleted(s, r) || std::all_of(blob, blob + segment.blob_bytes(), [](uint8_t b) { return b == 0; }))
+                continue; // deleted, or enrolled on the host and merged with device faceprints by compaction
+            RealSenseID::UserFaceprints_t user;
+            std::memcpy(&user.faceprints, blob, sizeof(RealSenseID::Faceprints));
+            ids.emplace_back(segment.user_id(r));
+            users.push_back(user);
+        }
+    }
+    for (size_t i = 0; i < users.size(); i++)
+        users[i].user_id = const_cast<char*>(ids[i].c_str()); // after ids stopped growing, the SDK only reads it
+    if (!users.empty() && authenticator->SetUsersFaceprints(users.data(), (unsigned int)users.size()) != RealSenseID::Status::Ok)
+        return -1;
+    return (long)users.size();
+} // end export_faceprints_to_device
+
+/**
+ * @brief Returns a jpeg buffer from a small pool for reuse
+ *
+ * A buffer is free again, once the notification outbox released its
+ * reference. Buffers keep their capacity, so steady state encoding does not
+ * allocate.
+ */
+std::shared_ptr<std::vector<unsigned char>> acquire_jpeg_buffer()
+{
+    static std::shared_ptr<std::vector<unsigned char>> jpeg_buffers[JPEG_BUFFER_POOL];
+    for (auto& buffer : jpeg_buffers) {
+        if (!buffer)
+            buffer = std::make_shared<std::vector<unsigned char>>();
+        if (buffer.use_count() == 1) // not referenced by a pending notification
+            return buffer;
+    }
+    return std::make_shared<std::vector<unsigned char>>(); // pool exhausted, notifier is lagging behind
+}
+
+/**
+ * @class CvSnapshotCamera
+ * @brief SnapshotCamera on the ring buffer of snapshot_capture, encoded by cv::imencode
+ */
+class CvSnapshotCamera : public SnapshotCamera
+{
+    private:
+    SnapshotCapture& capture;
+    std::vector<int> jpeg_params;
+    cv::Mat frame; // rotated snapshot, reused
+    public:
+    CvSnapshotCamera(SnapshotCapture& capture, int jpeg_quality)
+        : capture(capture), jpeg_params{cv::IMWRITE_JPEG_QUALITY, jpeg_quality} {}
+    bool capture_jpeg(int64_t trigger_ts_us, std::vector<unsigned char>& jpeg) override
+    {
+        if (!capture.snapshot(trigger_ts_us, frame)) {
+            LOG_ERROR(LogModule::Snapshot, "no snapshot frame available");
+            return false;
+        }
+        if (!cv::imencode(".jpg", frame, jpeg, jpeg_params)) {
+            LOG_ERROR(LogModule::Snapshot, "could not encode snapshot");
+            return false;
+        }
+        return true;
+    }
+}; // end class CvSnapshotCamera
+
+/**
+ * @brief Snapshot stage of the trigger pipeline - encodes a camera snapshot as in-memory jpeg
+ *
+ * Runs on the snapshot worker thread in parallel to authentication and hands
+ * the jpeg to the notification outbox. The frame is taken from the ring
+ * buffer of the persistent capture service, so it may show the scene from
+ * before the trigger and no camera device is opened here. The jpeg is
+ * encoded with cv::imencode into a reused buffer; if save_snapshots is set,
+ * it is written to ~/smartdoorF455/snapshots/ afterwards - the notification
+ * has been handed off by then, so SD card I/O never delays the Telegram upload.
+ *
+ * @param event accepted trigger event
+ */
+void capture_snapshot(const TriggerEvent& event)
+{
+    int64_t capture_start_us = monotonic_us();
+    auto jpeg = acquire_jpeg_buffer();
+    if (!snapshot_camera || !snapshot_camera->capture_jpeg(event.ts_us, *jpeg))
         return;
+    Notification notification;
+    notification.kind = Notification::Kind::Photo;
+    notification.photo_jpeg = jpeg;
+    notification.trigger_ts_us = event.ts_us;
+    Metrics::observe(MetricHistogram::SnapshotCapture, monotonic_us() - capture_start_us);
+    if (outbox)
+        outbox->post(std::move(notification));
+    if (save_snapshots) { // optional persistence, off the notification path
+        std::string home_dir = getenv("HOME");
+        std::string snapshot_dir = home_dir + "/smartdoorF455/snapshots/";
+        if (!std::filesystem::exists(snapshot_dir)) {
+            std::filesystem::create_directory(snapshot_dir); // create directory if it doesn't exist
+        }
+        std::string snapshot_file = snapshot_dir +"snapshot_" + std::to_string(std::time(nullptr)) + ".jpg"; // filename with timestamp
+        std::ofstream file(snapshot_file, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(jpeg->data()), jpeg->size());
+        if (!file)
+            LOG_ERROR(LogModule::Snapshot, "could not write %s", snapshot_file.c_str());
     }
-    initial_run = false;
-    last_run = Clock::now();
-    std::cout << "presence detected - serial port: " << serial_config.port << std::endl;
-    authenticator->Authenticate(auth_clbk); // trigger camera authentication process
-    std::cout << "authenticator called " << std::endl;
-#ifdef STDOUT_ADDTL_INFO /* when presence is detected triggered facial authentication  */
-    std::cout << return_current_time_and_date()  << " authentication triggered" << std::endl;
-#endif /* STDOUT_ADDTL_INFO */
-    // std::this_thread::sleep_for(std::chrono::milliseconds {400});
-    if (send_snapshot && use_telegram) { // start preview to save snapshot and send to telegram bot 
-        std::string snapshot_file;
-        // std::this_thread::sleep_for(std::chrono::milliseconds {400});
-        cv::VideoCapture camera(0, cv::CAP_V4L2); // open Intel RealSenseID camera as a webcam and store snapshot as jpg file
-        if (!camera.isOpened()) {
-            std::cerr << "ERROR: Could not open camera" << std::endl;
-        } else { // camera opened for snapshot
-            std::string home_dir = getenv("HOME");
-            std::string snapshot_dir = home_dir + "/smartdoorF455/snapshots/";
-            if (!std::filesystem::exists(snapshot_dir)) {
-                std::filesystem::create_directory(snapshot_dir); // create directory if it doesn't exist
-            }
-            snapshot_file = snapshot_dir +"snapshot_" + std::to_string(std::time(nullptr)) + ".jpg"; // filename with timestamp
-            cv::Mat frame;
-            camera >> frame;
-            cv::rotate(frame, frame, cv::ROTATE_90_COUNTERCLOCKWISE);
-            if (!frame.empty()) {
-                cv::imwrite(snapshot_file, frame);
-            }
-            camera.release(); // Closes video file or capturing device
-            try {
-                if (chat_id != 0) {
-                    // take snapshot and send to telegram bot
-                    string photoMimeType = "image/jpeg";
-                    bot->getApi().sendPhoto(chat_id, TgBot::InputFile::fromFile(snapshot_file, photoMimeType));
-                    /* std::ifstream file(snapshot_file, std::ios::binary);
-                    if (file) {
-                        TgBot::InputFile::Ptr inputFile(new TgBot::InputFile);
-                    inputFile->setFile(file, snapshot_file);
-                    bot->getApi().sendPhoto(chat_id, inputFile);
-                    } */
-                } // if (chat_id != 0)
-            } // try
-            catch (TgBot::TgException& e) {
-                std::cout << "error sending telegram photo: " << e.what() << std::endl;
+} // end capture_snapshot
+
+/**
+ * @brief Reads the trigger gate settings of section [raspi] in config.toml
+ *
+ * @param table parsed config.toml
+ * @return edge policy, burst window and reauthentication hold-off
+ */
+GateConfig read_gate_config(const toml::table& table)
+{
+    GateConfig config;
+    std::string edge = table["raspi"]["trigger_edge"].value_or(std::string("both"));
+    if (edge == "rising")
+        config.edge_policy = EdgePolicy::Rising;
+    else if (edge == "falling")
+        config.edge_policy = EdgePolicy::Falling;
+    else if (edge != "both")
+        std::cerr << "Warning: raspi.trigger_edge must be rising, falling or both; using both" << std::endl;
+    uint32_t wait_time_until_reauthentication = table["raspi"]["wait_time_until_reauthentication"].value_or(3); // in seconds
+    config.holdoff_us = (int64_t)wait_time_until_reauthentication * 1000000;
+    config.burst_us = table["raspi"]["trigger_burst_usec"].value_or(config.burst_us);
+    return config;
+}
+
+/**
+ * @brief Reads section [snapshot] of config.toml
+ *
+ * @return SnapshotCaptureConfig with defaults for missing keys
+ */
+SnapshotCaptureConfig read_snapshot_config()
+{
+    SnapshotCaptureConfig config;
+    config.source = config_toml["snapshot"]["source"].value_or(config.source);
+    config.fps = config_toml["snapshot"]["fps"].value_or(config.fps);
+    config.width = config_toml["snapshot"]["width"].value_or(config.width);
+    config.height = config_toml["snapshot"]["height"].value_or(config.height);
+    config.ring_frames = config_toml["snapshot"]["ring_frames"].value_or(config.ring_frames);
+    config.pre_trigger_ms = config_toml["snapshot"]["pre_trigger_msec"].value_or(config.pre_trigger_ms);
+    config.max_buffer_mb = config_toml["snapshot"]["max_buffer_mb"].value_or(config.max_buffer_mb);
+    config.rotation = config_toml["snapshot"]["rotation"].value_or(config.rotation);
+    return config;
+} // end read_snapshot_config
+
+/**
+ * @brief Reads section [motion] of config.toml
+ *
+ * @return MotionPresenceConfig with defaults for missing keys
+ */
+MotionPresenceConfig read_motion_config()
+{
+    MotionPresenceConfig config;
+    config.source = config_toml["motion"]["source"].value_or(config.source);
+    config.fps = config_toml["motion"]["fps"].value_or(config.fps);
+    config.width = config_toml["motion"]["width"].value_or(config.width);
+    config.height = config_toml["motion"]["height"].value_or(config.height);
+    config.threshold = config_toml["motion"]["threshold"].value_or(config.threshold);
+    config.min_area_percent = config_toml["motion"]["min_area_percent"].value_or(config.min_area_percent);
+    config.min_frames = config_toml["motion"]["min_frames"].value_or(config.min_frames);
+    config.still_frames = config_toml["motion"]["still_frames"].value_or(config.still_frames);
+    config.learn_shift = config_toml["motion"]["learn_shift"].value_or(config.learn_shift);
+    config.cpu_budget_percent = config_toml["motion"]["cpu_budget_percent"].value_or(config.cpu_budget_percent);
+    return config;
+} // end read_motion_config
+
+/**
+ * @brief Reads section [metrics] of config.toml
+ *
+ * @return MetricsConfig, listen is empty if the endpoint is off
+ */
+MetricsConfig read_metrics_config()
+{
+    MetricsConfig config;
+    config.listen = config_toml["metrics"]["listen"].value_or(config.listen);
+    return config;
+} // end read_metrics_config
+
+/**
+ * @brief Reads section [threads] of config.toml
+ *
+ * Every entry is a thread name with cpus, policy and priority, e.g.
+ * display = { cpus = [3], policy = "fifo", priority = 50 }
+ */
+void read_thread_config()
+{
+    auto threads = config_toml["threads"].as_table();
+    if (!threads)
+        return; // threads are named, placement is inherited
+    for (auto&& [name, node] : *threads) {
+        auto entry = node.as_table();
+        if (!entry) {
+            std::cerr << "threads: entry " << name.str() << " is no table, ignored" << std::endl;
+            continue;
+        }
+        ThreadPolicy policy;
+        if (auto cpus = (*entry)["cpus"].as_array()) {
+            for (auto&& cpu : *cpus)
+                policy.cpus.push_back(cpu.value_or(0));
+        }
+        policy.policy = (*entry)["policy"].value_or(policy.policy);
+        policy.priority = (*entry)["priority"].value_or(policy.priority);
+        set_thread_policy(std::string(name.str()), policy);
+    }
+    std::cout << "threads: " << threads->size() << " placements configured, cap_sys_nice "
+              << (has_cap_sys_nice() ? "effective" : "missing") << std::endl;
+} // end read_thread_config
+
+/**
+ * @brief Reads the idle power settings of section [matrix_options] of config.toml
+ *
+ * @param table parsed config.toml
+ * @return PanelPowerConfig with defaults for missing keys
+ */
+PanelPowerConfig read_panel_power_config(const toml::table& table)
+{
+    PanelPowerConfig config;
+    config.idle_after_s = table["matrix_options"]["idle_after_s"].value_or(config.idle_after_s);
+    config.blank_after_s = table["matrix_options"]["blank_after_s"].value_or(config.blank_after_s);
+    config.idle_brightness = table["matrix_options"]["idle_brightness"].value_or(config.idle_brightness);
+    config.idle_pwm_bits = table["matrix_options"]["idle_pwm_bits"].value_or(config.idle_pwm_bits);
+    config.limit_refresh_rate_hz = table["matrix_options"]["limit_refresh_rate_hz"].value_or(config.limit_refresh_rate_hz);
+    return config;
+} // end read_panel_power_config
+
+/**
+ * @brief Reads section [animation] of config.toml
+ *
+ * @param table parsed config.toml
+ * @return AnimationConfig with defaults for missing keys
+ */
+AnimationConfig read_animation_config(const toml::table& table)
+{
+    AnimationConfig config;
+    config.fps = table["animation"]["fps"].value_or(config.fps);
+    config.cpu_budget_percent = table["animation"]["cpu_budget_percent"].value_or(config.cpu_budget_percent);
+    config.marquee_speed = table["animation"]["marquee_speed"].value_or(config.marquee_speed);
+    config.sprite_sheet = table["animation"]["sprite_sheet"].value_or(config.sprite_sheet);
+    config.sprite_frame_width = table["animation"]["sprite_frame_width"].value_or(config.sprite_frame_width);
+    config.sprite_frame_height = table["animation"]["sprite_frame_height"].value_or(config.sprite_frame_height);
+    config.sprite_fps = table["animation"]["sprite_fps"].value_or(config.sprite_fps);
+    if (auto position = table["animation"]["sprite_position"].as_array()) {
+        config.sprite_x = position->at(0).value_or(config.sprite_x);
+        config.sprite_y = position->at(1).value_or(config.sprite_y);
+    }
+    config.sprite_duration_ms = table["animation"]["sprite_duration_ms"].value_or(config.sprite_duration_ms);
+    if (auto key = table["animation"]["sprite_key_color"].as_array()) {
+        config.sprite_key_color = Rgb{ (uint8_t)key->at(0).value_or(0), (uint8_t)key->at(1).value_or(0), (uint8_t)key->at(2).value_or(0) };
+    }
+    return config;
+} // end read_animation_config
+
+/**
+ * @brief Reads color key of section as [r, g, b]
+ *
+ * @return false if the key is not an array of three values 0..255; color keeps its default then
+ */
+bool read_color(const toml::table& table, const char* section, const char* key, Rgb& color)
+{
+    auto node = table[section][key];
+    if (!node)
+        return true; // default
+    const toml::array* rgb = node.as_array();
+    if (rgb == nullptr || rgb->size() != 3) {
+        std::cerr << "config: " << section << "." << key << " must be [r, g, b]" << std::endl;
+        return false;
+    }
+    int64_t value[3];
+    for (int i = 0; i < 3; i++) {
+        value[i] = rgb->at(i).value_or(int64_t(-1));
+        if (value[i] < 0 || value[i] > 255) {
+            std::cerr << "config: " << section << "." << key << " values must be 0..255" << std::endl;
+            return false;
+        }
+    }
+    color = Rgb{ (uint8_t)value[0], (uint8_t)value[1], (uint8_t)value[2] };
+    return true;
+}
+
+/**
+ * @brief Reads the display settings of sections [matrix_options] and [animation] of config.toml
+ *
+ * @return false if a value is invalid
+ */
+bool read_display_config(const toml::table& table, DisplayConfig& display)
+{
+    bool valid = read_color(table, "matrix_options", "clock_color", display.clock_color)
+        & read_color(table, "matrix_options", "date_color", display.date_color)
+        & read_color(table, "matrix_options", "day_color", display.day_color)
+        & read_color(table, "matrix_options", "username_color", display.username_color)
+        & read_color(table, "matrix_options", "bg_color", display.bg_color)
+        & read_color(table, "matrix_options", "outline_color", display.outline_color)
+        & read_color(table, "matrix_options", "alert_color", display.alert_color);
+    display.brightness = table["matrix_options"]["brightness"].value_or(display.brightness);
+    display.pixel_mapper_config = table["matrix_options"]["pixel_mapper_config"].value_or(display.pixel_mapper_config);
+    display.hardware_mapping = table["matrix_options"]["hardware_mapping"].value_or(display.hardware_mapping);
+    display.power = read_panel_power_config(table);
+    display.animation = read_animation_config(table);
+    if (display.brightness < 1 || display.brightness > 100 || display.power.idle_brightness < 1 || display.power.idle_brightness > 100) {
+        std::cerr << "config: matrix_options.brightness and idle_brightness must be 1..100" << std::endl;
+        valid = false;
+    }
+    if (display.power.idle_pwm_bits < 1 || display.power.idle_pwm_bits > 11) {
+        std::cerr << "config: matrix_options.idle_pwm_bits must be 1..11" << std::endl;
+        valid = false;
+    }
+    return valid;
+} // end read_display_config
+
+/**
+ * @brief Reads the device settings of section [camera] of config.toml
+ *
+ * @return false if a value is not one of the names in smartdoorF455.hpp
+ */
+bool read_camera_config(const toml::table& table, CameraConfig& camera)
+{
+    camera.camera_rotation = table["camera"]["camera_rotation"].value_or(camera.camera_rotation);
+    camera.security_level = table["camera"]["security_level"].value_or(camera.security_level);
+    camera.frontal_face_policy = table["camera"]["frontal_face_policy"].value_or(camera.frontal_face_policy);
+    camera.matcher_confidence_level = table["camera"]["matcher_confidence_level"].value_or(camera.matcher_confidence_level);
+    camera.algo_flow = table["camera"]["algo_flow"].value_or(camera.algo_flow);
+    camera.dump_mode = table["camera"]["dump_mode"].value_or(camera.dump_mode);
+    camera.max_spoofs = table["camera"]["max_spoofs"].value_or(camera.max_spoofs);
+    camera.gpio_auth_toggling = table["camera"]["gpio_auth_toggling"].value_or(camera.gpio_auth_toggling);
+    bool valid = true;
+    auto check = [&valid](const char* key, const std::string& value, bool known) {
+        if (!known) {
+            std::cerr << "config: camera." << key << " \"" << value << "\" is not a valid value" << std::endl;
+            valid = false;
+        }
+    };
+    check("camera_rotation", camera.camera_rotation, camera_rotation.count(camera.camera_rotation) > 0);
+    check("security_level", camera.security_level, security_level.count(camera.security_level) > 0);
+    check("frontal_face_policy", camera.frontal_face_policy, frontal_face_policy.count(camera.frontal_face_policy) > 0);
+    check("matcher_confidence_level", camera.matcher_confidence_level, matcher_confidence_level.count(camera.matcher_confidence_level) > 0);
+    check("algo_flow", camera.algo_flow, algo_flow.count(camera.algo_flow) > 0);
+    check("dump_mode", camera.dump_mode, dump_mode.count(camera.dump_mode) > 0);
+    check("max_spoofs", std::to_string(camera.max_spoofs), camera.max_spoofs >= 0 && camera.max_spoofs <= 255);
+    return valid;
+} // end read_camera_config
+
+/**
+ * @brief Reads section [log] of config.toml
+ *
+ * A file name starting with "~/" is taken relative to $HOME.
+ * @return false if a level is none of debug, info, warn, error, off
+ */
+bool read_log_config(const toml::table& table, LogConfig& log)
+{
+    log.file = table["log"]["file"].value_or(log.file);
+    const char* home_dir = getenv("HOME");
+    if (log.file.compare(0, 2, "~/") == 0 && home_dir != nullptr)
+        log.file = std::string(home_dir) + log.file.substr(1);
+    log.max_bytes = (size_t)table["log"]["max_size_mb"].value_or(int64_t(log.max_bytes >> 20)) << 20;
+    log.keep_files = table["log"]["keep_files"].value_or(log.keep_files);
+    bool valid = true;
+    std::string level = table["log"]["level"].value_or(std::string("info"));
+    if (!parse_log_level(level, log.level)) {
+        std::cerr << "config: log.level \"" << level << "\" is not a valid value" << std::endl;
+        valid = false;
+    }
+    for (LogLevel& module_level : log.module_levels)
+        module_level = log.level;
+    if (const toml::table* modules = table["log"]["modules"].as_table()) {
+        for (auto&& [key, node] : *modules) {
+            int m = 0;
+            while (m < (int)LogModule::COUNT && key.str() != log_module_name((LogModule)m))
+                m++;
+            std::string name = node.value_or(std::string());
+            if (m == (int)LogModule::COUNT || !parse_log_level(name, log.module_levels[m])) {
+                std::cerr << "config: log.modules." << key.str() << " \"" << name << "\" is not a valid module or level" << std::endl;
+                valid = false;
             }
-        } // if (!camera.isOpened())
-    } // end if (send_snapshot)  
-} // end presence_detected_clbk
+        }
+    }
+    if (log.max_bytes == 0 || log.keep_files < 0) {
+        std::cerr << "config: log.max_size_mb must be at least 1, log.keep_files at least 0" << std::endl;
+        valid = false;
+    }
+    return valid;
+} // end read_log_config
+
+/**
+ * @brief Stores every key of table as "section.key" with its value as text
+ */
+void collect_config_values(const toml::table& table, const std::string& prefix, std::map<std::string, std::string>& values)
+{
+    for (auto&& [key, node] : table) {
+        std::string name = prefix.empty() ? std::string(key.str()) : prefix + "." + std::string(key.str());
+        if (const toml::table* section = node.as_table()) {
+            collect_config_values(*section, name, values);
+            continue;
+        }
+        std::ostringstream text;
+        node.visit([&text](auto&& value) { text << value; });
+        values[name] = text.str();
+    }
+}
+
+/**
+ * @brief Parses and validates the settings used after startup into a typed snapshot
+ *
+ * @param table parsed config.toml
+ * @return snapshot to publish in app_config, nullptr if a value is invalid
+ */
+std::shared_ptr<AppConfig> read_app_config(const toml::table& table)
+{
+    auto config = std::make_shared<AppConfig>();
+    config->gate = read_gate_config(table);
+    bool valid = read_display_config(table, config->display);
+    valid = read_camera_config(table, config->camera) && valid;
+    valid = read_log_config(table, config->log) && valid;
+    if (!valid)
+        return nullptr;
+    collect_config_values(table, "", config->values);
+    return config;
+} // end read_app_config
+
+/**
+ * @brief Writes changed device settings to the connected F455, between two authentications
+ *
+ * Holds the trigger gate while the device is written, so no authentication
+ * starts meanwhile; a running control job is preempted and resumed later.
+ *
+ * @return false if an authentication is running, try again later
+ */
+bool apply_camera_config(const CameraConfig& camera)
+{
+    if (!trigger_pipeline.try_hold())
+        return false;
+    if (control_engine)
+        control_engine->device().acquire_for_auth();
+    auto status = authenticator->SetDeviceConfig(to_device_config(camera));
+    if (control_engine)
+        control_engine->device().release_auth();
+    trigger_pipeline.release_hold();
+    if (status != RealSenseID::Status::Ok)
+        LOG_ERROR(LogModule::Config, "failed to set device config: %s", RealSenseID::Description(status));
+    else
+        LOG_INFO(LogModule::Config, "device config of the F455 updated");
+    return true;
+}
+
+/**
+ * @brief Reloads config.toml and applies what changed
+ *
+ * Called by the main loop on SIGHUP or when config.toml was saved. Display
+ * settings are taken over by the render thread with the next frame, gate
+ * windows right away; device settings are written to the F455 by the main
+ * loop once no authentication runs (see pending_camera). Changes of other
+ * keys are logged, they take effect after a restart.
+ *
+ * @param pending_camera set to the new snapshot if device settings changed
+ */
+void reload_config(std::shared_ptr<const AppConfig>& pending_camera)
+{
+    toml::table table;
+    try {
+        table = toml::parse_file(CONFIG_FILE);
+    }
+    catch (const toml::parse_error& err) {
+        std::ostringstream reason;
+        reason << err;
+        LOG_ERROR(LogModule::Config, "%s not reloaded, parsing failed: %s", CONFIG_FILE, reason.str().c_str());
+        return;
+    }
+    std::shared_ptr<const AppConfig> next = read_app_config(table);
+    if (!next) {
+        LOG_ERROR(LogModule::Config, "%s not reloaded, running configuration kept", CONFIG_FILE);
+        return;
+    }
+    std::shared_ptr<const AppConfig> current = app_config.get();
+    ConfigDelta delta = diff_config(*current, *next);
+    if (delta.empty()) {
+        LOG_INFO(LogModule::Config, "reloaded, nothing changed");
+        return;
+    }
+    for (const std::string& key : delta.restart)
+        LOG_WARN(LogModule::Config, "%s changed, takes effect after a restart", key.c_str());
+    app_config.publish(next);
+    if (delta.gate)
+        trigger_pipeline.retime(next->gate);
+    if (delta.display && led_display)
+        led_display->notify(); // render thread takes over the new settings
+    if (delta.camera)
+        pending_camera = next;
+    if (delta.log)
+        AsyncLog::set_levels(next->log);
+    LOG_INFO(LogModule::Config, "reloaded%s%s%s%s updated", delta.display ? ", display" : "", delta.gate ? ", trigger gate" : "",
+             delta.camera ? ", camera" : "", delta.log ? ", log levels" : "");
+} // end reload_config
+
+/**
+ * @brief Sender of the notification outbox - sends Telegram messages and photos
+ *
+ * Runs on the outbox sender thread, so a slow or unreachable Telegram
+ * server does not stall the door opener.
+ *
+ * @param notification message or photo to send
+ * @return Retry on network errors and rate limiting, Failed if Telegram rejected the request
+ */
+NotificationOutbox::SendResult send_notification(const Notification& notification)
+{
+    if (!use_telegram || chat_id == 0)
+        return NotificationOutbox::SendResult::Failed;
+    LOG_DEBUG(LogModule::Telegram, "sending to chat_id %ld", chat_id);
+    TraceSpan span(TraceStage::TelegramSend, notification.trigger_ts_us);
+    try {
+        if (notification.kind == Notification::Kind::Photo && notification.photo_jpeg) {
+            // send in-memory jpeg snapshot to telegram bot, no file system round-trip
+            // TgBot::InputFile owns its payload as std::string - the buffer keeps its capacity between photos
+            static TgBot::InputFile::Ptr photo = std::make_shared<TgBot::InputFile>();
+            photo->data.assign(reinterpret_cast<const char*>(notification.photo_jpeg->data()), notification.photo_jpeg->size());
+            photo->mimeType = "image/jpeg";
+            photo->fileName = "snapshot.jpg";
+            bot->getApi().sendPhoto(chat_id, photo);
+        }
+        else {
+            bot->getApi().sendMessage(chat_id, notification.text);
+        }
+    } // try
+    catch (TgBot::TgException& e) {
+        LOG_WARN(LogModule::Telegram, "error sending telegram message: %s", e.what());
+        switch (e.errorCode) { // request itself is wrong - retrying won't help
+            case TgBot::TgException::ErrorCode::BadRequest:
+            case TgBot::TgException::ErrorCode::Unauthorized:
+            case TgBot::TgException::ErrorCode::Forbidden:
+            case TgBot::TgException::ErrorCode::NotFound:
+                return NotificationOutbox::SendResult::Failed;
+            default:
+                return NotificationOutbox::SendResult::Retry;
+        }
+    }
+    catch (std::exception& e) { // network errors, timeouts
+        LOG_WARN(LogModule::Telegram, "error sending telegram message: %s", e.what());
+        return NotificationOutbox::SendResult::Retry;
+    }
+    return NotificationOutbox::SendResult::Sent;
+} // end send_notification
+
+/**
+ * @brief Prints metrics of the notification outbox
+ */
+void print_outbox_metrics()
+{
+    if (!outbox)
+        return;
+    std::cout << "telegram outbox depth: " << outbox->depth() << ", sent: " << outbox->sent_count()
+              << ", failed: " << outbox->failed_count() << ", dropped: " << outbox->dropped_count()
+              << ", coalesced: " << outbox->coalesced_count() << ", retries: " << outbox->retry_count()
+              << ", send latency last/max: " << outbox->last_send_latency_us() / 1000 << "/" << outbox->max_send_latency_us() / 1000 << " ms"
+              << ", queued: " << outbox->last_queue_latency_us() / 1000 << " ms" << std::endl;
+}
+
+/**
+ * @brief Writes the counters and queue depths of the components for the metrics endpoint
+ *
+ * Called on the metrics server thread on every scrape; the components count
+ * in relaxed atomics of their own, reading them takes no lock.
+ */
+void write_component_metrics(std::ostream& os)
+{
+    write_counter(os, "smartdoor_sensor_edges_total", "presence triggers posted by sensor edges and motion detection", trigger_pipeline.triggers_posted());
+    write_counter(os, "smartdoor_triggers_accepted_total", "triggers that passed the trigger gate", trigger_pipeline.triggers_accepted());
+    write_counter(os, "smartdoor_triggers_dropped_total", "accepted triggers dropped, authentication queue full", trigger_pipeline.triggers_dropped());
+    os << "# HELP smartdoor_triggers_rejected_total triggers rejected by the trigger gate, by reason\n"
+          "# TYPE smartdoor_triggers_rejected_total counter\n";
+    for (int d = (int)GateDecision::Accept + 1; d < (int)GateDecision::COUNT; d++)
+        os << "smartdoor_triggers_rejected_total{reason=\"" << gate_decision_name((GateDecision)d) << "\"} "
+           << trigger_pipeline.trigger_gate().decision_count((GateDecision)d) << "\n";
+    write_gauge(os, "smartdoor_trigger_queue_depth", "accepted triggers waiting for authentication", trigger_pipeline.trigger_queue_depth());
+    write_gauge(os, "smartdoor_snapshot_queue_depth", "accepted triggers waiting for a snapshot", trigger_pipeline.snapshot_queue_depth());
+    if (mqtt_session) {
+        write_counter(os, "smartdoor_mqtt_publishes_total", "door open messages published", mqtt_session->publish_count());
+        write_counter(os, "smartdoor_mqtt_publish_failures_total", "door open messages not published", mqtt_session->publish_failures());
+        write_counter(os, "smartdoor_mqtt_acks_total", "door open messages acknowledged by the broker", mqtt_session->ack_count());
+        write_counter(os, "smartdoor_mqtt_status_publishes_total", "control job status messages published", mqtt_session->message_publish_count());
+        write_counter(os, "smartdoor_mqtt_reconnects_total", "reconnects to the MQTT broker", mqtt_session->reconnect_count());
+        write_gauge(os, "smartdoor_mqtt_connected", "1 if connected to the MQTT broker", mqtt_session->is_connected() ? 1 : 0);
+    }
+    if (outbox) {
+        write_counter(os, "smartdoor_telegram_sent_total", "telegram messages and photos sent", outbox->sent_count());
+        write_counter(os, "smartdoor_telegram_failures_total", "telegram messages given up", outbox->failed_count());
+        write_counter(os, "smartdoor_telegram_retries_total", "telegram sends retried", outbox->retry_count());
+        write_counter(os, "smartdoor_telegram_dropped_total", "telegram messages dropped, outbox full", outbox->dropped_count());
+        write_gauge(os, "smartdoor_outbox_depth", "telegram messages waiting to be sent", outbox->depth());
+    }
+    if (control_engine)
+        write_gauge(os, "smartdoor_control_queue_depth", "topic_control jobs waiting", control_engine->queued());
+    write_counter(os, "smartdoor_log_written_total", "messages written to the asynchronous log", AsyncLog::written_count());
+    write_counter(os, "smartdoor_log_dropped_total", "messages dropped, log ring full", AsyncLog::dropped_count());
+} // end write_component_metrics
+
+/**
+ * @brief Prints counters of the asynchronous log
+ */
+void print_log_metrics()
+{
+    std::cout << "log messages written: " << AsyncLog::written_count() << ", dropped: " << AsyncLog::dropped_count()
+              << ", file rotations: " << AsyncLog::rotation_count() << std::endl;
+}
+
+/**
+ * @brief Prints how long startup took and when the first trigger was accepted
+ */
+void print_startup_metrics()
+{
+    int64_t first_trigger_us = trigger_pipeline.first_accepted_ts_us();
+    std::cout << "startup: ready " << startup_ready_us / 1000 << " ms after launch, first accepted trigger ";
+    if (first_trigger_us != 0)
+        std::cout << (first_trigger_us - launch_us) / 1000 << " ms after launch" << std::endl;
+    else
+        std::cout << "none yet" << std::endl;
+}
+
+/**
+ * @brief Stops what the startup stages started before one of them failed
+ *
+ * Same order as the shutdown at the end of main(), without its statistics;
+ * every stop() returns at once if its component was never started.
+ */
+void stop_after_failed_startup()
+{
+    if (motion_presence)
+        motion_presence->stop();
+    if (control_engine)
+        control_engine->stop();
+    if (gpio_trigger)
+        gpio_trigger->stop();
+    trigger_pipeline.stop();
+    if (outbox)
+        outbox->stop();
+    if (snapshot_capture)
+        snapshot_capture->stop();
+    if (mqtt_session)
+        mqtt_session->stop();
+    if (led_display)
+        led_display->stop(); // the returned panel clears the LEDs
+    if (faceprint_store)
+        faceprint_store->stop_compaction();
+    if (authenticator)
+        authenticator->Disconnect();
+    AsyncLog::stop();
+} // end stop_after_failed_startup
 
 /**
  * @brief Signal handler for handling interrupt signals.
@@ -495,177 +1460,119 @@ void signalHandler( int signum ) {
     interrupt_received = true; /* CTRL+C pressed - let's terminate this program */ 
     std::cout << "\nInterrupt signal (" << signum << ") received.\n";
 }
+
+/**
+ * @brief Signal handler for SIGHUP - requests a reload of config.toml
+ *
+ * Only sets a flag; the main loop parses the file and applies the changes.
+ *
+ * @param signum The signal number that was received.
+ */
+void reloadSignalHandler( int signum ) {
+    reload_requested = 1;
+}
+
 /**
- * @class matrixLEDTask
- * @brief Class to manage an RGB LED matrix display by calling 
- * @brief task_function every update interval as a separate thread
+ * @brief Signal handler for SIGUSR1 - requests a latency trace report
  *
- * This class handles the initialization and operation of an RGB LED matrix display.
- * It runs a worker thread that periodically updates the display with time, date,
- * and user authentication information. The display uses double buffering for smooth updates.
+ * Only sets a flag; the report is printed by the main loop, as formatting
+ * and sorting percentiles is not async-signal-safe.
  *
- * Features:
- * - Configurable LED matrix parameters (rows, columns, brightness, etc.)
- * - Real-time display of clock, date and day of week
- * - Display of authenticated user names
- * - Double buffering for smooth display updates
- * - Configurable colors for different display elements
+ * @param signum The signal number that was received.
+ */
+void traceSignalHandler( int signum ) {
+    dump_trace_requested = 1;
+}
+/**
+ * @class RgbMatrixPanel
+ * @brief LedPanel on the HUB75 LED matrix, driven by rpi-rgb-led-matrix
+ *
+ * Rendering - clock, date, day, names, hints, alerts and animation - is done
+ * by LedDisplay (see led_display.hpp); this class only copies the rendered
+ * rows to the offscreen canvas and swaps it at vsync.
  *
  * @note Requires rpi-rgb-led-matrix library
- * @note Configuration is read from a TOML config file
  *
  * Example usage:
  * @code
- * matrixLEDTask matrix(100); // Create with 100ms update interval
- * matrixLEDTask.start(); // Start the display thread
- * // ... program main loop ...
- * matrixLEDTask.stop(); // Stop the display thread
+ * led_display->start(RgbMatrixPanel::open(app_config.get()->display)); // creates the refresh thread
  * @endcode
  */
-class matrixLEDTask {
-private:
-    std::atomic<bool> running{false};
-    std::thread worker_thread;
-    static rgb_matrix::Color clock_color, date_color, day_color, username_color, bg_color, outline_color;
-    static rgb_matrix::Font font_time, font_date, font_day, font_name;
-    static RGBMatrix::Options matrix_options; 
-    static rgb_matrix::RuntimeOptions runtime_opt;
-    static FrameCanvas *offscreen;
-    static RGBMatrix *matrix;
-    unsigned static int interval_ms;
-    PeriodicExecutor<> executor_a;
-    // render_clock will invoked in separate thread by PeriodicExecutor
-    void render_clock() {
-        static int counter = 0;
-        static bool first_run = true;
-        if (first_run){
-            pid_t tid;
-            first_run = false;
-            tid = syscall(SYS_gettid);
-            cout << "process id: " << getpid() << ", task_function process id: " << tid << endl;
-        }
-         
-        auto now = std::chrono::system_clock::now();
-        auto in_time_t = std::chrono::system_clock::to_time_t(now);
-        std::stringstream ss;
-            
-        counter++;
-        offscreen->Fill(bg_color.r, bg_color.g, bg_color.b); // blank screen
-        ss << std::put_time(std::localtime(&in_time_t), "%H:%M");
-        rgb_matrix::DrawText(offscreen, font_time, 0, LINE_OFFSET_1, clock_color, NULL, ss.str().c_str(), 0);
-        ss.str("");
-        ss << std::put_time(std::localtime(&in_time_t), "%A");
-        rgb_matrix::DrawText(offscreen, font_day, 0, LINE_OFFSET_2, day_color,  NULL, ss.str().c_str(), 0);
-        ss.str("");
-        ss << std::put_time(std::localtime(&in_time_t), "%d.%m"); // %d.%m 
-        rgb_matrix::DrawText(offscreen, font_date, 0, LINE_OFFSET_3, date_color,  NULL, ss.str().c_str(), 0);
-        if (!name_lastauthenticated.load()->empty()){
-            static unsigned int iterations = 0;
-            rgb_matrix::DrawText(offscreen, font_name, 0, LINE_OFFSET_4, username_color, NULL, name_lastauthenticated.load()->c_str(), 0);
-            if (iterations++ > DISPLAY_NAME_IN_ITERATIONS){
-                iterations = 0;
-                name_lastauthenticated.load()->clear(); // reset last authenticated name
-            }
+class RgbMatrixPanel : public LedPanel
+{
+    private:
+    RGBMatrix::Options matrix_options;
+    rgb_matrix::RuntimeOptions runtime_opt;
+    std::string pixel_mapper_config, hardware_mapping; // matrix_options points into them
+    RGBMatrix* matrix = nullptr;
+    FrameCanvas* offscreen = nullptr;
+    RgbMatrixPanel() = default;
+    public:
+    /**
+     * @brief creates the matrix from the display settings of config.toml
+     * @return nullptr if the matrix could not be created
+     */
+    static std::unique_ptr<RgbMatrixPanel> open(const DisplayConfig& display)
+    {
+        std::unique_ptr<RgbMatrixPanel> panel(new RgbMatrixPanel());
+        RGBMatrix::Options& matrix_options = panel->matrix_options;
+        matrix_options.led_rgb_sequence = "RBG"; // set options for LED matrix
+        matrix_options.rows = 32;
+        matrix_options.cols = 64;
+        matrix_options.brightness = display.brightness;
+        panel->pixel_mapper_config = display.pixel_mapper_config; // options keep pointers, the strings outlive a reload
+        panel->hardware_mapping = display.hardware_mapping;
+        matrix_options.pixel_mapper_config = panel->pixel_mapper_config.c_str(); // e.g. "Rotate:90"
+        matrix_options.disable_hardware_pulsing = true;
+        matrix_options.hardware_mapping = panel->hardware_mapping.c_str(); // e.g. "adafruit-hat"
+        matrix_options.limit_refresh_rate_hz = display.power.limit_refresh_rate_hz; // refresh thread sleeps out the rest of each frame
+        std::cout << "Using hardware mapping: " << matrix_options.hardware_mapping << " - empty string is direct cable connection" << std::endl;
+        std::vector<pid_t> threads_before = list_threads();
+        panel->matrix = RGBMatrix::CreateFromOptions(matrix_options, panel->runtime_opt);
+        place_new_threads(threads_before, "matrix_refresh"); // overrides the library's own core 3 / priority 99 if configured
+        if (panel->matrix == NULL) {
+            std::cerr << "Failed to create RGBMatrix" << std::endl;
+            return nullptr;
         }
-        /* OPEN topic: display authentication hint
-        else if (authentication_hint[0] != '\0'){ 
-        }*/
-        /* be creative and add more information here - scroll stock prices or display weather forecast */
-        offscreen = matrix->SwapOnVSync(offscreen); // swap LEDMatrix double buffer
-
-    } // render_clock
-    
-public:
-    // constructor with default  100ms interval
-    matrixLEDTask(int interval = 100) : running(false) { 
-        interval_ms = interval;
-    } // constructor matrixLEDTask
-    void start() {
-        if (!running) {
-            running = true;
-            // initialize matrix options, fonts, font colors from config.toml
-            clock_color = Color((uint8_t)config_toml["matrix_options"]["clock_color"].as_array()->at(0).value_or(255), 
-                                (uint8_t)config_toml["matrix_options"]["clock_color"].as_array()->at(1).value_or(28), 
-                                (uint8_t)config_toml["matrix_options"]["clock_color"].as_array()->at(2).value_or(0));
-
-            date_color = Color((uint8_t)config_toml["matrix_options"]["date_color"].as_array()->at(0).value_or(255), 
-                                    (uint8_t)config_toml["matrix_options"]["date_color"].as_array()->at(1).value_or(28), 
-                                    (uint8_t)config_toml["matrix_options"]["date_color"].as_array()->at(2).value_or(0));
-            day_color = Color((uint8_t)config_toml["matrix_options"]["day_color"].as_array()->at(0).value_or(255), 
-                                    (uint8_t)config_toml["matrix_options"]["day_color"].as_array()->at(1).value_or(28), 
-                                    (uint8_t)config_toml["matrix_options"]["day_color"].as_array()->at(2).value_or(0));
-            username_color = Color((uint8_t)config_toml["matrix_options"]["username_color"].as_array()->at(0).value_or(255), 
-                                    (uint8_t)config_toml["matrix_options"]["username_color"].as_array()->at(1).value_or(0),      
-                                    (uint8_t)config_toml["matrix_options"]["username_color"].as_array()->at(2).value_or(255));
-            bg_color = Color((uint8_t)config_toml["matrix_options"]["bg_color"].as_array()->at(0).value_or(0), 
-                                    (uint8_t)config_toml["matrix_options"]["bg_color"].as_array()->at(1).value_or(0), 
-                                    (uint8_t)config_toml["matrix_options"]["bg_color"].as_array()->at(2).value_or(0));
-            outline_color = Color((uint8_t)config_toml["matrix_options"]["outline_color"].as_array()->at(0).value_or(0), 
-                                    (uint8_t)config_toml["matrix_options"]["outline_color"].as_array()->at(1).value_or(0),            
-                                    (uint8_t)config_toml["matrix_options"]["outline_color"].as_array()->at(2).value_or(0));
-            if (!font_date.LoadFont(FONT_DATE) || !font_time.LoadFont(FONT_TIME) // Load fonts. This needs to be a filename with a bdf bitmap font.
-                || !font_day.LoadFont(FONT_DAY) || !font_name.LoadFont(FONT_NAME)) {
-                std::cerr << "Couldn't load fontfiles \n";
-                std::exit(1);
-            }
-            matrix_options.led_rgb_sequence = "RBG"; // set options for LED matrix
-            matrix_options.rows = 32;
-            matrix_options.cols = 64;
-            matrix_options.brightness = config_toml["matrix_options"]["brightness"].value_or(80);
-            matrix_options.pixel_mapper_config = config_toml["matrix_options"]["pixel_mapper_config"].value<std::string>().value().c_str(); // e.g. "Rotate:90"
-            matrix_options.disable_hardware_pulsing = true;
-            matrix_options.hardware_mapping = config_toml["matrix_options"]["hardware_mapping"].value<std::string>().value().c_str(); // e.g. "adafruit-hat"
-            std::cout << "Using hardware mapping: " << matrix_options.hardware_mapping << " - empty string is direct cable connection" << std::endl;
-            matrix = RGBMatrix::CreateFromOptions(matrix_options, runtime_opt);
-            if (matrix == NULL){
-                std::cerr << "Failed to create RGBMatrix" << std::endl;
-                std::exit(1);
-            }
-            offscreen = matrix->CreateFrameCanvas(); // offscreen canvas for double buffering
-            // end Initialization of RGB-Matrix-Display
-            
-            // thread being executed every DELAY_MSEC interval
-
-            executor_a.start(std::chrono::milliseconds(interval_ms), [&]() { matrixLEDTask::render_clock(); });
-            std::cout << "periodic thread task_function started (" << interval_ms << "ms interval)" << std::endl;
+        panel->offscreen = panel->matrix->CreateFrameCanvas(); // offscreen canvas for double buffering
+        return panel;
+    }
+    ~RgbMatrixPanel() override
+    {
+        if (matrix) {
+            matrix->Clear();
+            delete matrix;
         }
     }
-    
-    void stop() {
-        if (running) {
-            running = false;
-            executor_a.stop();
-            std::cout << "periodic thread task_function stopped" << std::endl;
+    int width() const override { return offscreen->width(); }
+    int height() const override { return offscreen->height(); }
+    int pwm_bits() const override { return matrix_options.pwm_bits; }
+    void set_rows(const Framebuffer& source, int top, int bottom) override
+    {
+        bottom = std::min(bottom, std::min(offscreen->height(), source.height));
+        const int width = std::min(offscreen->width(), source.width);
+        for (int y = std::max(top, 0); y < bottom; y++) {
+            const Rgb* row = source.pixel[y];
+            for (int x = 0; x < width; x++)
+                offscreen->SetPixel(x, y, row[x].r, row[x].g, row[x].b);
         }
-        
-        matrix->Clear(); 
-        delete matrix;
-        std::cout << "matrixLEDTask::task_function ended" << std::endl; 
     }
-    ~matrixLEDTask() {
-        stop();
+    void clear() override
+    {
+        offscreen->Clear();
     }
-};
-
-// Definitions for static members of matrixLEDTask to satisfy the linker.
-rgb_matrix::Color matrixLEDTask::clock_color;
-rgb_matrix::Color matrixLEDTask::date_color;
-rgb_matrix::Color matrixLEDTask::day_color;
-rgb_matrix::Color matrixLEDTask::username_color;
-rgb_matrix::Color matrixLEDTask::bg_color;
-rgb_matrix::Color matrixLEDTask::outline_color;
-
-rgb_matrix::Font matrixLEDTask::font_time;
-rgb_matrix::Font matrixLEDTask::font_date;
-rgb_matrix::Font matrixLEDTask::font_day;
-rgb_matrix::Font matrixLEDTask::font_name;
-
-RGBMatrix::Options matrixLEDTask::matrix_options;
-rgb_matrix::RuntimeOptions matrixLEDTask::runtime_opt;
-FrameCanvas* matrixLEDTask::offscreen = nullptr;
-RGBMatrix* matrixLEDTask::matrix = nullptr;
-
-unsigned int matrixLEDTask::interval_ms = DELAY_MSEC;
+    void swap(unsigned int vsync_fraction) override
+    {
+        offscreen = matrix->SwapOnVSync(offscreen, vsync_fraction); // swap LEDMatrix double buffer
+    }
+    void set_quality(uint8_t brightness, uint8_t pwm_bits) override
+    {
+        matrix->SetBrightness(brightness); // canvas shown by the refresh thread
+        matrix->SetPWMBits(pwm_bits);
+        offscreen->SetBrightness(brightness);
+        offscreen->SetPWMBits(pwm_bits);
+    }
+}; // end class RgbMatrixPanel
 /**
  * @brief Main function for the application.
  *
@@ -690,133 +1597,310 @@ int main(int argc, char** argv){
         std::cerr << "Parsing failed:\n" << err << "\n";
         return 1;
     }
-// init variables with values from toml config file
-    
-    // old:
-    // use_telegram = config_toml["telegram"]["use_telegram"].as_boolean(); // check if telegram bot is used
-
-    // improved: safe read with default + light coercion and warning on unexpected types
-    try {
-        auto node = config_toml["telegram"]["use_telegram"];
-        if (!node) {
-            use_telegram = false;
-        } else if (node.is_boolean()) {
-            use_telegram = node.value_or(false);
-        } else if (node.is_string()) {
-            std::string s = node.value<std::string>().value();
-            std::transform(s.begin(), s.end(), s.begin(), ::tolower);
-            use_telegram = (s == "true" || s == "1" || s == "yes" || s == "on");
-            std::cerr << "Warning: telegram.use_telegram is a string; coerced to " << use_telegram << std::endl;
-        } else if (node.is_integer()) {
-            use_telegram = (node.value<long long>().value() != 0);
-            std::cerr << "Warning: telegram.use_telegram is an integer; coerced to " << use_telegram << std::endl;
-        } else {
-            use_telegram = false;
-            std::cerr << "Warning: telegram.use_telegram has unexpected type; defaulting to false" << std::endl;
-        }
-    } catch (const std::exception& e) {
-        use_telegram = false;
-        std::cerr << "Error reading telegram.use_telegram: " << e.what() << " - defaulting to false" << std::endl;
+    std::shared_ptr<const AppConfig> config = read_app_config(config_toml); // validated once, see app_config.hpp
+    if (!config) {
+        std::cerr << "Invalid values in " << CONFIG_FILE << std::endl;
+        return 1;
     }
+    app_config.publish(config);
+    read_thread_config(); // before any thread starts; threads inherit the placement of main
+    place_this_thread("main");
+    if (!config->log.file.empty())
+        std::cout << "log: events are written to " << config->log.file << std::endl;
+    AsyncLog::start(config->log);
+    std::atexit(AsyncLog::stop); // writes what is left, on early returns as well
+    signal(SIGHUP, reloadSignalHandler); // kill -HUP $(pgrep -x smartdoorF455) reloads config.toml
+    signal(SIGTERM, signalHandler);
+    signal(SIGINT, signalHandler); // hit Ctrl+C to terminate program
+    signal(SIGUSR1, traceSignalHandler); // kill -USR1 $(pgrep -x smartdoorF455) prints latency percentiles per stage
+    // independent stages run concurrently, see startup_graph.hpp; a stage starts once the stages it depends on are done
+    int64_t gpio_sensor_pin = 0;
+    StartupGraph startup(launch_us);
+    startup.add("telegram", {}, [&] {
+        // old:
+        // use_telegram = config_toml["telegram"]["use_telegram"].as_boolean(); // check if telegram bot is used
 
-    if (use_telegram){
-        send_snapshot = config_toml["telegram"]["send_snapshot"].as_boolean(); // check if telegram bot shall be used to send photo
-        bot_token_string = config_toml["telegram"]["bot_token"].value<std::string>().value();
-        bot_token = bot_token_string.c_str();
-        chat_id = config_toml["telegram"]["chat_id"].value<long>().value();
-        bot = new TgBot::Bot(bot_token);  // create telegram bot object
+        // improved: safe read with default + light coercion and warning on unexpected types
         try {
-            if (chat_id != 0) {
-                bot->getApi().sendMessage(chat_id, std::string("smartdoorF455 started ..."));
+            auto node = config_toml["telegram"]["use_telegram"];
+            if (!node) {
+                use_telegram = false;
+            } else if (node.is_boolean()) {
+                use_telegram = node.value_or(false);
+            } else if (node.is_string()) {
+                std::string s = node.value<std::string>().value();
+                std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+                use_telegram = (s == "true" || s == "1" || s == "yes" || s == "on");
+                std::cerr << "Warning: telegram.use_telegram is a string; coerced to " << use_telegram << std::endl;
+            } else if (node.is_integer()) {
+                use_telegram = (node.value<long long>().value() != 0);
+                std::cerr << "Warning: telegram.use_telegram is an integer; coerced to " << use_telegram << std::endl;
+            } else {
+                use_telegram = false;
+                std::cerr << "Warning: telegram.use_telegram has unexpected type; defaulting to false" << std::endl;
             }
-        } // try send initial telegram message
-        catch (TgBot::TgException& e) {
-            std::cerr << "error sending telegram message: " << e.what() << std::endl;
+        } catch (const std::exception& e) {
+            use_telegram = false;
+            std::cerr << "Error reading telegram.use_telegram: " << e.what() << " - defaulting to false" << std::endl;
         }
-    } // use_telegram
-// end init global vars
-    int setupStatus = wiringPiSetupPinType(WPI_PIN_BCM);; // initialize WiringPi for GPIO usage, see 
-                                          // https://github.com/WiringPi/WiringPi/blob/master/documentation/deutsch/functions.md
-    if (setupStatus == -1) {
-        // Handle the error: GPIO initialization failed
-        // You might want to print an error message or exit the program
-        // maybe other instance of this program
-        cerr << "WiringPi failed to initialize GPIO" << endl;
-        cerr << "Please check, if another instance of this program runs concurrently" << endl;
-        cerr << "and if a different program is using the GPIO pins!" << endl;
-        cerr << "Exiting program..." << endl;
-        return 1; // Indicate failure
-    } 
-
-    int64_t gpio_sensor_pin = config_toml["raspi"]["gpio_sensor_pin"].value_or(0); 
-    int64_t gpio_sensor_pull = config_toml["raspi"]["gpio_sensor_pull"].value_or(0);
-    cout << "gpio sensor on pin " << gpio_sensor_pin << endl;
-    pinMode(gpio_sensor_pin, INPUT);
-    pullUpDnControl(gpio_sensor_pin, gpio_sensor_pull); // pull up/down mode (PUD_OFF, PUD_UP, PUD_DOWN)
-    wiringPiISR2(gpio_sensor_pin, INT_EDGE_BOTH,  &presence_detected_clbk, DEBOUNCE_PERIOD, NULL); // presence_detected_clbk will be called everytime when gpio_sensor_pin level changed
-                                                               // from  either high-to-low or low-to-high;  
-    if (!init_F455_camera()) { // find and initialize Intel RealSenseID camera
-        std::cerr << "Failed to initialize F455 camera" << std::endl;
-        return 1;
-    }
-    std::cout << "main() serial port: " << serial_config.port << std::endl;
-    // check if mosquitto is used
-    use_mosquitto = config_toml["mosquitto"]["use_mosquitto"].as_boolean(); // check if mosquitto is used
-    if (use_mosquitto) {
 
-        mosquitto_lib_init(); // initialize MQTT mosquitto client
-        mosq = mosquitto_new("Raspberry MQTT client", true, NULL);
-        if (!mosq) {
-            std::cerr << "Failed to create mosquitto client" << std::endl;
-            return 1;
+        if (use_telegram){
+            send_snapshot = config_toml["telegram"]["send_snapshot"].as_boolean(); // check if telegram bot shall be used to send photo
+            bot_token_string = config_toml["telegram"]["bot_token"].value<std::string>().value();
+            bot_token = bot_token_string.c_str();
+            chat_id = config_toml["telegram"]["chat_id"].value<long>().value();
+            std::string api_url = config_toml["telegram"]["api_url"].value_or(std::string("https://api.telegram.org"));
+#ifdef HAVE_CURL
+            static TgBot::CurlHttpClient telegram_http_client; // also handles http:// stand-ins for testing
+#else
+            static TgBot::BoostHttpOnlySslClient telegram_http_client;
+#endif
+            bot = new TgBot::Bot(bot_token, telegram_http_client, api_url);  // create telegram bot object
+            OutboxConfig outbox_config;
+            outbox_config.capacity = config_toml["telegram"]["outbox_size"].value_or(outbox_config.capacity);
+            outbox_config.coalesce_window_ms = config_toml["telegram"]["coalesce_window_sec"].value_or(30u) * 1000;
+            outbox_config.retry_max_ms = config_toml["telegram"]["retry_max_sec"].value_or(60u) * 1000;
+            outbox_config.max_attempts = config_toml["telegram"]["retry_attempts"].value_or(outbox_config.max_attempts);
+            outbox = std::make_unique<NotificationOutbox>(outbox_config, send_notification);
+            outbox->start();
+            if (chat_id != 0) { // initial telegram message, sent in background
+                Notification notification;
+                notification.text = "smartdoorF455 started ...";
+                outbox->post(std::move(notification));
+            }
+        } // use_telegram
+        return true;
+    });
+    startup.add("gpio", {}, [&] {
+        int setupStatus = wiringPiSetupPinType(WPI_PIN_BCM);; // initialize WiringPi for GPIO usage, see 
+                                              // https://github.com/WiringPi/WiringPi/blob/master/documentation/deutsch/functions.md
+        if (setupStatus == -1) {
+            // Handle the error: GPIO initialization failed
+            // You might want to print an error message or exit the program
+            // maybe other instance of this program
+            cerr << "WiringPi failed to initialize GPIO" << endl;
+            cerr << "Please check, if another instance of this program runs concurrently" << endl;
+            cerr << "and if a different program is using the GPIO pins!" << endl;
+            cerr << "Exiting program..." << endl;
+            return false; // Indicate failure
+        } 
+
+        gpio_sensor_pin = config_toml["raspi"]["gpio_sensor_pin"].value_or(0); 
+        int64_t gpio_sensor_pull = config_toml["raspi"]["gpio_sensor_pull"].value_or(0);
+        cout << "gpio sensor on pin " << gpio_sensor_pin << endl;
+        pinMode(gpio_sensor_pin, INPUT);
+        pullUpDnControl(gpio_sensor_pin, gpio_sensor_pull); // pull up/down mode (PUD_OFF, PUD_UP, PUD_DOWN)
+        return true;
+    });
+    startup.add("camera", {}, [] {
+        if (!init_F455_camera()) { // find and initialize Intel RealSenseID camera
+            std::cerr << "Failed to initialize F455 camera" << std::endl;
+            return false;
         }
-        const char *host = config_toml["mosquitto"]["host"].value<std::string>().value().c_str();
-        std::cout << "Connecting to mosquitto broker at " << host << std::endl;
-        int port = (int) config_toml["mosquitto"]["port"].value_or(1883); // default port is 1883
-        int keepalive = (int) config_toml["mosquitto"]["keepalive"].value_or(60); // default keepalive is 60 seconds
-        // connect to mosquitto broker
-        if (mosquitto_connect(mosq, host, port, keepalive) != MOSQ_ERR_SUCCESS)
-        {
-            std::cerr << "Failed to connect to mosquitto broker" << std::endl;
-            return 1;
+        std::cout << "main() serial port: " << serial_config.port << std::endl;
+        auth_device = std::make_unique<RealSenseAuthDevice>();
+        return true;
+    });
+    startup.add("faceprints", {"camera"}, [] {
+        host_matching = config_toml["camera"]["matching"].value_or(std::string("device")) == "host";
+        if (host_matching) { // F455 extracts faceprints, matching runs on the Pi
+            host_match_threshold = config_toml["camera"]["host_match_threshold"].value_or(host_match_threshold);
+            host_match_threads = config_toml["camera"]["host_match_threads"].value_or(host_match_threads);
+            std::string faceprint_dir = config_toml["camera"]["faceprint_db_dir"].value_or(std::string(getenv("HOME")) + "/smartdoorF455/faceprints");
+            faceprint_store = std::make_unique<FaceprintStore>(faceprint_dir, RSID_NUM_OF_RECOGNITION_FEATURES);
+            long loaded = faceprint_store->open() ? (long)faceprint_store->snapshot()->rows() : -1;
+            unsigned int device_users = 0;
+            authenticator->QueryNumberOfUsers(device_users);
+            if (loaded == 0) // first start, take over the users enrolled on the device
+                loaded = import_faceprints_from_device();
+            else if (device_users == 0 && loaded > 0) // replaced camera, keep it usable for device matching
+                std::cout << "exported " << export_faceprints_to_device() << " users to the empty device database" << std::endl;
+            if (loaded < 0) {
+                std::cerr << "Failed to open faceprint database " << faceprint_dir << ", using device matching" << std::endl;
+                faceprint_store.reset();
+                host_matching = false;
+            }
+            else {
+                std::cout << "host matching: " << loaded << " faceprints in " << faceprint_store->snapshot()->segments().size()
+                          << " segments of " << faceprint_dir << std::endl;
+                faceprint_store->start_compaction(config_toml["camera"]["faceprint_db_max_segments"].value_or(8u));
+            }
         }
-        // subscribe to mosquitto topics topic_door and topic_control
-        topic_door = config_toml["mosquitto"]["topic_door"].value<std::string>().value().c_str();
-        std::cout << "Subscribing to mosquitto topic: " << topic_door << std::endl;
-        if (mosquitto_subscribe(mosq, NULL, topic_door, 0) != MOSQ_ERR_SUCCESS)
-        {
-            std::cerr << "Failed to subscribe to mosquitto topic_door" << std::endl;
-            return 1;
+        return true;
+    });
+    startup.add("mqtt", {}, [] {
+        // check if mosquitto is used
+        use_mosquitto = config_toml["mosquitto"]["use_mosquitto"].as_boolean(); // check if mosquitto is used
+        if (use_mosquitto) {
+            MqttSessionConfig mqtt_config;
+            mqtt_config.host = config_toml["mosquitto"]["host"].value_or(mqtt_config.host);
+            mqtt_config.port = (int) config_toml["mosquitto"]["port"].value_or(1883); // default port is 1883
+            mqtt_config.keepalive = (int) config_toml["mosquitto"]["keepalive"].value_or(60); // default keepalive is 60 seconds
+            mqtt_config.client_id = config_toml["mosquitto"]["client_id"].value_or(mqtt_config.client_id);
+            mqtt_config.topic_door = config_toml["mosquitto"]["topic_door"].value_or(mqtt_config.topic_door);
+            mqtt_config.topic_control = config_toml["mosquitto"]["topic_control"].value_or(std::string());
+            mqtt_config.qos_door = (int) config_toml["mosquitto"]["qos_door"].value_or(1);
+            mqtt_config.reconnect_delay_max_s = config_toml["mosquitto"]["reconnect_delay_max"].value_or(30u);
+            mqtt_session = std::make_unique<MqttSession>(mqtt_config);
+            if (!mqtt_config.topic_control.empty()) { // enroll, delete and list users over MQTT
+                ControlEngineConfig control_config;
+                control_config.max_queued = config_toml["mosquitto"]["control_max_queued"].value_or(control_config.max_queued);
+                control_config.max_attempts = config_toml["mosquitto"]["control_max_attempts"].value_or(control_config.max_attempts);
+                control_config.resume_delay_ms = config_toml["mosquitto"]["control_resume_delay_ms"].value_or(control_config.resume_delay_ms);
+                std::string topic_status = config_toml["mosquitto"]["topic_status"].value_or(mqtt_config.topic_control + "/status");
+                control_engine = std::make_unique<ControlEngine>(control_config, run_control_job,
+                    [] { authenticator->Cancel(); }, // called by the auth worker to preempt a job
+                    [topic_status](const std::string& text) { mqtt_session->publish(topic_status, text); });
+                mqtt_session->set_message_handler([](const std::string& topic, const std::string& payload) {
+                    if (topic == mqtt_session->settings().topic_control)
+                        control_engine->submit(payload); // only parses and queues, network loop continues
+                });
+            }
+            std::vector<pid_t> threads_before = list_threads();
+            if (!mqtt_session->start()) // connects asynchronously and starts network loop thread
+            {
+                return false;
+            }
+            place_new_threads(threads_before, "mqtt");
+        } // end use_mosquitto
+        return true;
+    });
+    startup.add("display", {}, [] {
+        // the clock shows while the camera is still being connected; rendering is event driven
+        led_display = std::make_unique<LedDisplay>(app_config, display_state, panel_power, auth_status_name);
+        std::unique_ptr<LedPanel> panel = RgbMatrixPanel::open(app_config.get()->display);
+        return panel && led_display->start(std::move(panel));
+    });
+    // start trigger pipeline once camera and mosquitto are ready, then register the ISR posting into it;
+    // the ISR and the authentication results wake and update the display, so it goes first
+    startup.add("pipeline", {"telegram", "gpio", "camera", "faceprints", "mqtt", "display"}, [&] {
+        if (control_engine)
+            control_engine->start(); // jobs queued by MQTT meanwhile run now that the camera is connected
+        const GateConfig& gate_config = config->gate;
+        int debounce_usec = config_toml["raspi"]["debounce_usec"].value_or(DEBOUNCE_PERIOD);
+        std::string presence_sensor = config_toml["raspi"]["presence_sensor"].value_or(std::string("gpio")); // gpio, camera or both
+        bool motion_shares_snapshot_stream = false;
+        DoorControllerConfig door_config;
+        door_config.name_display_us = DISPLAY_NAME_MSEC * 1000LL;
+        door_config.hint_display_us = DISPLAY_HINT_MSEC * 1000LL;
+        door_config.alert_display_us = DISPLAY_ALERT_MSEC * 1000LL;
+        door_config.max_name_length = MAX_NAME_LENGTH;
+        door_controller = std::make_unique<DoorController>(door_config, display_state, trigger_pipeline, outbox.get(),
+            auth_status_name, [] { led_display->notify(); },
+            [](int64_t trigger_ts_us) {
+                // TRIGGER DOOR OPENER START - ADAPT THIS CODE according to your interface to 
+                //                             your door buzzer
+                if (use_mosquitto) // send MQTT message to Siedle gateway to open door - the session is kept
+                    mqtt_session->publish_door_open(trigger_ts_us); // connected by its network loop thread, no reconnect in this path
+                // TRIGGER DOOR OPENER END
+            });
+        trigger_pipeline.set_auth_stage(authenticate_presence);
+        if (presence_sensor == "camera" || presence_sensor == "both") { // motion posts the same trigger events as the ISR
+            motion_presence = std::make_unique<MotionPresence>(read_motion_config(),
+                [](int edge, int status) { trigger_pipeline.post_trigger(edge, status); wake_display(); });
         }
-        const char *topic_control = config_toml["mosquitto"]["topic_control"].value<std::string>().value().c_str();
-        std::cout << "Subscribing to mosquitto topic: " << topic_control << std::endl;
-        if (mosquitto_subscribe(mosq, NULL, topic_control, 0) != MOSQ_ERR_SUCCESS)
-        {
-            std::cerr << "Failed to subscribe to mosquitto topic_control" << std::endl;
-            return 1;
+        if (send_snapshot && use_telegram) {
+            save_snapshots = config_toml["snapshot"]["save_to_disk"].value_or(false);
+            jpeg_quality = config_toml["snapshot"]["jpeg_quality"].value_or(85);
+            SnapshotCaptureConfig snapshot_config = read_snapshot_config();
+            snapshot_capture = std::make_unique<SnapshotCapture>(snapshot_config);
+            if (motion_presence && motion_presence->settings().source == snapshot_config.source) { // webcam can be opened only once
+                MotionPresence* motion = motion_presence.get();
+                snapshot_capture->set_frame_observer([motion](const cv::Mat& frame, int64_t grab_ts_us) {
+                    motion->offer_frame(frame, grab_ts_us); }, motion->settings().fps);
+                motion_shares_snapshot_stream = true;
+            }
+            if (snapshot_capture->start()) {
+                snapshot_camera = std::make_unique<CvSnapshotCamera>(*snapshot_capture, jpeg_quality);
+                trigger_pipeline.set_snapshot_stage(capture_snapshot);
+            }
+            else {
+                snapshot_capture.reset(); // continue without snapshots
+                motion_shares_snapshot_stream = false;
+            }
         }
-        // need to rewrite for Paho
-        // mosquitto_message_callback_set(mosq, mqtt_control_clbk); // set callback function to handle incoming messages
-    } // end use_mosquitto
-    std::cout << "attention: name_lastauthenticated.load()->clear();" << std::endl;
-    name_lastauthenticated.load()->clear(); // Clear last authenticated name
-    std::cout << "over: name_lastauthenticated.load()->clear();" << std::endl;
-    signal(SIGTERM, signalHandler);
-    signal(SIGINT, signalHandler); // hit Ctrl+C to terminate program
-    matrixLEDTask matrix_task(DELAY_MSEC); // create matrixLEDTask object with DELAY_MSEC ms interval
-    matrix_task.start(); // start matrix LED task
+        trigger_pipeline.start(gate_config);
+        if (motion_presence && !motion_shares_snapshot_stream && !motion_presence->start())
+            motion_presence.reset(); // fall back to the presence sensor
+        if (presence_sensor != "camera" || !motion_presence) {
+            gpio_trigger = std::make_unique<GpioTriggerSource>((int)gpio_sensor_pin, gate_config.edge_policy, debounce_usec);
+            gpio_trigger->start([](int edge, int status) {
+                trigger_pipeline.post_trigger(edge, status); // lock-free, never blocks
+                wake_display();
+            });
+        }
+        return true;
+    });
+    if (!startup.run()) {
+        startup.print_timing(std::cout); // which stage failed and what had started
+        stop_after_failed_startup();
+        return 1;
+    }
+    startup_ready_us = startup.ready_us();
+    startup.print_timing(std::cout);
+    Metrics::set_status_names(auth_status_name);
+    MetricsConfig metrics_config = read_metrics_config();
+    MetricsServer metrics_server(metrics_config, [](std::ostream& os) {
+        write_component_metrics(os);
+        led_display->write_metrics(os);
+    });
+    if (!metrics_config.listen.empty())
+        metrics_server.start(); // runs without the endpoint if the address is taken
+    ConfigWatcher config_watcher(CONFIG_FILE); // saving config.toml reloads it like SIGHUP
+    std::shared_ptr<const AppConfig> pending_camera; // device settings waiting for a pause between authentications
     while (!interrupt_received){
-        std::this_thread::sleep_for(std::chrono::seconds(10));
-  
+        if (config_watcher.wait(1000) || reload_requested) { // sleeps a second unless config.toml is saved
+            reload_requested = 0;
+            reload_config(pending_camera);
+        }
+        if (pending_camera && apply_camera_config(pending_camera->camera))
+            pending_camera.reset();
+        if (dump_trace_requested) {
+            dump_trace_requested = 0;
+            LatencyTrace::dump(std::cout);
+            print_startup_metrics();
+            print_outbox_metrics();
+            print_log_metrics();
+            led_display->print_render_stats();
+        }
     } // end while (!interrupt_received)
+    metrics_server.stop(); // the collector reads the components stopped below
     
+    if (motion_presence) {
+        motion_presence->stop();
+        std::cout << "motion presence frames: " << motion_presence->frames_processed() << ", triggers: " << motion_presence->triggers_posted()
+                  << ", cpu: " << motion_presence->cpu_percent() << "%, fps: " << motion_presence->effective_fps() << std::endl;
+    }
+    if (control_engine) {
+        control_engine->stop(); // cancels a running enrollment
+        std::cout << "control jobs done: " << control_engine->jobs_done() << ", failed: " << control_engine->jobs_failed()
+                  << ", cancelled: " << control_engine->jobs_cancelled() << ", preempted: " << control_engine->device().preemption_count() << std::endl;
+    }
+    if (gpio_trigger)
+        gpio_trigger->stop(); // no more edges from the presence sensor
+    trigger_pipeline.stop(); // no more authentications or snapshots
+    print_startup_metrics();
+    print_outbox_metrics();
+    if (outbox)
+        outbox->stop(); // discard unsent notifications
+    if (snapshot_capture)
+        snapshot_capture->stop(); // release webcam stream
+    std::cout << "triggers posted: " << trigger_pipeline.triggers_posted() << ", accepted: " << trigger_pipeline.triggers_accepted()
+              << ", rejected: " << trigger_pipeline.triggers_rejected() << ", dropped: " << trigger_pipeline.triggers_dropped() << std::endl;
+    for (int d = (int)GateDecision::Accept + 1; d < (int)GateDecision::COUNT; d++) // why triggers were rejected
+        std::cout << "  " << gate_decision_name((GateDecision)d) << ": " << trigger_pipeline.trigger_gate().decision_count((GateDecision)d) << std::endl;
     if(use_mosquitto){
-        mosquitto_destroy(mosq); // free mosquitto struct
-        mosquitto_lib_cleanup(); // and cleanup
+        std::cout << "mqtt publishes: " << mqtt_session->publish_count() << ", failures: " << mqtt_session->publish_failures()
+                  << ", acks: " << mqtt_session->ack_count() << ", reconnects: " << mqtt_session->reconnect_count() << std::endl;
+        mqtt_session->stop(); // disconnect and stop network loop thread
     }
-    matrix_task.stop();
+    led_display->stop(); // the returned panel clears the LEDs when it goes out of scope
+    if (faceprint_store)
+        faceprint_store->stop_compaction(); // an interrupted compaction leaves only a tmp file behind
     authenticator->Disconnect(); // disconnect Intel RealSenseID F455 camera
     // authenticator->reset(nullptr);
+    AsyncLog::stop();
+    print_log_metrics();
     std::cout << "terminating program" << argv[0] << " all cleaned up..." << std::endl;
     return 0;
 } // end main
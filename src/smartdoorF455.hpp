@@ -31,7 +31,6 @@
  * @note See installation instructions in README file
  */
 #pragma once
-#include "PeriodicExecutor.hpp"
 #include "RealSenseID/FaceAuthenticator.h"
 #include "RealSenseID/DeviceConfig.h"
 #include "RealSenseID/SerialConfig.h"
@@ -53,6 +52,7 @@
 #include <wiringPi.h>
 #include <unistd.h> 
 #include <unordered_map>
+#include <cstring>
 #include <filesystem>
 #include <mqtt/async_client.h>
 #include <tgbot/tgbot.h>
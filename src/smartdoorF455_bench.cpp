@@ -0,0 +1,735 @@
+/**
+ * @file smartdoorF455_bench.cpp
+ * @brief Micro benchmarks of the hot paths of smartdoorF455: render, trigger, notification and config
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * Runs the code of the daemon headless with Google Benchmark, on the Pi as
+ * well as on an x86 dev box:
+ *
+ * - render_clock of LedDisplay on a MemoryPanel without vsync: an unchanged
+ *   tick, the name of an authenticated person, a spoof alert over the panel
+ * - BDF fonts: parsing an embedded font into a GlyphAtlas, drawing a line
+ *   with GlyphAtlas and with rgb_matrix::DrawText on the same canvas
+ * - animation: a frame of the door-open sprite and a scrolling name, swapped
+ *   at once (cost) and paced on a simulated 120 Hz vsync (interval, jitter)
+ * - time formatting: the clock lines of the display, a record of the
+ *   asynchronous log (written to a scratch file, rotated at 1 MB)
+ * - host faceprint matching: 10k, 50k and 100k synthetic faceprints scanned
+ *   by one thread and by one thread per core, in a FaceprintIndex and in a
+ *   memory-mapped FaceprintStore; opening the store for 1k to 100k users
+ * - presence debounce: a visit with bouncing edges through the TriggerGate,
+ *   and a 10 kHz edge storm offered from 1, 2 and 4 threads at once
+ * - parsing config.toml with toml++, as at startup and on reload
+ * - jpeg encoding of a 640x480 snapshot, as taken and rotated by 270 degrees
+ *   like the default of snapshot.rotation in config.toml
+ * - notification construction: authentication results through the
+ *   DoorController into the NotificationOutbox, the door opener counted only
+ *
+ * Results are printed as table; to track them across changes, write JSON
+ * and compare two runs with tools/compare.py of Google Benchmark:
+ * @code
+ * ./smartdoorF455_bench --benchmark_out=bench_pi.json --benchmark_out_format=json
+ * ./smartdoorF455_bench --benchmark_filter=Render --benchmark_repetitions=5
+ * @endcode
+ */
+#include "animation.hpp"
+#include "async_log.hpp"
+#include "door_controller.hpp"
+#include "faceprint_index.hpp"
+#include "faceprint_store.hpp"
+#include "glyph_atlas.hpp"
+#include "graphics.h"
+#include "hal_sim.hpp"
+#include "latency_trace.hpp"
+#include "led_display.hpp"
+#include "notification_outbox.hpp"
+#include "trigger_gate.hpp"
+#include "trigger_pipeline.hpp"
+#include "toml++/toml.hpp"
+#include <benchmark/benchmark.h>
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef BENCH_CONFIG_FILE
+#define BENCH_CONFIG_FILE "./config.toml" // CMakeLists.txt points it to bin/config.toml
+#endif
+#define BENCH_PANEL_WIDTH 32      // 64x32 panel rotated by 270 degrees, as in config.toml
+#define BENCH_PANEL_HEIGHT 64
+#define BENCH_SNAPSHOT_WIDTH 640
+#define BENCH_SNAPSHOT_HEIGHT 480
+#define BENCH_JPEG_QUALITY 85     // default of snapshot.jpeg_quality
+#define BENCH_BURST_USEC 50000    // trigger gate collapses bouncing edges within this window
+#define BENCH_BOUNCE_USEC 800     // distance of bouncing edges of the presence sensor
+#define BENCH_BOUNCES 4           // the contact opens and closes again this often per visit
+#define BENCH_STORM_SPACING_USEC 100 // edge storm at 10 kHz
+#define BENCH_STORM_AUTH_EDGES 10000 // the first thread ends an authentication after this many of its edges
+#define BENCH_SPRITE_FRAMES 8      // frames of the generated sprite sheet
+#define BENCH_VSYNC_HZ 120         // simulated refresh rate of the panel
+#define BENCH_ANIMATION_FRAMES 180 // paced frames, 3 s at 60 fps
+#define BENCH_FACEPRINT_DIMS 515  // RSID_NUM_OF_RECOGNITION_FEATURES
+#define BENCH_FACEPRINT_SIGMA 2000.0f // spread of the synthetic features
+#define BENCH_FACEPRINT_SEED 4711
+#define BENCH_LOG_MAX_BYTES (1 << 20)
+#define BENCH_LOG_DRAIN_MSEC 100  // twice the flush period of the log thread
+#define BENCH_LOG_RUNS 10         // runs of half a ring each
+
+/** scratch directory for the log and generated databases, $TMPDIR or /tmp */
+static std::string bench_tmp_dir()
+{
+    const char* tmp_dir = getenv("TMPDIR");
+    return tmp_dir ? tmp_dir : "/tmp";
+}
+
+/**
+ * @brief LedDisplay on a MemoryPanel, prepared without scheduler thread and drawn once as at startup
+ */
+struct RenderFixture {
+    ConfigChannel app_config;
+    StateChannel<DisplayState> display_state;
+    PanelPower panel_power;
+    LedDisplay display{ app_config, display_state, panel_power, sim_status_name };
+    bool ready = false;
+
+    RenderFixture() {
+        app_config.publish(std::make_shared<AppConfig>()); // defaults of app_config.hpp
+        ready = display.prepare(std::make_unique<MemoryPanel>(BENCH_PANEL_WIDTH, BENCH_PANEL_HEIGHT, 0));
+        if (ready)
+            display.render_clock(monotonic_us());
+    }
+};
+
+static void BM_RenderClockUnchanged(benchmark::State& state)
+{
+    RenderFixture fixture;
+    if (!fixture.ready) {
+        state.SkipWithError("embedded fonts missing");
+        return;
+    }
+    for (auto _ : state)
+        benchmark::DoNotOptimize(fixture.display.render_clock(monotonic_us()));
+    state.counters["skipped"] = (double)fixture.display.skipped_count();
+}
+BENCHMARK(BM_RenderClockUnchanged);
+
+static void BM_RenderClockName(benchmark::State& state)
+{
+    static const char* const names[] = { "Anna", "Ben", "Clara", "David" };
+    RenderFixture fixture;
+    if (!fixture.ready) {
+        state.SkipWithError("embedded fonts missing");
+        return;
+    }
+    size_t visit = 0;
+    for (auto _ : state) {
+        const int64_t now_us = monotonic_us();
+        fixture.display_state.update([&](DisplayState& display_state) { // what DoorController::on_result does
+            display_state.set_user(names[visit++ % 4], 16);
+            display_state.user_until_us = now_us + 5000000;
+        });
+        benchmark::DoNotOptimize(fixture.display.render_clock(now_us));
+    }
+    state.counters["rendered"] = (double)fixture.display.rendered_count();
+}
+BENCHMARK(BM_RenderClockName);
+
+static void BM_RenderClockAlert(benchmark::State& state)
+{
+    RenderFixture fixture;
+    if (!fixture.ready) {
+        state.SkipWithError("embedded fonts missing");
+        return;
+    }
+    for (auto _ : state) {
+        const int64_t now_us = monotonic_us();
+        fixture.display_state.update([&](DisplayState& display_state) { display_state.alert_until_us = now_us + 3000000; });
+        benchmark::DoNotOptimize(fixture.display.render_clock(now_us));
+    }
+    state.counters["rendered"] = (double)fixture.display.rendered_count();
+}
+BENCHMARK(BM_RenderClockAlert);
+
+static void BM_BdfLoad(benchmark::State& state, const char* font_name)
+{
+    const char* bdf = embedded_font(font_name);
+    if (bdf == nullptr) {
+        state.SkipWithError("font not embedded");
+        return;
+    }
+    for (auto _ : state) {
+        GlyphAtlas font;
+        benchmark::DoNotOptimize(font.load_bdf(bdf));
+    }
+    state.SetBytesProcessed(state.iterations() * (int64_t)strlen(bdf));
+}
+BENCHMARK_CAPTURE(BM_BdfLoad, 6x12, "6x12");
+BENCHMARK_CAPTURE(BM_BdfLoad, 4x6, "4x6");
+
+static void BM_BdfDrawText(benchmark::State& state, const char* font_name, const char* text)
+{
+    GlyphAtlas font;
+    const char* bdf = embedded_font(font_name);
+    if (bdf == nullptr || !font.load_bdf(bdf)) {
+        state.SkipWithError("font not embedded");
+        return;
+    }
+    Framebuffer frame;
+    frame.resize(BENCH_PANEL_WIDTH, BENCH_PANEL_HEIGHT);
+    frame.fill(Rgb{ 0, 0, 0 });
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(font.draw_text(frame, 0, font.baseline(), Rgb{ 255, 160, 0 }, text));
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * (int64_t)strlen(text));
+}
+BENCHMARK_CAPTURE(BM_BdfDrawText, clock, "6x12", "12:34");
+BENCHMARK_CAPTURE(BM_BdfDrawText, day, "4x6", "Donnerstag");
+BENCHMARK_CAPTURE(BM_BdfDrawText, name, "6x12", "Anna-Lena");
+
+/**
+ * @class FramebufferCanvas
+ * @brief rgb_matrix::Canvas on a Framebuffer, so DrawText sets the same pixels as GlyphAtlas
+ *
+ * Without the pixel mapper and bit planes of a FrameCanvas, the comparison
+ * shows the cost of the font path alone.
+ */
+class FramebufferCanvas : public rgb_matrix::Canvas {
+public:
+    explicit FramebufferCanvas(Framebuffer& frame) : frame(frame) {}
+    int width() const override { return frame.width; }
+    int height() const override { return frame.height; }
+    void SetPixel(int x, int y, uint8_t red, uint8_t green, uint8_t blue) override {
+        if (x >= 0 && x < frame.width && y >= 0 && y < frame.height)
+            frame.pixel[y][x] = Rgb{ red, green, blue };
+    }
+    void Clear() override { frame.fill(Rgb{ 0, 0, 0 }); }
+    void Fill(uint8_t red, uint8_t green, uint8_t blue) override { frame.fill(Rgb{ red, green, blue }); }
+
+private:
+    Framebuffer& frame;
+};
+
+/**
+ * @brief the former text path: rgb_matrix::DrawText with a font loaded from a BDF file
+ *
+ * The embedded BDF is written to a scratch file first, so both benchmarks use the same font.
+ */
+static void BM_RgbMatrixDrawText(benchmark::State& state, const char* font_name, const char* text)
+{
+    const char* bdf = embedded_font(font_name);
+    if (bdf == nullptr) {
+        state.SkipWithError("font not embedded");
+        return;
+    }
+    const std::string path = bench_tmp_dir() + "/smartdoorF455_bench_" + font_name + ".bdf";
+    std::ofstream(path) << bdf;
+    rgb_matrix::Font font;
+    const bool loaded = font.LoadFont(path.c_str());
+    std::remove(path.c_str());
+    if (!loaded) {
+        state.SkipWithError("rgb_matrix::Font cannot load the font");
+        return;
+    }
+    Framebuffer frame;
+    frame.resize(BENCH_PANEL_WIDTH, BENCH_PANEL_HEIGHT);
+    frame.fill(Rgb{ 0, 0, 0 });
+    FramebufferCanvas canvas(frame);
+    const rgb_matrix::Color color(255, 160, 0);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(rgb_matrix::DrawText(&canvas, font, 0, font.baseline(), color, nullptr, text));
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * (int64_t)strlen(text));
+}
+BENCHMARK_CAPTURE(BM_RgbMatrixDrawText, clock, "6x12", "12:34");
+BENCHMARK_CAPTURE(BM_RgbMatrixDrawText, day, "4x6", "Donnerstag");
+BENCHMARK_CAPTURE(BM_RgbMatrixDrawText, name, "6x12", "Anna-Lena");
+
+/**
+ * @brief door-open animation loaded from a generated sprite sheet: a ball rolling over the panel
+ */
+struct AnimationFixture {
+    AnimationConfig config;
+    std::unique_ptr<AnimationPlayer> player;
+    GlyphAtlas font;
+    bool ready = false;
+
+    AnimationFixture() {
+        config.sprite_sheet = bench_tmp_dir() + "/smartdoorF455_bench_sprites.ppm";
+        std::ofstream ppm(config.sprite_sheet, std::ios::binary);
+        const int sheet_width = config.sprite_frame_width * BENCH_SPRITE_FRAMES;
+        ppm << "P6\n" << sheet_width << " " << config.sprite_frame_height << "\n255\n";
+        const int radius = config.sprite_frame_width / 3;
+        for (int y = 0; y < config.sprite_frame_height; y++) {
+            for (int x = 0; x < sheet_width; x++) {
+                const int dx = x % config.sprite_frame_width - config.sprite_frame_width / 2;
+                const int dy = y - config.sprite_frame_height / 2 + (x / config.sprite_frame_width) % 3; // bouncing
+                const bool ball = dx * dx + dy * dy <= radius * radius;
+                const char rgb[3] = { (char)(ball ? 230 : 0), (char)(ball ? 40 : 0), (char)(ball ? 20 + 20 * (x / config.sprite_frame_width) : 0) };
+                ppm.write(rgb, 3);
+            }
+        }
+        ppm.close();
+        player.reset(new AnimationPlayer(config));
+        const char* bdf = embedded_font("4x6");
+        ready = player->load_sprite_sheet() && bdf != nullptr && font.load_bdf(bdf);
+        std::remove(config.sprite_sheet.c_str());
+    }
+};
+
+/**
+ * @brief one animation frame per iteration: marquee, sprite, copy to the panel, paced swap
+ *
+ * What LedDisplay does while the door-open sprite plays and a name too wide
+ * for the panel scrolls. vsync_hz 0 swaps at once and shows the cost of a
+ * frame; at BENCH_VSYNC_HZ the FramePacer divides the refresh rate down to
+ * at most config.fps and the counters show frame interval and jitter.
+ */
+static void BM_AnimationFrame(benchmark::State& state)
+{
+    static AnimationFixture fixture; // the sprite sheet is loaded once
+    if (!fixture.ready) {
+        state.SkipWithError("sprite sheet or font not loaded");
+        return;
+    }
+    MemoryPanel panel(BENCH_PANEL_WIDTH, BENCH_PANEL_HEIGHT, (int)state.range(0));
+    FramePacer pacer(fixture.config.fps, fixture.config.cpu_budget_percent);
+    Marquee marquee(fixture.config.marquee_speed);
+    Framebuffer frame;
+    frame.resize(BENCH_PANEL_WIDTH, BENCH_PANEL_HEIGHT);
+    frame.fill(Rgb{ 0, 0, 0 });
+    const int bottom = BENCH_PANEL_HEIGHT;
+    const int top = bottom - fixture.font.height();
+    marquee.set_text(fixture.font, "Anna-Lena Mustermann", frame.width, top + fixture.font.baseline(), top, bottom,
+                     Rgb{ 0, 200, 0 }, Rgb{ 0, 0, 0 }, monotonic_us());
+    for (auto _ : state) {
+        const int64_t now_us = monotonic_us();
+        if (!fixture.player->active(now_us))
+            fixture.player->play_sprite(now_us);
+        const int64_t cpu_start_us = thread_cpu_us();
+        frame.fill_rows(0, top, Rgb{ 0, 0, 0 }); // the sprite moves over the clock layer
+        fixture.player->draw(frame, now_us);
+        marquee.draw(frame, now_us);
+        panel.set_rows(frame, 0, frame.height);
+        const int64_t cpu_us = thread_cpu_us() - cpu_start_us;
+        panel.swap(pacer.vsync_fraction());
+        pacer.frame_done(cpu_us, monotonic_us());
+    }
+    state.counters["cost_us"] = pacer.mean_cost_us();
+    if (state.range(0) == 0)
+        return; // without vsync the pacer has no refresh period to divide
+    state.counters["interval_us"] = pacer.mean_interval_us();
+    state.counters["jitter_us"] = pacer.jitter_us();
+    state.counters["max_interval_us"] = (double)pacer.max_interval_us();
+    state.counters["fps"] = pacer.effective_fps();
+    state.counters["vsync_fraction"] = pacer.vsync_fraction();
+}
+BENCHMARK(BM_AnimationFrame)->ArgName("vsync_hz")->Arg(0)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_AnimationFrame)->ArgName("vsync_hz")->Arg(BENCH_VSYNC_HZ)->Iterations(BENCH_ANIMATION_FRAMES)->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_FormatClockLines(benchmark::State& state)
+{
+    char text[BASE_LINES][DISPLAY_LINE_CHARS];
+    time_t now = time(nullptr);
+    for (auto _ : state) {
+        format_clock_lines(now++, text); // a new second every call, nothing cached
+        benchmark::DoNotOptimize(text);
+    }
+}
+BENCHMARK(BM_FormatClockLines);
+
+/**
+ * @brief lets the log thread empty the ring, so that every record of a run finds a free slot
+ */
+static void drain_log(const benchmark::State&)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(BENCH_LOG_DRAIN_MSEC));
+}
+
+static void BM_LogRecord(benchmark::State& state)
+{
+    const uint64_t dropped_before = AsyncLog::dropped_count();
+    int64_t latency_ms = 0;
+    for (auto _ : state)
+        LOG_INFO(LogModule::Auth, "edge-to-unlock latency: %lld ms", (long long)latency_ms++);
+    state.counters["dropped"] = (double)(AsyncLog::dropped_count() - dropped_before);
+}
+// half a ring per run, a burst the log thread would drain in the daemon; more would measure dropping
+BENCHMARK(BM_LogRecord)->Iterations(AsyncLog::RING_RECORDS / 2)->Repetitions(BENCH_LOG_RUNS)->ReportAggregatesOnly(true)->Setup(drain_log);
+
+static void BM_TriggerGateVisit(benchmark::State& state)
+{
+    GateConfig config;
+    config.burst_us = BENCH_BURST_USEC;
+    TriggerGate gate;
+    gate.configure(config);
+    int64_t ts_us = 0;
+    for (auto _ : state) {
+        ts_us += config.holdoff_us; // next visit right after the hold-off
+        benchmark::DoNotOptimize(gate.offer((int)EdgePolicy::Rising, 1, ts_us));
+        for (int b = 1; b <= 2 * BENCH_BOUNCES; b++) {
+            const int edge = b % 2 ? (int)EdgePolicy::Falling : (int)EdgePolicy::Rising;
+            benchmark::DoNotOptimize(gate.offer(edge, 1, ts_us + b * BENCH_BOUNCE_USEC));
+        }
+        gate.release(); // authentication done
+    }
+    state.SetItemsProcessed(state.iterations() * (2 * BENCH_BOUNCES + 1));
+    state.counters["accepted"] = (double)gate.accepted_count();
+}
+BENCHMARK(BM_TriggerGateVisit);
+
+/** gate shared by the threads of BM_TriggerEdgeStorm, like the ISR and motion detection share it in the daemon */
+static TriggerGate storm_gate;
+
+/**
+ * @brief edges from every thread, BENCH_STORM_SPACING_USEC apart in trace time, into one gate
+ *
+ * A 10 kHz storm - a broken sensor or a flickering barrier: every thread
+ * offers its edges interleaved with the others, the first thread finishes
+ * an authentication every BENCH_STORM_AUTH_EDGES edges.
+ */
+static void BM_TriggerEdgeStorm(benchmark::State& state)
+{
+    if (state.thread_index() == 0) {
+        GateConfig config;
+        config.burst_us = BENCH_BURST_USEC;
+        config.holdoff_us = 0;
+        storm_gate.configure(config);
+    }
+    uint64_t before[(int)GateDecision::COUNT]; // the counters of the shared gate run on across runs
+    for (int d = 0; d < (int)GateDecision::COUNT; d++)
+        before[d] = storm_gate.decision_count((GateDecision)d);
+    const int64_t stride_us = (int64_t)state.threads() * BENCH_STORM_SPACING_USEC;
+    int64_t ts_us = (int64_t)state.thread_index() * BENCH_STORM_SPACING_USEC;
+    int64_t edges = 0;
+    for (auto _ : state) {
+        const int edge = edges % 2 ? (int)EdgePolicy::Falling : (int)EdgePolicy::Rising;
+        benchmark::DoNotOptimize(storm_gate.offer(edge, 1, ts_us));
+        ts_us += stride_us;
+        if (state.thread_index() == 0 && ++edges % BENCH_STORM_AUTH_EDGES == 0)
+            storm_gate.release(); // authentication done
+    }
+    state.SetItemsProcessed(state.iterations());
+    if (state.thread_index() == 0) {
+        auto since = [&before](GateDecision d) { return (double)(storm_gate.decision_count(d) - before[(int)d]); };
+        state.counters["accepted"] = since(GateDecision::Accept);
+        state.counters["collapsed"] = since(GateDecision::BurstCollapsed);
+        state.counters["in_flight"] = since(GateDecision::InFlight);
+    }
+}
+BENCHMARK(BM_TriggerEdgeStorm)->Threads(1)->Threads(2)->Threads(4)->UseRealTime();
+
+/**
+ * @brief raw device faceprints: random features, every user enrolled once
+ */
+static void generate_faceprint(std::mt19937& rng, int16_t* features)
+{
+    std::normal_distribution<float> feature(0.0f, BENCH_FACEPRINT_SIGMA);
+    for (size_t f = 0; f < BENCH_FACEPRINT_DIMS; f++)
+        features[f] = (int16_t)std::max(-32767.0f, std::min(32767.0f, feature(rng)));
+}
+
+/**
+ * @brief probe of the same person as features, another frame: every feature disturbed a little
+ */
+static std::vector<int16_t> probe_of(const int16_t* features, std::mt19937& rng)
+{
+    std::normal_distribution<float> noise(0.0f, BENCH_FACEPRINT_SIGMA / 10);
+    std::vector<int16_t> probe(features, features + BENCH_FACEPRINT_DIMS);
+    for (int16_t& f : probe)
+        f = (int16_t)std::max(-32767.0f, std::min(32767.0f, f + noise(rng)));
+    return probe;
+}
+
+/** index of the last run, rebuilt only if the row count changes; 100k rows take 110 MB */
+static std::unique_ptr<FaceprintIndex> match_index;
+static std::vector<int16_t> match_probe;
+
+static void BM_FaceprintMatch(benchmark::State& state)
+{
+    const size_t rows = (size_t)state.range(0);
+    const unsigned int threads = (unsigned int)state.range(1);
+    if (!match_index || match_index->size() != rows) {
+        match_index.reset(); // free the old one before allocating the new one
+        match_index.reset(new FaceprintIndex(BENCH_FACEPRINT_DIMS));
+        match_index->reserve(rows);
+        std::mt19937 rng(BENCH_FACEPRINT_SEED);
+        std::vector<int16_t> features(BENCH_FACEPRINT_DIMS);
+        for (size_t r = 0; r < rows; r++) {
+            generate_faceprint(rng, features.data());
+            match_index->add("user" + std::to_string(r), features.data());
+            if (r == rows / 2)
+                match_probe = probe_of(features.data(), rng);
+        }
+    }
+    FaceprintMatch match;
+    for (auto _ : state) {
+        match = match_index->best_match(match_probe.data(), threads);
+        benchmark::DoNotOptimize(match);
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+    state.counters["score"] = match.score;
+    state.counters["found"] = match.index == (long)(rows / 2);
+}
+
+/** 10k, 50k and 100k users, scanned on the calling thread and on all cores */
+static void faceprint_match_args(benchmark::internal::Benchmark* benchmark)
+{
+    const int cores = (int)std::max(2u, std::thread::hardware_concurrency());
+    for (int rows : { 10000, 50000, 100000 }) {
+        benchmark->Args({ rows, 1 });
+        benchmark->Args({ rows, cores });
+    }
+}
+BENCHMARK(BM_FaceprintMatch)->ArgNames({ "rows", "threads" })->Apply(faceprint_match_args)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+/** directories of the generated faceprint databases, removed at exit */
+static std::vector<std::string> store_dirs;
+static std::vector<int16_t> store_probe;
+
+/**
+ * @brief generates a faceprint database of rows users in one segment, once per row count
+ * @return its directory, empty if it could not be written
+ */
+static std::string generated_store(size_t rows)
+{
+    const std::string dir = bench_tmp_dir() + "/smartdoorF455_bench_faceprints_" + std::to_string(rows);
+    if (std::find(store_dirs.begin(), store_dirs.end(), dir) != store_dirs.end())
+        return dir;
+    std::filesystem::remove_all(dir);
+    std::vector<FaceprintRecord> records(rows);
+    std::mt19937 rng(BENCH_FACEPRINT_SEED);
+    for (size_t r = 0; r < rows; r++) {
+        records[r].user_id = "user" + std::to_string(r);
+        records[r].features.resize(BENCH_FACEPRINT_DIMS);
+        generate_faceprint(rng, records[r].features.data());
+    }
+    FaceprintStore store(dir, BENCH_FACEPRINT_DIMS);
+    if (!store.open() || !store.replace(records))
+        return std::string();
+    store_dirs.push_back(dir);
+    return dir;
+}
+
+/**
+ * @brief startup of host matching: reading the manifest and mapping the segment
+ *
+ * Nothing is parsed per user, so the time stays flat from 1k to 100k users;
+ * the complexity fit printed after the runs shows it.
+ */
+static void BM_FaceprintStoreOpen(benchmark::State& state)
+{
+    const size_t rows = (size_t)state.range(0);
+    const std::string dir = generated_store(rows);
+    if (dir.empty()) {
+        state.SkipWithError("cannot write the faceprint database");
+        return;
+    }
+    size_t rows_opened = 0;
+    for (auto _ : state) {
+        FaceprintStore store(dir, BENCH_FACEPRINT_DIMS);
+        if (!store.open()) {
+            state.SkipWithError("cannot open the faceprint database");
+            break;
+        }
+        rows_opened = store.snapshot()->rows();
+    }
+    state.SetComplexityN((int64_t)rows);
+    state.counters["rows"] = (double)rows_opened;
+}
+BENCHMARK(BM_FaceprintStoreOpen)->ArgName("rows")->RangeMultiplier(10)->Range(1000, 100000)->Complexity()
+    ->Unit(benchmark::kMicrosecond);
+
+/** store of the last run, opened again only if the row count changes */
+static std::unique_ptr<FaceprintStore> match_store;
+
+/**
+ * @brief the matching path of the door: snapshot()->best_match on the mapped rows
+ */
+static void BM_FaceprintStoreMatch(benchmark::State& state)
+{
+    const size_t rows = (size_t)state.range(0);
+    const unsigned int threads = (unsigned int)state.range(1);
+    if (!match_store || match_store->snapshot()->rows() != rows) {
+        const std::string dir = generated_store(rows);
+        match_store.reset(dir.empty() ? nullptr : new FaceprintStore(dir, BENCH_FACEPRINT_DIMS));
+        if (!match_store || !match_store->open()) {
+            match_store.reset();
+            state.SkipWithError("cannot open the faceprint database");
+            return;
+        }
+        std::mt19937 rng(BENCH_FACEPRINT_SEED); // the same sequence as generated_store(), up to row rows / 2
+        std::vector<int16_t> features(BENCH_FACEPRINT_DIMS);
+        for (size_t r = 0; r <= rows / 2; r++)
+            generate_faceprint(rng, features.data());
+        store_probe = probe_of(features.data(), rng);
+    }
+    FaceprintMatch match;
+    for (auto _ : state) {
+        match = match_store->snapshot()->best_match(store_probe.data(), threads);
+        benchmark::DoNotOptimize(match);
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+    state.counters["score"] = match.score;
+    state.counters["found"] = match.user_id == "user" + std::to_string(rows / 2);
+}
+
+/** 10k and 100k users, scanned on the calling thread and on all cores */
+static void faceprint_store_match_args(benchmark::internal::Benchmark* benchmark)
+{
+    const int cores = (int)std::max(2u, std::thread::hardware_concurrency());
+    for (int rows : { 10000, 100000 }) {
+        benchmark->Args({ rows, 1 });
+        benchmark->Args({ rows, cores });
+    }
+}
+BENCHMARK(BM_FaceprintStoreMatch)->ArgNames({ "rows", "threads" })->Apply(faceprint_store_match_args)->UseRealTime()
+    ->Unit(benchmark::kMicrosecond);
+
+static void BM_ConfigParse(benchmark::State& state)
+{
+    std::ifstream file(BENCH_CONFIG_FILE);
+    std::stringstream text;
+    text << file.rdbuf();
+    const std::string config_text = text.str();
+    if (!file || config_text.empty()) {
+        state.SkipWithError("cannot read " BENCH_CONFIG_FILE);
+        return;
+    }
+    try {
+        for (auto _ : state) {
+            toml::table table = toml::parse(config_text, BENCH_CONFIG_FILE);
+            benchmark::DoNotOptimize(table);
+        }
+    }
+    catch (const toml::parse_error& err) {
+        state.SkipWithError(err.what());
+        return;
+    }
+    state.SetBytesProcessed(state.iterations() * (int64_t)config_text.size());
+}
+BENCHMARK(BM_ConfigParse)->Unit(benchmark::kMicrosecond);
+
+static void BM_SnapshotJpeg(benchmark::State& state)
+{
+    const int rotation = (int)state.range(0);
+    cv::Mat frame(BENCH_SNAPSHOT_HEIGHT, BENCH_SNAPSHOT_WIDTH, CV_8UC3);
+    for (int y = 0; y < frame.rows; y++) { // gradient with sensor noise, compresses like a webcam frame
+        for (int x = 0; x < frame.cols; x++)
+            frame.at<cv::Vec3b>(y, x) = cv::Vec3b((uchar)(x * 255 / frame.cols), (uchar)(y * 255 / frame.rows), (uchar)((x + y) / 4));
+    }
+    cv::Mat noise(frame.size(), CV_8UC3);
+    cv::randu(noise, cv::Scalar::all(0), cv::Scalar::all(16));
+    frame += noise;
+    const std::vector<int> jpeg_params = { cv::IMWRITE_JPEG_QUALITY, BENCH_JPEG_QUALITY };
+    cv::Mat rotated;
+    std::vector<unsigned char> jpeg;
+    for (auto _ : state) {
+        const cv::Mat* snapshot = &frame;
+        if (rotation == 270) { // as SnapshotCapture::snapshot() with snapshot.rotation = 270
+            cv::rotate(frame, rotated, cv::ROTATE_90_COUNTERCLOCKWISE);
+            snapshot = &rotated;
+        }
+        if (!cv::imencode(".jpg", *snapshot, jpeg, jpeg_params)) {
+            state.SkipWithError("cannot encode jpeg");
+            return;
+        }
+    }
+    state.counters["jpeg_bytes"] = (double)jpeg.size();
+}
+BENCHMARK(BM_SnapshotJpeg)->ArgName("rotation")->Arg(0)->Arg(270)->Unit(benchmark::kMillisecond);
+
+/**
+ * @brief DoorController handing notifications to a running outbox whose sender returns at once
+ */
+struct NotifyFixture {
+    StateChannel<DisplayState> display_state;
+    TriggerPipeline pipeline;
+    NotificationOutbox outbox{ OutboxConfig(), [](const Notification&) { return NotificationOutbox::SendResult::Sent; } };
+    uint64_t doors_opened = 0;
+    DoorController door{ DoorControllerConfig(), display_state, pipeline, &outbox, sim_status_name, nullptr,
+                         [this](int64_t) { doors_opened++; } };
+
+    NotifyFixture() { outbox.start(); }
+    ~NotifyFixture() { outbox.stop(); }
+
+};
+
+/** one outbox for all notification benchmarks, its thread is started once */
+static std::unique_ptr<NotifyFixture> notify_fixture;
+
+static NotifyFixture& shared_notify_fixture()
+{
+    if (!notify_fixture)
+        notify_fixture.reset(new NotifyFixture());
+    return *notify_fixture;
+}
+
+static void count_notifications(benchmark::State& state, const NotificationOutbox& outbox,
+                                uint64_t sent_before, uint64_t coalesced_before, uint64_t dropped_before)
+{
+    state.counters["sent"] = (double)(outbox.sent_count() - sent_before);
+    state.counters["coalesced"] = (double)(outbox.coalesced_count() - coalesced_before);
+    state.counters["dropped"] = (double)(outbox.dropped_count() - dropped_before);
+}
+
+static void BM_NotifyGranted(benchmark::State& state)
+{
+    NotifyFixture& fixture = shared_notify_fixture();
+    const uint64_t sent = fixture.outbox.sent_count(), coalesced = fixture.outbox.coalesced_count(),
+                   dropped = fixture.outbox.dropped_count();
+    for (auto _ : state)
+        fixture.door.on_result(AuthOutcome::Granted, (int)SimStatus::Success, "Anna");
+    count_notifications(state, fixture.outbox, sent, coalesced, dropped);
+}
+BENCHMARK(BM_NotifyGranted);
+
+static void BM_NotifyDenied(benchmark::State& state)
+{
+    NotifyFixture& fixture = shared_notify_fixture();
+    const uint64_t sent = fixture.outbox.sent_count(), coalesced = fixture.outbox.coalesced_count(),
+                   dropped = fixture.outbox.dropped_count();
+    for (auto _ : state)
+        fixture.door.on_result(AuthOutcome::Denied, (int)SimStatus::Forbidden, nullptr);
+    count_notifications(state, fixture.outbox, sent, coalesced, dropped);
+}
+BENCHMARK(BM_NotifyDenied);
+
+int main(int argc, char** argv)
+{
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    LogConfig log_config; // records are formatted and written as in the daemon, stdout stays free for the results
+    log_config.file = bench_tmp_dir() + "/smartdoorF455_bench.log";
+    log_config.max_bytes = BENCH_LOG_MAX_BYTES;
+    log_config.keep_files = 0;
+    AsyncLog::start(log_config);
+    benchmark::AddCustomContext("config_file", BENCH_CONFIG_FILE);
+    benchmark::AddCustomContext("panel", std::to_string(BENCH_PANEL_WIDTH) + "x" + std::to_string(BENCH_PANEL_HEIGHT));
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    notify_fixture.reset();
+    match_store.reset();
+    for (const std::string& dir : store_dirs)
+        std::filesystem::remove_all(dir);
+    AsyncLog::stop();
+    return 0;
+}
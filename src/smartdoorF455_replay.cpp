@@ -0,0 +1,311 @@
+/**
+ * @file smartdoorF455_replay.cpp
+ * @brief Replays a day of door traffic at accelerated time against the pipeline of the daemon
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * Runs the components of smartdoorF455 behind the simulated hardware of
+ * hal_sim.hpp, for soak and load tests on a plain Linux box:
+ *
+ * - TraceTriggerSource plays a generated day (see generate_day_trace()) or
+ *   a trace read from CSV into the TriggerPipeline and wakes the display
+ * - ScriptedAuthDevice authenticates whoever stands at the door, its results
+ *   go to the DoorController of the daemon: display state, door opener,
+ *   notifications
+ * - LedDisplay renders into a MemoryPanel; with ppm_dir every shown frame is
+ *   written there, the last one always to ppm_dir or the working directory
+ * - SimSnapshotCamera and a simulated, slow Telegram sender feed the
+ *   NotificationOutbox
+ * - if mqtt_port is given (not 0), the door is opened through MqttSession on
+ *   a mosquitto broker on 127.0.0.1
+ *
+ * Time runs speed times faster: trace, authentication, snapshot and sender
+ * latencies as well as gate hold-off, burst window, display durations and
+ * outbox windows are divided by speed, so the pipeline sees the same
+ * sequence of events as on a day at the door, compressed. Minute ticks,
+ * vsync and panel idle times are not scaled. Edge-to-unlock is reported in
+ * real time and in trace time; queueing that does not shrink with speed
+ * shows up as a growing trace-time latency.
+ *
+ * Ctrl-C ends the replay early and prints the report.
+ *
+ * Usage:
+ * @code
+ * ./smartdoorF455_replay [trace=day] [speed=100] [hours=24] [ppm_dir=] [mqtt_port=0] [save_trace=]
+ * ./smartdoorF455_replay day 100 24 /tmp/frames 0 /tmp/day.csv  # generate, replay and keep the trace
+ * ./smartdoorF455_replay /tmp/day.csv 1000                        # replay it again, 10x faster
+ * @endcode
+ */
+#include "async_log.hpp"
+#include "door_controller.hpp"
+#include "door_trace.hpp"
+#include "hal_sim.hpp"
+#include "led_display.hpp"
+#include "metrics.hpp"
+#include "mqtt_session.hpp"
+#include "notification_outbox.hpp"
+#include "trigger_pipeline.hpp"
+#include <algorithm>
+#include <csignal>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#define REPLAY_PANEL_WIDTH 32       // 64x32 panel rotated by 270 degrees, as in config.toml
+#define REPLAY_PANEL_HEIGHT 64
+#define REPLAY_REFRESH_HZ 120       // limit_refresh_rate_hz of config.toml
+#define REPLAY_BURST_USEC 50000     // trigger gate collapses bouncing edges within this window
+#define REPLAY_SNAPSHOT_USEC 120000 // frame from the ring, rotated and encoded
+#define REPLAY_JPEG_BYTES 48000
+#define REPLAY_NOTIFY_USEC 1500000  // Telegram round-trip
+#define REPLAY_NOTIFY_FAIL_EVERY 10 // every n-th send fails and is retried
+#define REPLAY_PROGRESS_MSEC 5000   // progress line this often, real time
+
+static volatile sig_atomic_t interrupt_received = 0;
+
+static void interrupt_handler(int /*signum*/)
+{
+    interrupt_received = 1;
+}
+
+static std::mutex samples_mutex;
+static std::vector<int64_t> dispatch_us; // trigger -> start of authentication
+static std::vector<int64_t> unlock_us;   // trigger -> door opened
+
+/**
+ * @brief prints min/p50/p95/p99/max of a sample vector in milliseconds, multiplied by scale
+ */
+static void print_stats(const char* name, std::vector<int64_t> samples, double scale = 1.0)
+{
+    if (samples.empty()) {
+        std::cout << name << ": no samples" << std::endl;
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    auto pct = [&](double p) { return samples[(size_t)(p * (samples.size() - 1))] * scale / 1000.0; };
+    std::cout << name << " [ms] n=" << samples.size()
+              << " min=" << samples.front() * scale / 1000.0
+              << " p50=" << pct(0.50)
+              << " p95=" << pct(0.95)
+              << " p99=" << pct(0.99)
+              << " max=" << samples.back() * scale / 1000.0 << std::endl;
+}
+
+/**
+ * @brief parses a whole command line argument as T, throws std::invalid_argument or std::out_of_range
+ */
+template <typename T>
+static T parse_number(const std::string& text)
+{
+    size_t end = 0;
+    const T value = std::is_integral<T>::value ? (T)std::stoi(text, &end) : (T)std::stod(text, &end);
+    if (end != text.size())
+        throw std::invalid_argument(text);
+    return value;
+}
+
+static std::string trace_clock(int64_t at_us)
+{
+    char text[16];
+    snprintf(text, sizeof(text), "%02lld:%02lld", (long long)(at_us / 3600000000LL), (long long)(at_us / 60000000 % 60));
+    return text;
+}
+
+int main(int argc, char** argv)
+{
+    std::string trace_source = argc > 1 ? argv[1] : "day";
+    double speed = 100.0;
+    double hours = 24.0;
+    std::string ppm_dir = argc > 4 ? argv[4] : "";
+    int mqtt_port = 0;
+    std::string save_path = argc > 6 ? argv[6] : "";
+    try {
+        if (argc > 7 || trace_source.empty() || trace_source[0] == '-') // --help, -h
+            throw std::invalid_argument(trace_source);
+        speed = argc > 2 ? parse_number<double>(argv[2]) : speed;
+        hours = argc > 3 ? parse_number<double>(argv[3]) : hours;
+        mqtt_port = argc > 5 ? parse_number<int>(argv[5]) : mqtt_port;
+        if (!(speed > 0) || !(hours > 0) || mqtt_port < 0 || mqtt_port > 65535)
+            throw std::out_of_range("speed and hours must be positive, mqtt_port a port");
+    }
+    catch (const std::exception&) {
+        std::cerr << "usage: " << argv[0] << " [trace=day] [speed=100] [hours=24] [ppm_dir=] [mqtt_port=0] [save_trace=]" << std::endl;
+        return 1;
+    }
+
+    // trace first: nothing runs yet that would have to be stopped if it cannot be read or saved
+    DoorTrace trace;
+    const int64_t limit_us = (int64_t)(hours * 3600 * 1000000);
+    if (trace_source == "day") {
+        TraceProfile profile;
+        profile.duration_us = limit_us;
+        trace = generate_day_trace(profile);
+    }
+    else if (!load_trace(trace_source, trace)) {
+        return 1;
+    }
+    trace.events.erase(std::remove_if(trace.events.begin(), trace.events.end(),
+                                      [limit_us](const DoorEvent& event) { return event.at_us >= limit_us; }),
+                       trace.events.end());
+    trace.duration_us = std::min(trace.duration_us, limit_us);
+    if (!save_path.empty() && !save_trace(save_path, trace))
+        return 1;
+
+    signal(SIGINT, interrupt_handler);
+    signal(SIGTERM, interrupt_handler);
+    LogConfig log_config; // warnings to stdout: denied and spoofed attempts, failed sends
+    for (LogLevel& level : log_config.module_levels)
+        level = LogLevel::Warn;
+    log_config.module_levels[(int)LogModule::Main] = LogLevel::Info;
+    AsyncLog::start(log_config);
+
+    int visits[4] = {};
+    for (const DoorEvent& event : trace.events)
+        visits[(int)event.visitor]++;
+    std::cout << "replaying " << trace.events.size() << " visits in " << trace_clock(trace.duration_us) << " h at " << speed
+              << "x: residents=" << visits[(int)Visitor::Resident] << " strangers=" << visits[(int)Visitor::Stranger]
+              << " spoofers=" << visits[(int)Visitor::Spoofer] << " passersby=" << visits[(int)Visitor::Passerby]
+              << ", about " << trace.duration_us / speed / 1e6 << " s" << std::endl;
+
+    // the config the daemon would have read from config.toml, defaults of app_config.hpp
+    ConfigChannel app_config;
+    auto config = std::make_shared<AppConfig>();
+    config->gate.holdoff_us = (int64_t)(config->gate.holdoff_us / speed);
+    config->gate.burst_us = (int64_t)(REPLAY_BURST_USEC / speed);
+    app_config.publish(config);
+
+    StateChannel<DisplayState> display_state;
+    PanelPower panel_power;
+    LedDisplay display(app_config, display_state, panel_power, sim_status_name);
+    auto panel = std::make_unique<MemoryPanel>(REPLAY_PANEL_WIDTH, REPLAY_PANEL_HEIGHT, REPLAY_REFRESH_HZ, ppm_dir);
+    MemoryPanel* memory_panel = panel.get();
+    if (!display.start(std::move(panel))) {
+        AsyncLog::stop();
+        return 1;
+    }
+
+    std::unique_ptr<MqttSession> mqtt_session;
+    if (mqtt_port) { // loopback broker
+        MqttSessionConfig mqtt_config;
+        mqtt_config.host = "127.0.0.1";
+        mqtt_config.port = mqtt_port;
+        mqtt_config.client_id = "smartdoorF455_replay";
+        mqtt_config.topic_door = "smartdoorF455_replay/exec";
+        mqtt_session = std::make_unique<MqttSession>(mqtt_config);
+        if (!mqtt_session->start()) {
+            display.stop();
+            AsyncLog::stop();
+            return 1;
+        }
+    }
+
+    std::atomic<uint64_t> send_attempts{0};
+    OutboxConfig outbox_config;
+    outbox_config.coalesce_window_ms = (unsigned int)std::max(outbox_config.coalesce_window_ms / speed, 1.0);
+    outbox_config.retry_initial_ms = (unsigned int)std::max(outbox_config.retry_initial_ms / speed, 1.0);
+    outbox_config.retry_max_ms = (unsigned int)std::max(outbox_config.retry_max_ms / speed, 1.0);
+    NotificationOutbox outbox(outbox_config, [&](const Notification& n) { // simulated slow, flaky Telegram
+        TraceSpan span(TraceStage::TelegramSend, n.trigger_ts_us);
+        std::this_thread::sleep_for(std::chrono::microseconds((int64_t)(REPLAY_NOTIFY_USEC / speed)));
+        if (send_attempts.fetch_add(1, std::memory_order_relaxed) % REPLAY_NOTIFY_FAIL_EVERY == REPLAY_NOTIFY_FAIL_EVERY - 1)
+            return NotificationOutbox::SendResult::Retry;
+        return NotificationOutbox::SendResult::Sent;
+    });
+    outbox.start();
+
+    TriggerPipeline pipeline;
+    DoorControllerConfig door_config;
+    door_config.name_display_us = (int64_t)(door_config.name_display_us / speed);
+    door_config.hint_display_us = (int64_t)(door_config.hint_display_us / speed);
+    door_config.alert_display_us = (int64_t)(door_config.alert_display_us / speed);
+    DoorController door(door_config, display_state, pipeline, &outbox, sim_status_name,
+        [&display] { display.notify(); },
+        [&mqtt_session](int64_t trigger_ts_us) {
+            if (mqtt_session)
+                mqtt_session->publish_door_open(trigger_ts_us);
+            if (trigger_ts_us != 0) {
+                std::lock_guard<std::mutex> lock(samples_mutex);
+                unlock_us.push_back(monotonic_us() - trigger_ts_us);
+            }
+        });
+    ScriptedAuthDevice auth_device(AuthScript(), speed);
+    SimSnapshotCamera snapshot_camera(REPLAY_SNAPSHOT_USEC, REPLAY_JPEG_BYTES, speed);
+    pipeline.set_auth_stage([&](const TriggerEvent& event) { // what authenticate_presence does in the daemon
+        int64_t auth_start_us = monotonic_us();
+        {
+            std::lock_guard<std::mutex> lock(samples_mutex);
+            dispatch_us.push_back(auth_start_us - event.ts_us);
+        }
+        TraceSpan span(TraceStage::Authenticate, event.ts_us);
+        auth_device.authenticate(door);
+        Metrics::observe(MetricHistogram::AuthDuration, monotonic_us() - auth_start_us);
+    });
+    pipeline.set_snapshot_stage([&](const TriggerEvent& event) { // what capture_snapshot does in the daemon
+        int64_t capture_start_us = monotonic_us();
+        auto jpeg = std::make_shared<std::vector<unsigned char>>();
+        if (!snapshot_camera.capture_jpeg(event.ts_us, *jpeg))
+            return;
+        Metrics::observe(MetricHistogram::SnapshotCapture, monotonic_us() - capture_start_us);
+        Notification notification;
+        notification.kind = Notification::Kind::Photo;
+        notification.photo_jpeg = jpeg;
+        notification.trigger_ts_us = event.ts_us;
+        outbox.post(std::move(notification));
+    });
+    pipeline.start(config->gate);
+
+    TraceTriggerSource trigger_source(trace, speed, [&auth_device](const DoorEvent* visit) { auth_device.present(visit); });
+    const int64_t replay_start_us = monotonic_us();
+    trigger_source.start([&](int edge, int status) { // what the ISR does in the daemon
+        pipeline.post_trigger(edge, status);
+        panel_power.activity(monotonic_us());
+        display.notify();
+    });
+    while (!trigger_source.wait(REPLAY_PROGRESS_MSEC) && !interrupt_received) {
+        LOG_INFO(LogModule::Main, "trace %s, triggers accepted %llu, granted %llu, denied %llu, spoofs %llu, outbox depth %zu",
+                 trace_clock(trigger_source.position_us()).c_str(), (unsigned long long)pipeline.triggers_accepted(),
+                 (unsigned long long)door.granted_count(), (unsigned long long)door.denied_count(),
+                 (unsigned long long)door.spoof_count(), outbox.depth());
+    }
+    trigger_source.stop();
+    const int64_t replay_us = monotonic_us() - replay_start_us;
+    std::this_thread::sleep_for(std::chrono::microseconds((int64_t)(AuthScript().no_face_us * 2 / speed))); // last authentication
+    pipeline.stop();
+    std::unique_ptr<LedPanel> stopped_panel = display.stop(); // memory_panel stays valid for the report
+    std::string last_frame = (ppm_dir.empty() ? std::string(".") : ppm_dir) + "/smartdoorF455_replay_last.ppm";
+    if (memory_panel->write_ppm(last_frame))
+        std::cout << "last frame written to " << last_frame << std::endl;
+
+    std::cout << "replayed " << trace_clock(trigger_source.position_us()) << " h of trace in " << replay_us / 1e6
+              << " s, " << trigger_source.position_us() / (double)std::max<int64_t>(replay_us, 1) << "x" << std::endl;
+    const TriggerGate& gate = pipeline.trigger_gate();
+    for (int d = 0; d < (int)GateDecision::COUNT; d++)
+        std::cout << "gate " << gate_decision_name((GateDecision)d) << "=" << gate.decision_count((GateDecision)d) << std::endl;
+    std::cout << "edges=" << trigger_source.edges_posted() << " triggers posted=" << pipeline.triggers_posted()
+              << " accepted=" << pipeline.triggers_accepted() << " rejected=" << pipeline.triggers_rejected()
+              << " dropped=" << pipeline.triggers_dropped() << " snapshots dropped=" << pipeline.snapshots_dropped() << std::endl;
+    std::cout << "authentications=" << auth_device.attempts() << " granted=" << door.granted_count()
+              << " (residents " << visits[(int)Visitor::Resident] << ") denied=" << door.denied_count()
+              << " spoofs=" << door.spoof_count() << " (spoofers " << visits[(int)Visitor::Spoofer] << ")" << std::endl;
+    std::cout << "panel swaps=" << memory_panel->swaps() << std::endl;
+    if (mqtt_session) {
+        std::cout << "mqtt connected=" << mqtt_session->is_connected() << " publishes=" << mqtt_session->publish_count()
+                  << " acks=" << mqtt_session->ack_count() << std::endl;
+        mqtt_session->stop();
+    }
+    outbox.stop();
+    std::cout << "outbox depth=" << outbox.depth() << " sent=" << outbox.sent_count() << " failed=" << outbox.failed_count()
+              << " dropped=" << outbox.dropped_count() << " coalesced=" << outbox.coalesced_count()
+              << " retries=" << outbox.retry_count() << std::endl;
+    print_stats("trigger-to-authenticate", dispatch_us);
+    print_stats("edge-to-unlock", unlock_us);
+    print_stats("edge-to-unlock in trace time", unlock_us, speed);
+    LatencyTrace::dump(std::cout);
+    AsyncLog::stop();
+    std::cout << "log written=" << AsyncLog::written_count() << " dropped=" << AsyncLog::dropped_count() << std::endl;
+    return 0;
+}
@@ -0,0 +1,325 @@
+/**
+ * @file smartdoorF455_sim.cpp
+ * @brief Simulator for the smartdoorF455 trigger pipeline
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * Drives TriggerPipeline with a simulated presence sensor and a simulated
+ * authenticator, so edge-to-unlock latency can be measured on a plain Linux
+ * box without Raspberry Pi, F455 camera or LED matrix.
+ *
+ * - simulated sensor: a person arrives every interval_ms (exponentially
+ *   distributed) and produces a short burst of bouncing edges
+ * - simulated authenticator: takes 400..900 ms, 90% success
+ * - snapshot stage takes 300 ms (V4L2 open), notification sender 1500 ms
+ *   (slow Telegram round-trip) and fails every 4th time - neither must
+ *   delay the unlock
+ * - if mqtt_port is given (not 0), the door command is published with QoS 1
+ *   to a mosquitto broker on 127.0.0.1 through MqttSession; commands on
+ *   smartdoorF455_sim/control are run by the ControlEngine and reported on
+ *   smartdoorF455_sim/control/status
+ * - enroll_jobs enrollments (4 s each, simulated poses) are submitted at
+ *   start; door authentications preempt them, device_wait in the trace shows
+ *   how long an authentication waited for a preempted enrollment
+ * - authentication results and enrollment poses are written to a
+ *   StateChannel<DisplayState> from several threads while a simulated display
+ *   thread reads it at 60 fps and counts torn snapshots; the channel itself
+ *   is stressed by tests/test_state_channel.cpp
+ *
+ * Usage:
+ * @code
+ * ./smartdoorF455_sim [persons=20] [interval_ms=1500] [holdoff_ms=1000] [mqtt_port=0] [enroll_jobs=3]
+ * @endcode
+ */
+#include "trigger_pipeline.hpp"
+#include "mqtt_session.hpp"
+#include "notification_outbox.hpp"
+#include "control_engine.hpp"
+#include "display_state.hpp"
+#include "async_log.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#define SIM_EDGES_PER_PERSON 4      // bouncing edges generated by one person passing the sensor
+#define SIM_EDGE_BOUNCE_USEC 800    // distance of bouncing edges
+#define SIM_BURST_USEC 50000        // trigger gate collapses bouncing edges within this window
+#define SIM_AUTH_MIN_MSEC 400       // simulated authentication duration
+#define SIM_AUTH_MAX_MSEC 900
+#define SIM_AUTH_SUCCESS_PERCENT 90
+#define SIM_SNAPSHOT_MSEC 300       // simulated V4L2 open and capture
+#define SIM_NOTIFY_MSEC 1500        // simulated Telegram round-trip
+#define SIM_NOTIFY_FAIL_EVERY 4     // every n-th send fails and is retried
+#define SIM_ENROLL_POSES 8          // simulated enrollment reports this many poses
+#define SIM_ENROLL_POSE_MSEC 500    // duration of one pose
+#define SIM_CANCEL_POLL_MSEC 20     // simulated device reacts to a cancel within this time
+#define SIM_CONTROL_TOPIC "smartdoorF455_sim/control"
+#define SIM_DISPLAY_FPS 60          // simulated LED matrix thread reads the display state this often
+#define SIM_DISPLAY_NAME_USEC 5000000
+
+static std::mutex samples_mutex;
+static std::vector<int64_t> dispatch_us; // trigger -> start of authentication
+static std::vector<int64_t> unlock_us;   // trigger -> door-open publish
+
+/**
+ * @brief prints min/p50/p95/p99/max of a sample vector in milliseconds
+ */
+static void print_stats(const char* name, std::vector<int64_t> samples)
+{
+    if (samples.empty()) {
+        std::cout << name << ": no samples" << std::endl;
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    auto pct = [&](double p) { return samples[(size_t)(p * (samples.size() - 1))] / 1000.0; };
+    std::cout << name << " [ms] n=" << samples.size()
+              << " min=" << samples.front() / 1000.0
+              << " p50=" << pct(0.50)
+              << " p95=" << pct(0.95)
+              << " p99=" << pct(0.99)
+              << " max=" << samples.back() / 1000.0 << std::endl;
+}
+
+/**
+ * @brief parses argv[index] as a non-negative integer, keeps value if the argument is missing
+ * @return false if the argument is not a number
+ */
+static bool parse_arg(int argc, char** argv, int index, int& value)
+{
+    if (argc <= index)
+        return true;
+    char* end = nullptr;
+    errno = 0;
+    long parsed = strtol(argv[index], &end, 10);
+    if (end == argv[index] || *end != '\0' || errno == ERANGE || parsed < 0 || parsed > INT_MAX)
+        return false;
+    value = (int)parsed;
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    int persons = 20;
+    int interval_ms = 1500;
+    int holdoff_ms = 1000;
+    int mqtt_port = 0;
+    int enroll_jobs = 3;
+    if (argc > 6 || !parse_arg(argc, argv, 1, persons) || !parse_arg(argc, argv, 2, interval_ms)
+        || !parse_arg(argc, argv, 3, holdoff_ms) || !parse_arg(argc, argv, 4, mqtt_port)
+        || !parse_arg(argc, argv, 5, enroll_jobs) || interval_ms == 0) {
+        std::cerr << "usage: " << argv[0] << " [persons=20] [interval_ms=1500] [holdoff_ms=1000] [mqtt_port=0] [enroll_jobs=3]" << std::endl;
+        return 1;
+    }
+    std::unique_ptr<MqttSession> mqtt_session;
+    AsyncLog::start(LogConfig()); // MQTT and control messages to stdout
+
+    // simulated device database and enrollment, cancelled like FaceAuthenticator::Cancel()
+    std::mutex users_mutex;
+    std::vector<std::string> users = { "alice", "bob" };
+    std::atomic<bool> device_cancel{false};
+    StateChannel<DisplayState> display_state;
+    ControlEngineConfig control_config;
+    control_config.resume_delay_ms = 1000;
+    ControlEngine control_engine(control_config, [&](const ControlJob& job, const ControlEngine::ProgressSink& progress) {
+        std::lock_guard<std::mutex> lock(users_mutex);
+        switch (job.kind) {
+        case ControlJob::Kind::Enroll:
+            device_cancel = false;
+            for (int pose = 0; pose < SIM_ENROLL_POSES; pose++) {
+                for (int t = 0; t < SIM_ENROLL_POSE_MSEC; t += SIM_CANCEL_POLL_MSEC) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(SIM_CANCEL_POLL_MSEC));
+                    if (device_cancel)
+                        return false;
+                }
+                progress("pose " + std::to_string(pose + 1) + "/" + std::to_string(SIM_ENROLL_POSES));
+                display_state.update([&](DisplayState& state) { // enrollment hint, second writer thread
+                    state.hint = pose;
+                    state.hint_until_us = monotonic_us() + SIM_ENROLL_POSE_MSEC * 1000LL;
+                });
+            }
+            users.push_back(job.user_id);
+            return true;
+        case ControlJob::Kind::Delete: {
+            auto it = std::find(users.begin(), users.end(), job.user_id);
+            if (it == users.end())
+                return false;
+            users.erase(it);
+            return true;
+        }
+        case ControlJob::Kind::List: {
+            std::string list;
+            for (const auto& user : users)
+                list += (list.empty() ? "" : ", ") + user;
+            progress(list);
+            return true;
+        }
+        }
+        return false;
+    }, [&] { device_cancel = true; }, [&](const std::string& text) {
+        if (mqtt_session)
+            mqtt_session->publish(SIM_CONTROL_TOPIC "/status", text);
+    });
+    if (mqtt_port) { // loopback broker
+        MqttSessionConfig mqtt_config;
+        mqtt_config.host = "127.0.0.1";
+        mqtt_config.port = mqtt_port;
+        mqtt_config.client_id = "smartdoorF455_sim";
+        mqtt_config.topic_door = "smartdoorF455_sim/exec";
+        mqtt_config.topic_control = SIM_CONTROL_TOPIC;
+        mqtt_session = std::make_unique<MqttSession>(mqtt_config);
+        mqtt_session->set_message_handler([&](const std::string& topic, const std::string& payload) {
+            if (topic == SIM_CONTROL_TOPIC)
+                control_engine.submit(payload);
+        });
+        if (!mqtt_session->start()) {
+            AsyncLog::stop(); // writes why, and ends the log thread before it is destroyed
+            return 1;
+        }
+    }
+    control_engine.start();
+    for (int j = 0; j < enroll_jobs; j++)
+        control_engine.submit("enroll sim" + std::to_string(j + 1));
+    if (enroll_jobs > 0)
+        control_engine.submit("list");
+    std::mt19937 rng(4711);
+    std::mutex rng_mutex;
+    std::atomic<int> unlocked{0}, denied{0}, photos{0}, messages{0};
+
+    // simulated LED matrix thread; a successful result always has user_until_us = auth_ts_us + SIM_DISPLAY_NAME_USEC
+    std::atomic<bool> display_running{true};
+    uint64_t display_reads = 0, display_torn = 0;
+    std::thread display([&] {
+        while (display_running) {
+            DisplayState state = display_state.read();
+            display_reads++;
+            if (state.auth_status == 0 && state.user_until_us != state.auth_ts_us + SIM_DISPLAY_NAME_USEC)
+                display_torn++;
+            std::this_thread::sleep_for(std::chrono::microseconds(1000000 / SIM_DISPLAY_FPS));
+        }
+    });
+
+    std::atomic<int> send_attempts{0};
+    OutboxConfig outbox_config;
+    outbox_config.coalesce_window_ms = 3000;
+    outbox_config.retry_initial_ms = 200;
+    NotificationOutbox outbox(outbox_config, [&](const Notification& n) { // simulated slow, flaky Telegram
+        TraceSpan span(TraceStage::TelegramSend, n.trigger_ts_us);
+        std::this_thread::sleep_for(std::chrono::milliseconds(SIM_NOTIFY_MSEC));
+        if (++send_attempts % SIM_NOTIFY_FAIL_EVERY == 0)
+            return NotificationOutbox::SendResult::Retry;
+        (n.kind == Notification::Kind::Photo ? photos : messages)++;
+        return NotificationOutbox::SendResult::Sent;
+    });
+    outbox.start();
+    TriggerPipeline pipeline;
+    pipeline.set_auth_stage([&](const TriggerEvent& ev) { // simulated authenticator
+        control_engine.device().acquire_for_auth(ev.ts_us); // preempts a running enrollment
+        int64_t start = monotonic_us();
+        int duration_ms;
+        bool success;
+        {
+            std::lock_guard<std::mutex> lock(rng_mutex);
+            duration_ms = std::uniform_int_distribution<int>(SIM_AUTH_MIN_MSEC, SIM_AUTH_MAX_MSEC)(rng);
+            success = std::uniform_int_distribution<int>(1, 100)(rng) <= SIM_AUTH_SUCCESS_PERCENT;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(duration_ms));
+        LatencyTrace::record(TraceStage::Authenticate, start, monotonic_us(), ev.ts_us);
+        control_engine.device().release_auth();
+        // what MyAuthClbk::OnResult does: update the display, publish "open", then hand off the message
+        display_state.update([&](DisplayState& state) {
+            state.auth_status = success ? 0 : 1;
+            state.auth_ts_us = monotonic_us();
+            if (success) {
+                state.set_user("sim", 5);
+                state.user_until_us = state.auth_ts_us + SIM_DISPLAY_NAME_USEC;
+            }
+            state.auth_count++;
+        });
+        int64_t unlock = monotonic_us();
+        if (success && mqtt_session)
+            mqtt_session->publish_door_open(ev.ts_us); // records the MqttPublish span
+        {
+            std::lock_guard<std::mutex> lock(samples_mutex);
+            dispatch_us.push_back(start - ev.ts_us);
+            if (success)
+                unlock_us.push_back(unlock - ev.ts_us);
+        }
+        Notification n;
+        n.text = success ? "Door opened for sim" : "unauthorized person tried to access";
+        n.trigger_ts_us = ev.ts_us;
+        outbox.post(std::move(n));
+        (success ? unlocked : denied)++;
+    });
+    pipeline.set_snapshot_stage([&](const TriggerEvent& ev) { // simulated snapshot camera
+        std::this_thread::sleep_for(std::chrono::milliseconds(SIM_SNAPSHOT_MSEC));
+        Notification n;
+        n.kind = Notification::Kind::Photo;
+        n.photo_jpeg = std::make_shared<const std::vector<unsigned char>>(64 * 1024, (unsigned char)ev.seq);
+        n.trigger_ts_us = ev.ts_us;
+        outbox.post(std::move(n));
+    });
+    GateConfig gate_config;
+    gate_config.holdoff_us = (int64_t)holdoff_ms * 1000;
+    gate_config.burst_us = SIM_BURST_USEC;
+    pipeline.start(gate_config);
+
+    // simulated presence sensor
+    std::exponential_distribution<double> arrival(1.0 / interval_ms);
+    std::cout << "simulating " << persons << " persons, mean interval " << interval_ms
+              << " ms, hold-off " << holdoff_ms << " ms" << std::endl;
+    for (int p = 0; p < persons; p++) {
+        int wait_ms;
+        {
+            std::lock_guard<std::mutex> lock(rng_mutex);
+            wait_ms = (int)arrival(rng);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(wait_ms));
+        for (int e = 0; e < SIM_EDGES_PER_PERSON; e++) {
+            pipeline.post_trigger((e % 2) ? 1 : 2, 1); // alternate falling/rising edge
+            std::this_thread::sleep_for(std::chrono::microseconds(SIM_EDGE_BOUNCE_USEC));
+        }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(SIM_AUTH_MAX_MSEC + 100));
+    pipeline.stop();
+    control_engine.stop();
+    display_running = false;
+    display.join();
+    std::cout << "display state updates=" << display_state.update_count() << " reads=" << display_reads
+              << " torn=" << display_torn << std::endl;
+    std::cout << "control jobs done=" << control_engine.jobs_done() << " failed=" << control_engine.jobs_failed()
+              << " cancelled=" << control_engine.jobs_cancelled() << " restarted=" << control_engine.jobs_restarted()
+              << " queued=" << control_engine.queued() << " preemptions=" << control_engine.device().preemption_count() << std::endl;
+    if (mqtt_session) {
+        std::cout << "mqtt connected=" << mqtt_session->is_connected() << " publishes=" << mqtt_session->publish_count()
+                  << " acks=" << mqtt_session->ack_count() << " last ack latency=" << mqtt_session->last_ack_latency_us() << " us" << std::endl;
+        mqtt_session->stop();
+    }
+
+    const TriggerGate& gate = pipeline.trigger_gate();
+    for (int d = 0; d < (int)GateDecision::COUNT; d++)
+        std::cout << "gate " << gate_decision_name((GateDecision)d) << "=" << gate.decision_count((GateDecision)d) << std::endl;
+    std::cout << "triggers posted=" << pipeline.triggers_posted()
+              << " accepted=" << pipeline.triggers_accepted()
+              << " rejected=" << pipeline.triggers_rejected()
+              << " dropped=" << pipeline.triggers_dropped() << std::endl;
+    std::cout << "unlocked=" << unlocked << " denied=" << denied
+              << " messages sent=" << messages << " photos sent=" << photos
+              << std::endl;
+    std::cout << "outbox depth=" << outbox.depth() << " sent=" << outbox.sent_count() << " failed=" << outbox.failed_count()
+              << " dropped=" << outbox.dropped_count() << " coalesced=" << outbox.coalesced_count()
+              << " retries=" << outbox.retry_count() << std::endl;
+    outbox.stop();
+    print_stats("trigger-to-authenticate", dispatch_us);
+    print_stats("edge-to-unlock", unlock_us);
+    LatencyTrace::dump(std::cout);
+    AsyncLog::stop();
+    std::cout << "log written=" << AsyncLog::written_count() << " dropped=" << AsyncLog::dropped_count() << std::endl;
+    return 0;
+}
@@ -0,0 +1,216 @@
+/**
+ * @file snapshot_capture.cpp
+ * @brief Persistent snapshot capture service with pre-trigger frame ring buffer
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ */
+#include "snapshot_capture.hpp"
+#include "async_log.hpp"
+#include "latency_trace.hpp" // monotonic_us()
+#include "thread_placement.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+
+SnapshotCapture::SnapshotCapture(const SnapshotCaptureConfig& config) : config(config)
+{
+}
+
+SnapshotCapture::~SnapshotCapture()
+{
+    stop();
+}
+
+/**
+ * @brief opens V4L2 device (numeric source) or video file (any other source)
+ */
+bool SnapshotCapture::open_source()
+{
+    file_source = config.source.empty() || !std::all_of(config.source.begin(), config.source.end(), ::isdigit);
+    if (file_source) {
+        camera.open(config.source);
+    }
+    else {
+        camera.open(std::stoi(config.source), cv::CAP_V4L2); // Intel RealSenseID camera as a webcam
+        camera.set(cv::CAP_PROP_FRAME_WIDTH, config.width);
+        camera.set(cv::CAP_PROP_FRAME_HEIGHT, config.height);
+        camera.set(cv::CAP_PROP_FPS, config.fps);
+        camera.set(cv::CAP_PROP_BUFFERSIZE, 1); // keep driver queue short, frames must be fresh
+    }
+    return camera.isOpened();
+}
+
+/**
+ * @brief preallocates ring slots for the negotiated frame size, all unused
+ *
+ * The number of slots is capped so that the ring never exceeds max_buffer_mb.
+ */
+void SnapshotCapture::allocate_ring(int width, int height, int type)
+{
+    size_t frame_bytes = (size_t)width * height * CV_ELEM_SIZE(type);
+    size_t max_frames = ((size_t)config.max_buffer_mb << 20) / std::max<size_t>(frame_bytes, 1);
+    size_t frames = std::min<size_t>(std::max(config.ring_frames, 1u), std::max<size_t>(max_frames, 1));
+    if (frames < config.ring_frames)
+        std::cerr << "snapshot ring limited to " << frames << " frames by max_buffer_mb=" << config.max_buffer_mb << std::endl;
+    ring.assign(frames, Slot());
+    for (auto& slot : ring)
+        slot.frame.create(height, width, type);
+    ring_bytes = frames * frame_bytes;
+    ring_slots = (unsigned int)frames;
+    head = 0;
+}
+
+bool SnapshotCapture::start()
+{
+    if (running)
+        return true;
+    if (!open_source()) {
+        std::cerr << "ERROR: Could not open snapshot source " << config.source << std::endl;
+        return false;
+    }
+    int width = (int)camera.get(cv::CAP_PROP_FRAME_WIDTH);
+    int height = (int)camera.get(cv::CAP_PROP_FRAME_HEIGHT);
+    if (width <= 0 || height <= 0) {
+        width = config.width;
+        height = config.height;
+    }
+    allocate_ring(width, height);
+    std::cout << "snapshot capture " << config.source << ": " << width << "x" << height << " @ " << config.fps
+              << " fps, " << ring.size() << " frames, " << (buffer_bytes() >> 10) << " KiB" << std::endl;
+    running = true;
+    capture_thread = std::thread(&SnapshotCapture::capture_loop, this);
+    return true;
+}
+
+void SnapshotCapture::stop()
+{
+    if (!running)
+        return;
+    running = false;
+    if (capture_thread.joinable())
+        capture_thread.join();
+    camera.release(); // Closes video file or capturing device
+}
+
+void SnapshotCapture::set_frame_observer(FrameObserver observer, double fps)
+{
+    frame_observer = std::move(observer);
+    observer_fps = fps;
+}
+
+/**
+ * @brief capture thread - grabs continuously, decodes and stores at config.fps
+ *
+ * A V4L2 device paces the loop itself; grab() without retrieve() is cheap and
+ * drops stale driver buffers. A video file is paced by sleeping. A frame
+ * observer gets its frames outside of the ring lock.
+ */
+void SnapshotCapture::capture_loop()
+{
+    place_this_thread("snapshot_cam");
+    const int64_t period_us = (int64_t)(1e6 / std::max(config.fps, 0.1));
+    const int64_t observer_period_us = frame_observer ? (int64_t)(1e6 / std::max(observer_fps, 0.1)) : INT64_MAX / 2;
+    int64_t next_store_us = monotonic_us();
+    int64_t next_observe_us = frame_observer ? next_store_us : INT64_MAX;
+    while (running) {
+        if (file_source) {
+            int64_t next_us = std::min(next_store_us, next_observe_us);
+            std::this_thread::sleep_for(std::chrono::microseconds(std::max<int64_t>(next_us - monotonic_us(), 0)));
+        }
+        if (!camera.grab()) {
+            if (file_source) { // loop video file
+                camera.set(cv::CAP_PROP_POS_FRAMES, 0);
+                continue;
+            }
+            LOG_WARN(LogModule::Snapshot, "grab failed, reopening %s", config.source.c_str());
+            camera.release();
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            open_source();
+            continue;
+        }
+        int64_t now = monotonic_us();
+        bool store = now >= next_store_us;
+        bool observe = now >= next_observe_us;
+        if (!store && !observe)
+            continue;
+        if (observe) {
+            next_observe_us += observer_period_us;
+            if (next_observe_us < now)
+                next_observe_us = now + observer_period_us;
+        }
+        if (store) {
+            next_store_us += period_us;
+            if (next_store_us < now) // we fell behind, don't try to catch up
+                next_store_us = now + period_us;
+        }
+        if (!camera.retrieve(grabbed) || grabbed.empty())
+            continue;
+        if (observe)
+            frame_observer(grabbed, now);
+        if (!store)
+            continue;
+        bool format_changed = false;
+        {
+            std::lock_guard<std::mutex> lock(ring_mutex);
+            if (grabbed.size() != ring[head].frame.size() || grabbed.type() != ring[head].frame.type()) {
+                // a reopen negotiated another format: the frames of the old one are dropped
+                // with the old ring, so no snapshot is taken from before the change
+                allocate_ring(grabbed.cols, grabbed.rows, grabbed.type());
+                format_changed = true;
+            }
+            Slot& slot = ring[head];
+            grabbed.copyTo(slot.frame); // no reallocation, slot memory is reused
+            slot.ts_us = now;
+            head = (head + 1) % ring.size();
+        }
+        captured.fetch_add(1, std::memory_order_relaxed);
+        if (format_changed) {
+            format_changes.fetch_add(1, std::memory_order_relaxed);
+            LOG_WARN(LogModule::Snapshot, "frame format changed to %dx%d, ring reallocated with %u frames",
+                     grabbed.cols, grabbed.rows, ring_slots.load(std::memory_order_relaxed));
+        }
+    }
+}
+
+void SnapshotCapture::rotate_into(const cv::Mat& src, cv::Mat& dst) const
+{
+    switch (config.rotation) {
+        case 90:  cv::rotate(src, dst, cv::ROTATE_90_CLOCKWISE); break;
+        case 180: cv::rotate(src, dst, cv::ROTATE_180); break;
+        case 270: cv::rotate(src, dst, cv::ROTATE_90_COUNTERCLOCKWISE); break;
+        default:  src.copyTo(dst); break;
+    }
+}
+
+bool SnapshotCapture::snapshot(int64_t trigger_ts_us, cv::Mat& frame)
+{
+    const int64_t wanted_us = trigger_ts_us - (int64_t)config.pre_trigger_ms * 1000;
+    std::lock_guard<std::mutex> lock(ring_mutex);
+    const Slot* best = nullptr;
+    for (const auto& slot : ring) {
+        if (slot.ts_us == 0)
+            continue;
+        if (!best || std::llabs(slot.ts_us - wanted_us) < std::llabs(best->ts_us - wanted_us))
+            best = &slot;
+    }
+    if (!best)
+        return false;
+    rotate_into(best->frame, frame);
+    return true;
+}
+
+size_t SnapshotCapture::frames_between(int64_t from_us, int64_t to_us, std::vector<cv::Mat>& frames)
+{
+    std::lock_guard<std::mutex> lock(ring_mutex);
+    size_t count = 0;
+    for (size_t i = 0; i < ring.size(); i++) {
+        const Slot& slot = ring[(head + i) % ring.size()]; // oldest first
+        if (slot.ts_us == 0 || slot.ts_us < from_us || slot.ts_us > to_us)
+            continue;
+        frames.emplace_back();
+        rotate_into(slot.frame, frames.back());
+        count++;
+    }
+    return count;
+}
@@ -0,0 +1,127 @@
+/**
+ * @file snapshot_capture.hpp
+ * @brief Persistent snapshot capture service with pre-trigger frame ring buffer
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * Keeps the F455 webcam stream (or a video file for testing) open at a low
+ * frame rate and stores the most recent frames in a preallocated ring of
+ * cv::Mat buffers. A snapshot for a presence trigger is copied straight from
+ * memory and may be taken from before the trigger, i.e. before the person
+ * turned towards the camera - no V4L2 open/negotiate in the latency path.
+ *
+ * Memory use is bounded by ring_frames * width * height * 3 bytes and capped
+ * by max_buffer_mb, both configured in section [snapshot] of config.toml.
+ * If a reopened device negotiates another frame size, the ring is
+ * reallocated for it, empty, within the same bound.
+ */
+#pragma once
+#include <opencv2/opencv.hpp> // @see https://docs.opencv.org/4.x/
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief settings of section [snapshot] in config.toml
+ */
+struct SnapshotCaptureConfig {
+    std::string source = "0";        // V4L2 device index or path to a video file
+    double fps = 5.0;                // frames stored per second
+    int width = 640;                 // requested frame size, the device may negotiate another one
+    int height = 480;
+    unsigned int ring_frames = 8;    // number of frames kept in memory
+    unsigned int pre_trigger_ms = 300; // snapshot is taken this long before the trigger
+    unsigned int max_buffer_mb = 32; // upper bound of ring buffer memory
+    int rotation = 270;              // clockwise rotation applied to snapshots: 0, 90, 180, 270
+};
+
+/**
+ * @class SnapshotCapture
+ * @brief Long-lived capture thread filling a bounded ring of frames
+ *
+ * Example usage:
+ * @code
+ * SnapshotCapture capture(config);
+ * capture.start();
+ * cv::Mat frame;
+ * if (capture.snapshot(event.ts_us, frame)) cv::imwrite("snapshot.jpg", frame);
+ * capture.stop();
+ * @endcode
+ */
+class SnapshotCapture {
+public:
+    using FrameObserver = std::function<void(const cv::Mat& frame, int64_t grab_ts_us)>;
+
+    explicit SnapshotCapture(const SnapshotCaptureConfig& config);
+    ~SnapshotCapture();
+    SnapshotCapture(const SnapshotCapture&) = delete;
+    SnapshotCapture& operator=(const SnapshotCapture&) = delete;
+
+    /**
+     * @brief opens the capture source, allocates the ring and starts the capture thread
+     * @return false if the source could not be opened
+     */
+    bool start();
+    void stop();
+
+    /**
+     * @brief hands decoded frames to observer on the capture thread; must be set before start()
+     *
+     * Lets the motion presence detector share the webcam stream, which can
+     * only be opened once. Frames are decoded at the higher of both rates.
+     * @param observer called with the unrotated frame, must not keep a reference to it
+     * @param observer_fps frames per second handed to the observer
+     */
+    void set_frame_observer(FrameObserver observer, double observer_fps);
+
+    /**
+     * @brief copies the stored frame closest to trigger_ts_us - pre_trigger_ms
+     *
+     * @param trigger_ts_us monotonic timestamp of the trigger (see monotonic_us())
+     * @param frame receives the rotated frame
+     * @return false if no frame has been captured yet
+     */
+    bool snapshot(int64_t trigger_ts_us, cv::Mat& frame);
+
+    /**
+     * @brief copies all stored frames captured between from_us and to_us, oldest first
+     * @return number of frames appended to frames
+     */
+    size_t frames_between(int64_t from_us, int64_t to_us, std::vector<cv::Mat>& frames);
+
+    size_t buffer_bytes() const { return ring_bytes.load(std::memory_order_relaxed); }
+    unsigned int ring_size() const { return ring_slots.load(std::memory_order_relaxed); }
+    uint64_t frames_captured() const { return captured.load(std::memory_order_relaxed); }
+    /** times a reopened device delivered another frame size and the ring was reallocated */
+    uint64_t frame_format_changes() const { return format_changes.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        cv::Mat frame;
+        int64_t ts_us = 0; // 0 marks an unused slot
+    };
+    SnapshotCaptureConfig config;
+    cv::VideoCapture camera;
+    bool file_source = false;
+    std::vector<Slot> ring;
+    size_t head = 0;       // next slot to be written
+    std::atomic<size_t> ring_bytes{0};
+    std::atomic<unsigned int> ring_slots{0};
+    std::mutex ring_mutex; // held while copying a frame into or out of the ring, or reallocating it
+    std::thread capture_thread;
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> captured{0}, format_changes{0};
+    cv::Mat grabbed;       // decode target, reused for every frame
+    FrameObserver frame_observer;
+    double observer_fps = 0.0;
+
+    bool open_source();
+    void allocate_ring(int width, int height, int type = CV_8UC3);
+    void capture_loop();
+    void rotate_into(const cv::Mat& src, cv::Mat& dst) const;
+};
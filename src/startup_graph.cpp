@@ -0,0 +1,115 @@
+/**
+ * @file startup_graph.cpp
+ * @brief Dependency-aware startup: independent initialization stages run concurrently
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ */
+#include "startup_graph.hpp"
+#include "latency_trace.hpp" // monotonic_us()
+#include <algorithm>
+#include <condition_variable>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <pthread.h>
+#include <thread>
+
+#define THREAD_NAME_CHARS 15 // pthread_setname_np limit without terminating zero
+
+bool StartupGraph::add(const std::string& name, const std::vector<std::string>& after, Stage stage)
+{
+    Node node;
+    node.name = name;
+    node.stage = std::move(stage);
+    for (const Node& existing : nodes) {
+        if (existing.name == name) {
+            std::cerr << "startup: stage " << name << " added twice" << std::endl;
+            return false;
+        }
+    }
+    for (const std::string& dependency : after) {
+        size_t index = 0;
+        while (index < nodes.size() && nodes[index].name != dependency)
+            index++;
+        if (index == nodes.size()) {
+            std::cerr << "startup: stage " << name << " depends on unknown stage " << dependency << std::endl;
+            return false;
+        }
+        node.after.push_back(index);
+    }
+    nodes.push_back(std::move(node));
+    return true;
+}
+
+bool StartupGraph::run()
+{
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::vector<std::thread> threads;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        size_t running = 0;
+        for (Node& node : nodes) {
+            if (node.state == State::Running)
+                running++;
+            if (node.state != State::Pending)
+                continue;
+            bool ready = true, blocked = false;
+            for (size_t dependency : node.after) {
+                State state = nodes[dependency].state;
+                ready = ready && state == State::Done;
+                blocked = blocked || state == State::Failed || state == State::Skipped;
+            }
+            if (blocked) {
+                node.state = State::Skipped;
+                std::cerr << "startup: stage " << node.name << " skipped, a stage it depends on failed" << std::endl;
+            }
+            else if (ready) {
+                node.state = State::Running;
+                node.start_us = monotonic_us() - launch_us;
+                running++;
+                threads.emplace_back([this, &node, &mutex, &finished] {
+                    pthread_setname_np(pthread_self(), ("init:" + node.name).substr(0, THREAD_NAME_CHARS).c_str());
+                    bool ok = node.stage();
+                    std::lock_guard<std::mutex> guard(mutex);
+                    node.end_us = monotonic_us() - launch_us;
+                    node.state = ok ? State::Done : State::Failed;
+                    finished.notify_one();
+                });
+            }
+        }
+        if (running == 0)
+            break;
+        finished.wait(lock); // a stage ended, its dependents may start now
+    }
+    lock.unlock();
+    for (std::thread& thread : threads)
+        thread.join();
+    bool ok = true;
+    for (const Node& node : nodes) {
+        ready_after_us = std::max(ready_after_us, node.end_us);
+        if (node.state != State::Done) {
+            ok = false;
+            if (node.state == State::Failed)
+                std::cerr << "startup: stage " << node.name << " failed" << std::endl;
+        }
+    }
+    return ok;
+}
+
+void StartupGraph::print_timing(std::ostream& out) const
+{
+    static const char* const state_names[] = { "pending", "running", "done", "failed", "skipped" };
+    int64_t serial_us = 0;
+    for (const Node& node : nodes) {
+        out << "startup: " << std::left << std::setw(12) << node.name << std::right << " " << std::setw(9) << state_names[(int)node.state];
+        if (node.state == State::Done || node.state == State::Failed) {
+            out << std::fixed << std::setprecision(1) << std::setw(9) << node.start_us / 1000.0 << " .. " << std::setw(9) << node.end_us / 1000.0
+                << " ms (" << (node.end_us - node.start_us) / 1000.0 << " ms)";
+            serial_us += node.end_us - node.start_us;
+        }
+        out << std::endl;
+    }
+    out << std::fixed << std::setprecision(1) << "startup: ready " << ready_after_us / 1000.0 << " ms after launch, "
+        << serial_us / 1000.0 << " ms if run one after the other" << std::defaultfloat << std::setprecision(6) << std::endl;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file startup_graph.hpp
+ * @brief Dependency-aware startup: independent initialization stages run concurrently
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * main() used to initialize everything one after the other - Telegram,
+ * wiringPi, device discovery, serial handshake, device configuration, MQTT
+ * connect, fonts and LED matrix - so the door was usable only after the sum
+ * of all network round trips and serial handshakes.
+ *
+ * StartupGraph runs each stage on a thread of its own as soon as the stages
+ * it depends on succeeded: the clock shows while the camera is still being
+ * connected, MQTT connects while the serial handshake runs. A stage whose
+ * dependency failed is skipped. Start and end of every stage are recorded
+ * relative to the launch of the program and logged.
+ *
+ * Stage threads are named "init:<stage>", threads created by a library
+ * within a stage inherit that name (see place_new_threads()).
+ *
+ * Example usage:
+ * @code
+ * StartupGraph startup(launch_us);
+ * startup.add("camera", {}, init_F455_camera);
+ * startup.add("display", {}, [&] { matrix_task.start(); return true; });
+ * startup.add("pipeline", {"camera"}, start_trigger_pipeline);
+ * if (!startup.run())
+ *     return 1;
+ * startup.print_timing(std::cout);
+ * @endcode
+ *
+ * The header has no hardware dependencies.
+ */
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+/**
+ * @class StartupGraph
+ * @brief Runs initialization stages in dependency order, independent stages concurrently
+ */
+class StartupGraph {
+public:
+    /** initialization step, returns false on failure */
+    using Stage = std::function<bool()>;
+
+    /** @param launch_us monotonic_us() at program start, timing is relative to it */
+    explicit StartupGraph(int64_t launch_us) : launch_us(launch_us) {}
+
+    /**
+     * @brief adds a stage that runs once all stages named in after succeeded
+     * @return false if a stage of that name exists or a dependency is unknown
+     */
+    bool add(const std::string& name, const std::vector<std::string>& after, Stage stage);
+
+    /**
+     * @brief runs all stages and returns when none is left
+     * @return false if a stage failed or was skipped
+     */
+    bool run();
+
+    /** one line per stage: start and end after launch and duration, then the overall time */
+    void print_timing(std::ostream& out) const;
+
+    /** time from launch until the last stage ended */
+    int64_t ready_us() const { return ready_after_us; }
+
+private:
+    enum class State { Pending, Running, Done, Failed, Skipped };
+    struct Node {
+        std::string name;
+        std::vector<size_t> after; // indices of the dependencies
+        Stage stage;
+        State state = State::Pending;
+        int64_t start_us = 0, end_us = 0; // after launch
+    };
+    int64_t launch_us;
+    int64_t ready_after_us = 0;
+    std::vector<Node> nodes; // in order of add(), dependencies always before dependents
+};
@@ -0,0 +1,42 @@
+/**
+ * @file test_check.hpp
+ * @brief Minimal checks for the ctest targets in src/tests
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * The tests have no framework dependency: CHECK() prints the failed
+ * condition with file and line and counts it, a test program returns
+ * test_result() from main, so ctest reports it as failed.
+ *
+ * Example usage:
+ * @code
+ * CHECK(gate.offer(2, 1, 0) == GateDecision::Accept);
+ * return test_result("trigger_gate");
+ * @endcode
+ */
+#pragma once
+#include <iostream>
+
+inline int& check_failures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                  \
+    do {                                                                                  \
+        if (!(condition)) {                                                               \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" \
+                      << std::endl;                                                       \
+            check_failures()++;                                                           \
+        }                                                                                 \
+    } while (0)
+
+/** prints the summary of a test program, 0 if all checks passed */
+inline int test_result(const char* name)
+{
+    std::cout << name << ": " << (check_failures() ? "FAILED" : "passed") << ", " << check_failures()
+              << " failed checks" << std::endl;
+    return check_failures() ? 1 : 0;
+}
@@ -0,0 +1,123 @@
+/**
+ * @file test_state_channel.cpp
+ * @brief Stress test of StateChannel<DisplayState>: several writers, one reader
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * TEST_WRITERS threads call update() in tight loops, like the authentication
+ * callback, the hint callback and control commands at once, while the reader
+ * - the render thread - checks every snapshot it gets:
+ * - the user name, the hint and all timestamps belong to the same update
+ *   (no torn name or clock fields)
+ * - auth_count never goes back, and neither does the sequence of any writer
+ *
+ * Built with -fsanitize=thread where ThreadSanitizer is available, see
+ * CMakeLists.txt; a data race then fails the test as well.
+ */
+#include "test_check.hpp"
+#include "display_state.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#define TEST_WRITERS 4
+#define TEST_UPDATES 50000               // per writer
+#define TEST_USER_MAX_CHARS 40           // MAX_NAME_LENGTH of a long name
+#define TEST_SHOW_USEC 5000000           // user_until_us - auth_ts_us of every update
+#define TEST_WRITER_CLOCK 1000000000LL   // auth_ts_us = writer * TEST_WRITER_CLOCK + sequence
+
+/**
+ * @brief what writer writes in its update sequence; every field is derived from both
+ */
+static void write_update(DisplayState& state, int writer, int64_t sequence)
+{
+    char name[DISPLAY_USER_BYTES];
+    snprintf(name, sizeof(name), "writer%d-%lld-äöü-padding-to-a-long-name", writer, (long long)sequence);
+    state.set_user(name, TEST_USER_MAX_CHARS);
+    state.auth_status = writer;
+    state.hint = (int32_t)(sequence % 8);
+    state.auth_ts_us = writer * TEST_WRITER_CLOCK + sequence;
+    state.user_until_us = state.auth_ts_us + TEST_SHOW_USEC;
+    state.hint_until_us = state.auth_ts_us + state.hint;
+    state.alert_until_us = -state.auth_ts_us;
+    state.auth_count++;
+}
+
+/**
+ * @brief true if all fields of state come from one write_update() call
+ */
+static bool consistent(const DisplayState& state, int& writer, int64_t& sequence)
+{
+    if (memchr(state.user, '\0', sizeof(state.user)) == nullptr)
+        return false; // unterminated name
+    writer = state.auth_status;
+    sequence = state.auth_ts_us - writer * TEST_WRITER_CLOCK;
+    if (writer < 0 || writer >= TEST_WRITERS || sequence < 0 || sequence >= TEST_UPDATES)
+        return false;
+    DisplayState expected;
+    write_update(expected, writer, sequence);
+    return strcmp(state.user, expected.user) == 0 && state.hint == expected.hint
+        && state.user_until_us == expected.user_until_us && state.hint_until_us == expected.hint_until_us
+        && state.alert_until_us == expected.alert_until_us;
+}
+
+int main()
+{
+    StateChannel<DisplayState> channel;
+    std::atomic<int> writers_running{TEST_WRITERS};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> writers;
+    for (int w = 0; w < TEST_WRITERS; w++) {
+        writers.emplace_back([&channel, &writers_running, &go, w] {
+            while (!go.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            for (int64_t i = 0; i < TEST_UPDATES; i++)
+                channel.update([w, i](DisplayState& state) { write_update(state, w, i); });
+            writers_running.fetch_sub(1, std::memory_order_release);
+        });
+    }
+
+    uint64_t reads = 0, torn = 0, count_back = 0, sequence_back = 0, last_count = 0;
+    int64_t last_sequence[TEST_WRITERS];
+    for (int64_t& sequence : last_sequence)
+        sequence = -1;
+    go.store(true, std::memory_order_release);
+    bool last_round = false;
+    while (!last_round) {
+        last_round = writers_running.load(std::memory_order_acquire) == 0; // one more read after the last update
+        const DisplayState state = channel.read();
+        reads++;
+        if (state.auth_count == 0)
+            continue; // nothing published yet
+        int writer;
+        int64_t sequence;
+        if (!consistent(state, writer, sequence)) {
+            torn++;
+            continue;
+        }
+        if (state.auth_count < last_count)
+            count_back++;
+        if (sequence < last_sequence[writer])
+            sequence_back++;
+        last_count = state.auth_count;
+        last_sequence[writer] = sequence;
+    }
+    for (std::thread& writer : writers)
+        writer.join();
+
+    const DisplayState final_state = channel.read();
+    std::cout << "state_channel: reads=" << reads << " torn=" << torn << " updates=" << channel.update_count() << std::endl;
+    CHECK(torn == 0);
+    CHECK(count_back == 0);
+    CHECK(sequence_back == 0);
+    CHECK(reads > 1);
+    CHECK(channel.update_count() == (uint64_t)TEST_WRITERS * TEST_UPDATES);
+    CHECK(final_state.auth_count == (uint64_t)TEST_WRITERS * TEST_UPDATES);
+    int writer;
+    int64_t sequence;
+    CHECK(consistent(final_state, writer, sequence) && sequence == TEST_UPDATES - 1);
+    return test_result("state_channel");
+}
@@ -0,0 +1,210 @@
+/**
+ * @file test_trigger_gate.cpp
+ * @brief Unit tests of TriggerGate and the hold of TriggerPipeline
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * Covers the checks of TriggerGate::offer() in their order - edge policy,
+ * status, burst window, in-flight suppression, hold-off - plus hold() and
+ * release(), TriggerPipeline::try_hold()/release_hold() and concurrent
+ * offers from several threads. Timestamps are synthetic except for the
+ * pipeline test, which goes through post_trigger().
+ */
+#include "test_check.hpp"
+#include "trigger_gate.hpp"
+#include "trigger_pipeline.hpp"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#define TEST_RISING 2   // INT_EDGE_RISING
+#define TEST_FALLING 1  // INT_EDGE_FALLING
+#define TEST_THREADS 8  // concurrent offers in the race tests
+#define TEST_PIPELINE_WAIT_MSEC 2000
+
+static GateConfig gate_config(EdgePolicy policy, int64_t holdoff_us, int64_t burst_us)
+{
+    GateConfig config;
+    config.edge_policy = policy;
+    config.holdoff_us = holdoff_us;
+    config.burst_us = burst_us;
+    return config;
+}
+
+static void test_edge_policy()
+{
+    TriggerGate gate;
+    gate.configure(gate_config(EdgePolicy::Rising, 0, 0));
+    CHECK(gate.offer(TEST_FALLING, 1, 1000) == GateDecision::EdgeFiltered);
+    CHECK(gate.offer(TEST_RISING, 1, 2000) == GateDecision::Accept);
+    gate.release();
+    CHECK(gate.offer(0, 1, 3000) == GateDecision::Accept); // unknown edge passes any policy
+    gate.release();
+
+    gate.configure(gate_config(EdgePolicy::Falling, 0, 0));
+    CHECK(gate.offer(TEST_RISING, 1, 1000) == GateDecision::EdgeFiltered);
+    CHECK(gate.offer(TEST_FALLING, 1, 2000) == GateDecision::Accept);
+    gate.release();
+
+    gate.configure(gate_config(EdgePolicy::Both, 0, 0));
+    CHECK(gate.offer(TEST_RISING, 1, 1000) == GateDecision::Accept);
+    gate.release();
+    CHECK(gate.offer(TEST_FALLING, 1, 2000) == GateDecision::Accept);
+    gate.release();
+    CHECK(gate.decision_count(GateDecision::EdgeFiltered) == 2); // configure() keeps the counters
+
+    TriggerGate status_gate;
+    status_gate.configure(gate_config(EdgePolicy::Both, 0, 0));
+    CHECK(status_gate.offer(TEST_RISING, 0, 1000) == GateDecision::InvalidStatus);
+    CHECK(status_gate.offer(TEST_RISING, 1, 2000) == GateDecision::Accept);
+}
+
+static void test_burst_window()
+{
+    TriggerGate gate;
+    gate.configure(gate_config(EdgePolicy::Both, 0, 50000));
+    CHECK(gate.offer(TEST_RISING, 1, 100000) == GateDecision::Accept);
+    gate.release(); // a fast authentication, the contact still bounces
+    CHECK(gate.offer(TEST_FALLING, 1, 100800) == GateDecision::BurstCollapsed);
+    CHECK(gate.offer(TEST_RISING, 1, 149999) == GateDecision::BurstCollapsed);
+    CHECK(gate.offer(TEST_RISING, 1, 150000) == GateDecision::Accept); // window measured from the first edge
+    gate.release();
+
+    // a rejected edge opens a burst too, its bounces are collapsed instead of counted as in flight
+    CHECK(gate.hold());
+    CHECK(gate.offer(TEST_RISING, 1, 300000) == GateDecision::InFlight);
+    CHECK(gate.offer(TEST_FALLING, 1, 300800) == GateDecision::BurstCollapsed);
+    gate.release();
+    CHECK(gate.offer(TEST_RISING, 1, 310000) == GateDecision::BurstCollapsed);
+    CHECK(gate.offer(TEST_RISING, 1, 350000) == GateDecision::Accept);
+    gate.release();
+
+    gate.retime(gate_config(EdgePolicy::Both, 0, 0)); // burst collapsing off
+    CHECK(gate.offer(TEST_RISING, 1, 350001) == GateDecision::Accept);
+    CHECK(gate.decision_count(GateDecision::BurstCollapsed) == 4);
+}
+
+static void test_in_flight()
+{
+    TriggerGate gate;
+    gate.configure(gate_config(EdgePolicy::Both, 0, 0));
+    CHECK(!gate.is_in_flight());
+    CHECK(gate.offer(TEST_RISING, 1, 1000) == GateDecision::Accept);
+    CHECK(gate.is_in_flight());
+    for (int64_t ts_us = 2000; ts_us < 12000; ts_us += 1000)
+        CHECK(gate.offer(TEST_RISING, 1, ts_us) == GateDecision::InFlight);
+    gate.release();
+    CHECK(!gate.is_in_flight());
+    CHECK(gate.offer(TEST_RISING, 1, 13000) == GateDecision::Accept);
+    CHECK(gate.decision_count(GateDecision::InFlight) == 10);
+    CHECK(gate.accepted_count() == 2);
+    CHECK(gate.rejected_count() == 10);
+}
+
+static void test_hold_off()
+{
+    TriggerGate gate;
+    gate.configure(gate_config(EdgePolicy::Both, 1000000, 0));
+    CHECK(gate.offer(TEST_RISING, 1, 5000000) == GateDecision::Accept);
+    gate.release();
+    CHECK(gate.offer(TEST_RISING, 1, 5500000) == GateDecision::HoldOff);
+    CHECK(gate.offer(TEST_RISING, 1, 5999999) == GateDecision::HoldOff);
+    CHECK(gate.offer(TEST_RISING, 1, 6000000) == GateDecision::Accept); // measured from the last accept
+    gate.release();
+
+    gate.retime(gate_config(EdgePolicy::Both, 200000, 0)); // wait_time_until_reauthentication reloaded
+    CHECK(gate.settings().holdoff_us == 200000);
+    CHECK(gate.offer(TEST_RISING, 1, 6100000) == GateDecision::HoldOff);
+    CHECK(gate.offer(TEST_RISING, 1, 6200000) == GateDecision::Accept);
+    gate.release();
+
+    gate.configure(gate_config(EdgePolicy::Both, 1000000, 0)); // resets the last accept
+    CHECK(gate.offer(TEST_RISING, 1, 6300000) == GateDecision::Accept);
+    CHECK(gate.decision_count(GateDecision::HoldOff) == 3);
+}
+
+static void test_hold()
+{
+    TriggerGate gate;
+    gate.configure(gate_config(EdgePolicy::Both, 0, 0));
+    CHECK(gate.hold());
+    CHECK(gate.is_in_flight());
+    CHECK(!gate.hold()); // already held
+    CHECK(gate.offer(TEST_RISING, 1, 1000) == GateDecision::InFlight);
+    gate.release();
+    CHECK(gate.offer(TEST_RISING, 1, 2000) == GateDecision::Accept);
+    CHECK(!gate.hold()); // an authentication is in flight
+    gate.release();
+    CHECK(gate.hold());
+    gate.release();
+
+    TriggerPipeline pipeline; // the same through the pipeline, with a worker releasing the gate
+    pipeline.start(gate_config(EdgePolicy::Both, 0, 0));
+    CHECK(pipeline.try_hold());
+    CHECK(!pipeline.post_trigger(TEST_RISING, 1));
+    CHECK(pipeline.trigger_gate().decision_count(GateDecision::InFlight) == 1);
+    pipeline.release_hold();
+    CHECK(pipeline.post_trigger(TEST_RISING, 1));
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(TEST_PIPELINE_WAIT_MSEC);
+    while (pipeline.trigger_gate().is_in_flight() && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    CHECK(!pipeline.trigger_gate().is_in_flight()); // auth worker released it
+    CHECK(pipeline.try_hold());
+    pipeline.release_hold();
+    pipeline.stop();
+    CHECK(pipeline.triggers_accepted() == 1);
+}
+
+/**
+ * @brief threads offering at the same time - one accept per burst and per authentication
+ */
+static void test_concurrent_offers()
+{
+    TriggerGate gate;
+    gate.configure(gate_config(EdgePolicy::Both, 0, 50000));
+    std::atomic<bool> go{false};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < TEST_THREADS; t++) {
+        threads.emplace_back([&gate, &go, t] {
+            while (!go.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            gate.offer(TEST_RISING, 1, 1000000 + t * 100); // one burst
+        });
+    }
+    go.store(true, std::memory_order_release);
+    for (std::thread& thread : threads)
+        thread.join();
+    CHECK(gate.accepted_count() == 1);
+    CHECK(gate.decision_count(GateDecision::BurstCollapsed) == TEST_THREADS - 1);
+
+    TriggerGate flight_gate;
+    flight_gate.configure(gate_config(EdgePolicy::Both, 0, 0));
+    threads.clear();
+    go.store(false);
+    for (int t = 0; t < TEST_THREADS; t++) {
+        threads.emplace_back([&flight_gate, &go, t] {
+            while (!go.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            for (int e = 0; e < 1000; e++) // never released: a single authentication
+                flight_gate.offer(TEST_RISING, 1, (int64_t)(e * TEST_THREADS + t) * 100);
+        });
+    }
+    go.store(true, std::memory_order_release);
+    for (std::thread& thread : threads)
+        thread.join();
+    CHECK(flight_gate.accepted_count() == 1);
+    CHECK(flight_gate.accepted_count() + flight_gate.rejected_count() == (uint64_t)TEST_THREADS * 1000);
+}
+
+int main()
+{
+    test_edge_policy();
+    test_burst_window();
+    test_in_flight();
+    test_hold_off();
+    test_hold();
+    test_concurrent_offers();
+    return test_result("trigger_gate");
+}
@@ -0,0 +1,179 @@
+/**
+ * @file thread_placement.cpp
+ * @brief Names, CPU affinity and scheduling policy of every thread, configured per thread name
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ */
+#include "thread_placement.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <linux/capability.h>
+#include <map>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define THREAD_NAME_CHARS 15 // pthread_setname_np limit without terminating zero
+
+static std::mutex policies_mutex;
+static std::map<std::string, ThreadPolicy> policies;
+
+void set_thread_policy(const std::string& name, const ThreadPolicy& policy)
+{
+    std::lock_guard<std::mutex> lock(policies_mutex);
+    policies[name.substr(0, THREAD_NAME_CHARS)] = policy;
+}
+
+bool has_cap_sys_nice()
+{
+    if (geteuid() == 0)
+        return true;
+    struct __user_cap_header_struct header = { _LINUX_CAPABILITY_VERSION_3, 0 };
+    struct __user_cap_data_struct data[_LINUX_CAPABILITY_U32S_3] = {};
+    if (syscall(SYS_capget, &header, data) != 0)
+        return false;
+    return (data[CAP_TO_INDEX(CAP_SYS_NICE)].effective & CAP_TO_MASK(CAP_SYS_NICE)) != 0;
+}
+
+/**
+ * @brief sets the name of thread tid; the main thread keeps the process name, pgrep -x finds it by that
+ */
+static void set_thread_name(pid_t tid, const std::string& name)
+{
+    if (tid == getpid())
+        return;
+    if (tid == (pid_t)syscall(SYS_gettid)) {
+        pthread_setname_np(pthread_self(), name.c_str());
+        return;
+    }
+    std::ofstream comm("/proc/self/task/" + std::to_string(tid) + "/comm");
+    comm << name;
+}
+
+/**
+ * @brief logs the placement of thread tid as the kernel reports it
+ */
+static void log_placement(pid_t tid, const std::string& name)
+{
+    std::ostringstream line;
+    line << "threads: " << name << " (tid " << tid << ") cpus";
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(tid, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set))
+                line << " " << cpu;
+        }
+    }
+    struct sched_param param = {};
+    int policy = sched_getscheduler(tid);
+    sched_getparam(tid, &param);
+    if (policy == SCHED_FIFO)
+        line << ", fifo " << param.sched_priority;
+    else if (policy == SCHED_RR)
+        line << ", rr " << param.sched_priority;
+    else
+        line << ", other nice " << getpriority(PRIO_PROCESS, tid);
+    std::cout << line.str() << std::endl;
+}
+
+/**
+ * @brief names thread tid and applies the policy configured for name
+ */
+static void place_thread(pid_t tid, const std::string& name)
+{
+    set_thread_name(tid, name);
+    ThreadPolicy policy;
+    bool configured;
+    {
+        std::lock_guard<std::mutex> lock(policies_mutex);
+        auto entry = policies.find(name);
+        if (entry == policies.end()) {
+            size_t dot = name.find('.'); // name.2 is placed like name
+            entry = dot == std::string::npos ? policies.end() : policies.find(name.substr(0, dot));
+        }
+        configured = entry != policies.end();
+        if (configured)
+            policy = entry->second;
+    }
+    if (configured && !policy.cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : policy.cpus) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE)
+                CPU_SET(cpu, &set);
+        }
+        if (sched_setaffinity(tid, sizeof(set), &set) != 0)
+            std::cerr << "threads: cannot set CPU affinity of " << name << ": " << strerror(errno) << std::endl;
+    }
+    if (configured && policy.policy == "fifo") {
+        struct sched_param param = {};
+        param.sched_priority = std::min(std::max(policy.priority, sched_get_priority_min(SCHED_FIFO)), sched_get_priority_max(SCHED_FIFO));
+        if (!has_cap_sys_nice())
+            std::cerr << "threads: " << name << " stays SCHED_OTHER, SCHED_FIFO needs cap_sys_nice - see run_smartdoorF455.sh" << std::endl;
+        else if (sched_setscheduler(tid, SCHED_FIFO, &param) != 0)
+            std::cerr << "threads: cannot set SCHED_FIFO of " << name << ": " << strerror(errno) << std::endl;
+    }
+    else if (configured && policy.policy == "other") {
+        struct sched_param param = {};
+        if (sched_setscheduler(tid, SCHED_OTHER, &param) != 0 || setpriority(PRIO_PROCESS, tid, policy.priority) != 0)
+            std::cerr << "threads: cannot set SCHED_OTHER nice " << policy.priority << " of " << name << ": " << strerror(errno) << std::endl;
+    }
+    else if (configured && !policy.policy.empty()) {
+        std::cerr << "threads: unknown policy \"" << policy.policy << "\" of " << name << ", use \"other\" or \"fifo\"" << std::endl;
+    }
+    log_placement(tid, name);
+}
+
+void place_this_thread(const char* name)
+{
+    place_thread((pid_t)syscall(SYS_gettid), std::string(name).substr(0, THREAD_NAME_CHARS));
+}
+
+std::vector<pid_t> list_threads()
+{
+    std::vector<pid_t> threads;
+    DIR* tasks = opendir("/proc/self/task");
+    if (tasks == nullptr)
+        return threads;
+    while (struct dirent* entry = readdir(tasks)) {
+        if (entry->d_name[0] != '.')
+            threads.push_back((pid_t)atoi(entry->d_name));
+    }
+    closedir(tasks);
+    std::sort(threads.begin(), threads.end());
+    return threads;
+}
+
+/**
+ * @brief name of thread tid as the kernel reports it, empty if it ended
+ */
+static std::string thread_name(pid_t tid)
+{
+    std::string name;
+    std::ifstream comm("/proc/self/task/" + std::to_string(tid) + "/comm");
+    std::getline(comm, name);
+    return name;
+}
+
+void place_new_threads(const std::vector<pid_t>& before, const char* name)
+{
+    // a new thread inherits the name of the thread that created it - threads started
+    // meanwhile by other threads, e.g. concurrent startup stages, carry other names
+    const std::string creator = thread_name((pid_t)syscall(SYS_gettid));
+    int count = 0;
+    for (pid_t tid : list_threads()) {
+        if (std::binary_search(before.begin(), before.end(), tid) || thread_name(tid) != creator)
+            continue;
+        std::string numbered = ++count == 1 ? std::string(name) : std::string(name) + "." + std::to_string(count);
+        place_thread(tid, numbered.substr(0, THREAD_NAME_CHARS));
+    }
+}
@@ -0,0 +1,60 @@
+/**
+ * @file thread_placement.hpp
+ * @brief Names, CPU affinity and scheduling policy of every thread, configured per thread name
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * run_smartdoorF455.sh used to pin the process to the isolated core 3 with
+ * taskset after launch, so the GPIO ISR thread, the display thread, the
+ * matrix refresh thread and the RealSenseID threads competed for one core.
+ * Instead every thread is placed by name, as configured in section
+ * [threads] of config.toml:
+ *
+ * - threads of this program call place_this_thread("name") when they start
+ * - threads created inside libraries (wiringPi ISR, matrix refresh,
+ *   mosquitto network loop, RealSenseID) are found as the threads that
+ *   appeared while the library call ran (list_threads() before and after)
+ *   with the name of the calling thread, and placed with place_new_threads()
+ *
+ * Every placed thread gets its name (pthread_setname_np, shown by
+ * top -H and ps -L), the configured CPU set and SCHED_OTHER or SCHED_FIFO
+ * with its priority; the effective placement read back from the kernel is
+ * logged. SCHED_FIFO needs CAP_SYS_NICE, which run_smartdoorF455.sh grants
+ * with setcap; without it the policy is left unchanged and a warning
+ * logged. A name without a [threads] entry is only named.
+ */
+#pragma once
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+/**
+ * @brief placement of one thread name, an entry of section [threads] in config.toml
+ */
+struct ThreadPolicy {
+    std::vector<int> cpus;  // allowed CPUs, empty = inherited
+    std::string policy;     // "other" or "fifo", empty = inherited
+    int priority = 0;       // 1..99 for "fifo", nice value -20..19 for "other"
+};
+
+/** sets the placement of threads named name; call before the threads start */
+void set_thread_policy(const std::string& name, const ThreadPolicy& policy);
+
+/** names the calling thread and applies its policy; name is cut to 15 characters */
+void place_this_thread(const char* name);
+
+/** thread ids of this process, from /proc/self/task */
+std::vector<pid_t> list_threads();
+
+/**
+ * @brief names and places the threads not in before, e.g. created by a library call
+ *
+ * Only threads still carrying the name of the calling thread count, so threads
+ * started concurrently by other threads are left alone. The first new thread is
+ * called name, further ones name.2, name.3, ...
+ */
+void place_new_threads(const std::vector<pid_t>& before, const char* name);
+
+/** true if the process may use SCHED_FIFO (effective CAP_SYS_NICE or root) */
+bool has_cap_sys_nice();
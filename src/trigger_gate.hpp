@@ -0,0 +1,182 @@
+/**
+ * @file trigger_gate.hpp
+ * @brief Lock-free gate deciding which presence sensor edges start an authentication
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * Replaces the function-local statics (initial_run, last_run) of the former
+ * presence_detected_clbk. All state is held in atomics, so offer() may be
+ * called from the wiringPi ISR thread and from simulated sensors concurrently.
+ * An edge passes the gate, if
+ * - its edge matches the edge policy (rising, falling or both),
+ * - the wiringPi status is OK,
+ * - it starts a new burst - edges within burst_us after the first edge of a
+ *   burst are collapsed into it (bouncing contacts, PIR re-triggering),
+ * - no authentication is in flight - the gate stays armed from accept until
+ *   release(), so overlapping triggers are dropped without touching Authenticate,
+ * - holdoff_us passed since the last accepted edge (wait_time_until_reauthentication).
+ */
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @brief edges passing the gate; values match INT_EDGE_FALLING/RISING/BOTH of wiringPi
+ */
+enum class EdgePolicy : int {
+    Falling = 1,
+    Rising = 2,
+    Both = 3
+};
+
+/**
+ * @brief outcome of TriggerGate::offer(), in the order the checks are done
+ */
+enum class GateDecision : int {
+    Accept = 0,       // starts an authentication
+    EdgeFiltered,     // edge does not match the edge policy
+    InvalidStatus,    // wiringPi reported an error
+    BurstCollapsed,   // part of a burst that already passed or was rejected
+    InFlight,         // an authentication is still running
+    HoldOff,          // too early after the last accepted edge
+    COUNT
+};
+
+inline const char* gate_decision_name(GateDecision decision)
+{
+    static const char* const names[(int)GateDecision::COUNT] = {
+        "accept", "edge_filtered", "invalid_status", "burst_collapsed", "in_flight", "hold_off" };
+    return names[(int)decision];
+}
+
+/**
+ * @brief settings of the gate, read from section [raspi] in config.toml
+ */
+struct GateConfig {
+    EdgePolicy edge_policy = EdgePolicy::Both;
+    int64_t holdoff_us = 3000000; // minimum time between two accepted edges
+    int64_t burst_us = 0;         // edges this close to the start of a burst are collapsed, 0 = off
+};
+
+/**
+ * @class TriggerGate
+ * @brief Edge policy, burst collapsing, in-flight state and hold-off on atomics
+ *
+ * Example usage:
+ * @code
+ * TriggerGate gate;
+ * gate.configure(config);
+ * if (gate.offer(edge, status, monotonic_us()) == GateDecision::Accept) {
+ *     authenticate();
+ *     gate.release();
+ * }
+ * @endcode
+ */
+class TriggerGate {
+public:
+    TriggerGate() = default;
+    TriggerGate(const TriggerGate&) = delete;
+    TriggerGate& operator=(const TriggerGate&) = delete;
+
+    /**
+     * @brief sets policy and windows and resets the state; not concurrent to offer()
+     */
+    void configure(const GateConfig& gate_config) {
+        edge_policy = gate_config.edge_policy;
+        retime(gate_config);
+        burst_start_us.store(NEVER, std::memory_order_relaxed);
+        last_accept_us.store(NEVER, std::memory_order_relaxed);
+        in_flight.store(false, std::memory_order_release);
+    }
+
+    /**
+     * @brief takes over hold-off and burst window of gate_config, concurrent to offer(); the edge policy stays
+     */
+    void retime(const GateConfig& gate_config) {
+        holdoff_us.store(gate_config.holdoff_us, std::memory_order_relaxed);
+        burst_us.store(gate_config.burst_us, std::memory_order_relaxed);
+    }
+
+    GateConfig settings() const {
+        GateConfig config;
+        config.edge_policy = edge_policy;
+        config.holdoff_us = holdoff_us.load(std::memory_order_relaxed);
+        config.burst_us = burst_us.load(std::memory_order_relaxed);
+        return config;
+    }
+
+    /**
+     * @brief decides whether an edge starts an authentication
+     *
+     * Lock-free and allocation free without retry loops, safe to call from
+     * the ISR thread. An accepted edge arms the gate until release() is called.
+     *
+     * @param edge INT_EDGE_RISING/INT_EDGE_FALLING as reported by wiringPi, 0 if unknown (passes any policy)
+     * @param status wfiStatus.statusOK, 1 if valid
+     * @param ts_us monotonic timestamp of the edge
+     */
+    GateDecision offer(int edge, int status, int64_t ts_us) {
+        if (edge != 0 && (edge & (int)edge_policy) == 0)
+            return count(GateDecision::EdgeFiltered);
+        if (status != 1)
+            return count(GateDecision::InvalidStatus);
+        int64_t burst_start = burst_start_us.load(std::memory_order_acquire);
+        const int64_t burst = burst_us.load(std::memory_order_relaxed);
+        if (burst > 0 && ts_us - burst_start < burst)
+            return count(GateDecision::BurstCollapsed);
+        if (!burst_start_us.compare_exchange_strong(burst_start, ts_us, std::memory_order_acq_rel))
+            return count(GateDecision::BurstCollapsed); // a concurrent edge opened the burst
+        if (in_flight.load(std::memory_order_acquire))
+            return count(GateDecision::InFlight);
+        if (ts_us - last_accept_us.load(std::memory_order_relaxed) < holdoff_us.load(std::memory_order_relaxed))
+            return count(GateDecision::HoldOff);
+        bool idle = false;
+        if (!in_flight.compare_exchange_strong(idle, true, std::memory_order_acq_rel))
+            return count(GateDecision::InFlight);
+        last_accept_us.store(ts_us, std::memory_order_relaxed);
+        return count(GateDecision::Accept);
+    }
+
+    /**
+     * @brief disarms the gate once the authentication of the accepted edge finished
+     */
+    void release() { in_flight.store(false, std::memory_order_release); }
+
+    /**
+     * @brief arms the gate without an edge, so no authentication starts until release()
+     * @return false if an authentication is in flight
+     */
+    bool hold() {
+        bool idle = false;
+        return in_flight.compare_exchange_strong(idle, true, std::memory_order_acq_rel);
+    }
+
+    bool is_in_flight() const { return in_flight.load(std::memory_order_acquire); }
+    uint64_t decision_count(GateDecision decision) const {
+        return counts[(int)decision].load(std::memory_order_relaxed);
+    }
+    uint64_t accepted_count() const { return decision_count(GateDecision::Accept); }
+    uint64_t rejected_count() const {
+        uint64_t sum = 0;
+        for (int d = (int)GateDecision::Accept + 1; d < (int)GateDecision::COUNT; d++)
+            sum += counts[d].load(std::memory_order_relaxed);
+        return sum;
+    }
+
+private:
+    static constexpr int64_t NEVER = INT64_MIN / 2; // far in the past, without overflow in ts_us - NEVER
+
+    EdgePolicy edge_policy = EdgePolicy::Both; // the ISR is registered with it, set before offer() is called
+    std::atomic<int64_t> holdoff_us{GateConfig().holdoff_us};
+    std::atomic<int64_t> burst_us{0};
+    alignas(64) std::atomic<int64_t> burst_start_us{NEVER};
+    std::atomic<int64_t> last_accept_us{NEVER};
+    std::atomic<bool> in_flight{false};
+    alignas(64) std::atomic<uint64_t> counts[(int)GateDecision::COUNT] = {};
+
+    GateDecision count(GateDecision decision) {
+        counts[(int)decision].fetch_add(1, std::memory_order_relaxed);
+        return decision;
+    }
+};
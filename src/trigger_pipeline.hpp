@@ -0,0 +1,343 @@
+/**
+ * @file trigger_pipeline.hpp
+ * @brief Asynchronous trigger pipeline between presence sensor and door opener
+ * @copyright MIT License. See LICENSE file in root directory.
+ * @copyright Copyright (C) 2025 Joerg Wallmersperger
+ *
+ * @details
+ * The wiringPi ISR thread stamps an edge with a monotonic time and offers it
+ * to a lock-free TriggerGate (edge policy, burst collapsing, in-flight state,
+ * hold-off - see trigger_gate.hpp). Only accepted edges are pushed as
+ * TriggerEvent into a lock-free bounded queue, so edge storms never reach
+ * the worker threads:
+ * - auth worker: calls the authentication stage (FaceAuthenticator::Authenticate
+ *   on the target) and releases the gate afterwards.
+ *   The door-open path MyAuthClbk::OnResult -> MQTT publish runs in this
+ *   context and never waits on camera capture or Telegram round-trips.
+ * - snapshot worker: captures a snapshot for every accepted trigger
+ * Text and photo notifications are delivered by the sender thread of
+ * NotificationOutbox (see notification_outbox.hpp).
+ *
+ * The header has no hardware dependencies, so the same pipeline is driven by
+ * the simulated sensor and authenticator in smartdoorF455_sim.cpp.
+ */
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <time.h>
+#include <semaphore.h>
+#include "latency_trace.hpp"
+#include "trigger_gate.hpp"
+#include "thread_placement.hpp"
+
+/**
+ * @class BoundedQueue
+ * @brief Lock-free bounded multi-producer/multi-consumer queue
+ *
+ * Array based queue with per cell sequence numbers (D. Vyukov). Capacity
+ * has to be a power of two. try_push() and try_pop() never block and never
+ * allocate, which makes try_push() safe to call from the GPIO ISR thread.
+ */
+template <typename T, size_t Capacity>
+class BoundedQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+    static constexpr size_t mask = Capacity - 1;
+    alignas(64) Cell buffer[Capacity];
+    alignas(64) std::atomic<size_t> enqueue_pos{0};
+    alignas(64) std::atomic<size_t> dequeue_pos{0};
+
+public:
+    BoundedQueue() {
+        for (size_t i = 0; i < Capacity; i++)
+            buffer[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    /**
+     * @brief appends an element, returns false if queue is full
+     */
+    template <typename U>
+    bool try_push(U&& value) {
+        Cell* cell;
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &buffer[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::forward<U>(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief removes the oldest element, returns false if queue is empty
+     */
+    bool try_pop(T& value) {
+        Cell* cell;
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &buffer[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false; // empty
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(cell->data);
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief approximate number of queued elements (for statistics only)
+     */
+    size_t size_approx() const {
+        size_t head = dequeue_pos.load(std::memory_order_relaxed);
+        size_t tail = enqueue_pos.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+    static constexpr size_t capacity() { return Capacity; }
+};
+
+/**
+ * @class WaitableQueue
+ * @brief BoundedQueue with a POSIX semaphore to let a consumer thread sleep
+ *
+ * sem_post() is async-signal-safe and does not take a lock, so producers stay
+ * non-blocking. Consumers wait with a timeout, which lets worker threads
+ * notice a shutdown request.
+ */
+template <typename T, size_t Capacity>
+class WaitableQueue {
+private:
+    BoundedQueue<T, Capacity> queue;
+    sem_t items;
+    std::atomic<uint64_t> dropped{0};
+
+public:
+    WaitableQueue() { sem_init(&items, 0, 0); }
+    ~WaitableQueue() { sem_destroy(&items); }
+
+    template <typename U>
+    bool push(U&& value) {
+        if (!queue.try_push(std::forward<U>(value))) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        sem_post(&items);
+        return true;
+    }
+
+    /**
+     * @brief waits up to timeout_ms for an element
+     * @return true if an element was popped into value
+     */
+    bool pop_wait(T& value, unsigned int timeout_ms) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (sem_timedwait(&items, &deadline) != 0)
+            return false; // timeout or EINTR
+        return queue.try_pop(value);
+    }
+
+    bool try_pop(T& value) {
+        if (sem_trywait(&items) != 0)
+            return false;
+        return queue.try_pop(value);
+    }
+
+    size_t size_approx() const { return queue.size_approx(); }
+    uint64_t dropped_count() const { return dropped.load(std::memory_order_relaxed); }
+};
+
+/**
+ * @brief event posted by the presence sensor ISR (or a simulated sensor)
+ */
+struct TriggerEvent {
+    uint64_t seq = 0;   // sequence number of trigger
+    int64_t ts_us = 0;  // monotonic timestamp at ISR entry in microseconds
+    int edge = 0;       // INT_EDGE_RISING/INT_EDGE_FALLING as reported by wiringPi, 0 if unknown
+    int status = 0;     // wfiStatus.statusOK, 1 if valid
+};
+
+/**
+ * @class TriggerPipeline
+ * @brief Fans trigger events out to auth and snapshot workers
+ *
+ * Example usage:
+ * @code
+ * TriggerPipeline pipeline;
+ * pipeline.set_auth_stage([](const TriggerEvent& ev) { authenticator->Authenticate(auth_clbk); });
+ * pipeline.start(gate_config);            // edge policy, burst window and hold-off
+ * pipeline.post_trigger(INT_EDGE_RISING, 1);  // from ISR
+ * // ...
+ * pipeline.stop();
+ * @endcode
+ */
+class TriggerPipeline {
+public:
+    using TriggerStage = std::function<void(const TriggerEvent&)>;
+
+    static constexpr size_t TRIGGER_QUEUE_SIZE = 64;
+    static constexpr unsigned int WORKER_POLL_MSEC = 200; // shutdown latency of worker threads
+
+    TriggerPipeline() = default;
+    TriggerPipeline(const TriggerPipeline&) = delete;
+    TriggerPipeline& operator=(const TriggerPipeline&) = delete;
+    ~TriggerPipeline() { stop(); }
+
+    /** stage run on the auth worker for every accepted trigger */
+    void set_auth_stage(TriggerStage stage) { auth_stage = std::move(stage); }
+    /** optional stage run on the snapshot worker for every accepted trigger */
+    void set_snapshot_stage(TriggerStage stage) { snapshot_stage = std::move(stage); }
+
+    /**
+     * @brief configures the trigger gate and starts worker threads
+     * @param gate_config edge policy, burst window and reauthentication hold-off
+     */
+    void start(const GateConfig& gate_config) {
+        if (running)
+            return;
+        gate.configure(gate_config);
+        running = true;
+        auth_thread = std::thread(&TriggerPipeline::auth_worker, this);
+        snapshot_thread = std::thread(&TriggerPipeline::snapshot_worker, this);
+    }
+
+    /** new hold-off and burst window while running; the edge policy stays, the ISR was registered with it */
+    void retime(const GateConfig& gate_config) { gate.retime(gate_config); }
+
+    /**
+     * @brief keeps authentications from starting, e.g. while the device is reconfigured
+     * @return false if an authentication is in flight; release_hold() after success
+     */
+    bool try_hold() { return gate.hold(); }
+    void release_hold() { gate.release(); }
+
+    void stop() {
+        if (!running)
+            return;
+        running = false;
+        if (auth_thread.joinable()) auth_thread.join();
+        if (snapshot_thread.joinable()) snapshot_thread.join();
+    }
+
+    /**
+     * @brief called from the ISR - timestamps an edge and enqueues it if it passes the gate
+     *
+     * Lock-free and allocation free. Returns false if the edge was rejected
+     * by the gate or the queue was full.
+     */
+    bool post_trigger(int edge, int status) {
+        TriggerEvent ev;
+        ev.ts_us = monotonic_us();
+        ev.seq = next_seq.fetch_add(1, std::memory_order_relaxed);
+        ev.edge = edge;
+        ev.status = status;
+        GateDecision decision = gate.offer(edge, status, ev.ts_us);
+        bool queued = false;
+        if (decision == GateDecision::Accept) {
+            queued = trigger_queue.push(ev);
+            if (!queued)
+                gate.release(); // dropped, nothing in flight
+            int64_t none = 0;
+            if (queued)
+                first_accept_us.compare_exchange_strong(none, ev.ts_us, std::memory_order_relaxed);
+        }
+        int64_t now = monotonic_us();
+        LatencyTrace::record(TraceStage::IsrEntry, ev.ts_us, now, ev.ts_us);
+        LatencyTrace::record(queued ? TraceStage::DebounceAccept : TraceStage::DebounceReject, now, now, ev.ts_us);
+        return queued;
+    }
+
+    /**
+     * @brief timestamp of the trigger currently being authenticated, 0 if none
+     *
+     * Used by the authentication callback to compute edge-to-unlock latency.
+     */
+    int64_t inflight_trigger_ts_us() const { return inflight_ts_us.load(std::memory_order_acquire); }
+
+    /** timestamp of the first trigger accepted since start, 0 if none yet */
+    int64_t first_accepted_ts_us() const { return first_accept_us.load(std::memory_order_relaxed); }
+
+    uint64_t triggers_posted() const { return next_seq.load(std::memory_order_relaxed); }
+    uint64_t triggers_accepted() const { return gate.accepted_count(); }
+    uint64_t triggers_rejected() const { return gate.rejected_count(); }
+    uint64_t triggers_dropped() const { return trigger_queue.dropped_count(); }
+    const TriggerGate& trigger_gate() const { return gate; }
+    uint64_t snapshots_dropped() const { return snapshot_queue.dropped_count(); }
+    size_t trigger_queue_depth() const { return trigger_queue.size_approx(); }
+    size_t snapshot_queue_depth() const { return snapshot_queue.size_approx(); }
+
+private:
+    WaitableQueue<TriggerEvent, TRIGGER_QUEUE_SIZE> trigger_queue;
+    WaitableQueue<TriggerEvent, TRIGGER_QUEUE_SIZE> snapshot_queue;
+    TriggerGate gate;
+    TriggerStage auth_stage, snapshot_stage;
+    std::thread auth_thread, snapshot_thread;
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> next_seq{0};
+    std::atomic<int64_t> inflight_ts_us{0};
+    std::atomic<int64_t> first_accept_us{0};
+
+    /**
+     * @brief runs the authentication stage for triggers accepted by the gate
+     *
+     * The gate stays in flight until the stage returned, triggers arriving
+     * meanwhile are dropped in post_trigger() already.
+     */
+    void auth_worker() {
+        place_this_thread("auth");
+        TriggerEvent ev;
+        while (running) {
+            if (!trigger_queue.pop_wait(ev, WORKER_POLL_MSEC))
+                continue;
+            if (snapshot_stage)
+                snapshot_queue.push(ev); // capture in parallel to authentication
+            inflight_ts_us.store(ev.ts_us, std::memory_order_release);
+            if (auth_stage)
+                auth_stage(ev);
+            inflight_ts_us.store(0, std::memory_order_release);
+            gate.release();
+        }
+    }
+
+    void snapshot_worker() {
+        place_this_thread("snapshot");
+        TriggerEvent ev;
+        while (running) {
+            if (snapshot_queue.pop_wait(ev, WORKER_POLL_MSEC) && snapshot_stage)
+                snapshot_stage(ev);
+        }
+    }
+};